@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Helpers shared by the scheduler benchmark workloads.
+ *
+ * Every workload runs for a fixed duration and prints a single JSON object
+ * on stdout, which meson-scripts/run_bench collects into the report.
+ */
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_USEC	1000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+/* Maximum number of latency samples kept by a workload */
+#define MAX_SAMPLES	(1 << 20)
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* System-wide number of context switches from /proc/stat */
+static inline uint64_t read_ctxsw(void)
+{
+	unsigned long long ctxt = 0;
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/stat", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "ctxt %llu", &ctxt) == 1)
+			break;
+	fclose(f);
+
+	return ctxt;
+}
+
+static inline int nr_cpus(void)
+{
+	long nr = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return nr > 0 ? nr : 1;
+}
+
+__attribute__((noreturn, format(printf, 1, 2)))
+static inline void bench_fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fprintf(stderr, ": %s\n", strerror(errno));
+	exit(1);
+}
+
+/*
+ * Latency samples in ns. Once MAX_SAMPLES is reached, new samples overwrite
+ * the oldest ones, which is good enough for steady-state workloads.
+ */
+struct lat_samples {
+	uint64_t *buf;
+	uint64_t nr;
+};
+
+static inline void lat_init(struct lat_samples *lat)
+{
+	lat->buf = calloc(MAX_SAMPLES, sizeof(*lat->buf));
+	if (!lat->buf)
+		bench_fail("calloc");
+	lat->nr = 0;
+}
+
+static inline void lat_record(struct lat_samples *lat, uint64_t ns)
+{
+	lat->buf[lat->nr++ % MAX_SAMPLES] = ns;
+}
+
+/* Merge @src into @dst, used to combine the samples of multiple threads */
+static inline void lat_merge(struct lat_samples *dst, const struct lat_samples *src)
+{
+	uint64_t i, nr = src->nr < MAX_SAMPLES ? src->nr : MAX_SAMPLES;
+
+	for (i = 0; i < nr; i++)
+		lat_record(dst, src->buf[i]);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Sort the samples, must be called before lat_pct_us() */
+static inline void lat_sort(struct lat_samples *lat)
+{
+	uint64_t nr = lat->nr < MAX_SAMPLES ? lat->nr : MAX_SAMPLES;
+
+	qsort(lat->buf, nr, sizeof(*lat->buf), cmp_u64);
+}
+
+static inline double lat_pct_us(const struct lat_samples *lat, double pct)
+{
+	uint64_t nr = lat->nr < MAX_SAMPLES ? lat->nr : MAX_SAMPLES;
+
+	if (!nr)
+		return 0;
+	return (double)lat->buf[(uint64_t)((nr - 1) * pct / 100)] / NSEC_PER_USEC;
+}
+
+/* Return the unsigned integer argument at @argv[@idx], or @dfl if missing */
+static inline unsigned int arg_uint(int argc, char **argv, int idx, unsigned int dfl)
+{
+	if (argc <= idx)
+		return dfl;
+	return strtoul(argv[idx], NULL, 0);
+}
+
+/*
+ * Print the result of a workload. @extra, if not NULL, is appended verbatim
+ * and must be a list of JSON members, e.g. "\"foo\": 1".
+ */
+static inline void print_result(const char *workload, double secs, uint64_t ops,
+				uint64_t ctxsw, const struct lat_samples *lat,
+				const char *extra)
+{
+	printf("{\"workload\": \"%s\", \"duration_s\": %.3f, \"ops\": %llu, "
+	       "\"ops_per_sec\": %.1f, \"ctxsw\": %llu, \"ctxsw_per_sec\": %.1f",
+	       workload, secs, (unsigned long long)ops, ops / secs,
+	       (unsigned long long)ctxsw, ctxsw / secs);
+	if (lat)
+		printf(", \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f",
+		       lat_pct_us(lat, 50), lat_pct_us(lat, 99), lat_pct_us(lat, 100));
+	if (extra)
+		printf(", %s", extra);
+	printf("}\n");
+	fflush(stdout);
+}
+
+#endif /* __BENCH_H */
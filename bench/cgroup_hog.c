@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Cgroup-weighted CPU hog benchmark.
+ *
+ * Two cgroups with different cpu.weight values are populated with the same
+ * number of CPU hogs, enough to oversubscribe all the CPUs. A scheduler
+ * honoring cgroup weights should split the CPU time between the two groups
+ * proportionally to their weights: fairness reports the measured ratio of
+ * CPU usage divided by the ratio of the weights, 1.0 being perfect.
+ *
+ * Needs root and cgroup v2 mounted at /sys/fs/cgroup.
+ *
+ * Usage: bench_cgroup_hog [SECS] [HOGS_PER_GROUP] [HI_WEIGHT] [LO_WEIGHT]
+ */
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+#define CGROUP_ROOT	"/sys/fs/cgroup"
+
+enum { HI, LO, NR_GROUPS };
+
+static const char *group_names[NR_GROUPS] = { "hi", "lo" };
+
+static void write_file(const char *path, const char *fmt, ...)
+{
+	char buf[64];
+	va_list args;
+	int fd, len;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		bench_fail("open %s", path);
+	if (write(fd, buf, len) != len)
+		bench_fail("write %s", path);
+	close(fd);
+}
+
+/* Return the usage_usec field of cpu.stat of @cgrp */
+static uint64_t read_usage_us(const char *cgrp)
+{
+	unsigned long long usage = 0;
+	char path[256], line[256];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/cpu.stat", cgrp);
+	f = fopen(path, "r");
+	if (!f)
+		bench_fail("fopen %s", path);
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "usage_usec %llu", &usage) == 1)
+			break;
+	fclose(f);
+
+	return usage;
+}
+
+/* Spin forever, accounting units of work into @counter */
+static void __attribute__((noreturn)) hog(volatile uint64_t *counter)
+{
+	volatile uint64_t x = 0;
+	int i;
+
+	for (;;) {
+		for (i = 0; i < 100000; i++)
+			x += i;
+		__atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int secs = arg_uint(argc, argv, 1, 10);
+	unsigned int nr_hogs = arg_uint(argc, argv, 2, nr_cpus());
+	unsigned int weights[NR_GROUPS] = {
+		arg_uint(argc, argv, 3, 400),
+		arg_uint(argc, argv, 4, 100),
+	};
+	char parent[64], cgrps[NR_GROUPS][96], path[256], extra[256];
+	uint64_t usage[NR_GROUPS], base_ops[NR_GROUPS], start, ctxsw, ops = 0;
+	volatile uint64_t *counters;
+	double elapsed, share_ratio, weight_ratio;
+	pid_t *pids;
+	unsigned int g, i;
+
+	pids = calloc(NR_GROUPS * nr_hogs, sizeof(*pids));
+	counters = mmap(NULL, sizeof(*counters) * NR_GROUPS, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!pids || counters == MAP_FAILED)
+		bench_fail("alloc");
+
+	if (access(CGROUP_ROOT "/cgroup.controllers", F_OK))
+		bench_fail("cgroup v2 not found at " CGROUP_ROOT);
+
+	/* Set up the cgroups, the cpu controller may already be enabled */
+	snprintf(parent, sizeof(parent), CGROUP_ROOT "/bench_cgroup_hog.%d", getpid());
+	if (mkdir(parent, 0755))
+		bench_fail("mkdir %s", parent);
+	write_file(CGROUP_ROOT "/cgroup.subtree_control", "+cpu");
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", parent);
+	write_file(path, "+cpu");
+	for (g = 0; g < NR_GROUPS; g++) {
+		snprintf(cgrps[g], sizeof(cgrps[g]), "%s/%s", parent, group_names[g]);
+		if (mkdir(cgrps[g], 0755))
+			bench_fail("mkdir %s", cgrps[g]);
+		snprintf(path, sizeof(path), "%s/cpu.weight", cgrps[g]);
+		write_file(path, "%u", weights[g]);
+	}
+
+	for (g = 0; g < NR_GROUPS; g++) {
+		snprintf(path, sizeof(path), "%s/cgroup.procs", cgrps[g]);
+		for (i = 0; i < nr_hogs; i++) {
+			pid_t pid = fork();
+
+			if (pid < 0)
+				bench_fail("fork");
+			if (!pid) {
+				write_file(path, "0");
+				hog(&counters[g]);
+			}
+			pids[g * nr_hogs + i] = pid;
+		}
+	}
+
+	/* Give the hogs the time to join their cgroups */
+	usleep(100000);
+
+	ctxsw = read_ctxsw();
+	start = now_ns();
+	for (g = 0; g < NR_GROUPS; g++) {
+		usage[g] = read_usage_us(cgrps[g]);
+		base_ops[g] = counters[g];
+	}
+
+	sleep(secs);
+
+	for (g = 0; g < NR_GROUPS; g++) {
+		usage[g] = read_usage_us(cgrps[g]) - usage[g];
+		ops += counters[g] - base_ops[g];
+	}
+	elapsed = (double)(now_ns() - start) / NSEC_PER_SEC;
+	ctxsw = read_ctxsw() - ctxsw;
+
+	for (i = 0; i < NR_GROUPS * nr_hogs; i++)
+		kill(pids[i], SIGKILL);
+	for (i = 0; i < NR_GROUPS * nr_hogs; i++)
+		waitpid(pids[i], NULL, 0);
+	for (g = 0; g < NR_GROUPS; g++)
+		rmdir(cgrps[g]);
+	rmdir(parent);
+
+	share_ratio = (double)usage[HI] / (usage[LO] ? usage[LO] : 1);
+	weight_ratio = (double)weights[HI] / (weights[LO] ? weights[LO] : 1);
+	snprintf(extra, sizeof(extra),
+		 "\"hi_weight\": %u, \"lo_weight\": %u, "
+		 "\"hi_usage_us\": %llu, \"lo_usage_us\": %llu, "
+		 "\"fairness\": %.3f",
+		 weights[HI], weights[LO],
+		 (unsigned long long)usage[HI], (unsigned long long)usage[LO],
+		 share_ratio / weight_ratio);
+
+	print_result("cgroup_hog", elapsed, ops, ctxsw, NULL, extra);
+
+	return 0;
+}
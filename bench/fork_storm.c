@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Fork/exec storm benchmark.
+ *
+ * Worker threads repeatedly fork() a child which exec()s /bin/true and wait
+ * for it to exit. This stresses task creation and the initial placement of
+ * new tasks (.select_cpu() with SCX_WAKE_FORK/SCX_WAKE_EXEC, .init_task()
+ * and .exit_task()). The recorded latency covers the whole
+ * fork-exec-exit-wait cycle.
+ *
+ * Usage: bench_fork_storm [SECS] [WORKERS]
+ */
+#include <pthread.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+struct worker {
+	pthread_t thread;
+	uint64_t nr_spawns;
+	struct lat_samples lat;
+};
+
+static volatile bool stop;
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	char *const child_argv[] = { "true", NULL };
+
+	while (!stop) {
+		uint64_t start = now_ns();
+		int status;
+		pid_t pid;
+
+		pid = fork();
+		if (pid < 0)
+			bench_fail("fork");
+		if (!pid) {
+			execv("/bin/true", child_argv);
+			_exit(127);
+		}
+		if (waitpid(pid, &status, 0) < 0)
+			bench_fail("waitpid");
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "child exited with status 0x%x\n", status);
+			exit(1);
+		}
+
+		lat_record(&w->lat, now_ns() - start);
+		w->nr_spawns++;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int secs = arg_uint(argc, argv, 1, 10);
+	unsigned int nr_workers = arg_uint(argc, argv, 2, nr_cpus());
+	struct worker *workers;
+	struct lat_samples lat;
+	uint64_t start, ctxsw, nr_spawns = 0;
+	double elapsed;
+	unsigned int i;
+
+	workers = calloc(nr_workers, sizeof(*workers));
+	if (!workers)
+		bench_fail("calloc");
+	lat_init(&lat);
+
+	ctxsw = read_ctxsw();
+	start = now_ns();
+	for (i = 0; i < nr_workers; i++) {
+		lat_init(&workers[i].lat);
+		if (pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]))
+			bench_fail("pthread_create");
+	}
+
+	sleep(secs);
+	stop = true;
+
+	for (i = 0; i < nr_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		nr_spawns += workers[i].nr_spawns;
+		lat_merge(&lat, &workers[i].lat);
+	}
+	elapsed = (double)(now_ns() - start) / NSEC_PER_SEC;
+	ctxsw = read_ctxsw() - ctxsw;
+	lat_sort(&lat);
+
+	print_result("fork_storm", elapsed, nr_spawns, ctxsw, &lat, NULL);
+
+	return 0;
+}
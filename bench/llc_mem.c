@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * LLC-sensitive memory-bound benchmark.
+ *
+ * Worker threads chase pointers through a private, randomly permuted buffer
+ * sized to fit in a slice of the last level cache. Each load depends on the
+ * previous one, so throughput is bound by memory latency: workers that are
+ * migrated across LLCs, or stacked on a shared LLC while others sit idle,
+ * have to refill their working set from memory and get slower.
+ *
+ * Usage: bench_llc_mem [SECS] [WORKERS] [KB_PER_WORKER]
+ */
+#include <pthread.h>
+#include "bench.h"
+
+#define CACHELINE_SIZE	64
+
+/* Number of loads between checks of the stop flag */
+#define LOADS_PER_ROUND	4096
+
+struct worker {
+	pthread_t thread;
+	size_t nr_lines;
+	uint64_t nr_loads;
+	uint64_t sink;
+};
+
+struct line {
+	struct line *next;
+	char pad[CACHELINE_SIZE - sizeof(struct line *)];
+};
+
+static volatile bool stop;
+
+/* Link the lines of @lines into a single random cycle */
+static struct line *build_chain(struct line *lines, size_t nr, unsigned int seed)
+{
+	struct line *head;
+	size_t *order, i;
+
+	order = malloc(nr * sizeof(*order));
+	if (!order)
+		bench_fail("malloc");
+	for (i = 0; i < nr; i++)
+		order[i] = i;
+	for (i = nr - 1; i > 0; i--) {
+		size_t j = rand_r(&seed) % (i + 1), tmp = order[i];
+
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for (i = 0; i < nr; i++)
+		lines[order[i]].next = &lines[order[(i + 1) % nr]];
+	head = &lines[order[0]];
+
+	free(order);
+	return head;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct line *lines, *p;
+	int i;
+
+	if (posix_memalign((void **)&lines, CACHELINE_SIZE, w->nr_lines * sizeof(*lines)))
+		bench_fail("posix_memalign");
+	p = build_chain(lines, w->nr_lines, (uintptr_t)w);
+
+	while (!stop) {
+		for (i = 0; i < LOADS_PER_ROUND; i++)
+			p = p->next;
+		w->nr_loads += LOADS_PER_ROUND;
+	}
+	/* Keep the chase from being optimized away */
+	w->sink = (uintptr_t)p;
+	free(lines);
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int secs = arg_uint(argc, argv, 1, 10);
+	unsigned int nr_workers = arg_uint(argc, argv, 2, nr_cpus());
+	unsigned int kb = arg_uint(argc, argv, 3, 1024);
+	uint64_t start, ctxsw, nr_loads = 0;
+	struct worker *workers;
+	char extra[128];
+	double elapsed;
+	unsigned int i;
+
+	workers = calloc(nr_workers, sizeof(*workers));
+	if (!workers)
+		bench_fail("calloc");
+
+	ctxsw = read_ctxsw();
+	start = now_ns();
+	for (i = 0; i < nr_workers; i++) {
+		workers[i].nr_lines = (size_t)kb * 1024 / CACHELINE_SIZE;
+		if (workers[i].nr_lines < 2)
+			workers[i].nr_lines = 2;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]))
+			bench_fail("pthread_create");
+	}
+
+	sleep(secs);
+	stop = true;
+
+	for (i = 0; i < nr_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		nr_loads += workers[i].nr_loads;
+	}
+	elapsed = (double)(now_ns() - start) / NSEC_PER_SEC;
+	ctxsw = read_ctxsw() - ctxsw;
+
+	snprintf(extra, sizeof(extra), "\"kb_per_worker\": %u, \"ns_per_load\": %.2f",
+		 kb, nr_loads ? elapsed * NSEC_PER_SEC * nr_workers / nr_loads : 0);
+
+	print_result("llc_mem", elapsed, nr_loads, ctxsw, NULL, extra);
+
+	return 0;
+}
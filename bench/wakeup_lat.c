@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Wakeup latency benchmark.
+ *
+ * Pairs of threads ping-pong a timestamp over two pipes. The receiver of
+ * each message records the time elapsed since the sender wrote it, which is
+ * the time it took the scheduler to wake up and run the receiver.
+ *
+ * Usage: bench_wakeup_lat [SECS] [PAIRS]
+ */
+#include <pthread.h>
+#include "bench.h"
+
+struct pair {
+	int ping[2];
+	int pong[2];
+	uint64_t nr_round_trips;
+	struct lat_samples lat;
+};
+
+static volatile bool stop;
+
+/* Receive a timestamp from @rfd and record its latency, false on EOF */
+static bool recv_ts(int rfd, struct lat_samples *lat)
+{
+	uint64_t ts;
+
+	if (read(rfd, &ts, sizeof(ts)) != sizeof(ts))
+		return false;
+	lat_record(lat, now_ns() - ts);
+	return true;
+}
+
+static bool send_ts(int wfd)
+{
+	uint64_t ts = now_ns();
+
+	return write(wfd, &ts, sizeof(ts)) == sizeof(ts);
+}
+
+static void *pinger(void *arg)
+{
+	struct pair *pair = arg;
+
+	while (!stop) {
+		if (!send_ts(pair->ping[1]) || !recv_ts(pair->pong[0], &pair->lat))
+			break;
+		pair->nr_round_trips++;
+	}
+	/* Wake up the ponger for good */
+	close(pair->ping[1]);
+
+	return NULL;
+}
+
+static void *ponger(void *arg)
+{
+	struct pair *pair = arg;
+	struct lat_samples lat;
+
+	lat_init(&lat);
+	while (recv_ts(pair->ping[0], &lat))
+		if (!send_ts(pair->pong[1]))
+			break;
+	lat_merge(&pair->lat, &lat);
+	free(lat.buf);
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int secs = arg_uint(argc, argv, 1, 10);
+	unsigned int nr_pairs = arg_uint(argc, argv, 2, (nr_cpus() + 1) / 2);
+	pthread_t *threads;
+	struct pair *pairs;
+	struct lat_samples lat;
+	uint64_t start, ctxsw, nr_round_trips = 0;
+	double elapsed;
+	unsigned int i;
+
+	pairs = calloc(nr_pairs, sizeof(*pairs));
+	threads = calloc(nr_pairs * 2, sizeof(*threads));
+	if (!pairs || !threads)
+		bench_fail("calloc");
+	lat_init(&lat);
+
+	ctxsw = read_ctxsw();
+	start = now_ns();
+	for (i = 0; i < nr_pairs; i++) {
+		struct pair *pair = &pairs[i];
+
+		if (pipe(pair->ping) || pipe(pair->pong))
+			bench_fail("pipe");
+		lat_init(&pair->lat);
+		if (pthread_create(&threads[i * 2], NULL, pinger, pair) ||
+		    pthread_create(&threads[i * 2 + 1], NULL, ponger, pair))
+			bench_fail("pthread_create");
+	}
+
+	sleep(secs);
+	stop = true;
+
+	for (i = 0; i < nr_pairs * 2; i++)
+		pthread_join(threads[i], NULL);
+	elapsed = (double)(now_ns() - start) / NSEC_PER_SEC;
+	ctxsw = read_ctxsw() - ctxsw;
+
+	for (i = 0; i < nr_pairs; i++) {
+		nr_round_trips += pairs[i].nr_round_trips;
+		lat_merge(&lat, &pairs[i].lat);
+	}
+	lat_sort(&lat);
+
+	/* Every round trip is made of two wakeups */
+	print_result("wakeup_lat", elapsed, nr_round_trips * 2, ctxsw, &lat, NULL);
+
+	return 0;
+}
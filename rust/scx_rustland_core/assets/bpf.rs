@@ -13,9 +13,13 @@ use std::ffi::c_int;
 use std::ffi::c_ulong;
 use std::fs::File;
 use std::io::Read;
+use std::os::fd::AsFd;
+use std::os::fd::AsRawFd;
 
 use std::collections::HashMap;
+use std::sync::atomic::fence;
 use std::sync::atomic::AtomicBool;
+use std::sync::atomic::AtomicU32;
 use std::sync::atomic::Ordering;
 use std::sync::Arc;
 use std::sync::Once;
@@ -58,6 +62,13 @@ const SCHED_EXT: i32 = 7;
 #[allow(dead_code)]
 pub const RL_CPU_ANY: i32 = bpf_intf::RL_CPU_ANY as i32;
 
+// Maximum amount of tasks tracked by the BPF component.
+//
+// Slot ids of the queued tasks (QueuedTask.slot) are always lower than this value, so they can be
+// used to index per-task state in a Vec.
+#[allow(dead_code)]
+pub const MAX_TASK_SLOTS: usize = bpf_intf::MAX_TASK_SLOTS as usize;
+
 /// High-level Rust abstraction to interact with a generic sched-ext BPF component.
 ///
 /// Overview
@@ -70,6 +81,10 @@ pub const RL_CPU_ANY: i32 = bpf_intf::RL_CPU_ANY as i32;
 /// objects) and dispatch tasks (in the form of DispatchedTask objects), using respectively the
 /// methods dequeue_task() and dispatch_task().
 ///
+/// Dispatched tasks are buffered and sent to the BPF component in batches of up to
+/// MAX_DISPATCH_BATCH tasks, when a batch is full or when notify_complete() is called. Use
+/// flush_dispatched() to send a partial batch earlier.
+///
 /// BPF counters and statistics can be accessed using the methods nr_*_mut(), in particular
 /// nr_queued_mut() and nr_scheduled_mut() can be updated to notify the BPF component if the
 /// user-space scheduler has some pending work to do or not.
@@ -78,10 +93,11 @@ pub const RL_CPU_ANY: i32 = bpf_intf::RL_CPU_ANY as i32;
 /// whether the BPF component exited, and to shutdown and report the exit message.
 /// whether the BPF component exited, and to shutdown and report exit message.
 
-// Task queued for scheduling from the BPF component (see bpf_intf::queued_task_ctx).
+// Task queued for scheduling from the BPF component (see bpf_intf::task_slot).
 #[derive(Debug, PartialEq, Eq, PartialOrd, Clone)]
 pub struct QueuedTask {
     pub pid: i32,              // pid that uniquely identifies a task
+    pub slot: u32,             // slot id, unique among the live tasks and reused after exit
     pub cpu: i32,              // CPU where the task is running
     pub flags: u64,            // task enqueue flags
     pub sum_exec_runtime: u64, // Total cpu time
@@ -122,39 +138,90 @@ impl DispatchedTask {
 
 // Helpers used to submit tasks to the BPF user ring buffer.
 unsafe impl Plain for bpf_intf::dispatched_task_ctx {}
+unsafe impl Plain for bpf_intf::dispatched_task_batch {}
+
+// Maximum amount of tasks sent to the BPF component in a single user ring buffer message.
+const MAX_DISPATCH_BATCH: usize = bpf_intf::MAX_DISPATCH_BATCH as usize;
 
-impl AsMut<bpf_intf::dispatched_task_ctx> for bpf_intf::dispatched_task_ctx {
-    fn as_mut(&mut self) -> &mut bpf_intf::dispatched_task_ctx {
-        self
+impl QueuedTask {
+    fn from_slot(id: u32, slot: &bpf_intf::task_slot) -> Self {
+        QueuedTask {
+            pid: slot.pid,
+            slot: id,
+            cpu: slot.cpu,
+            flags: slot.flags,
+            sum_exec_runtime: slot.sum_exec_runtime,
+            nvcsw: slot.nvcsw,
+            weight: slot.weight,
+            slice: slot.slice,
+            vtime: slot.vtime,
+            cpumask_cnt: slot.cpumask_cnt,
+        }
     }
 }
 
-// Message received from the dispatcher (see bpf_intf::queued_task_ctx for details).
-//
-// NOTE: eventually libbpf-rs will provide a better abstraction for this.
-struct EnqueuedMessage {
-    inner: bpf_intf::queued_task_ctx,
+// Task table shared with the BPF component, updated in place by the BPF enqueue path (see
+// bpf_intf::task_slot).
+struct TaskSlots {
+    slots: *const bpf_intf::task_slot,
+    len: usize,
 }
 
-impl EnqueuedMessage {
-    fn from_bytes(bytes: &[u8]) -> Self {
-        let queued_task_struct = unsafe { *(bytes.as_ptr() as *const bpf_intf::queued_task_ctx) };
-        EnqueuedMessage {
-            inner: queued_task_struct,
+impl TaskSlots {
+    fn new(map: &libbpf_rs::Map) -> Result<Self> {
+        let len = std::mem::size_of::<bpf_intf::task_slot>() * MAX_TASK_SLOTS;
+        let slots = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_SHARED,
+                map.as_fd().as_raw_fd(),
+                0,
+            )
+        };
+        if slots == libc::MAP_FAILED {
+            return Err(anyhow::Error::msg(format!(
+                "Failed to mmap task_slots ({})",
+                std::io::Error::last_os_error()
+            )));
+        }
+
+        Ok(Self {
+            slots: slots as *const bpf_intf::task_slot,
+            len,
+        })
+    }
+
+    // Read slot @id as updated by the enqueue that sent the notification with sequence counter
+    // @seq. Return None if the slot has been updated again since then (a newer notification will
+    // follow) or if the task exited.
+    fn read(&self, id: u32, seq: u32) -> Option<bpf_intf::task_slot> {
+        if id as usize >= MAX_TASK_SLOTS {
+            return None;
+        }
+        unsafe {
+            let slot = self.slots.add(id as usize);
+            let slot_seq = &*(std::ptr::addr_of!((*slot).seq) as *const AtomicU32);
+
+            if slot_seq.load(Ordering::Acquire) != seq {
+                return None;
+            }
+            let copy = std::ptr::read_volatile(slot);
+            fence(Ordering::Acquire);
+            if slot_seq.load(Ordering::Relaxed) != seq {
+                return None;
+            }
+
+            Some(copy)
         }
     }
+}
 
-    fn to_queued_task(&self) -> QueuedTask {
-        QueuedTask {
-            pid: self.inner.pid,
-            cpu: self.inner.cpu,
-            flags: self.inner.flags,
-            sum_exec_runtime: self.inner.sum_exec_runtime,
-            nvcsw: self.inner.nvcsw,
-            weight: self.inner.weight,
-            slice: self.inner.slice,
-            vtime: self.inner.vtime,
-            cpumask_cnt: self.inner.cpumask_cnt,
+impl Drop for TaskSlots {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.slots as *mut libc::c_void, self.len);
         }
     }
 }
@@ -164,14 +231,16 @@ pub struct BpfScheduler<'cb> {
     shutdown: Arc<AtomicBool>,             // Determine scheduler shutdown
     queued: libbpf_rs::RingBuffer<'cb>,    // Ring buffer of queued tasks
     dispatched: libbpf_rs::UserRingBuffer, // User Ring buffer of dispatched tasks
+    task_slots: TaskSlots,                 // Shared table of queued tasks
+    dispatch_batch: Vec<DispatchedTask>,   // Dispatched tasks not sent yet
     struct_ops: Option<libbpf_rs::Link>,   // Low-level BPF methods
 }
 
-// Buffer to store a task read from the ring buffer.
+// Buffer to store a task notification read from the ring buffer.
 //
 // NOTE: make the buffer aligned to 64-bits to prevent misaligned dereferences when accessing the
 // buffer using a pointer.
-const BUFSIZE: usize = std::mem::size_of::<QueuedTask>();
+const BUFSIZE: usize = std::mem::size_of::<bpf_intf::queued_task_msg>();
 
 #[repr(align(8))]
 struct AlignedBuffer([u8; BUFSIZE]);
@@ -227,8 +296,8 @@ impl<'cb> BpfScheduler<'cb> {
         //
         // # Safety
         //
-        // Each invocation of the callback will trigger the copy of exactly one QueuedTask item to
-        // BUF. The caller must be synchronize to ensure that multiple invocations of the callback
+        // Each invocation of the callback will trigger the copy of exactly one queued_task_msg
+        // item to BUF. The caller must be synchronize to ensure that multiple invocations of the callback
         // are not happening at the same time, but this is implicitly guaranteed by the fact that
         // the caller is a single-thread process (for now).
         //
@@ -236,8 +305,8 @@ impl<'cb> BpfScheduler<'cb> {
         fn callback(data: &[u8]) -> i32 {
             unsafe {
                 // SAFETY: copying from the BPF ring buffer to BUF is safe, since the size of BUF
-                // is exactly the size of QueuedTask and the callback operates in chunks of
-                // QueuedTask items. It also copies exactly one QueuedTask at a time, this is
+                // is exactly the size of queued_task_msg and the callback operates in chunks of
+                // queued_task_msg items. It also copies exactly one item at a time, this is
                 // guaranteed by the error code returned by this callback (see below). From a
                 // thread-safety perspective this is also correct, assuming the caller is a
                 // single-thread process (as it is for now).
@@ -292,6 +361,9 @@ impl<'cb> BpfScheduler<'cb> {
         let dispatched = libbpf_rs::UserRingBuffer::new(&maps.dispatched)
             .expect("failed to create user ringbuf");
 
+        // Map the shared table of queued tasks.
+        let task_slots = TaskSlots::new(&maps.task_slots)?;
+
         // Make sure to use the SCHED_EXT class at least for the scheduler itself.
         match Self::use_sched_ext() {
             0 => Ok(Self {
@@ -299,6 +371,8 @@ impl<'cb> BpfScheduler<'cb> {
                 shutdown,
                 queued,
                 dispatched,
+                task_slots,
+                dispatch_batch: Vec::with_capacity(MAX_DISPATCH_BATCH),
                 struct_ops,
             }),
             err => Err(anyhow::Error::msg(format!(
@@ -399,7 +473,10 @@ impl<'cb> BpfScheduler<'cb> {
     // some point, otherwise the BPF component will keep waking-up the user-space scheduler in a
     // busy loop, causing unnecessary high CPU consumption.
     pub fn notify_complete(&mut self, nr_pending: u64) {
-        self.skel.maps.bss_data.nr_scheduled = nr_pending;
+        // Tasks that can't be sent now (the user ring buffer is full) are retried at the next
+        // scheduling cycle, so count them as pending.
+        let _ = self.flush_dispatched();
+        self.skel.maps.bss_data.nr_scheduled = nr_pending + self.dispatch_batch.len() as u64;
         std::thread::yield_now();
     }
 
@@ -433,6 +510,12 @@ impl<'cb> BpfScheduler<'cb> {
         &mut self.skel.maps.bss_data.nr_user_dispatches
     }
 
+    // Counter of dispatch batches received by the BPF component.
+    #[allow(dead_code)]
+    pub fn nr_dispatch_batches_mut(&mut self) -> &mut u64 {
+        &mut self.skel.maps.bss_data.nr_dispatch_batches
+    }
+
     // Counter of user kernel events.
     #[allow(dead_code)]
     pub fn nr_kernel_dispatches_mut(&mut self) -> &mut u64 {
@@ -509,55 +592,75 @@ impl<'cb> BpfScheduler<'cb> {
 
     // Receive a task to be scheduled from the BPF dispatcher.
     pub fn dequeue_task(&mut self) -> Result<Option<QueuedTask>, i32> {
-        match self.queued.consume_raw() {
-            0 => {
-                self.skel.maps.bss_data.nr_queued = 0;
-                Ok(None)
-            }
-            LIBBPF_STOP => {
-                // A valid task is received, convert data to a proper task struct.
-                let task = unsafe { EnqueuedMessage::from_bytes(&BUF.0).to_queued_task() };
-                let _ = self.skel.maps.bss_data.nr_queued.saturating_sub(1);
-
-                Ok(Some(task))
+        loop {
+            match self.queued.consume_raw() {
+                0 => {
+                    self.skel.maps.bss_data.nr_queued = 0;
+                    return Ok(None);
+                }
+                LIBBPF_STOP => {
+                    // A task notification is received, read the task from its slot.
+                    let msg = unsafe { *(BUF.0.as_ptr() as *const bpf_intf::queued_task_msg) };
+                    let _ = self.skel.maps.bss_data.nr_queued.saturating_sub(1);
+
+                    // Skip notifications superseded by a later enqueue or by the task's exit.
+                    if let Some(slot) = self.task_slots.read(msg.slot, msg.seq) {
+                        return Ok(Some(QueuedTask::from_slot(msg.slot, &slot)));
+                    }
+                }
+                res if res < 0 => return Err(res),
+                res => panic!(
+                    "Unexpected return value from libbpf-rs::consume_raw(): {}",
+                    res
+                ),
             }
-            res if res < 0 => Err(res),
-            res => panic!(
-                "Unexpected return value from libbpf-rs::consume_raw(): {}",
-                res
-            ),
         }
     }
 
     // Send a task to the dispatcher.
+    //
+    // The task is added to the current batch, which is sent to the BPF component when it is full
+    // or at the latest by notify_complete(). An error means that the task was not accepted
+    // because the user ring buffer is full.
     pub fn dispatch_task(&mut self, task: &DispatchedTask) -> Result<(), libbpf_rs::Error> {
-        // Reserve a slot in the user ring buffer.
-        let mut urb_sample = self
-            .dispatched
-            .reserve(std::mem::size_of::<bpf_intf::dispatched_task_ctx>())?;
+        if self.dispatch_batch.len() >= MAX_DISPATCH_BATCH {
+            self.flush_dispatched()?;
+        }
+        self.dispatch_batch.push(task.clone());
+
+        Ok(())
+    }
+
+    // Send the tasks buffered by dispatch_task() to the dispatcher as a single batch.
+    //
+    // On failure the tasks are kept in the batch and sent at the next flush.
+    pub fn flush_dispatched(&mut self) -> Result<(), libbpf_rs::Error> {
+        let nr = self.dispatch_batch.len();
+        if nr == 0 {
+            return Ok(());
+        }
+
+        // Reserve a slot in the user ring buffer, large enough for the valid entries only.
+        let size = std::mem::size_of::<bpf_intf::dispatched_task_batch>()
+            - (MAX_DISPATCH_BATCH - nr) * std::mem::size_of::<bpf_intf::dispatched_task_ctx>();
+        let mut urb_sample = self.dispatched.reserve(size)?;
         let bytes = urb_sample.as_mut();
-        let dispatched_task = plain::from_mut_bytes::<bpf_intf::dispatched_task_ctx>(bytes)
-            .expect("failed to convert bytes");
-
-        // Convert the dispatched task into the low-level dispatched task context.
-        let bpf_intf::dispatched_task_ctx {
-            pid,
-            cpu,
-            flags,
-            slice_ns,
-            vtime,
-            cpumask_cnt,
-            ..
-        } = &mut dispatched_task.as_mut();
-
-        *pid = task.pid;
-        *cpu = task.cpu;
-        *flags = task.flags;
-        *slice_ns = task.slice_ns;
-        *vtime = task.vtime;
-        *cpumask_cnt = task.cpumask_cnt;
-
-        // Store the task in the user ring buffer.
+
+        // Convert the dispatched tasks into the low-level dispatched task contexts and copy only
+        // the valid part of the batch to the reserved slot.
+        let mut batch: bpf_intf::dispatched_task_batch = unsafe { std::mem::zeroed() };
+        batch.nr = nr as u32;
+        for (ctx, task) in batch.tasks.iter_mut().zip(self.dispatch_batch.drain(..)) {
+            ctx.pid = task.pid;
+            ctx.cpu = task.cpu;
+            ctx.flags = task.flags;
+            ctx.slice_ns = task.slice_ns;
+            ctx.vtime = task.vtime;
+            ctx.cpumask_cnt = task.cpumask_cnt;
+        }
+        bytes.copy_from_slice(&unsafe { plain::as_bytes(&batch) }[..size]);
+
+        // Store the batch in the user ring buffer.
         //
         // NOTE: submit() only updates the reserved slot in the user ring buffer, so it is not
         // expected to fail.
@@ -75,11 +75,31 @@ struct domain_arg {
 };
 
 /*
- * Task sent to the user-space scheduler by the BPF dispatcher.
+ * Maximum amount of tasks that can be tracked in the shared task table.
+ *
+ * Tasks that don't get a slot (table full) bypass the user-space scheduler.
+ */
+#define MAX_TASK_SLOTS 65536
+
+/*
+ * Slot of a task in the task table shared with the user-space scheduler.
+ *
+ * Slot ids are assigned when a task is created and released when it exits.
+ * The BPF component updates the slot in place each time the task is queued,
+ * then it notifies the user-space scheduler sending only the slot id (see
+ * struct queued_task_msg).
  *
  * All attributes are collected from the kernel by the the BPF component.
  */
-struct queued_task_ctx {
+struct task_slot {
+	/*
+	 * Sequence counter: odd while the slot is being updated, incremented
+	 * by two at each update and when the task exits. It allows the
+	 * user-space scheduler to detect torn or superseded reads without any
+	 * lock.
+	 */
+	u32 seq;
+	u32 pad;
 	s32 pid;
 	s32 cpu; /* CPU where the task is running */
 	u64 flags; /* task enqueue flags */
@@ -91,6 +111,18 @@ struct queued_task_ctx {
 	u64 cpumask_cnt; /* cpumask generation counter */
 };
 
+/*
+ * Task sent to the user-space scheduler by the BPF dispatcher.
+ *
+ * The notification is valid only if @seq matches the current sequence counter
+ * of the slot, otherwise the task has been queued again (a new notification
+ * will follow) or it exited.
+ */
+struct queued_task_msg {
+	u32 slot;
+	u32 seq;
+};
+
 /*
  * Task sent to the BPF dispatcher by the user-space scheduler.
  *
@@ -106,4 +138,22 @@ struct dispatched_task_ctx {
 	u64 cpumask_cnt; /* cpumask generation counter */
 };
 
+/*
+ * Maximum amount of dispatch decisions carried by a single message of the
+ * @dispatched user ring buffer.
+ */
+#define MAX_DISPATCH_BATCH 32
+
+/*
+ * Batch of tasks sent to the BPF dispatcher by the user-space scheduler.
+ *
+ * Only the first @nr entries of @tasks are copied to the user ring buffer, so
+ * a partial batch costs no more than the decisions it carries.
+ */
+struct dispatched_task_batch {
+	u32 nr;
+	u32 pad;
+	struct dispatched_task_ctx tasks[MAX_DISPATCH_BATCH];
+};
+
 #endif /* __INTF_H */
@@ -18,6 +18,13 @@
  * @dispatched for the messages sent by the user-space scheduler to the BPF
  * dispatcher.
  *
+ * The attributes of the queued tasks are not copied through @queued: they are
+ * updated in place in @task_slots, a table shared with the user-space
+ * scheduler via mmap(), and only the slot id of the task is sent.
+ *
+ * The user-space scheduler sends its dispatch decisions in batches of up to
+ * MAX_DISPATCH_BATCH tasks (see intf.h).
+ *
  * The BPF dispatcher is completely agnostic of the particular scheduling
  * policy implemented in user-space. For this reason developers that are
  * willing to use this scheduler to experiment scheduling policies should be
@@ -81,6 +88,9 @@ volatile u64 nr_running, nr_online_cpus;
 volatile u64 nr_user_dispatches, nr_kernel_dispatches,
 	     nr_cancel_dispatches, nr_bounce_dispatches;
 
+/* Amount of dispatch batches received from the user-space scheduler */
+volatile u64 nr_dispatch_batches;
+
 /* Failure statistics */
 volatile u64 nr_failed_dispatches, nr_sched_congested;
 
@@ -144,19 +154,40 @@ static int calloc_cpumask(struct bpf_cpumask **p_cpumask)
 #define MAX_DISPATCH_SLOT (MAX_ENQUEUED_TASKS / 8)
 
 /*
- * The map containing tasks that are queued to user space from the kernel.
+ * The map containing the slot ids of the tasks that are queued to user space
+ * from the kernel.
  *
  * This map is drained by the user space scheduler.
  */
 struct {
 	__uint(type, BPF_MAP_TYPE_RINGBUF);
 	__uint(max_entries, MAX_ENQUEUED_TASKS *
-				sizeof(struct queued_task_ctx));
+			    (sizeof(struct queued_task_msg) + BPF_RINGBUF_HDR_SZ));
 } queued SEC(".maps");
 
 /*
- * The user ring buffer containing pids that are dispatched from user space to
- * the kernel.
+ * Task table shared with the user-space scheduler, indexed by slot id.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(map_flags, BPF_F_MMAPABLE);
+	__type(key, u32);
+	__type(value, struct task_slot);
+	__uint(max_entries, MAX_TASK_SLOTS);
+} task_slots SEC(".maps");
+
+/*
+ * Free slot ids of @task_slots, filled in rustland_init().
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_QUEUE);
+	__type(value, u32);
+	__uint(max_entries, MAX_TASK_SLOTS);
+} free_task_slots SEC(".maps");
+
+/*
+ * The user ring buffer containing the batches of tasks that are dispatched
+ * from user space to the kernel (see struct dispatched_task_batch).
  *
  * Drained by the kernel in .dispatch().
  */
@@ -221,6 +252,17 @@ struct task_ctx {
 	 * current task's cpumask.
 	 */
 	u64 cpumask_cnt;
+
+	/*
+	 * Slot id of the task in @task_slots (-1 if the task has no slot).
+	 */
+	s32 slot;
+
+	/*
+	 * Set while a thread of the user-space scheduler process is handling
+	 * a page fault.
+	 */
+	bool in_mm_fault;
 };
 
 /* Map that contains task-local storage. */
@@ -246,43 +288,58 @@ struct task_ctx *try_lookup_task_ctx(const struct task_struct *p)
 }
 
 /*
- * Intercept when a task is executing __handle_mm_fault().
+ * Return the slot of a task in @task_slots or NULL if the task has no slot.
  */
-struct {
-	__uint(type, BPF_MAP_TYPE_HASH);
-	__type(key, __u32);
-	__type(value, __u64);
-	__uint(max_entries, MAX_ENQUEUED_TASKS);
-} pid_mm_fault_map SEC(".maps");
-
-SEC("kprobe/handle_mm_fault")
-int BPF_KPROBE(kprobe_handle_mm_fault, void *vma,
-			unsigned long address, unsigned int flags)
+static struct task_slot *lookup_task_slot(const struct task_ctx *tctx)
 {
-	pid_t pid = bpf_get_current_pid_tgid() >> 32;
-	u64 value = true;
+	u32 slot;
 
-	bpf_map_update_elem(&pid_mm_fault_map, &pid, &value, BPF_ANY);
+	if (!tctx || tctx->slot < 0)
+		return NULL;
+	slot = tctx->slot;
 
-	return 0;
+	return bpf_map_lookup_elem(&task_slots, &slot);
+}
+
+/*
+ * Intercept when a thread of the user-space scheduler process is executing
+ * handle_mm_fault().
+ *
+ * A thread that faults on the scheduler's address space may hold locks (e.g.,
+ * mmap_lock) that the user-space scheduler needs to make progress, so it must
+ * never wait for the user-space scheduler to be dispatched. Faults of any
+ * other task can't block the user-space scheduler, so all the other tasks
+ * only pay for the tgid check.
+ */
+static struct task_ctx *usersched_fault_task_ctx(void)
+{
+	if ((bpf_get_current_pid_tgid() >> 32) != usersched_pid)
+		return NULL;
+
+	return bpf_task_storage_get(&task_ctx_stor,
+				    bpf_get_current_task_btf(), 0, 0);
 }
 
-SEC("kretprobe/handle_mm_fault")
-int BPF_KRETPROBE(kretprobe_handle_mm_fault)
+SEC("fentry/handle_mm_fault")
+int BPF_PROG(fentry_handle_mm_fault)
 {
-	pid_t pid = bpf_get_current_pid_tgid() >> 32;
-	bpf_map_delete_elem(&pid_mm_fault_map, &pid);
+	struct task_ctx *tctx = usersched_fault_task_ctx();
+
+	if (tctx)
+		tctx->in_mm_fault = true;
 
 	return 0;
 }
 
-/*
- * Return true if a task is handling a page fault, false otherwise.
- */
-static bool in_mm_fault(pid_t pid)
+SEC("fexit/handle_mm_fault")
+int BPF_PROG(fexit_handle_mm_fault)
 {
-	u64 *value = bpf_map_lookup_elem(&pid_mm_fault_map, &pid);
-	return value != NULL;
+	struct task_ctx *tctx = usersched_fault_task_ctx();
+
+	if (tctx)
+		tctx->in_mm_fault = false;
+
+	return 0;
 }
 
 /*
@@ -734,23 +791,32 @@ int rs_select_cpu(struct task_cpu_arg *input)
 }
 
 /*
- * Fill @task with all the information that need to be sent to the user-space
- * scheduler.
+ * Update the slot of task @p with all the information that need to be sent
+ * to the user-space scheduler and return the resulting sequence counter.
+ *
+ * The enqueue path is serialized for a given task, so there is only one
+ * writer. Both sequence counter updates are full barriers: the first one
+ * orders the data writes after the counter becomes odd, the second one
+ * publishes them.
  */
-static void get_task_info(struct queued_task_ctx *task,
-			  const struct task_struct *p, u64 enq_flags)
+static u32 update_task_slot(struct task_slot *slot, const struct task_struct *p,
+			    const struct task_ctx *tctx, u64 enq_flags)
 {
-	struct task_ctx *tctx = try_lookup_task_ctx(p);
-
-	task->pid = p->pid;
-	task->cpu = scx_bpf_task_cpu(p);
-	task->flags = enq_flags;
-	task->sum_exec_runtime = p->se.sum_exec_runtime;
-	task->nvcsw = p->nvcsw;
-	task->weight = p->scx.weight;
-	task->slice = p->scx.slice;
-	task->vtime = p->scx.dsq_vtime;
-	task->cpumask_cnt = tctx ? tctx->cpumask_cnt : 0;
+	u32 seq = __sync_fetch_and_add(&slot->seq, 1) + 1;
+
+	slot->pid = p->pid;
+	slot->cpu = scx_bpf_task_cpu(p);
+	slot->flags = enq_flags;
+	slot->sum_exec_runtime = p->se.sum_exec_runtime;
+	slot->nvcsw = p->nvcsw;
+	slot->weight = p->scx.weight;
+	slot->slice = p->scx.slice;
+	slot->vtime = p->scx.dsq_vtime;
+	slot->cpumask_cnt = tctx->cpumask_cnt;
+
+	__sync_val_compare_and_swap(&slot->seq, seq, seq + 1);
+
+	return seq + 1;
 }
 
 /*
@@ -782,6 +848,17 @@ static void kick_task_cpu(struct task_struct *p)
 	scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
 }
 
+/*
+ * Dispatch task @p directly from the kernel to the shared DSQ, bypassing the
+ * user-space scheduler.
+ */
+static void dispatch_direct(struct task_struct *p, u64 enq_flags)
+{
+	scx_bpf_dispatch_vtime(p, SHARED_DSQ, SCX_SLICE_DFL, 0, enq_flags);
+	__sync_fetch_and_add(&nr_kernel_dispatches, 1);
+	kick_task_cpu(p);
+}
+
 /*
  * Task @p becomes ready to run. We can dispatch the task directly here if the
  * user-space scheduler is not required, or enqueue it to be processed by the
@@ -789,7 +866,9 @@ static void kick_task_cpu(struct task_struct *p)
  */
 void BPF_STRUCT_OPS(rustland_enqueue, struct task_struct *p, u64 enq_flags)
 {
-	struct queued_task_ctx *task;
+	struct queued_task_msg *msg;
+	struct task_slot *slot;
+	struct task_ctx *tctx;
 
 	/*
 	 * Scheduler is dispatched directly in .dispatch() when needed, so
@@ -817,10 +896,19 @@ void BPF_STRUCT_OPS(rustland_enqueue, struct task_struct *p, u64 enq_flags)
 	 * deadlock conditions. They can just be dispatched to the shared DSQ
 	 * using ith the highest priority.
 	 */
-	if (in_mm_fault(p->pid)) {
-		scx_bpf_dispatch_vtime(p, SHARED_DSQ, SCX_SLICE_DFL, 0, enq_flags);
-		__sync_fetch_and_add(&nr_kernel_dispatches, 1);
-		kick_task_cpu(p);
+	tctx = try_lookup_task_ctx(p);
+	if (tctx && tctx->in_mm_fault) {
+		dispatch_direct(p, enq_flags);
+		return;
+	}
+
+	/*
+	 * Tasks without a slot in the shared task table can't be seen by the
+	 * user-space scheduler.
+	 */
+	slot = lookup_task_slot(tctx);
+	if (!tctx || !slot) {
+		dispatch_direct(p, enq_flags);
 		return;
 	}
 
@@ -832,18 +920,16 @@ void BPF_STRUCT_OPS(rustland_enqueue, struct task_struct *p, u64 enq_flags)
 	 * will be dispatched directly from the kernel (using the first CPU
 	 * available in this case).
 	 */
-	task = bpf_ringbuf_reserve(&queued, sizeof(*task), 0);
-	if (!task) {
+	msg = bpf_ringbuf_reserve(&queued, sizeof(*msg), 0);
+	if (!msg) {
 		sched_congested(p);
-		scx_bpf_dispatch_vtime(p, SHARED_DSQ,
-				       SCX_SLICE_DFL, 0, enq_flags);
-		__sync_fetch_and_add(&nr_kernel_dispatches, 1);
-		kick_task_cpu(p);
+		dispatch_direct(p, enq_flags);
 		return;
 	}
-	get_task_info(task, p, enq_flags);
-	dbg_msg("enqueue: pid=%d (%s)", p->pid, p->comm);
-	bpf_ringbuf_submit(task, 0);
+	msg->slot = tctx->slot;
+	msg->seq = update_task_slot(slot, p, tctx, enq_flags);
+	dbg_msg("enqueue: pid=%d (%s) slot=%d", p->pid, p->comm, tctx->slot);
+	bpf_ringbuf_submit(msg, 0);
 
 	__sync_fetch_and_add(&nr_queued, 1);
 }
@@ -884,21 +970,40 @@ static bool dispatch_user_scheduler(void)
 }
 
 /*
- * Handle a task dispatched from user-space, performing the actual low-level
- * BPF dispatch.
+ * Return true if there are enough dispatch slots left to handle a whole batch
+ * of tasks, plus the user-space scheduler itself.
+ */
+static bool can_dispatch_batch(void)
+{
+	return scx_bpf_dispatch_nr_slots() > MAX_DISPATCH_BATCH;
+}
+
+/*
+ * Handle a batch of tasks dispatched from user-space, performing the actual
+ * low-level BPF dispatch of each one of them.
  */
 static long handle_dispatched_task(struct bpf_dynptr *dynptr, void *context)
 {
 	const struct dispatched_task_ctx *task;
+	u32 nr, i;
 
-	task = bpf_dynptr_data(dynptr, 0, sizeof(*task));
-	if (!task)
+	if (bpf_dynptr_read(&nr, sizeof(nr), dynptr, 0, 0))
 		return 0;
+	nr = MIN(nr, MAX_DISPATCH_BATCH);
 
-	dispatch_task(task);
-	__sync_fetch_and_add(&nr_user_dispatches, 1);
+	bpf_for(i, 0, nr) {
+		task = bpf_dynptr_data(dynptr,
+				offsetof(struct dispatched_task_batch, tasks) +
+				i * sizeof(*task), sizeof(*task));
+		if (!task)
+			break;
 
-	return !!scx_bpf_dispatch_nr_slots();
+		dispatch_task(task);
+		__sync_fetch_and_add(&nr_user_dispatches, 1);
+	}
+	__sync_fetch_and_add(&nr_dispatch_batches, 1);
+
+	return can_dispatch_batch();
 }
 
 /*
@@ -922,8 +1027,14 @@ void BPF_STRUCT_OPS(rustland_dispatch, s32 cpu, struct task_struct *prev)
 	/*
 	 * Consume all tasks from the @dispatched list and immediately dispatch
 	 * them on the target CPU decided by the user-space scheduler.
+	 *
+	 * Stop draining as soon as a whole batch may not fit in the dispatch
+	 * buffer anymore: the remaining batches will be consumed by the next
+	 * .dispatch().
 	 */
-	bpf_user_ringbuf_drain(&dispatched, handle_dispatched_task, NULL, 0);
+	if (can_dispatch_batch())
+		bpf_user_ringbuf_drain(&dispatched, handle_dispatched_task,
+				       NULL, 0);
 
 	/*
 	 * Check if the user-space scheduler needs to run.
@@ -1081,6 +1192,7 @@ s32 BPF_STRUCT_OPS(rustland_init_task, struct task_struct *p,
 {
 	struct task_ctx *tctx;
 	struct bpf_cpumask *cpumask;
+	u32 slot;
 
 	tctx = bpf_task_storage_get(&task_ctx_stor, p, 0,
 				    BPF_LOCAL_STORAGE_GET_F_CREATE);
@@ -1108,9 +1220,48 @@ s32 BPF_STRUCT_OPS(rustland_init_task, struct task_struct *p,
 	if (cpumask)
 		bpf_cpumask_release(cpumask);
 
+	/*
+	 * Assign a slot in the shared task table. If the table is full the
+	 * task is still allowed to run, but it will always bypass the
+	 * user-space scheduler.
+	 */
+	if (bpf_map_pop_elem(&free_task_slots, &slot)) {
+		dbg_msg("warning: no task slot for pid=%d (%s)", p->pid, p->comm);
+		tctx->slot = -1;
+	} else {
+		tctx->slot = slot;
+	}
+
 	return 0;
 }
 
+/*
+ * Task @p is leaving the scheduler: release its slot in the shared task table.
+ */
+void BPF_STRUCT_OPS(rustland_exit_task, struct task_struct *p,
+		    struct scx_exit_task_args *args)
+{
+	struct task_slot *slot;
+	struct task_ctx *tctx;
+	u32 id;
+
+	tctx = try_lookup_task_ctx(p);
+	slot = lookup_task_slot(tctx);
+	if (!tctx || !slot)
+		return;
+
+	/*
+	 * Invalidate the notifications still pending in @queued, so that they
+	 * are not mistaken for the next owner of the slot.
+	 */
+	__sync_fetch_and_add(&slot->seq, 2);
+
+	id = tctx->slot;
+	tctx->slot = -1;
+	if (bpf_map_push_elem(&free_task_slots, &id, 0))
+		scx_bpf_error("Failed to release task slot %u", id);
+}
+
 /*
  * Heartbeat scheduler timer callback.
  *
@@ -1281,6 +1432,7 @@ int enable_sibling_cpu(struct domain_arg *input)
  */
 s32 BPF_STRUCT_OPS_SLEEPABLE(rustland_init)
 {
+	u32 slot;
 	int err;
 
 	/* Compile-time checks */
@@ -1290,6 +1442,16 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(rustland_init)
 	err = dsq_init();
 	if (err)
 		return err;
+
+	/* All the task slots are initially free */
+	bpf_for(slot, 0, MAX_TASK_SLOTS) {
+		err = bpf_map_push_elem(&free_task_slots, &slot, 0);
+		if (err) {
+			scx_bpf_error("failed to initialize task slots: %d", err);
+			return err;
+		}
+	}
+
 	err = usersched_timer_init();
 	if (err)
 		return err;
@@ -1318,6 +1480,7 @@ SCX_OPS_DEFINE(rustland,
 	       .set_cpumask		= (void *)rustland_set_cpumask,
 	       .cpu_release		= (void *)rustland_cpu_release,
 	       .init_task		= (void *)rustland_init_task,
+	       .exit_task		= (void *)rustland_exit_task,
 	       .init			= (void *)rustland_init,
 	       .exit			= (void *)rustland_exit,
 	       .flags			= SCX_OPS_ENQ_LAST | SCX_OPS_KEEP_BUILTIN_IDLE,
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Copyright (c) 2026 sched_ext contributors
+
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+//! Building blocks shared by the microbenchmarks in this directory:
+//! positional arguments, a stop flag, looping worker threads and ping-pong
+//! thread pairs which wake each other up over pipes.
+//!
+//! A benchmark spawns its threads with a [`StopFlag`], calls [`run_for()`]
+//! and joins the threads to collect their counts.
+
+// Not every example uses every helper.
+#![allow(dead_code)]
+
+use std::env::args;
+use std::mem;
+use std::sync::atomic::AtomicBool;
+use std::sync::atomic::Ordering;
+use std::sync::Arc;
+use std::thread;
+use std::thread::JoinHandle;
+use std::time::Duration;
+use std::time::Instant;
+
+/// Positional argument @idx parsed as usize, @dfl if it's missing.
+pub fn arg(idx: usize, dfl: usize) -> usize {
+    args()
+        .nth(idx)
+        .map_or(dfl, |a| a.parse().expect("invalid argument"))
+}
+
+/// Pin the calling thread to @cpu.
+pub fn pin_to_cpu(cpu: usize) {
+    unsafe {
+        let mut set: libc::cpu_set_t = mem::zeroed();
+        libc::CPU_SET(cpu, &mut set);
+        assert!(
+            libc::sched_setaffinity(0, mem::size_of::<libc::cpu_set_t>(), &set) == 0,
+            "sched_setaffinity failed"
+        );
+    }
+}
+
+/// Tells the benchmark threads to wind down, see [`run_for()`].
+#[derive(Clone, Default)]
+pub struct StopFlag(Arc<AtomicBool>);
+
+impl StopFlag {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn stopped(&self) -> bool {
+        self.0.load(Ordering::Relaxed)
+    }
+
+    pub fn stop(&self) {
+        self.0.store(true, Ordering::Relaxed);
+    }
+}
+
+/// Let the threads watching @stop run for @duration, then stop them and
+/// return the elapsed time in seconds.
+pub fn run_for(duration: Duration, stop: &StopFlag) -> f64 {
+    let started_at = Instant::now();
+    thread::sleep(duration);
+    stop.stop();
+    started_at.elapsed().as_secs_f64()
+}
+
+/// Spawn a thread calling @f until @stop and return the sum of the counts
+/// it returned.
+pub fn spawn_loop<F>(stop: &StopFlag, f: F) -> JoinHandle<u64>
+where
+    F: Fn() -> u64 + Send + 'static,
+{
+    let stop = stop.clone();
+    thread::spawn(move || {
+        let mut nr = 0;
+        while !stop.stopped() {
+            nr += f();
+        }
+        nr
+    })
+}
+
+fn pipe() -> (i32, i32) {
+    let mut fds = [0; 2];
+    assert!(unsafe { libc::pipe(fds.as_mut_ptr()) } == 0, "pipe failed");
+    (fds[0], fds[1])
+}
+
+// Read one byte from @rfd and write it back to @wfd, return false on EOF.
+fn bounce(rfd: i32, wfd: i32) -> bool {
+    let mut b = 0u8;
+    unsafe {
+        if libc::read(rfd, &mut b as *mut u8 as *mut libc::c_void, 1) != 1 {
+            return false;
+        }
+        libc::write(wfd, &b as *const u8 as *const libc::c_void, 1) == 1
+    }
+}
+
+/// A pair of threads ping-ponging a byte over two pipes, so that every round
+/// trip wakes up both of them once.
+pub struct PingPong {
+    pinger: JoinHandle<u64>,
+    ponger: JoinHandle<()>,
+    pong_r: i32,
+}
+
+impl PingPong {
+    /// Start a pair which runs until @stop, with both threads pinned to @cpu
+    /// if specified.
+    pub fn spawn(cpu: Option<usize>, stop: &StopFlag) -> Self {
+        let (ping_r, ping_w) = pipe();
+        let (pong_r, pong_w) = pipe();
+
+        let stop = stop.clone();
+        let pinger = thread::spawn(move || {
+            if let Some(cpu) = cpu {
+                pin_to_cpu(cpu);
+            }
+            let mut nr = 0u64;
+            let b = 0u8;
+            unsafe { libc::write(ping_w, &b as *const u8 as *const libc::c_void, 1) };
+            while !stop.stopped() && bounce(pong_r, ping_w) {
+                nr += 1;
+            }
+            // Wake up the ponger for good.
+            unsafe { libc::close(ping_w) };
+            nr
+        });
+        let ponger = thread::spawn(move || {
+            if let Some(cpu) = cpu {
+                pin_to_cpu(cpu);
+            }
+            while bounce(ping_r, pong_w) {}
+            unsafe {
+                libc::close(pong_w);
+                libc::close(ping_r);
+            }
+        });
+
+        // The ponger may still write its last byte after the pinger is done,
+        // so the read end stays open until both are joined.
+        Self {
+            pinger,
+            ponger,
+            pong_r,
+        }
+    }
+
+    /// Wait for both threads and return the number of round trips.
+    pub fn join(self) -> u64 {
+        let round_trips = self.pinger.join().unwrap();
+        self.ponger.join().unwrap();
+        unsafe { libc::close(self.pong_r) };
+        round_trips
+    }
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Copyright (c) 2026 sched_ext contributors
+
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+//! End-to-end scheduling decisions per second benchmark for the schedulers
+//! built on scx_rustland_core (e.g., scx_rustland and scx_rlfifo).
+//!
+//! Pairs of threads ping-pong a byte over two pipes, so every round trip
+//! wakes up two tasks, each of them going through a full round trip via the
+//! user-space scheduler (enqueue, dequeue_task(), dispatch_task()). Spinner
+//! threads can be added to keep the CPUs busy, so that tasks can't be
+//! dispatched straight to idle CPUs.
+//!
+//! The reported wakeups/s are the decisions completed by the workload, while
+//! ctxsw/s are the system-wide context switches from /proc/stat. Run it with
+//! the scheduler loaded and compare the numbers across scheduler versions:
+//!
+//! $ cargo run --release --example dispatch_rate [PAIRS] [SPINNERS] [SECS]
+
+mod common;
+
+use std::fs;
+use std::thread;
+use std::time::Duration;
+
+use common::arg;
+use common::run_for;
+use common::spawn_loop;
+use common::PingPong;
+use common::StopFlag;
+
+fn ctxt_switches() -> u64 {
+    fs::read_to_string("/proc/stat")
+        .unwrap_or_default()
+        .lines()
+        .find_map(|l| l.strip_prefix("ctxt "))
+        .and_then(|v| v.trim().parse().ok())
+        .unwrap_or(0)
+}
+
+fn main() {
+    let nr_cpus = thread::available_parallelism().map_or(1, |n| n.get());
+    let nr_pairs = arg(1, nr_cpus);
+    let nr_spinners = arg(2, 0);
+    let duration = Duration::from_secs(arg(3, 10) as u64);
+
+    let stop = StopFlag::new();
+
+    let spinners: Vec<_> = (0..nr_spinners)
+        .map(|_| {
+            spawn_loop(&stop, || {
+                std::hint::spin_loop();
+                0
+            })
+        })
+        .collect();
+    let pairs: Vec<_> = (0..nr_pairs)
+        .map(|_| PingPong::spawn(None, &stop))
+        .collect();
+
+    let ctxt_start = ctxt_switches();
+    let elapsed = run_for(duration, &stop);
+    let ctxt = ctxt_switches() - ctxt_start;
+
+    let round_trips: u64 = pairs.into_iter().map(|p| p.join()).sum();
+    for t in spinners {
+        t.join().unwrap();
+    }
+
+    println!(
+        "pairs={} spinners={} wakeups/s={:.0} ctxsw/s={:.0} rtt={:.1}us",
+        nr_pairs,
+        nr_spinners,
+        (round_trips * 2) as f64 / elapsed,
+        ctxt as f64 / elapsed,
+        elapsed * 1e6 * nr_pairs as f64 / round_trips.max(1) as f64,
+    );
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Copyright (c) 2026 sched_ext contributors
+
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+//! Page fault rate microbenchmark.
+//!
+//! Worker threads repeatedly map an anonymous region, touch each of its pages
+//! to fault them in and unmap it. Any per-fault work done by the scheduler
+//! (e.g., probes attached to handle_mm_fault()) shows up as a lower fault rate.
+//! Compare the reported rates with and without the scheduler loaded, or across
+//! scheduler versions:
+//!
+//! $ cargo run --release --example fault_rate [WORKERS] [SECS]
+
+mod common;
+
+use std::ptr;
+use std::thread;
+use std::time::Duration;
+
+use common::arg;
+use common::run_for;
+use common::spawn_loop;
+use common::StopFlag;
+
+const PAGE_SIZE: usize = 4096;
+const NR_PAGES: usize = 256;
+
+// Fault in NR_PAGES pages and return the number of faults.
+fn fault_pages() -> u64 {
+    let len = PAGE_SIZE * NR_PAGES;
+    unsafe {
+        let addr = libc::mmap(
+            ptr::null_mut(),
+            len,
+            libc::PROT_READ | libc::PROT_WRITE,
+            libc::MAP_PRIVATE | libc::MAP_ANONYMOUS,
+            -1,
+            0,
+        );
+        assert!(addr != libc::MAP_FAILED, "mmap failed");
+        for i in 0..NR_PAGES {
+            ptr::write_volatile((addr as *mut u8).add(i * PAGE_SIZE), 1);
+        }
+        libc::munmap(addr, len);
+    }
+    NR_PAGES as u64
+}
+
+fn main() {
+    let nr_cpus = thread::available_parallelism().map_or(1, |n| n.get());
+    let nr_workers = arg(1, nr_cpus);
+    let duration = Duration::from_secs(arg(2, 10) as u64);
+
+    let stop = StopFlag::new();
+    let workers: Vec<_> = (0..nr_workers)
+        .map(|_| spawn_loop(&stop, fault_pages))
+        .collect();
+
+    let elapsed = run_for(duration, &stop);
+    let nr_faults: u64 = workers.into_iter().map(|w| w.join().unwrap()).sum();
+
+    println!(
+        "workers={} faults/s={:.0} ns/fault={:.1}",
+        nr_workers,
+        nr_faults as f64 / elapsed,
+        elapsed * 1e9 * nr_workers as f64 / nr_faults.max(1) as f64,
+    );
+}
@@ -0,0 +1,82 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+//! Compare per-record ravg_read() against RavgBatch::read().
+//!
+//! $ cargo run --release -p scx_utils --example ravg_bench [NR_RECORDS...]
+
+use scx_utils::ravg::ravg_read;
+use scx_utils::ravg::RavgBatch;
+use std::env::args;
+use std::hint::black_box;
+use std::time::Duration;
+use std::time::Instant;
+
+const HALF_LIFE: u32 = 100_000_000;
+const FRAC_BITS: u32 = 20;
+const NOW: u64 = 1_000_000_000_000;
+
+fn best_of<F: FnMut()>(runs: usize, mut f: F) -> Duration {
+    (0..runs)
+        .map(|_| {
+            let started_at = Instant::now();
+            f();
+            started_at.elapsed()
+        })
+        .min()
+        .unwrap()
+}
+
+fn main() {
+    let sizes: Vec<usize> = match args().len() {
+        1 => vec![10_000, 100_000, 1_000_000],
+        _ => args().skip(1).map(|a| a.parse().unwrap()).collect(),
+    };
+
+    println!(
+        "{:>10} {:>12} {:>12} {:>8}",
+        "records", "scalar(us)", "batch(us)", "speedup"
+    );
+
+    for nr in sizes {
+        let mut batch = RavgBatch::with_capacity(nr);
+        let mut recs = Vec::with_capacity(nr);
+        let mut seed = 0x2545f4914f6cdd1du64;
+        for _ in 0..nr {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            let rec = (
+                seed % (1 << 20),
+                NOW - seed % (8 * HALF_LIFE as u64),
+                (seed >> 8) % (1 << 40),
+                (seed >> 16) % (1 << 40),
+            );
+            batch.push(rec.0, rec.1, rec.2, rec.3);
+            recs.push(rec);
+        }
+
+        let mut out = Vec::with_capacity(nr);
+        let scalar = best_of(5, || {
+            out.clear();
+            out.extend(recs.iter().map(|&(val, val_at, old, cur)| {
+                ravg_read(val, val_at, old, cur, NOW, HALF_LIFE, FRAC_BITS)
+            }));
+            black_box(&out);
+        });
+        let batched = best_of(5, || {
+            batch.read(NOW, HALF_LIFE, FRAC_BITS, &mut out);
+            black_box(&out);
+        });
+
+        println!(
+            "{:>10} {:>12.1} {:>12.1} {:>7.2}x",
+            nr,
+            scalar.as_secs_f64() * 1e6,
+            batched.as_secs_f64() * 1e6,
+            scalar.as_secs_f64() / batched.as_secs_f64()
+        );
+    }
+}
@@ -0,0 +1,132 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+//
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+//! # Histogram Utilities
+//!
+//! Rust userland utilities to read the per-CPU log-linear histograms
+//! recorded with SCX_HIST_DEFINE() and scx_hist_record(). See
+//! [hist.bpf.h](https://github.com/sched-ext/scx/blob/main/scheds/include/scx/hist.bpf.h)
+//! and
+//! [hist_impl.bpf.h](https://github.com/sched-ext/scx/blob/main/scheds/include/scx/hist_impl.bpf.h)
+//! for details. This is the equivalent of the scx_hist_*() helpers in
+//! scx/common.h.
+
+use std::ops::Sub;
+
+pub const SCX_HIST_SUB_BITS: u32 = 2;
+pub const SCX_HIST_SUB_BUCKETS: usize = 1 << SCX_HIST_SUB_BITS;
+pub const SCX_HIST_NR_BUCKETS: usize = (64 - SCX_HIST_SUB_BITS as usize + 1) * SCX_HIST_SUB_BUCKETS;
+
+/// A merged histogram. Histograms are cumulative; subtract an older
+/// snapshot to get the distribution of an interval.
+#[derive(Clone, Debug)]
+pub struct Hist {
+    pub buckets: Vec<u64>,
+}
+
+impl Default for Hist {
+    fn default() -> Self {
+        Self {
+            buckets: vec![0; SCX_HIST_NR_BUCKETS],
+        }
+    }
+}
+
+impl Hist {
+    /// Merge the per-CPU copies of a histogram as returned by
+    /// `MapCore::lookup_percpu()`.
+    pub fn from_percpu(percpu: &[Vec<u8>]) -> Self {
+        let mut hist = Self::default();
+        for raw in percpu.iter() {
+            for (bucket, chunk) in hist.buckets.iter_mut().zip(raw.chunks_exact(8)) {
+                *bucket += u64::from_ne_bytes(chunk.try_into().unwrap());
+            }
+        }
+        hist
+    }
+
+    /// Smallest value which falls into `bucket`.
+    pub fn bucket_min(bucket: usize) -> u64 {
+        if bucket < SCX_HIST_SUB_BUCKETS {
+            return bucket as u64;
+        }
+        let msb = bucket / SCX_HIST_SUB_BUCKETS + SCX_HIST_SUB_BITS as usize - 1;
+        let sub = bucket % SCX_HIST_SUB_BUCKETS;
+        ((SCX_HIST_SUB_BUCKETS + sub) as u64) << (msb - SCX_HIST_SUB_BITS as usize)
+    }
+
+    /// Largest value which falls into `bucket`.
+    pub fn bucket_max(bucket: usize) -> u64 {
+        if bucket >= SCX_HIST_NR_BUCKETS - 1 {
+            return u64::MAX;
+        }
+        Self::bucket_min(bucket + 1) - 1
+    }
+
+    /// Total number of recorded values.
+    pub fn count(&self) -> u64 {
+        self.buckets.iter().sum()
+    }
+
+    /// Upper bound of the bucket containing the `pct`'th percentile value,
+    /// e.g. 99.9 for p999. 0 if empty.
+    pub fn percentile(&self, pct: f64) -> u64 {
+        let total = self.count();
+        if total == 0 {
+            return 0;
+        }
+        // Round the rank up so that e.g. p99 of 10 samples is the largest.
+        let target = ((total as f64 * pct / 100.0).ceil() as u64).max(1);
+
+        let mut acc = 0;
+        for (i, cnt) in self.buckets.iter().enumerate() {
+            acc += cnt;
+            if acc >= target {
+                return Self::bucket_max(i);
+            }
+        }
+        Self::bucket_max(SCX_HIST_NR_BUCKETS - 1)
+    }
+}
+
+impl<'a, 'b> Sub<&'b Hist> for &'a Hist {
+    type Output = Hist;
+
+    fn sub(self, rhs: &'b Hist) -> Hist {
+        Hist {
+            buckets: self
+                .buckets
+                .iter()
+                .zip(rhs.buckets.iter())
+                .map(|(l, r)| l.wrapping_sub(*r))
+                .collect(),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_bucket_bounds() {
+        // Bucket bounds must tile the whole u64 range.
+        assert_eq!(Hist::bucket_min(0), 0);
+        for b in 1..SCX_HIST_NR_BUCKETS {
+            assert_eq!(Hist::bucket_min(b), Hist::bucket_max(b - 1) + 1);
+        }
+        assert_eq!(Hist::bucket_max(SCX_HIST_NR_BUCKETS - 1), u64::MAX);
+    }
+
+    #[test]
+    fn test_percentile() {
+        let mut hist = Hist::default();
+        hist.buckets[1] = 90;
+        hist.buckets[20] = 10;
+        assert_eq!(hist.percentile(50.0), 1);
+        assert_eq!(hist.percentile(99.0), Hist::bucket_max(20));
+        assert_eq!(Hist::default().percentile(99.0), 0);
+    }
+}
@@ -58,6 +58,8 @@ pub mod compat;
 mod libbpf_logger;
 pub use libbpf_logger::init_libbpf_logging;
 
+pub mod hist;
+
 pub mod ravg;
 
 mod topology;
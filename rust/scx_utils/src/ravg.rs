@@ -12,6 +12,31 @@
 //! [ravg_impl.bpf.h](https://github.com/sched-ext/scx/blob/main/scheds/include/common/ravg_impl.bpf.h)
 //! for details.
 
+// Pre-computed decayed full-period values.
+const FULL_SUMS: [f64; 20] = [
+    0.5,
+    0.75,
+    0.875,
+    0.9375,
+    0.96875,
+    0.984375,
+    0.9921875,
+    0.99609375,
+    0.998046875,
+    0.9990234375,
+    0.99951171875,
+    0.999755859375,
+    0.9998779296875,
+    0.99993896484375,
+    0.999969482421875,
+    0.9999847412109375,
+    0.9999923706054688,
+    0.9999961853027344,
+    0.9999980926513672,
+    0.9999990463256836,
+    // Use the same value beyond this point.
+];
+
 /// Read the current running average
 ///
 /// Read the running average value at `@now` of ravg_data (`@val`,
@@ -58,31 +83,6 @@ pub fn ravg_read(
         // Fold the oldest period whicy may be partial.
         old += val * normalized_dur(half_life - val_at % half_life) / full_decay;
 
-        // Pre-computed decayed full-period values.
-        const FULL_SUMS: [f64; 20] = [
-            0.5,
-            0.75,
-            0.875,
-            0.9375,
-            0.96875,
-            0.984375,
-            0.9921875,
-            0.99609375,
-            0.998046875,
-            0.9990234375,
-            0.99951171875,
-            0.999755859375,
-            0.9998779296875,
-            0.99993896484375,
-            0.999969482421875,
-            0.9999847412109375,
-            0.9999923706054688,
-            0.9999961853027344,
-            0.9999980926513672,
-            0.9999990463256836,
-            // Use the same value beyond this point.
-        ];
-
         // Fold the full periods in the middle.
         if seq_delta >= 2 {
             let idx = ((seq_delta - 2) as usize).min(FULL_SUMS.len() - 1);
@@ -100,3 +100,180 @@ pub fn ravg_read(
     //
     old * (1.0 - normalized_dur(now % half_life) / 2.0) + cur / 2.0
 }
+
+/// Batch of ravg_data records in structure-of-arrays layout
+///
+/// Load balancers read hundreds to millions of ravg_data records at the same
+/// `@now` every interval. Collect them with `push()` and evaluate them all in
+/// one `read()` call instead of calling `ravg_read()` on each. The per-record
+/// work is a straight-line loop over parallel arrays, with `@now`-derived
+/// values hoisted out and the `powi()` decay replaced by an exponent bit
+/// construction, which lets the compiler vectorize it for the target's SIMD
+/// units (SSE/AVX2, NEON) without architecture-specific code.
+///
+/// The results match `ravg_read()` up to floating point rounding.
+#[derive(Clone, Debug, Default)]
+pub struct RavgBatch {
+    val: Vec<u64>,
+    val_at: Vec<u64>,
+    old: Vec<u64>,
+    cur: Vec<u64>,
+}
+
+impl RavgBatch {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn with_capacity(capacity: usize) -> Self {
+        Self {
+            val: Vec::with_capacity(capacity),
+            val_at: Vec::with_capacity(capacity),
+            old: Vec::with_capacity(capacity),
+            cur: Vec::with_capacity(capacity),
+        }
+    }
+
+    /// Append a ravg_data record. Takes the fields separately for the same
+    /// reason as `ravg_read()`.
+    pub fn push(&mut self, val: u64, val_at: u64, old: u64, cur: u64) {
+        self.val.push(val);
+        self.val_at.push(val_at);
+        self.old.push(old);
+        self.cur.push(cur);
+    }
+
+    pub fn len(&self) -> usize {
+        self.val.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.val.is_empty()
+    }
+
+    pub fn clear(&mut self) {
+        self.val.clear();
+        self.val_at.clear();
+        self.old.clear();
+        self.cur.clear();
+    }
+
+    /// Read the running averages of all records at `@now`
+    ///
+    /// `@out` is cleared and filled with one value per record in `push()`
+    /// order.
+    pub fn read(&self, now: u64, half_life: u32, frac_bits: u32, out: &mut Vec<f64>) {
+        let half_life = half_life as u64;
+        let hl_inv = 1.0 / half_life as f64;
+        let ravg_1_inv = 1.0 / (1u64 << frac_bits) as f64;
+        let now_seq = now / half_life;
+        let now_rem = now % half_life;
+
+        out.clear();
+        out.reserve(self.len());
+        out.extend(
+            self.val
+                .iter()
+                .zip(self.val_at.iter())
+                .zip(self.old.iter().zip(self.cur.iter()))
+                .map(|((&val, &val_at), (&old, &cur))| {
+                    let val_seq = val_at / half_life;
+                    let val_rem = val_at - val_seq * half_life;
+
+                    // ravg_read() clamps @now to @val_at.
+                    let (cur_seq, cur_rem) = if val_at > now {
+                        (val_seq, val_rem)
+                    } else {
+                        (now_seq, now_rem)
+                    };
+                    let seq_delta = cur_seq - val_seq;
+                    let now_frac = cur_rem as f64 * hl_inv;
+
+                    let val = val as f64;
+                    let old = old as f64 * ravg_1_inv;
+                    let cur = cur as f64 * ravg_1_inv;
+
+                    let (old, cur) = if seq_delta > 0 {
+                        // 2^-seq_delta built directly from the exponent bits.
+                        let shift = seq_delta.min(1022);
+                        let decay = f64::from_bits((1023 - shift) << 52);
+                        let full_sum = if seq_delta >= 2 {
+                            FULL_SUMS[((seq_delta - 2) as usize).min(FULL_SUMS.len() - 1)]
+                        } else {
+                            0.0
+                        };
+                        let partial = (half_life - val_rem) as f64 * hl_inv;
+
+                        (
+                            (old + cur + val * partial) * decay + val * full_sum,
+                            val * now_frac,
+                        )
+                    } else {
+                        (old, cur + val * (cur_rem - val_rem) as f64 * hl_inv)
+                    };
+
+                    old * (1.0 - now_frac / 2.0) + cur / 2.0
+                }),
+        );
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_batch_matches_scalar() {
+        const HALF_LIFE: u32 = 100_000_000;
+        const FRAC_BITS: u32 = 20;
+        let now = 1_000_000_000_000u64;
+
+        // Cover the same-period, partial, multi-period, long-idle and
+        // val_at-in-the-future cases.
+        let mut batch = RavgBatch::new();
+        let mut seed = 0x2545f4914f6cdd1du64;
+        for i in 0..4096u64 {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            let age = match i % 5 {
+                0 => seed % HALF_LIFE as u64,
+                1 => seed % (2 * HALF_LIFE as u64),
+                2 => seed % (30 * HALF_LIFE as u64),
+                3 => seed % (2000 * HALF_LIFE as u64),
+                _ => 0,
+            };
+            let val_at = if i % 5 == 4 { now + seed % 1000 } else { now - age };
+            batch.push(
+                seed % (1 << 20),
+                val_at,
+                (seed >> 8) % (1 << 40),
+                (seed >> 16) % (1 << 40),
+            );
+        }
+
+        let mut out = vec![];
+        batch.read(now, HALF_LIFE, FRAC_BITS, &mut out);
+        assert_eq!(out.len(), batch.len());
+
+        for i in 0..batch.len() {
+            let expected = ravg_read(
+                batch.val[i],
+                batch.val_at[i],
+                batch.old[i],
+                batch.cur[i],
+                now,
+                HALF_LIFE,
+                FRAC_BITS,
+            );
+            let diff = (out[i] - expected).abs();
+            assert!(
+                diff <= expected.abs() * 1e-12 + 1e-9,
+                "record {}: batch {} != scalar {}",
+                i,
+                out[i],
+                expected
+            );
+        }
+    }
+}
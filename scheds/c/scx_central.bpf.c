@@ -37,32 +37,56 @@
  *    SCX_KICK_PREEMPT is used to trigger scheduling and CPUs to move to the
  *    next tasks.
  *
+ * d. Timer dispatch
+ *
+ *    With timer_dispatch set, the scheduling loop runs from the central timer
+ *    instead of the central CPU's dispatch() path. Tasks are queued on
+ *    CENTRAL_DSQ_ID without kicking anyone and every timer tick pre-stages
+ *    the next task into the local dsq of each CPU which doesn't have one
+ *    with scx_bpf_dispatch_from_dsq(). A CPU whose task blocks then finds
+ *    its next task already there, so CPUs only get interrupted to wake up
+ *    from idle or when their slice expires, at the cost of up to one timer
+ *    interval of dispatch latency.
+ *
  * This scheduler is designed to maximize usage of various SCX mechanisms. A
- * more practical implementation would likely put the scheduling loop outside
- * the central CPU's dispatch() path and add some form of priority mechanism.
+ * more practical implementation would likely add some form of priority
+ * mechanism.
  *
  * Copyright (c) 2022 Meta Platforms, Inc. and affiliates.
  * Copyright (c) 2022 Tejun Heo <tj@kernel.org>
  * Copyright (c) 2022 David Vernet <dvernet@meta.com>
  */
 #include <scx/common.bpf.h>
+#include <scx/hist_impl.bpf.h>
+#include "scx_central.h"
 
 char _license[] SEC("license") = "GPL";
 
 enum {
 	FALLBACK_DSQ_ID		= 0,
+	CENTRAL_DSQ_ID		= 1,
 	MS_TO_NS		= 1000LLU * 1000,
 	TIMER_INTERVAL_NS	= 1 * MS_TO_NS,
+
+	/* bound the time the timer spends looking for a task for one CPU */
+	STAGE_SCAN_MAX		= 32,
 };
 
 const volatile s32 central_cpu;
 const volatile u32 nr_cpu_ids = 1;	/* !0 for veristat, set during init */
 const volatile u64 slice_ns;
+const volatile bool timer_dispatch;
+const volatile u64 timer_interval_ns = TIMER_INTERVAL_NS;
 
 bool timer_pinned = true;
-u64 nr_total, nr_locals, nr_queued, nr_lost_pids;
-u64 nr_timers, nr_dispatches, nr_mismatches, nr_retries;
-u64 nr_overflows;
+
+/* nr_queued steers the timer and nr_timers rotates its scan, keep them global */
+u64 nr_queued, nr_timers;
+
+STAT_DEFINE(stats, CENTRAL_NR_STATS);
+
+/* [dispatch latency] in nsecs, from enqueue() until the task runs */
+SCX_HIST_DEFINE(hists, 1);
 
 UEI_DEFINE(uei);
 
@@ -87,11 +111,30 @@ struct {
 	__type(value, struct central_timer);
 } central_timer SEC(".maps");
 
+struct task_ctx {
+	u64	enqueued_at;
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
+	__type(value, struct task_ctx);
+} task_ctx_stor SEC(".maps");
+
 static bool vtime_before(u64 a, u64 b)
 {
 	return (s64)(a - b) < 0;
 }
 
+/* kicking another CPU costs it an IPI, count those */
+static void kick_cpu(s32 cpu, u64 flags)
+{
+	if (cpu != bpf_get_smp_processor_id())
+		stat_inc(stats, CENTRAL_STAT_IPIS);
+	scx_bpf_kick_cpu(cpu, flags);
+}
+
 s32 BPF_STRUCT_OPS(central_select_cpu, struct task_struct *p,
 		   s32 prev_cpu, u64 wake_flags)
 {
@@ -106,9 +149,14 @@ s32 BPF_STRUCT_OPS(central_select_cpu, struct task_struct *p,
 
 void BPF_STRUCT_OPS(central_enqueue, struct task_struct *p, u64 enq_flags)
 {
+	struct task_ctx *taskc;
 	s32 pid = p->pid;
 
-	__sync_fetch_and_add(&nr_total, 1);
+	stat_inc(stats, CENTRAL_STAT_TOTAL);
+
+	taskc = bpf_task_storage_get(&task_ctx_stor, p, 0, 0);
+	if (taskc)
+		taskc->enqueued_at = bpf_ktime_get_ns();
 
 	/*
 	 * Push per-cpu kthreads at the head of local dsq's and preempt the
@@ -117,14 +165,20 @@ void BPF_STRUCT_OPS(central_enqueue, struct task_struct *p, u64 enq_flags)
 	 * guarantee as we depend on the BPF timer which may run from ksoftirqd.
 	 */
 	if ((p->flags & PF_KTHREAD) && p->nr_cpus_allowed == 1) {
-		__sync_fetch_and_add(&nr_locals, 1);
+		stat_inc(stats, CENTRAL_STAT_LOCALS);
 		scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_INF,
 				 enq_flags | SCX_ENQ_PREEMPT);
 		return;
 	}
 
+	/* the central timer picks it up, nobody needs to be kicked */
+	if (timer_dispatch) {
+		scx_bpf_dispatch(p, CENTRAL_DSQ_ID, SCX_SLICE_INF, enq_flags);
+		return;
+	}
+
 	if (bpf_map_push_elem(&central_q, &pid, 0)) {
-		__sync_fetch_and_add(&nr_overflows, 1);
+		stat_inc(stats, CENTRAL_STAT_OVERFLOWS);
 		scx_bpf_dispatch(p, FALLBACK_DSQ_ID, SCX_SLICE_INF, enq_flags);
 		return;
 	}
@@ -132,7 +186,7 @@ void BPF_STRUCT_OPS(central_enqueue, struct task_struct *p, u64 enq_flags)
 	__sync_fetch_and_add(&nr_queued, 1);
 
 	if (!scx_bpf_task_running(p))
-		scx_bpf_kick_cpu(central_cpu, SCX_KICK_PREEMPT);
+		kick_cpu(central_cpu, SCX_KICK_PREEMPT);
 }
 
 static bool dispatch_to_cpu(s32 cpu)
@@ -148,7 +202,7 @@ static bool dispatch_to_cpu(s32 cpu)
 
 		p = bpf_task_from_pid(pid);
 		if (!p) {
-			__sync_fetch_and_add(&nr_lost_pids, 1);
+			stat_inc(stats, CENTRAL_STAT_LOST_PIDS);
 			continue;
 		}
 
@@ -157,7 +211,7 @@ static bool dispatch_to_cpu(s32 cpu)
 		 * bounce it to the fallback dsq.
 		 */
 		if (!bpf_cpumask_test_cpu(cpu, p->cpus_ptr)) {
-			__sync_fetch_and_add(&nr_mismatches, 1);
+			stat_inc(stats, CENTRAL_STAT_MISMATCHES);
 			scx_bpf_dispatch(p, FALLBACK_DSQ_ID, SCX_SLICE_INF, 0);
 			bpf_task_release(p);
 			/*
@@ -175,7 +229,7 @@ static bool dispatch_to_cpu(s32 cpu)
 		scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | cpu, SCX_SLICE_INF, 0);
 
 		if (cpu != central_cpu)
-			scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+			kick_cpu(cpu, SCX_KICK_IDLE);
 
 		bpf_task_release(p);
 		return true;
@@ -186,9 +240,19 @@ static bool dispatch_to_cpu(s32 cpu)
 
 void BPF_STRUCT_OPS(central_dispatch, s32 cpu, struct task_struct *prev)
 {
+	/*
+	 * The timer stages tasks for all CPUs. The central CPU can serve itself
+	 * without interrupting anyone, the others wait for the timer.
+	 */
+	if (timer_dispatch) {
+		if (cpu == central_cpu)
+			scx_bpf_consume(CENTRAL_DSQ_ID);
+		return;
+	}
+
 	if (cpu == central_cpu) {
 		/* dispatch for all other CPUs first */
-		__sync_fetch_and_add(&nr_dispatches, 1);
+		stat_inc(stats, CENTRAL_STAT_DISPATCHES);
 
 		bpf_for(cpu, 0, nr_cpu_ids) {
 			bool *gimme;
@@ -213,8 +277,8 @@ void BPF_STRUCT_OPS(central_dispatch, s32 cpu, struct task_struct *prev)
 		 * Kick self explicitly to retry.
 		 */
 		if (!scx_bpf_dispatch_nr_slots()) {
-			__sync_fetch_and_add(&nr_retries, 1);
-			scx_bpf_kick_cpu(central_cpu, SCX_KICK_PREEMPT);
+			stat_inc(stats, CENTRAL_STAT_RETRIES);
+			kick_cpu(central_cpu, SCX_KICK_PREEMPT);
 			return;
 		}
 
@@ -236,7 +300,7 @@ void BPF_STRUCT_OPS(central_dispatch, s32 cpu, struct task_struct *prev)
 		 * Force dispatch on the scheduling CPU so that it finds a task
 		 * to run for us.
 		 */
-		scx_bpf_kick_cpu(central_cpu, SCX_KICK_PREEMPT);
+		kick_cpu(central_cpu, SCX_KICK_PREEMPT);
 	}
 }
 
@@ -244,8 +308,17 @@ void BPF_STRUCT_OPS(central_running, struct task_struct *p)
 {
 	s32 cpu = scx_bpf_task_cpu(p);
 	u64 *started_at = ARRAY_ELEM_PTR(cpu_started_at, cpu, nr_cpu_ids);
+	u64 now = bpf_ktime_get_ns();
+	struct task_ctx *taskc;
+
 	if (started_at)
-		*started_at = bpf_ktime_get_ns() ?: 1;	/* 0 indicates idle */
+		*started_at = now ?: 1;	/* 0 indicates idle */
+
+	taskc = bpf_task_storage_get(&task_ctx_stor, p, 0, 0);
+	if (taskc && taskc->enqueued_at) {
+		scx_hist_record(&hists, 0, now - taskc->enqueued_at);
+		taskc->enqueued_at = 0;
+	}
 }
 
 void BPF_STRUCT_OPS(central_stopping, struct task_struct *p, bool runnable)
@@ -256,10 +329,38 @@ void BPF_STRUCT_OPS(central_stopping, struct task_struct *p, bool runnable)
 		*started_at = 0;
 }
 
+/*
+ * Move the first task on CENTRAL_DSQ_ID which can run on @cpu to its local
+ * dsq. Called from the central timer, where scx_bpf_dispatch() isn't allowed.
+ */
+static bool stage_to_cpu(s32 cpu)
+{
+	struct task_struct *p;
+	u32 nr_scanned = 0;
+
+	bpf_for_each(scx_dsq, p, CENTRAL_DSQ_ID, 0) {
+		if (++nr_scanned > STAGE_SCAN_MAX) {
+			stat_inc(stats, CENTRAL_STAT_SCAN_LIMIT);
+			break;
+		}
+
+		if (!bpf_cpumask_test_cpu(cpu, p->cpus_ptr))
+			continue;
+
+		if (__COMPAT_scx_bpf_dispatch_from_dsq(BPF_FOR_EACH_ITER, p,
+						       SCX_DSQ_LOCAL_ON | cpu, 0)) {
+			stat_inc(stats, CENTRAL_STAT_STAGED);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static int central_timerfn(void *map, int *key, struct bpf_timer *timer)
 {
 	u64 now = bpf_ktime_get_ns();
-	u64 nr_to_kick = nr_queued;
+	u64 nr_to_kick = timer_dispatch ? 0 : nr_queued;
 	s32 i, curr_cpu;
 
 	curr_cpu = bpf_get_smp_processor_id();
@@ -272,12 +373,27 @@ static int central_timerfn(void *map, int *key, struct bpf_timer *timer)
 	bpf_for(i, 0, nr_cpu_ids) {
 		s32 cpu = (nr_timers + i) % nr_cpu_ids;
 		u64 *started_at;
+		bool idle;
 
-		if (cpu == central_cpu)
+		started_at = ARRAY_ELEM_PTR(cpu_started_at, cpu, nr_cpu_ids);
+		idle = started_at && !*started_at;
+
+		if (timer_dispatch) {
+			/*
+			 * Keep the next task staged on every CPU. Staging to an
+			 * idle CPU's local dsq already wakes it up, only busy
+			 * CPUs may need to be kicked below.
+			 */
+			if (!scx_bpf_dsq_nr_queued(SCX_DSQ_LOCAL_ON | cpu) &&
+			    stage_to_cpu(cpu) && idle && cpu != central_cpu)
+				stat_inc(stats, CENTRAL_STAT_IPIS);
+			if (idle)
+				continue;
+		} else if (cpu == central_cpu) {
 			continue;
+		}
 
 		/* kick iff the current one exhausted its slice */
-		started_at = ARRAY_ELEM_PTR(cpu_started_at, cpu, nr_cpu_ids);
 		if (started_at && *started_at &&
 		    vtime_before(now, *started_at + slice_ns))
 			continue;
@@ -291,14 +407,23 @@ static int central_timerfn(void *map, int *key, struct bpf_timer *timer)
 		else
 			continue;
 
-		scx_bpf_kick_cpu(cpu, SCX_KICK_PREEMPT);
+		kick_cpu(cpu, SCX_KICK_PREEMPT);
 	}
 
-	bpf_timer_start(timer, TIMER_INTERVAL_NS, BPF_F_TIMER_CPU_PIN);
+	bpf_timer_start(timer, timer_interval_ns, BPF_F_TIMER_CPU_PIN);
 	__sync_fetch_and_add(&nr_timers, 1);
 	return 0;
 }
 
+s32 BPF_STRUCT_OPS(central_init_task, struct task_struct *p,
+		   struct scx_init_task_args *args)
+{
+	if (!bpf_task_storage_get(&task_ctx_stor, p, 0,
+				  BPF_LOCAL_STORAGE_GET_F_CREATE))
+		return -ENOMEM;
+	return 0;
+}
+
 int BPF_STRUCT_OPS_SLEEPABLE(central_init)
 {
 	u32 key = 0;
@@ -309,6 +434,17 @@ int BPF_STRUCT_OPS_SLEEPABLE(central_init)
 	if (ret)
 		return ret;
 
+	if (timer_dispatch) {
+		if (!bpf_ksym_exists(scx_bpf_dispatch_from_dsq)) {
+			scx_bpf_error("timer dispatch needs scx_bpf_dispatch_from_dsq()");
+			return -EOPNOTSUPP;
+		}
+
+		ret = scx_bpf_create_dsq(CENTRAL_DSQ_ID, -1);
+		if (ret)
+			return ret;
+	}
+
 	timer = bpf_map_lookup_elem(&central_timer, &key);
 	if (!timer)
 		return -ESRCH;
@@ -321,7 +457,7 @@ int BPF_STRUCT_OPS_SLEEPABLE(central_init)
 	bpf_timer_init(timer, &central_timer, CLOCK_MONOTONIC);
 	bpf_timer_set_callback(timer, central_timerfn);
 
-	ret = bpf_timer_start(timer, TIMER_INTERVAL_NS, BPF_F_TIMER_CPU_PIN);
+	ret = bpf_timer_start(timer, timer_interval_ns, BPF_F_TIMER_CPU_PIN);
 	/*
 	 * BPF_F_TIMER_CPU_PIN is pretty new (>=6.7). If we're running in a
 	 * kernel which doesn't have it, bpf_timer_start() will return -EINVAL.
@@ -331,7 +467,7 @@ int BPF_STRUCT_OPS_SLEEPABLE(central_init)
 	 */
 	if (ret == -EINVAL) {
 		timer_pinned = false;
-		ret = bpf_timer_start(timer, TIMER_INTERVAL_NS, 0);
+		ret = bpf_timer_start(timer, timer_interval_ns, 0);
 	}
 	if (ret)
 		scx_bpf_error("bpf_timer_start failed (%d)", ret);
@@ -356,6 +492,7 @@ SCX_OPS_DEFINE(central_ops,
 	       .dispatch		= (void *)central_dispatch,
 	       .running			= (void *)central_running,
 	       .stopping		= (void *)central_stopping,
+	       .init_task		= (void *)central_init_task,
 	       .init			= (void *)central_init,
 	       .exit			= (void *)central_exit,
 	       .name			= "central");
@@ -13,6 +13,7 @@
 #include <libgen.h>
 #include <bpf/bpf.h>
 #include <scx/common.h>
+#include "scx_central.h"
 #include "scx_central.bpf.skel.h"
 
 const char help_fmt[] =
@@ -20,12 +21,17 @@ const char help_fmt[] =
 "\n"
 "See the top-level comment in .bpf.c for more details.\n"
 "\n"
-"Usage: %s [-s SLICE_US] [-c CPU]\n"
+"Usage: %s [-s SLICE_US] [-c CPU] [-t] [-i INTERVAL_US]\n"
 "\n"
-"  -s SLICE_US   Override slice duration\n"
-"  -c CPU        Override the central CPU (default: 0)\n"
-"  -v            Print libbpf debug messages\n"
-"  -h            Display this help and exit\n";
+"  -s SLICE_US     Override slice duration\n"
+"  -c CPU          Override the central CPU (default: 0)\n"
+"  -t              Dispatch from the central timer instead of the central CPU's dispatch()\n"
+"  -i INTERVAL_US  Override the central timer interval (default: 1000, min: 10)\n"
+"  -v              Print libbpf debug messages\n"
+"  -h              Display this help and exit\n";
+
+/* a shorter central timer interval turns it into a softirq busy loop */
+#define MIN_TIMER_INTERVAL_US	10
 
 static bool verbose;
 static volatile int exit_req;
@@ -46,7 +52,8 @@ int main(int argc, char **argv)
 {
 	struct scx_central *skel;
 	struct bpf_link *link;
-	__u64 seq = 0, ecode;
+	struct scx_hist last_hist;
+	__u64 seq = 0, ecode, last_ipis;
 	__s32 opt;
 	cpu_set_t *cpuset;
 
@@ -54,13 +61,16 @@ int main(int argc, char **argv)
 	signal(SIGINT, sigint_handler);
 	signal(SIGTERM, sigint_handler);
 restart:
+	memset(&last_hist, 0, sizeof(last_hist));
+	last_ipis = 0;
+
 	skel = SCX_OPS_OPEN(central_ops, scx_central);
 
 	skel->rodata->central_cpu = 0;
 	skel->rodata->nr_cpu_ids = libbpf_num_possible_cpus();
 	skel->rodata->slice_ns = __COMPAT_ENUM_OR_ZERO("scx_public_consts", "SCX_SLICE_DFL");
 
-	while ((opt = getopt(argc, argv, "s:c:pvh")) != -1) {
+	while ((opt = getopt(argc, argv, "s:c:ti:pvh")) != -1) {
 		switch (opt) {
 		case 's':
 			skel->rodata->slice_ns = strtoull(optarg, NULL, 0) * 1000;
@@ -68,6 +78,22 @@ restart:
 		case 'c':
 			skel->rodata->central_cpu = strtoul(optarg, NULL, 0);
 			break;
+		case 't':
+			skel->rodata->timer_dispatch = true;
+			break;
+		case 'i': {
+			char *end;
+			__u64 intv_us = strtoull(optarg, &end, 0);
+
+			if (end == optarg || *end != '\0' ||
+			    intv_us < MIN_TIMER_INTERVAL_US) {
+				fprintf(stderr, "Invalid timer interval \"%s\", must be at least %dus\n",
+					optarg, MIN_TIMER_INTERVAL_US);
+				return 1;
+			}
+			skel->rodata->timer_interval_ns = intv_us * 1000;
+			break;
+		}
 		case 'v':
 			verbose = true;
 			break;
@@ -104,30 +130,49 @@ restart:
 	CPU_FREE(cpuset);
 
 	link = SCX_OPS_ATTACH(skel, central_ops, scx_central);
+attached:
 
 	if (!skel->data->timer_pinned)
 		printf("WARNING : BPF_F_TIMER_CPU_PIN not available, timer not pinned to central\n");
 
 	while (!exit_req && !UEI_EXITED(skel, uei)) {
+		__u64 stats[CENTRAL_NR_STATS];
+		struct scx_hist hist;
+
+		if (scx_stat_read(bpf_map__fd(skel->maps.stats), stats, CENTRAL_NR_STATS))
+			memset(stats, 0, sizeof(stats));
+
 		printf("[SEQ %llu]\n", seq++);
-		printf("total   :%10" PRIu64 "    local:%10" PRIu64 "   queued:%10" PRIu64 "  lost:%10" PRIu64 "\n",
-		       skel->bss->nr_total,
-		       skel->bss->nr_locals,
+		printf("total   :%10llu    local:%10llu   queued:%10llu  lost:%10llu\n",
+		       stats[CENTRAL_STAT_TOTAL],
+		       stats[CENTRAL_STAT_LOCALS],
 		       skel->bss->nr_queued,
-		       skel->bss->nr_lost_pids);
-		printf("timer   :%10" PRIu64 " dispatch:%10" PRIu64 " mismatch:%10" PRIu64 " retry:%10" PRIu64 "\n",
+		       stats[CENTRAL_STAT_LOST_PIDS]);
+		printf("timer   :%10llu dispatch:%10llu mismatch:%10llu retry:%10llu\n",
 		       skel->bss->nr_timers,
-		       skel->bss->nr_dispatches,
-		       skel->bss->nr_mismatches,
-		       skel->bss->nr_retries);
-		printf("overflow:%10" PRIu64 "\n",
-		       skel->bss->nr_overflows);
+		       stats[CENTRAL_STAT_DISPATCHES],
+		       stats[CENTRAL_STAT_MISMATCHES],
+		       stats[CENTRAL_STAT_RETRIES]);
+		printf("overflow:%10llu   staged:%10llu scan_max:%10llu\n",
+		       stats[CENTRAL_STAT_OVERFLOWS],
+		       stats[CENTRAL_STAT_STAGED],
+		       stats[CENTRAL_STAT_SCAN_LIMIT]);
+		printf("ipi     :%10llu    ipi/s:%10llu\n",
+		       stats[CENTRAL_STAT_IPIS],
+		       stats[CENTRAL_STAT_IPIS] - last_ipis);
+		last_ipis = stats[CENTRAL_STAT_IPIS];
+		if (!scx_hist_read(bpf_map__fd(skel->maps.hists), 0, &hist))
+			scx_hist_print_interval("dispatch_lat", &hist, &last_hist);
 		fflush(stdout);
 		sleep(1);
 	}
 
 	bpf_link__destroy(link);
 	ecode = UEI_REPORT(skel, uei);
+
+	if (UEI_ECODE_RESTART(ecode) &&
+	    (link = SCX_OPS_REATTACH(skel, central_ops, uei)))
+		goto attached;
 	scx_central__destroy(skel);
 
 	if (UEI_ECODE_RESTART(ecode))
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2022 Meta Platforms, Inc. and affiliates.
+ * Copyright (c) 2022 Tejun Heo <tj@kernel.org>
+ * Copyright (c) 2022 David Vernet <dvernet@meta.com>
+ */
+#ifndef __SCX_EXAMPLE_CENTRAL_H
+#define __SCX_EXAMPLE_CENTRAL_H
+
+enum central_stat_idx {
+	CENTRAL_STAT_TOTAL,
+	CENTRAL_STAT_LOCALS,
+	CENTRAL_STAT_LOST_PIDS,
+	CENTRAL_STAT_DISPATCHES,
+	CENTRAL_STAT_MISMATCHES,
+	CENTRAL_STAT_RETRIES,
+	CENTRAL_STAT_OVERFLOWS,
+	CENTRAL_STAT_STAGED,
+	CENTRAL_STAT_SCAN_LIMIT,
+	CENTRAL_STAT_IPIS,
+
+	CENTRAL_NR_STATS,
+};
+
+#endif /* __SCX_EXAMPLE_CENTRAL_H */
@@ -60,21 +60,7 @@ const volatile bool fifo_sched;
 u64 cvtime_now;
 UEI_DEFINE(uei);
 
-struct {
-	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
-	__type(key, u32);
-	__type(value, u64);
-	__uint(max_entries, FCG_NR_STATS);
-} stats SEC(".maps");
-
-static void stat_inc(enum fcg_stat_idx idx)
-{
-	u32 idx_v = idx;
-
-	u64 *cnt_p = bpf_map_lookup_elem(&stats, &idx_v);
-	if (cnt_p)
-		(*cnt_p)++;
-}
+STAT_DEFINE(stats, FCG_NR_STATS);
 
 struct fcg_cpu_ctx {
 	u64			cur_cgid;
@@ -196,16 +182,16 @@ static void cgrp_refresh_hweight(struct cgroup *cgrp, struct fcg_cgrp_ctx *cgc)
 	int level;
 
 	if (!cgc->nr_active) {
-		stat_inc(FCG_STAT_HWT_SKIP);
+		stat_inc(stats, FCG_STAT_HWT_SKIP);
 		return;
 	}
 
 	if (cgc->hweight_gen == hweight_gen) {
-		stat_inc(FCG_STAT_HWT_CACHE);
+		stat_inc(stats, FCG_STAT_HWT_CACHE);
 		return;
 	}
 
-	stat_inc(FCG_STAT_HWT_UPDATES);
+	stat_inc(stats, FCG_STAT_HWT_UPDATES);
 	bpf_for(level, 0, cgrp->level + 1) {
 		struct fcg_cgrp_ctx *cgc;
 		bool is_active;
@@ -242,7 +228,7 @@ static void cgrp_refresh_hweight(struct cgroup *cgrp, struct fcg_cgrp_ctx *cgc)
 			bpf_spin_unlock(&cgv_tree_lock);
 
 			if (!is_active) {
-				stat_inc(FCG_STAT_HWT_RACE);
+				stat_inc(stats, FCG_STAT_HWT_RACE);
 				break;
 			}
 		}
@@ -282,7 +268,7 @@ static void cgrp_enqueued(struct cgroup *cgrp, struct fcg_cgrp_ctx *cgc)
 
 	/* paired with cmpxchg in try_pick_next_cgroup() */
 	if (__sync_val_compare_and_swap(&cgc->queued, 0, 1)) {
-		stat_inc(FCG_STAT_ENQ_SKIP);
+		stat_inc(stats, FCG_STAT_ENQ_SKIP);
 		return;
 	}
 
@@ -295,7 +281,7 @@ static void cgrp_enqueued(struct cgroup *cgrp, struct fcg_cgrp_ctx *cgc)
 	/* NULL if the node is already on the rbtree */
 	cgv_node = bpf_kptr_xchg(&stash->node, NULL);
 	if (!cgv_node) {
-		stat_inc(FCG_STAT_ENQ_RACE);
+		stat_inc(stats, FCG_STAT_ENQ_RACE);
 		return;
 	}
 
@@ -337,7 +323,7 @@ s32 BPF_STRUCT_OPS(fcg_select_cpu, struct task_struct *p, s32 prev_cpu, u64 wake
 	 */
 	if (is_idle) {
 		set_bypassed_at(p, taskc);
-		stat_inc(FCG_STAT_LOCAL);
+		stat_inc(stats, FCG_STAT_LOCAL);
 		scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL, 0);
 	}
 
@@ -373,10 +359,10 @@ void BPF_STRUCT_OPS(fcg_enqueue, struct task_struct *p, u64 enq_flags)
 		 * more control over when tasks with custom cpumask get issued.
 		 */
 		if (p->nr_cpus_allowed == 1 && (p->flags & PF_KTHREAD)) {
-			stat_inc(FCG_STAT_LOCAL);
+			stat_inc(stats, FCG_STAT_LOCAL);
 			scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL, enq_flags);
 		} else {
-			stat_inc(FCG_STAT_GLOBAL);
+			stat_inc(stats, FCG_STAT_GLOBAL);
 			scx_bpf_dispatch(p, SCX_DSQ_GLOBAL, SCX_SLICE_DFL, enq_flags);
 		}
 		return;
@@ -433,11 +419,11 @@ static void update_active_weight_sums(struct cgroup *cgrp, bool runnable)
 	if (runnable) {
 		if (__sync_fetch_and_add(&cgc->nr_runnable, 1))
 			return;
-		stat_inc(FCG_STAT_ACT);
+		stat_inc(stats, FCG_STAT_ACT);
 	} else {
 		if (__sync_sub_and_fetch(&cgc->nr_runnable, 1))
 			return;
-		stat_inc(FCG_STAT_DEACT);
+		stat_inc(stats, FCG_STAT_DEACT);
 	}
 
 	/*
@@ -619,7 +605,7 @@ static bool try_pick_next_cgroup(u64 *cgidp)
 	rb_node = bpf_rbtree_first(&cgv_tree);
 	if (!rb_node) {
 		bpf_spin_unlock(&cgv_tree_lock);
-		stat_inc(FCG_STAT_PNC_NO_CGRP);
+		stat_inc(stats, FCG_STAT_PNC_NO_CGRP);
 		*cgidp = 0;
 		return true;
 	}
@@ -649,20 +635,20 @@ static bool try_pick_next_cgroup(u64 *cgidp)
 	 */
 	cgrp = bpf_cgroup_from_id(cgid);
 	if (!cgrp) {
-		stat_inc(FCG_STAT_PNC_GONE);
+		stat_inc(stats, FCG_STAT_PNC_GONE);
 		goto out_free;
 	}
 
 	cgc = bpf_cgrp_storage_get(&cgrp_ctx, cgrp, 0, 0);
 	if (!cgc) {
 		bpf_cgroup_release(cgrp);
-		stat_inc(FCG_STAT_PNC_GONE);
+		stat_inc(stats, FCG_STAT_PNC_GONE);
 		goto out_free;
 	}
 
 	if (!scx_bpf_consume(cgid)) {
 		bpf_cgroup_release(cgrp);
-		stat_inc(FCG_STAT_PNC_EMPTY);
+		stat_inc(stats, FCG_STAT_PNC_EMPTY);
 		goto out_stash;
 	}
 
@@ -687,13 +673,13 @@ static bool try_pick_next_cgroup(u64 *cgidp)
 	bpf_spin_unlock(&cgv_tree_lock);
 
 	*cgidp = cgid;
-	stat_inc(FCG_STAT_PNC_NEXT);
+	stat_inc(stats, FCG_STAT_PNC_NEXT);
 	return true;
 
 out_stash:
 	stash = bpf_map_lookup_elem(&cgv_node_stash, &cgid);
 	if (!stash) {
-		stat_inc(FCG_STAT_PNC_GONE);
+		stat_inc(stats, FCG_STAT_PNC_GONE);
 		goto out_free;
 	}
 
@@ -708,7 +694,7 @@ out_stash:
 		bpf_spin_lock(&cgv_tree_lock);
 		bpf_rbtree_add(&cgv_tree, &cgv_node->rb_node, cgv_node_less);
 		bpf_spin_unlock(&cgv_tree_lock);
-		stat_inc(FCG_STAT_PNC_RACE);
+		stat_inc(stats, FCG_STAT_PNC_RACE);
 	} else {
 		cgv_node = bpf_kptr_xchg(&stash->node, cgv_node);
 		if (cgv_node) {
@@ -741,12 +727,12 @@ void BPF_STRUCT_OPS(fcg_dispatch, s32 cpu, struct task_struct *prev)
 
 	if (vtime_before(now, cpuc->cur_at + cgrp_slice_ns)) {
 		if (scx_bpf_consume(cpuc->cur_cgid)) {
-			stat_inc(FCG_STAT_CNS_KEEP);
+			stat_inc(stats, FCG_STAT_CNS_KEEP);
 			return;
 		}
-		stat_inc(FCG_STAT_CNS_EMPTY);
+		stat_inc(stats, FCG_STAT_CNS_EMPTY);
 	} else {
-		stat_inc(FCG_STAT_CNS_EXPIRE);
+		stat_inc(stats, FCG_STAT_CNS_EXPIRE);
 	}
 
 	/*
@@ -755,7 +741,7 @@ void BPF_STRUCT_OPS(fcg_dispatch, s32 cpu, struct task_struct *prev)
 	 */
 	cgrp = bpf_cgroup_from_id(cpuc->cur_cgid);
 	if (!cgrp) {
-		stat_inc(FCG_STAT_CNS_GONE);
+		stat_inc(stats, FCG_STAT_CNS_GONE);
 		goto pick_next_cgroup;
 	}
 
@@ -772,7 +758,7 @@ void BPF_STRUCT_OPS(fcg_dispatch, s32 cpu, struct task_struct *prev)
 				     FCG_HWEIGHT_ONE / (cgc->hweight ?: 1));
 		bpf_spin_unlock(&cgv_tree_lock);
 	} else {
-		stat_inc(FCG_STAT_CNS_GONE);
+		stat_inc(stats, FCG_STAT_CNS_GONE);
 	}
 
 	bpf_cgroup_release(cgrp);
@@ -799,7 +785,7 @@ pick_next_cgroup:
 	 * any stall risk as the race is against enqueue.
 	 */
 	if (!picked_next)
-		stat_inc(FCG_STAT_PNC_FAIL);
+		stat_inc(stats, FCG_STAT_PNC_FAIL);
 }
 
 s32 BPF_STRUCT_OPS(fcg_init_task, struct task_struct *p,
@@ -46,12 +46,8 @@ UEI_DEFINE(uei);
  */
 #define SHARED_DSQ 0
 
-struct {
-	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
-	__uint(key_size, sizeof(u32));
-	__uint(value_size, sizeof(u64));
-	__uint(max_entries, 2);			/* [local, global] */
-} stats SEC(".maps");
+/* [local, global] */
+STAT_DEFINE(stats, 2);
 
 struct {
 	__uint(type, BPF_MAP_TYPE_HASH);
@@ -60,13 +56,6 @@ struct {
 	__uint(max_entries, 256);
 } task_data SEC(".maps");
 
-static void stat_inc(u32 idx)
-{
-	u64 *cnt_p = bpf_map_lookup_elem(&stats, &idx);
-	if (cnt_p)
-		(*cnt_p)++;
-}
-
 static inline bool vtime_before(u64 a, u64 b)
 {
 	return (s64)(a - b) < 0;
@@ -79,7 +68,7 @@ s32 BPF_STRUCT_OPS(ml_collect_select_cpu, struct task_struct *p, s32 prev_cpu, u
 
 	cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
 	if (is_idle) {
-		stat_inc(0);	/* count local queueing */
+		stat_inc(stats, 0);	/* count local queueing */
 		scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL, 0);
 	}
 
@@ -167,7 +156,7 @@ void BPF_STRUCT_OPS(ml_collect_enqueue, struct task_struct *p, u64 enq_flags)
 		}
 	}
 
-	stat_inc(1);	/* count global queueing */
+	stat_inc(stats, 1);	/* count global queueing */
 
 	if (fifo_sched) {
 		scx_bpf_dispatch(p, SHARED_DSQ, SCX_SLICE_DFL, enq_flags);
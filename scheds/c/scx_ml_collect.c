@@ -47,22 +47,8 @@ static void sigint_handler(int simple)
 
 static void read_stats(struct scx_ml_collect *skel, __u64 *stats)
 {
-	int nr_cpus = libbpf_num_possible_cpus();
-	__u64 cnts[2][nr_cpus];
-	__u32 idx;
-
-	memset(stats, 0, sizeof(stats[0]) * 2);
-
-	for (idx = 0; idx < 2; idx++) {
-		int ret, cpu;
-
-		ret = bpf_map_lookup_elem(bpf_map__fd(skel->maps.stats),
-					  &idx, cnts[idx]);
-		if (ret < 0)
-			continue;
-		for (cpu = 0; cpu < nr_cpus; cpu++)
-			stats[idx] += cnts[idx][cpu];
-	}
+	if (scx_stat_read(bpf_map__fd(skel->maps.stats), stats, 2))
+		memset(stats, 0, sizeof(stats[0]) * 2);
 }
 
 static void print_task_stats (struct task_sched_data * tsk_ptr) {
@@ -166,6 +152,7 @@ restart:
 
 	SCX_OPS_LOAD(skel, ml_collect_ops, scx_ml_collect, uei);
 	link = SCX_OPS_ATTACH(skel, ml_collect_ops, scx_ml_collect);
+attached:
 
 	while (!exit_req && !UEI_EXITED(skel, uei)) {
 		update_system_wide_data(skel);
@@ -181,6 +168,10 @@ restart:
 
 	bpf_link__destroy(link);
 	ecode = UEI_REPORT(skel, uei);
+
+	if (UEI_ECODE_RESTART(ecode) &&
+	    (link = SCX_OPS_REATTACH(skel, ml_collect_ops, uei)))
+		goto attached;
 	scx_ml_collect__destroy(skel);
 
 	if (UEI_ECODE_RESTART(ecode))
@@ -132,20 +132,7 @@ const volatile u32 nr_cpus = 1; /* !0 for veristat, set during init. */
 private(NESTS) struct bpf_cpumask __kptr *primary_cpumask;
 private(NESTS) struct bpf_cpumask __kptr *reserve_cpumask;
 
-struct {
-	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
-	__uint(key_size, sizeof(u32));
-	__uint(value_size, sizeof(u64));
-	__uint(max_entries, NEST_STAT(NR));
-} stats SEC(".maps");
-
-
-static __always_inline void stat_inc(u32 idx)
-{
-	u64 *cnt_p = bpf_map_lookup_elem(&stats, &idx);
-	if (cnt_p)
-		(*cnt_p)++;
-}
+STAT_DEFINE(stats, NEST_STAT(NR));
 
 static inline bool vtime_before(u64 a, u64 b)
 {
@@ -173,12 +160,12 @@ try_make_core_reserved(s32 cpu, struct bpf_cpumask * reserved, bool promotion)
 		__sync_fetch_and_add(&nr_reserved, 1);
 		bpf_cpumask_set_cpu(cpu, reserved);
 		if (promotion)
-			stat_inc(NEST_STAT(PROMOTED_TO_RESERVED));
+			stat_inc(stats, NEST_STAT(PROMOTED_TO_RESERVED));
 		else
-			stat_inc(NEST_STAT(DEMOTED_TO_RESERVED));
+			stat_inc(stats, NEST_STAT(DEMOTED_TO_RESERVED));
 	} else {
 		bpf_cpumask_clear_cpu(cpu, reserved);
-		stat_inc(NEST_STAT(RESERVED_AT_CAPACITY));
+		stat_inc(stats, NEST_STAT(RESERVED_AT_CAPACITY));
 	}
 }
 
@@ -195,7 +182,7 @@ static int compact_primary_core(void *map, int *key, struct bpf_timer *timer)
 	s32 cpu = bpf_get_smp_processor_id();
 	struct pcpu_ctx *pcpu_ctx;
 
-	stat_inc(NEST_STAT(CALLBACK_COMPACTED));
+	stat_inc(stats, NEST_STAT(CALLBACK_COMPACTED));
 	/*
 	 * If we made it to this callback, it means that the timer callback was
 	 * never cancelled, and so the core needs to be demoted from the
@@ -252,7 +239,7 @@ s32 BPF_STRUCT_OPS(nest_select_cpu, struct task_struct *p, s32 prev_cpu,
 	if (bpf_cpumask_test_cpu(tctx->attached_core, cast_mask(p_mask)) &&
 	    scx_bpf_test_and_clear_cpu_idle(tctx->attached_core)) {
 		cpu = tctx->attached_core;
-		stat_inc(NEST_STAT(WAKEUP_ATTACHED));
+		stat_inc(stats, NEST_STAT(WAKEUP_ATTACHED));
 		goto migrate_primary;
 	}
 
@@ -265,7 +252,7 @@ s32 BPF_STRUCT_OPS(nest_select_cpu, struct task_struct *p, s32 prev_cpu,
 	    bpf_cpumask_test_cpu(prev_cpu, cast_mask(p_mask)) &&
 	    scx_bpf_test_and_clear_cpu_idle(prev_cpu)) {
 		cpu = prev_cpu;
-		stat_inc(NEST_STAT(WAKEUP_PREV_PRIMARY));
+		stat_inc(stats, NEST_STAT(WAKEUP_PREV_PRIMARY));
 		goto migrate_primary;
 	}
 
@@ -274,7 +261,7 @@ s32 BPF_STRUCT_OPS(nest_select_cpu, struct task_struct *p, s32 prev_cpu,
 		cpu = scx_bpf_pick_idle_cpu(cast_mask(p_mask),
 					    SCX_PICK_IDLE_CORE);
 		if (cpu >= 0) {
-			stat_inc(NEST_STAT(WAKEUP_FULLY_IDLE_PRIMARY));
+			stat_inc(stats, NEST_STAT(WAKEUP_FULLY_IDLE_PRIMARY));
 			goto migrate_primary;
 		}
 	}
@@ -282,14 +269,14 @@ s32 BPF_STRUCT_OPS(nest_select_cpu, struct task_struct *p, s32 prev_cpu,
 	/* Then try _any_ idle core in primary, even if its hypertwin is active. */
 	cpu = scx_bpf_pick_idle_cpu(cast_mask(p_mask), 0);
 	if (cpu >= 0) {
-		stat_inc(NEST_STAT(WAKEUP_ANY_IDLE_PRIMARY));
+		stat_inc(stats, NEST_STAT(WAKEUP_ANY_IDLE_PRIMARY));
 		goto migrate_primary;
 	}
 
 	if (r_impatient > 0 && ++tctx->prev_misses >= r_impatient) {
 		direct_to_primary = true;
 		tctx->prev_misses = 0;
-		stat_inc(NEST_STAT(TASK_IMPATIENT));
+		stat_inc(stats, NEST_STAT(TASK_IMPATIENT));
 	}
 
 	reset_impatient = false;
@@ -300,7 +287,7 @@ s32 BPF_STRUCT_OPS(nest_select_cpu, struct task_struct *p, s32 prev_cpu,
 		cpu = scx_bpf_pick_idle_cpu(cast_mask(p_mask),
 					    SCX_PICK_IDLE_CORE);
 		if (cpu >= 0) {
-			stat_inc(NEST_STAT(WAKEUP_FULLY_IDLE_RESERVE));
+			stat_inc(stats, NEST_STAT(WAKEUP_FULLY_IDLE_RESERVE));
 			goto promote_to_primary;
 		}
 	}
@@ -308,7 +295,7 @@ s32 BPF_STRUCT_OPS(nest_select_cpu, struct task_struct *p, s32 prev_cpu,
 	/* Then try _any_ idle core in reserve, even if its hypertwin is active. */
 	cpu = scx_bpf_pick_idle_cpu(cast_mask(p_mask), 0);
 	if (cpu >= 0) {
-		stat_inc(NEST_STAT(WAKEUP_ANY_IDLE_RESERVE));
+		stat_inc(stats, NEST_STAT(WAKEUP_ANY_IDLE_RESERVE));
 		goto promote_to_primary;
 	}
 
@@ -334,7 +321,7 @@ s32 BPF_STRUCT_OPS(nest_select_cpu, struct task_struct *p, s32 prev_cpu,
 		 * already in the primary nest. This is unlikely, but we check
 		 * for it on what should be a relatively cold path regardless.
 		 */
-		stat_inc(NEST_STAT(WAKEUP_IDLE_OTHER));
+		stat_inc(stats, NEST_STAT(WAKEUP_IDLE_OTHER));
 		if (bpf_cpumask_test_cpu(cpu, cast_mask(primary)))
 			goto migrate_primary;
 		else if (bpf_cpumask_test_cpu(cpu, cast_mask(reserve)))
@@ -351,7 +338,7 @@ s32 BPF_STRUCT_OPS(nest_select_cpu, struct task_struct *p, s32 prev_cpu,
 	return prev_cpu;
 
 promote_to_primary:
-	stat_inc(NEST_STAT(PROMOTED_TO_PRIMARY));
+	stat_inc(stats, NEST_STAT(PROMOTED_TO_PRIMARY));
 migrate_primary:
 	if (reset_impatient)
 		tctx->prev_misses = 0;
@@ -363,7 +350,7 @@ migrate_primary:
 			if (bpf_timer_set_callback(&pcpu_ctx->timer, compact_primary_core))
 				scx_bpf_error("Failed to re-arm pcpu timer");
 			pcpu_ctx->scheduled_compaction = false;
-			stat_inc(NEST_STAT(CANCELLED_COMPACTION));
+			stat_inc(stats, NEST_STAT(CANCELLED_COMPACTION));
 		}
 	} else {
 		scx_bpf_error("Failed to lookup pcpu ctx");
@@ -440,7 +427,7 @@ void BPF_STRUCT_OPS(nest_dispatch, s32 cpu, struct task_struct *prev)
 			return;
 		}
 
-		stat_inc(NEST_STAT(NOT_CONSUMED));
+		stat_inc(stats, NEST_STAT(NOT_CONSUMED));
 		if (in_primary) {
 			/*
 			 * Immediately demote a primary core if the previous
@@ -455,7 +442,7 @@ void BPF_STRUCT_OPS(nest_dispatch, s32 cpu, struct task_struct *prev)
 			 */
 			if ((prev && prev->__state == TASK_DEAD) &&
 			    (cpu != bpf_cpumask_first(cast_mask(primary)))) {
-				stat_inc(NEST_STAT(EAGERLY_COMPACTED));
+				stat_inc(stats, NEST_STAT(EAGERLY_COMPACTED));
 				bpf_cpumask_clear_cpu(cpu, primary);
 				try_make_core_reserved(cpu, reserve, false);
 			} else  {
@@ -467,12 +454,12 @@ void BPF_STRUCT_OPS(nest_dispatch, s32 cpu, struct task_struct *prev)
 				 */
 				bpf_timer_start(&pcpu_ctx->timer, p_remove_ns,
 						BPF_F_TIMER_CPU_PIN);
-				stat_inc(NEST_STAT(SCHEDULED_COMPACTION));
+				stat_inc(stats, NEST_STAT(SCHEDULED_COMPACTION));
 			}
 		}
 		return;
 	}
-	stat_inc(NEST_STAT(CONSUMED));
+	stat_inc(stats, NEST_STAT(CONSUMED));
 }
 
 void BPF_STRUCT_OPS(nest_running, struct task_struct *p)
@@ -609,7 +596,9 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(nest_init)
 			return -ENOENT;
 		}
 		ctx->scheduled_compaction = false;
-		if (bpf_timer_init(&ctx->timer, &pcpu_ctxs, CLOCK_BOOTTIME)) {
+		/* already initialized if the scheduler was re-attached */
+		err = bpf_timer_init(&ctx->timer, &pcpu_ctxs, CLOCK_BOOTTIME);
+		if (err && err != -EBUSY) {
 			scx_bpf_error("Failed to initialize pcpu timer");
 			return -EINVAL;
 		}
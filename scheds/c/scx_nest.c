@@ -63,24 +63,10 @@ static struct nest_stat nest_stats[NEST_STAT(NR)] = {
 };
 #undef NEST_ST
 
-static void read_stats(struct scx_nest *skel, u64 *stats)
+static void read_stats(struct scx_nest *skel, __u64 *stats)
 {
-	int nr_cpus = libbpf_num_possible_cpus();
-	u64 cnts[NEST_STAT(NR)][nr_cpus];
-	u32 idx;
-
-	memset(stats, 0, sizeof(stats[0]) * NEST_STAT(NR));
-
-	for (idx = 0; idx < NEST_STAT(NR); idx++) {
-		int ret, cpu;
-
-		ret = bpf_map_lookup_elem(bpf_map__fd(skel->maps.stats),
-					  &idx, cnts[idx]);
-		if (ret < 0)
-			continue;
-		for (cpu = 0; cpu < nr_cpus; cpu++)
-			stats[idx] += cnts[idx][cpu];
-	}
+	if (scx_stat_read(bpf_map__fd(skel->maps.stats), stats, NEST_STAT(NR)))
+		memset(stats, 0, sizeof(stats[0]) * NEST_STAT(NR));
 }
 
 static void print_underline(const char *str)
@@ -201,9 +187,10 @@ restart:
 
 	SCX_OPS_LOAD(skel, nest_ops, scx_nest, uei);
 	link = SCX_OPS_ATTACH(skel, nest_ops, scx_nest);
+attached:
 
 	while (!exit_req && !UEI_EXITED(skel, uei)) {
-		u64 stats[NEST_STAT(NR)];
+		__u64 stats[NEST_STAT(NR)];
 		enum nest_stat_idx i;
 		enum nest_stat_group last_grp = -1;
 
@@ -216,7 +203,7 @@ restart:
 				print_stat_grp(nest_stat->group);
 				last_grp = nest_stat->group;
 			}
-			printf("%s=%" PRIu64 "\n", nest_stat->label, stats[nest_stat->idx]);
+			printf("%s=%llu\n", nest_stat->label, stats[nest_stat->idx]);
 		}
 		printf("\n");
 		print_active_nests(skel);
@@ -229,6 +216,10 @@ restart:
 
 	bpf_link__destroy(link);
 	ecode = UEI_REPORT(skel, uei);
+
+	if (UEI_ECODE_RESTART(ecode) &&
+	    (link = SCX_OPS_REATTACH(skel, nest_ops, uei)))
+		goto attached;
 	scx_nest__destroy(skel);
 
 	if (UEI_ECODE_RESTART(ecode))
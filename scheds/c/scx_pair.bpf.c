@@ -233,9 +233,7 @@ struct {
 } cgrp_q_idx_hash SEC(".maps");
 
 /* statistics */
-u64 nr_total, nr_dispatched, nr_missing, nr_kicks, nr_preemptions;
-u64 nr_exps, nr_exp_waits, nr_exp_empty;
-u64 nr_cgrp_next, nr_cgrp_coll, nr_cgrp_empty;
+STAT_DEFINE(stats, PAIR_NR_STATS);
 
 UEI_DEFINE(uei);
 
@@ -253,7 +251,7 @@ void BPF_STRUCT_OPS(pair_enqueue, struct task_struct *p, u64 enq_flags)
 	u32 *q_idx;
 	u64 *cgq_len;
 
-	__sync_fetch_and_add(&nr_total, 1);
+	stat_inc(stats, PAIR_STAT_TOTAL);
 
 	cgrp = scx_bpf_task_cgroup(p);
 	cgid = cgrp->kn->id;
@@ -340,7 +338,7 @@ static int try_dispatch(s32 cpu)
 	if (expired || pairc->draining) {
 		u64 new_cgid = 0;
 
-		__sync_fetch_and_add(&nr_exps, 1);
+		stat_inc(stats, PAIR_STAT_EXPS);
 
 		/*
 		 * We're done with the current cgid. An obvious optimization
@@ -363,7 +361,7 @@ static int try_dispatch(s32 cpu)
 			 * dispatch and clears its active mask, it'll push the
 			 * pair to the next cgroup and kick this CPU.
 			 */
-			__sync_fetch_and_add(&nr_exp_waits, 1);
+			stat_inc(stats, PAIR_STAT_EXP_WAITS);
 			bpf_spin_unlock(&pairc->lock);
 			if (expired && !pair_preempted)
 				kick_pair = true;
@@ -386,7 +384,7 @@ static int try_dispatch(s32 cpu)
 
 			if (bpf_map_pop_elem(&top_q, &new_cgid)) {
 				/* no active cgroup, go idle */
-				__sync_fetch_and_add(&nr_exp_empty, 1);
+				stat_inc(stats, PAIR_STAT_EXP_EMPTY);
 				return 0;
 			}
 
@@ -418,13 +416,13 @@ static int try_dispatch(s32 cpu)
 		 * start on the new cgroup.
 		 */
 		if (pairc->draining && !pairc->active_mask) {
-			__sync_fetch_and_add(&nr_cgrp_next, 1);
+			stat_inc(stats, PAIR_STAT_CGRP_NEXT);
 			pairc->cgid = new_cgid;
 			pairc->started_at = now;
 			pairc->draining = false;
 			kick_pair = true;
 		} else {
-			__sync_fetch_and_add(&nr_cgrp_coll, 1);
+			stat_inc(stats, PAIR_STAT_CGRP_COLL);
 		}
 	}
 
@@ -447,7 +445,7 @@ static int try_dispatch(s32 cpu)
 		cgq_len = MEMBER_VPTR(cgrp_q_len, [q_idx]);
 		if (!cgq_len || !(len = *(volatile u64 *)cgq_len)) {
 			/* the cgroup must be empty, expire and repeat */
-			__sync_fetch_and_add(&nr_cgrp_empty, 1);
+			stat_inc(stats, PAIR_STAT_CGRP_EMPTY);
 			bpf_spin_lock(&pairc->lock);
 			pairc->draining = true;
 			pairc->active_mask &= ~in_pair_mask;
@@ -476,12 +474,12 @@ static int try_dispatch(s32 cpu)
 
 	p = bpf_task_from_pid(pid);
 	if (p) {
-		__sync_fetch_and_add(&nr_dispatched, 1);
+		stat_inc(stats, PAIR_STAT_DISPATCHED);
 		scx_bpf_dispatch(p, SCX_DSQ_GLOBAL, SCX_SLICE_DFL, 0);
 		bpf_task_release(p);
 	} else {
 		/* we don't handle dequeues, retry on lost tasks */
-		__sync_fetch_and_add(&nr_missing, 1);
+		stat_inc(stats, PAIR_STAT_MISSING);
 		return -EAGAIN;
 	}
 
@@ -489,7 +487,7 @@ out_maybe_kick:
 	if (kick_pair) {
 		s32 *pair = (s32 *)ARRAY_ELEM_PTR(pair_cpu, cpu, nr_cpu_ids);
 		if (pair) {
-			__sync_fetch_and_add(&nr_kicks, 1);
+			stat_inc(stats, PAIR_STAT_KICKS);
 			scx_bpf_kick_cpu(*pair, SCX_KICK_PREEMPT);
 		}
 	}
@@ -525,7 +523,7 @@ void BPF_STRUCT_OPS(pair_cpu_acquire, s32 cpu, struct scx_cpu_acquire_args *args
 		s32 *pair = (s32 *)ARRAY_ELEM_PTR(pair_cpu, cpu, nr_cpu_ids);
 
 		if (pair) {
-			__sync_fetch_and_add(&nr_kicks, 1);
+			stat_inc(stats, PAIR_STAT_KICKS);
 			scx_bpf_kick_cpu(*pair, SCX_KICK_PREEMPT);
 		}
 	}
@@ -554,11 +552,11 @@ void BPF_STRUCT_OPS(pair_cpu_release, s32 cpu, struct scx_cpu_release_args *args
 		s32 *pair = (s32 *)ARRAY_ELEM_PTR(pair_cpu, cpu, nr_cpu_ids);
 
 		if (pair) {
-			__sync_fetch_and_add(&nr_kicks, 1);
+			stat_inc(stats, PAIR_STAT_KICKS);
 			scx_bpf_kick_cpu(*pair, SCX_KICK_PREEMPT | SCX_KICK_WAIT);
 		}
 	}
-	__sync_fetch_and_add(&nr_preemptions, 1);
+	stat_inc(stats, PAIR_STAT_PREEMPTIONS);
 }
 
 s32 BPF_STRUCT_OPS(pair_cgroup_init, struct cgroup *cgrp)
@@ -148,22 +148,27 @@ restart:
 	link = SCX_OPS_ATTACH(skel, pair_ops, scx_pair);
 
 	while (!exit_req && !UEI_EXITED(skel, uei)) {
+		__u64 stats[PAIR_NR_STATS];
+
+		if (scx_stat_read(bpf_map__fd(skel->maps.stats), stats, PAIR_NR_STATS))
+			memset(stats, 0, sizeof(stats));
+
 		printf("[SEQ %llu]\n", seq++);
-		printf(" total:%10" PRIu64 " dispatch:%10" PRIu64 "   missing:%10" PRIu64 "\n",
-		       skel->bss->nr_total,
-		       skel->bss->nr_dispatched,
-		       skel->bss->nr_missing);
-		printf(" kicks:%10" PRIu64 " preemptions:%7" PRIu64 "\n",
-		       skel->bss->nr_kicks,
-		       skel->bss->nr_preemptions);
-		printf("   exp:%10" PRIu64 " exp_wait:%10" PRIu64 " exp_empty:%10" PRIu64 "\n",
-		       skel->bss->nr_exps,
-		       skel->bss->nr_exp_waits,
-		       skel->bss->nr_exp_empty);
-		printf("cgnext:%10" PRIu64 "   cgcoll:%10" PRIu64 "   cgempty:%10" PRIu64 "\n",
-		       skel->bss->nr_cgrp_next,
-		       skel->bss->nr_cgrp_coll,
-		       skel->bss->nr_cgrp_empty);
+		printf(" total:%10llu dispatch:%10llu   missing:%10llu\n",
+		       stats[PAIR_STAT_TOTAL],
+		       stats[PAIR_STAT_DISPATCHED],
+		       stats[PAIR_STAT_MISSING]);
+		printf(" kicks:%10llu preemptions:%7llu\n",
+		       stats[PAIR_STAT_KICKS],
+		       stats[PAIR_STAT_PREEMPTIONS]);
+		printf("   exp:%10llu exp_wait:%10llu exp_empty:%10llu\n",
+		       stats[PAIR_STAT_EXPS],
+		       stats[PAIR_STAT_EXP_WAITS],
+		       stats[PAIR_STAT_EXP_EMPTY]);
+		printf("cgnext:%10llu   cgcoll:%10llu   cgempty:%10llu\n",
+		       stats[PAIR_STAT_CGRP_NEXT],
+		       stats[PAIR_STAT_CGRP_COLL],
+		       stats[PAIR_STAT_CGRP_EMPTY]);
 		fflush(stdout);
 		sleep(1);
 	}
@@ -6,4 +6,22 @@ enum {
 	MAX_CGRPS		= 4096,
 };
 
+enum pair_stat_idx {
+	PAIR_STAT_TOTAL,
+	PAIR_STAT_DISPATCHED,
+	PAIR_STAT_MISSING,
+	PAIR_STAT_KICKS,
+	PAIR_STAT_PREEMPTIONS,
+
+	PAIR_STAT_EXPS,
+	PAIR_STAT_EXP_WAITS,
+	PAIR_STAT_EXP_EMPTY,
+
+	PAIR_STAT_CGRP_NEXT,
+	PAIR_STAT_CGRP_COLL,
+	PAIR_STAT_CGRP_EMPTY,
+
+	PAIR_NR_STATS,
+};
+
 #endif /* __SCX_EXAMPLE_PAIR_H */
@@ -23,6 +23,7 @@
  * Copyright (c) 2022 David Vernet <dvernet@meta.com>
  */
 #include <scx/common.bpf.h>
+#include "scx_qmap.h"
 
 enum consts {
 	ONE_SEC_IN_NS		= 1000000000,
@@ -124,10 +125,9 @@ struct {
 	__type(value, struct cpu_ctx);
 } cpu_ctx_stor SEC(".maps");
 
-/* Statistics */
-u64 nr_enqueued, nr_dispatched, nr_reenqueued, nr_dequeued, nr_ddsp_from_enq;
-u64 nr_core_sched_execed;
-u64 nr_expedited_local, nr_expedited_remote, nr_expedited_lost, nr_expedited_from_timer;
+/* Statistics, nr_dispatched also drives the dsp_inf_loop_after test */
+STAT_DEFINE(stats, QMAP_NR_STATS);
+u64 nr_dispatched;
 u32 cpuperf_min, cpuperf_avg, cpuperf_max;
 u32 cpuperf_target_min, cpuperf_target_avg, cpuperf_target_max;
 
@@ -233,7 +233,7 @@ void BPF_STRUCT_OPS(qmap_enqueue, struct task_struct *p, u64 enq_flags)
 	/* if !WAKEUP, select_cpu() wasn't called, try direct dispatch */
 	if (!(enq_flags & SCX_ENQ_WAKEUP) &&
 	    (cpu = pick_direct_dispatch_cpu(p, scx_bpf_task_cpu(p))) >= 0) {
-		__sync_fetch_and_add(&nr_ddsp_from_enq, 1);
+		stat_inc(stats, QMAP_STAT_DDSP_FROM_ENQ);
 		scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | cpu, slice_ns, enq_flags);
 		return;
 	}
@@ -270,7 +270,7 @@ void BPF_STRUCT_OPS(qmap_enqueue, struct task_struct *p, u64 enq_flags)
 		tctx->highpri = true;
 		__sync_fetch_and_add(&nr_highpri_queued, 1);
 	}
-	__sync_fetch_and_add(&nr_enqueued, 1);
+	stat_inc(stats, QMAP_STAT_ENQUEUED);
 }
 
 /*
@@ -279,9 +279,9 @@ void BPF_STRUCT_OPS(qmap_enqueue, struct task_struct *p, u64 enq_flags)
  */
 void BPF_STRUCT_OPS(qmap_dequeue, struct task_struct *p, u64 deq_flags)
 {
-	__sync_fetch_and_add(&nr_dequeued, 1);
+	stat_inc(stats, QMAP_STAT_DEQUEUED);
 	if (deq_flags & SCX_DEQ_CORE_SCHED_EXEC)
-		__sync_fetch_and_add(&nr_core_sched_execed, 1);
+		stat_inc(stats, QMAP_STAT_CORE_SCHED_EXECED);
 }
 
 static void update_core_sched_head_seq(struct task_struct *p)
@@ -345,14 +345,14 @@ static bool dispatch_highpri(bool from_timer)
 						       SCX_ENQ_PREEMPT)) {
 			if (cpu == this_cpu) {
 				dispatched = true;
-				__sync_fetch_and_add(&nr_expedited_local, 1);
+				stat_inc(stats, QMAP_STAT_EXPEDITED_LOCAL);
 			} else {
-				__sync_fetch_and_add(&nr_expedited_remote, 1);
+				stat_inc(stats, QMAP_STAT_EXPEDITED_REMOTE);
 			}
 			if (from_timer)
-				__sync_fetch_and_add(&nr_expedited_from_timer, 1);
+				stat_inc(stats, QMAP_STAT_EXPEDITED_FROM_TIMER);
 		} else {
-			__sync_fetch_and_add(&nr_expedited_lost, 1);
+			stat_inc(stats, QMAP_STAT_EXPEDITED_LOST);
 		}
 
 		if (dispatched)
@@ -544,7 +544,7 @@ void BPF_STRUCT_OPS(qmap_cpu_release, s32 cpu, struct scx_cpu_release_args *args
 	 */
 	cnt = scx_bpf_reenqueue_local();
 	if (cnt)
-		__sync_fetch_and_add(&nr_reenqueued, cnt);
+		stat_add(stats, QMAP_STAT_REENQUEUED, cnt);
 }
 
 s32 BPF_STRUCT_OPS(qmap_init_task, struct task_struct *p,
@@ -12,6 +12,7 @@
 #include <libgen.h>
 #include <bpf/bpf.h>
 #include <scx/common.h>
+#include "scx_qmap.h"
 #include "scx_qmap.bpf.skel.h"
 
 const char help_fmt[] =
@@ -119,19 +120,24 @@ int main(int argc, char **argv)
 	link = SCX_OPS_ATTACH(skel, qmap_ops, scx_qmap);
 
 	while (!exit_req && !UEI_EXITED(skel, uei)) {
-		long nr_enqueued = skel->bss->nr_enqueued;
-		long nr_dispatched = skel->bss->nr_dispatched;
+		__u64 stats[QMAP_NR_STATS];
+		long nr_enqueued, nr_dispatched;
 
-		printf("stats  : enq=%lu dsp=%lu delta=%ld reenq=%"PRIu64" deq=%"PRIu64" core=%"PRIu64" enq_ddsp=%"PRIu64"\n",
+		if (scx_stat_read(bpf_map__fd(skel->maps.stats), stats, QMAP_NR_STATS))
+			memset(stats, 0, sizeof(stats));
+		nr_enqueued = stats[QMAP_STAT_ENQUEUED];
+		nr_dispatched = skel->bss->nr_dispatched;
+
+		printf("stats  : enq=%lu dsp=%lu delta=%ld reenq=%llu deq=%llu core=%llu enq_ddsp=%llu\n",
 		       nr_enqueued, nr_dispatched, nr_enqueued - nr_dispatched,
-		       skel->bss->nr_reenqueued, skel->bss->nr_dequeued,
-		       skel->bss->nr_core_sched_execed,
-		       skel->bss->nr_ddsp_from_enq);
-		printf("         exp_local=%"PRIu64" exp_remote=%"PRIu64" exp_timer=%"PRIu64" exp_lost=%"PRIu64"\n",
-		       skel->bss->nr_expedited_local,
-		       skel->bss->nr_expedited_remote,
-		       skel->bss->nr_expedited_from_timer,
-		       skel->bss->nr_expedited_lost);
+		       stats[QMAP_STAT_REENQUEUED], stats[QMAP_STAT_DEQUEUED],
+		       stats[QMAP_STAT_CORE_SCHED_EXECED],
+		       stats[QMAP_STAT_DDSP_FROM_ENQ]);
+		printf("         exp_local=%llu exp_remote=%llu exp_timer=%llu exp_lost=%llu\n",
+		       stats[QMAP_STAT_EXPEDITED_LOCAL],
+		       stats[QMAP_STAT_EXPEDITED_REMOTE],
+		       stats[QMAP_STAT_EXPEDITED_FROM_TIMER],
+		       stats[QMAP_STAT_EXPEDITED_LOST]);
 		if (__COMPAT_has_ksym("scx_bpf_cpuperf_cur"))
 			printf("cpuperf: cur min/avg/max=%u/%u/%u target min/avg/max=%u/%u/%u\n",
 			       skel->bss->cpuperf_min,
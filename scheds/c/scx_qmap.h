@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2022 Meta Platforms, Inc. and affiliates.
+ * Copyright (c) 2022 Tejun Heo <tj@kernel.org>
+ * Copyright (c) 2022 David Vernet <dvernet@meta.com>
+ */
+#ifndef __SCX_EXAMPLE_QMAP_H
+#define __SCX_EXAMPLE_QMAP_H
+
+enum qmap_stat_idx {
+	QMAP_STAT_ENQUEUED,
+	QMAP_STAT_REENQUEUED,
+	QMAP_STAT_DEQUEUED,
+	QMAP_STAT_DDSP_FROM_ENQ,
+	QMAP_STAT_CORE_SCHED_EXECED,
+
+	QMAP_STAT_EXPEDITED_LOCAL,
+	QMAP_STAT_EXPEDITED_REMOTE,
+	QMAP_STAT_EXPEDITED_LOST,
+	QMAP_STAT_EXPEDITED_FROM_TIMER,
+
+	QMAP_NR_STATS,
+};
+
+#endif /* __SCX_EXAMPLE_QMAP_H */
@@ -6,6 +6,7 @@
  * be switched to FIFO scheduling. It also demonstrates the following niceties.
  *
  * - Statistics tracking how many tasks are queued to local and global dsq's.
+ * - Per-CPU histograms of runqueue latency and slice usage.
  * - Termination notification for userspace.
  *
  * While very simple, this scheduler should work reasonably well on CPUs with a
@@ -21,6 +22,7 @@
  * Copyright (c) 2022 David Vernet <dvernet@meta.com>
  */
 #include <scx/common.bpf.h>
+#include <scx/hist_impl.bpf.h>
 
 char _license[] SEC("license") = "GPL";
 
@@ -38,18 +40,27 @@ UEI_DEFINE(uei);
  */
 #define SHARED_DSQ 0
 
+/* [local, global] */
+STAT_DEFINE(stats, 2);
+
+/* [runqueue latency, slice usage] in nsecs */
+SCX_HIST_DEFINE(hists, 2);
+
+struct task_ctx {
+	u64	runnable_at;
+	u64	running_at;
+};
+
 struct {
-	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
-	__uint(key_size, sizeof(u32));
-	__uint(value_size, sizeof(u64));
-	__uint(max_entries, 2);			/* [local, global] */
-} stats SEC(".maps");
+	__uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
+	__type(value, struct task_ctx);
+} task_ctx_stor SEC(".maps");
 
-static void stat_inc(u32 idx)
+static struct task_ctx *lookup_task_ctx(struct task_struct *p)
 {
-	u64 *cnt_p = bpf_map_lookup_elem(&stats, &idx);
-	if (cnt_p)
-		(*cnt_p)++;
+	return bpf_task_storage_get(&task_ctx_stor, p, 0, 0);
 }
 
 static inline bool vtime_before(u64 a, u64 b)
@@ -64,7 +75,7 @@ s32 BPF_STRUCT_OPS(simple_select_cpu, struct task_struct *p, s32 prev_cpu, u64 w
 
 	cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
 	if (is_idle) {
-		stat_inc(0);	/* count local queueing */
+		stat_inc(stats, 0);	/* count local queueing */
 		scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL, 0);
 	}
 
@@ -73,7 +84,7 @@ s32 BPF_STRUCT_OPS(simple_select_cpu, struct task_struct *p, s32 prev_cpu, u64 w
 
 void BPF_STRUCT_OPS(simple_enqueue, struct task_struct *p, u64 enq_flags)
 {
-	stat_inc(1);	/* count global queueing */
+	stat_inc(stats, 1);	/* count global queueing */
 
 	if (fifo_sched) {
 		scx_bpf_dispatch(p, SHARED_DSQ, SCX_SLICE_DFL, enq_flags);
@@ -97,8 +108,28 @@ void BPF_STRUCT_OPS(simple_dispatch, s32 cpu, struct task_struct *prev)
 	scx_bpf_consume(SHARED_DSQ);
 }
 
+void BPF_STRUCT_OPS(simple_runnable, struct task_struct *p, u64 enq_flags)
+{
+	struct task_ctx *taskc;
+
+	if ((taskc = lookup_task_ctx(p)))
+		taskc->runnable_at = bpf_ktime_get_ns();
+}
+
 void BPF_STRUCT_OPS(simple_running, struct task_struct *p)
 {
+	struct task_ctx *taskc;
+
+	if ((taskc = lookup_task_ctx(p))) {
+		u64 now = bpf_ktime_get_ns();
+
+		if (taskc->runnable_at) {
+			scx_hist_record(&hists, 0, now - taskc->runnable_at);
+			taskc->runnable_at = 0;
+		}
+		taskc->running_at = now;
+	}
+
 	if (fifo_sched)
 		return;
 
@@ -114,6 +145,17 @@ void BPF_STRUCT_OPS(simple_running, struct task_struct *p)
 
 void BPF_STRUCT_OPS(simple_stopping, struct task_struct *p, bool runnable)
 {
+	struct task_ctx *taskc;
+
+	if ((taskc = lookup_task_ctx(p))) {
+		u64 now = bpf_ktime_get_ns();
+
+		scx_hist_record(&hists, 1, now - taskc->running_at);
+		/* still runnable, the wait until the next run is runqueue latency */
+		if (runnable)
+			taskc->runnable_at = now;
+	}
+
 	if (fifo_sched)
 		return;
 
@@ -129,6 +171,15 @@ void BPF_STRUCT_OPS(simple_stopping, struct task_struct *p, bool runnable)
 	p->scx.dsq_vtime += (SCX_SLICE_DFL - p->scx.slice) * 100 / p->scx.weight;
 }
 
+s32 BPF_STRUCT_OPS(simple_init_task, struct task_struct *p,
+		   struct scx_init_task_args *args)
+{
+	if (!bpf_task_storage_get(&task_ctx_stor, p, 0,
+				  BPF_LOCAL_STORAGE_GET_F_CREATE))
+		return -ENOMEM;
+	return 0;
+}
+
 void BPF_STRUCT_OPS(simple_enable, struct task_struct *p)
 {
 	p->scx.dsq_vtime = vtime_now;
@@ -148,8 +199,10 @@ SCX_OPS_DEFINE(simple_ops,
 	       .select_cpu		= (void *)simple_select_cpu,
 	       .enqueue			= (void *)simple_enqueue,
 	       .dispatch		= (void *)simple_dispatch,
+	       .runnable		= (void *)simple_runnable,
 	       .running			= (void *)simple_running,
 	       .stopping		= (void *)simple_stopping,
+	       .init_task		= (void *)simple_init_task,
 	       .enable			= (void *)simple_enable,
 	       .init			= (void *)simple_init,
 	       .exit			= (void *)simple_exit,
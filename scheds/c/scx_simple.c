@@ -40,28 +40,15 @@ static void sigint_handler(int simple)
 
 static void read_stats(struct scx_simple *skel, __u64 *stats)
 {
-	int nr_cpus = libbpf_num_possible_cpus();
-	__u64 cnts[2][nr_cpus];
-	__u32 idx;
-
-	memset(stats, 0, sizeof(stats[0]) * 2);
-
-	for (idx = 0; idx < 2; idx++) {
-		int ret, cpu;
-
-		ret = bpf_map_lookup_elem(bpf_map__fd(skel->maps.stats),
-					  &idx, cnts[idx]);
-		if (ret < 0)
-			continue;
-		for (cpu = 0; cpu < nr_cpus; cpu++)
-			stats[idx] += cnts[idx][cpu];
-	}
+	if (scx_stat_read(bpf_map__fd(skel->maps.stats), stats, 2))
+		memset(stats, 0, sizeof(stats[0]) * 2);
 }
 
 int main(int argc, char **argv)
 {
 	struct scx_simple *skel;
 	struct bpf_link *link;
+	struct scx_hist last_hists[2];
 	__u32 opt;
 	__u64 ecode;
 
@@ -87,18 +74,30 @@ restart:
 
 	SCX_OPS_LOAD(skel, simple_ops, scx_simple, uei);
 	link = SCX_OPS_ATTACH(skel, simple_ops, scx_simple);
+attached:
+
+	memset(last_hists, 0, sizeof(last_hists));
 
 	while (!exit_req && !UEI_EXITED(skel, uei)) {
+		struct scx_hist hist;
 		__u64 stats[2];
 
 		read_stats(skel, stats);
 		printf("local=%llu global=%llu\n", stats[0], stats[1]);
+		if (!scx_hist_read(bpf_map__fd(skel->maps.hists), 0, &hist))
+			scx_hist_print_interval("runq_lat ", &hist, &last_hists[0]);
+		if (!scx_hist_read(bpf_map__fd(skel->maps.hists), 1, &hist))
+			scx_hist_print_interval("slice_use", &hist, &last_hists[1]);
 		fflush(stdout);
 		sleep(1);
 	}
 
 	bpf_link__destroy(link);
 	ecode = UEI_REPORT(skel, uei);
+
+	if (UEI_ECODE_RESTART(ecode) &&
+	    (link = SCX_OPS_REATTACH(skel, simple_ops, uei)))
+		goto attached;
 	scx_simple__destroy(skel);
 
 	if (UEI_ECODE_RESTART(ecode))
@@ -36,7 +36,7 @@ const volatile s32 usersched_pid;
 const volatile u32 num_possible_cpus = 64;
 
 /* Stats that are printed by user space. */
-u64 nr_failed_enqueues, nr_kernel_enqueues, nr_user_enqueues;
+STAT_DEFINE(stats, USERLAND_NR_STATS);
 
 /*
  * Number of tasks that are queued for scheduling.
@@ -193,10 +193,10 @@ static void enqueue_task_in_user_space(struct task_struct *p, u64 enq_flags)
 		 * If we fail to enqueue the task in user space, put it
 		 * directly on the global DSQ.
 		 */
-		__sync_fetch_and_add(&nr_failed_enqueues, 1);
+		stat_inc(stats, USERLAND_STAT_FAILED_ENQUEUES);
 		scx_bpf_dispatch(p, SCX_DSQ_GLOBAL, SCX_SLICE_DFL, enq_flags);
 	} else {
-		__sync_fetch_and_add(&nr_user_enqueues, 1);
+		stat_inc(stats, USERLAND_STAT_USER_ENQUEUES);
 		set_usersched_needed();
 	}
 }
@@ -217,7 +217,7 @@ void BPF_STRUCT_OPS(userland_enqueue, struct task_struct *p, u64 enq_flags)
 			dsq_id = SCX_DSQ_LOCAL;
 		tctx->force_local = false;
 		scx_bpf_dispatch(p, dsq_id, SCX_SLICE_DFL, enq_flags);
-		__sync_fetch_and_add(&nr_kernel_enqueues, 1);
+		stat_inc(stats, USERLAND_STAT_KERNEL_ENQUEUES);
 		return;
 	} else if (!is_usersched_task(p)) {
 		enqueue_task_in_user_space(p, enq_flags);
@@ -287,10 +287,13 @@ static void *run_stats_printer(void *arg)
 {
 	while (!exit_req) {
 		__u64 nr_failed_enqueues, nr_kernel_enqueues, nr_user_enqueues, total;
+		__u64 stats[USERLAND_NR_STATS];
 
-		nr_failed_enqueues = skel->bss->nr_failed_enqueues;
-		nr_kernel_enqueues = skel->bss->nr_kernel_enqueues;
-		nr_user_enqueues = skel->bss->nr_user_enqueues;
+		if (scx_stat_read(bpf_map__fd(skel->maps.stats), stats, USERLAND_NR_STATS))
+			memset(stats, 0, sizeof(stats));
+		nr_failed_enqueues = stats[USERLAND_STAT_FAILED_ENQUEUES];
+		nr_kernel_enqueues = stats[USERLAND_STAT_KERNEL_ENQUEUES];
+		nr_user_enqueues = stats[USERLAND_STAT_USER_ENQUEUES];
 		total = nr_failed_enqueues + nr_kernel_enqueues + nr_user_enqueues;
 
 		printf("o-----------------------o\n");
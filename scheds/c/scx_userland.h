@@ -4,6 +4,14 @@
 #ifndef __SCX_USERLAND_COMMON_H
 #define __SCX_USERLAND_COMMON_H
 
+enum userland_stat_idx {
+	USERLAND_STAT_FAILED_ENQUEUES,
+	USERLAND_STAT_KERNEL_ENQUEUES,
+	USERLAND_STAT_USER_ENQUEUES,
+
+	USERLAND_NR_STATS,
+};
+
 /*
  * An instance of a task that has been enqueued by the kernel for consumption
  * by a user space global scheduler thread.
@@ -247,6 +247,46 @@ ___scx_bpf_bstr_format_checker(const char *fmt, ...) {}
     __addr;                                                                    \
   })
 
+/**
+ * STAT_DEFINE - Define a set of per-CPU u64 stat counters
+ * @__name: name of the map
+ * @__nr: number of counters
+ *
+ * All @__nr counters live in a single per-CPU array element. Each CPU bumps
+ * its own copy which the percpu allocator keeps on cache lines no other CPU
+ * writes to, so stat_add() needs neither atomics nor padding. Userspace reads
+ * every counter on every CPU with one lookup through scx_stat_read() in
+ * scx/common.h.
+ */
+#define STAT_DEFINE(__name, __nr)                                              \
+  struct {                                                                     \
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);                                   \
+    __type(key, u32);                                                          \
+    __type(value, u64[__nr]);                                                  \
+    __uint(max_entries, 1);                                                    \
+  } __name SEC(".maps")
+
+/**
+ * stat_add - Add to a counter defined with STAT_DEFINE()
+ * @__map: the stat map
+ * @__idx: counter index
+ * @__v: value to add
+ *
+ * Out-of-range @__idx is silently ignored. Must be called with preemption
+ * disabled, which is the case for all struct_ops callbacks and tracing progs.
+ */
+#define stat_add(__map, __idx, __v)                                            \
+  ({                                                                           \
+    typeof((__map).value) __cnts;                                              \
+    u32 __zero = 0, __i = (__idx);                                             \
+                                                                               \
+    __cnts = bpf_map_lookup_elem(&(__map), &__zero);                           \
+    if (__cnts && __i < sizeof(*__cnts) / sizeof((*__cnts)[0]))                \
+      (*__cnts)[__i] += (__v);                                                 \
+  })
+
+#define stat_inc(__map, __idx) stat_add(__map, __idx, 1)
+
 /*
  * BPF declarations and helpers
  */
@@ -341,7 +381,7 @@ u32 bpf_cpumask_weight(const struct cpumask *cpumask) __ksym;
 /*
  * Access a cpumask in read-only mode (typically to check bits).
  */
-const struct cpumask *cast_mask(struct bpf_cpumask *mask) {
+static __always_inline const struct cpumask *cast_mask(struct bpf_cpumask *mask) {
   return (const struct cpumask *)mask;
 }
 
@@ -15,7 +15,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
 #include <errno.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
 
 typedef uint8_t u8;
 typedef uint16_t u16;
@@ -69,6 +73,195 @@ typedef int64_t s64;
 			bpf_map__initial_value((__skel)->maps.elfsec##_##arr, &__sz);	\
 	} while (0)
 
+/**
+ * scx_stat_read - Read and sum counters defined with STAT_DEFINE()
+ * @map_fd: fd of the stat map
+ * @stats: output array of @nr_stats counters, summed across all CPUs
+ * @nr_stats: number of counters in the map
+ *
+ * All counters on all CPUs are fetched with a single map lookup. Returns 0 on
+ * success, -errno on failure.
+ */
+static inline int scx_stat_read(int map_fd, __u64 *stats, int nr_stats)
+{
+	int nr_cpus = libbpf_num_possible_cpus();
+	u32 zero = 0;
+	__u64 *pcpu;
+	int cpu, i, ret;
+
+	if (nr_cpus < 0)
+		return nr_cpus;
+
+	pcpu = calloc((size_t)nr_cpus * nr_stats, sizeof(*pcpu));
+	if (!pcpu)
+		return -ENOMEM;
+
+	ret = bpf_map_lookup_elem(map_fd, &zero, pcpu);
+	if (ret < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	memset(stats, 0, sizeof(*stats) * nr_stats);
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		for (i = 0; i < nr_stats; i++)
+			stats[i] += pcpu[cpu * nr_stats + i];
+out:
+	free(pcpu);
+	return ret;
+}
+
+#include "hist.bpf.h"
+
+/**
+ * scx_hist_read - Read and merge a per-CPU histogram
+ * @map_fd: fd of the map defined with SCX_HIST_DEFINE()
+ * @idx: index of the histogram within the map
+ * @hist: output, the sum of all per-CPU copies
+ *
+ * All CPUs' copies are fetched with a single map lookup. Returns 0 on success,
+ * -errno on failure.
+ */
+static inline int scx_hist_read(int map_fd, u32 idx, struct scx_hist *hist)
+{
+	int nr_cpus = libbpf_num_possible_cpus();
+	struct scx_hist *pcpu;
+	int cpu, i, ret;
+
+	if (nr_cpus < 0)
+		return nr_cpus;
+
+	pcpu = calloc(nr_cpus, sizeof(*pcpu));
+	if (!pcpu)
+		return -ENOMEM;
+
+	ret = bpf_map_lookup_elem(map_fd, &idx, pcpu);
+	if (ret < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	memset(hist, 0, sizeof(*hist));
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		for (i = 0; i < SCX_HIST_NR_BUCKETS; i++)
+			hist->buckets[i] += pcpu[cpu].buckets[i];
+out:
+	free(pcpu);
+	return ret;
+}
+
+/**
+ * scx_hist_bucket_min - Smallest value which falls into a histogram bucket
+ * @bucket: bucket index
+ *
+ * The inverse of hist_impl.bpf.h::scx_hist_bucket().
+ */
+static inline u64 scx_hist_bucket_min(u32 bucket)
+{
+	u32 msb, sub;
+
+	if (bucket < SCX_HIST_SUB_BUCKETS)
+		return bucket;
+
+	msb = bucket / SCX_HIST_SUB_BUCKETS + SCX_HIST_SUB_BITS - 1;
+	sub = bucket % SCX_HIST_SUB_BUCKETS;
+	return (u64)(SCX_HIST_SUB_BUCKETS + sub) << (msb - SCX_HIST_SUB_BITS);
+}
+
+/**
+ * scx_hist_bucket_max - Largest value which falls into a histogram bucket
+ * @bucket: bucket index
+ */
+static inline u64 scx_hist_bucket_max(u32 bucket)
+{
+	if (bucket >= SCX_HIST_NR_BUCKETS - 1)
+		return UINT64_MAX;
+	return scx_hist_bucket_min(bucket + 1) - 1;
+}
+
+/**
+ * scx_hist_count - Total number of values recorded in a histogram
+ * @hist: histogram to count
+ */
+static inline u64 scx_hist_count(const struct scx_hist *hist)
+{
+	u64 cnt = 0;
+	int i;
+
+	for (i = 0; i < SCX_HIST_NR_BUCKETS; i++)
+		cnt += hist->buckets[i];
+	return cnt;
+}
+
+/**
+ * scx_hist_percentile - Estimate a percentile of a histogram
+ * @hist: histogram to evaluate
+ * @pct: percentile between 0 and 100, e.g. 99.9 for p999
+ *
+ * Returns the upper bound of the bucket containing the @pct'th percentile
+ * value, or 0 if @hist is empty.
+ */
+static inline u64 scx_hist_percentile(const struct scx_hist *hist, double pct)
+{
+	u64 total = scx_hist_count(hist), target, acc = 0;
+	double rank;
+	int i;
+
+	if (!total)
+		return 0;
+
+	/* round the rank up so that e.g. p99 of 10 samples is the largest */
+	rank = total * pct / 100.0;
+	target = (u64)rank;
+	if (target < rank || target < 1)
+		target++;
+
+	for (i = 0; i < SCX_HIST_NR_BUCKETS; i++) {
+		acc += hist->buckets[i];
+		if (acc >= target)
+			return scx_hist_bucket_max(i);
+	}
+	return scx_hist_bucket_max(SCX_HIST_NR_BUCKETS - 1);
+}
+
+/**
+ * scx_hist_diff - Subtract an older snapshot from a histogram
+ * @hist: histogram to update in place
+ * @prev: older snapshot of the same histogram
+ *
+ * Histograms are cumulative. Use this to compute per-interval distributions.
+ */
+static inline void scx_hist_diff(struct scx_hist *hist, const struct scx_hist *prev)
+{
+	int i;
+
+	for (i = 0; i < SCX_HIST_NR_BUCKETS; i++)
+		hist->buckets[i] -= prev->buckets[i];
+}
+
+/**
+ * scx_hist_print_interval - Print the percentiles of a histogram's last interval
+ * @name: label to print the percentiles with
+ * @hist: histogram of durations in nsecs
+ * @last: snapshot of @hist at the previous call, updated to @hist
+ *
+ * Prints p50, p99 and p999 in usecs of the values recorded since @last.
+ */
+static inline void scx_hist_print_interval(const char *name,
+					   const struct scx_hist *hist,
+					   struct scx_hist *last)
+{
+	struct scx_hist intv = *hist;
+
+	scx_hist_diff(&intv, last);
+	*last = *hist;
+
+	printf("%s p50=%" PRIu64 "us p99=%" PRIu64 "us p999=%" PRIu64 "us\n", name,
+	       scx_hist_percentile(&intv, 50) / 1000,
+	       scx_hist_percentile(&intv, 99) / 1000,
+	       scx_hist_percentile(&intv, 99.9) / 1000);
+}
+
 #include "user_exit_info.h"
 #include "compat.h"
 #include "enums.h"
@@ -10,6 +10,7 @@
 #include <bpf/btf.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 struct btf *__COMPAT_vmlinux_btf __attribute__((weak));
@@ -184,4 +185,175 @@ static inline long scx_hotplug_seq(void)
 	__link;									\
 })
 
+/*
+ * Re-attach the struct_ops of a loaded scheduler after it exited with
+ * SCX_ECODE_ACT_RESTART, e.g. on CPU hotplug. Reloading the skeleton
+ * re-verifies every program and throws away all BPF map state, so instead
+ * create a new struct_ops map from the one which was attached, pointing to
+ * the same already loaded programs, and attach that. The only field which
+ * has to change is hotplug_seq, which the kernel doesn't allow to update in
+ * the attached map.
+ *
+ * Looking up a struct_ops map returns the IDs of its programs in place of
+ * the FDs used to update it. Translate them back and update the new map
+ * with everything else as is. The skeleton's struct_ops map FD is replaced
+ * by the new map so that libbpf attaches it and the caller can keep using
+ * the skeleton as before.
+ *
+ * Returns 0 with the new link in @linkp, or -errno on failure.
+ */
+static inline int __COMPAT_struct_ops_reattach(struct bpf_map *map,
+					       struct bpf_link **linkp)
+{
+	struct bpf_map_info info = {};
+	u32 info_len = sizeof(info);
+	LIBBPF_OPTS(bpf_map_create_opts, opts);
+	const struct btf_type *vt, *t = NULL, *mt;
+	const struct btf_member *m;
+	u32 zero = 0, data_off = 0;
+	int *prog_fds = NULL;
+	void *value = NULL;
+	int i, ret, fd = bpf_map__fd(map), new_fd = -1;
+	const char *n;
+	char *data;
+
+	*linkp = NULL;
+
+	ret = bpf_map_get_info_by_fd(fd, &info, &info_len);
+	if (ret)
+		return ret;
+
+	/* struct bpf_struct_ops_sched_ext_ops: refcnt and state, then data */
+	__COMPAT_load_vmlinux_btf();
+	vt = btf__type_by_id(__COMPAT_vmlinux_btf, info.btf_vmlinux_value_type_id);
+	if (!vt || !btf_is_struct(vt))
+		return -ENOENT;
+
+	m = btf_members(vt);
+	for (i = 0; i < BTF_INFO_VLEN(vt->info); i++) {
+		n = btf__name_by_offset(__COMPAT_vmlinux_btf, m[i].name_off);
+		if (n && !strcmp(n, "data")) {
+			data_off = m[i].offset / 8;
+			t = btf__type_by_id(__COMPAT_vmlinux_btf, m[i].type);
+			break;
+		}
+	}
+	if (!t || !btf_is_struct(t))
+		return -ENOENT;
+
+	ret = -ENOMEM;
+	value = calloc(1, info.value_size);
+	prog_fds = calloc(BTF_INFO_VLEN(t->info), sizeof(*prog_fds));
+	if (!value || !prog_fds)
+		goto out;
+
+	ret = bpf_map_lookup_elem(fd, &zero, value);
+	if (ret)
+		goto out;
+
+	memset(value, 0, data_off);
+	data = (char *)value + data_off;
+
+	m = btf_members(t);
+	for (i = 0; i < BTF_INFO_VLEN(t->info); i++) {
+		__u64 *slot = (__u64 *)(data + m[i].offset / 8);
+		s32 tid = btf__resolve_type(__COMPAT_vmlinux_btf, m[i].type);
+
+		n = btf__name_by_offset(__COMPAT_vmlinux_btf, m[i].name_off);
+		mt = tid < 0 ? NULL : btf__type_by_id(__COMPAT_vmlinux_btf, tid);
+		if (!n || !mt) {
+			ret = -ENOENT;
+			goto out;
+		}
+
+		if (btf_is_ptr(mt) &&
+		    btf_is_func_proto(btf__type_by_id(__COMPAT_vmlinux_btf, mt->type))) {
+			if (!*slot)
+				continue;
+			prog_fds[i] = bpf_prog_get_fd_by_id(*slot);
+			if (prog_fds[i] <= 0) {
+				ret = prog_fds[i] < 0 ? prog_fds[i] : -EBADF;
+				prog_fds[i] = 0;
+				goto out;
+			}
+			*slot = prog_fds[i];
+		} else if (!strcmp(n, "hotplug_seq")) {
+			*slot = scx_hotplug_seq();
+		}
+	}
+
+	opts.btf_vmlinux_value_type_id = info.btf_vmlinux_value_type_id;
+	opts.map_flags = info.map_flags;
+	new_fd = bpf_map_create(BPF_MAP_TYPE_STRUCT_OPS, info.name, info.key_size,
+				info.value_size, 1, &opts);
+	if (new_fd < 0) {
+		ret = new_fd;
+		goto out;
+	}
+
+	ret = bpf_map_update_elem(new_fd, &zero, value, 0);
+	if (ret)
+		goto out;
+
+	/*
+	 * bpf_map__attach_struct_ops() skips updating the map if it's
+	 * already been updated and creates the link.
+	 */
+	if (dup2(new_fd, fd) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC)) {
+		ret = -errno;
+		goto out;
+	}
+
+	*linkp = bpf_map__attach_struct_ops(map);
+	ret = *linkp ? 0 : -errno;
+out:
+	if (new_fd >= 0)
+		close(new_fd);
+	if (prog_fds) {
+		for (i = 0; i < BTF_INFO_VLEN(t->info); i++)
+			if (prog_fds[i] > 0)
+				close(prog_fds[i]);
+	}
+	free(prog_fds);
+	free(value);
+	return ret;
+}
+
+static inline double __COMPAT_elapsed_ms(const struct timespec *from)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - from->tv_sec) * 1000.0 +
+		(now.tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+/*
+ * Called after the struct_ops link has been destroyed and UEI_REPORT() says
+ * the scheduler should be restarted. Resets the exit info and re-attaches
+ * the loaded skeleton, keeping all its maps. Returns NULL if the kernel
+ * refused, in which case the caller should fall back to destroying the
+ * skeleton and going through SCX_OPS_OPEN/LOAD/ATTACH() again.
+ *
+ * ops.init(), ops.init_task() and friends are called again on re-attach and
+ * must cope with the state left by the previous instance.
+ */
+#define SCX_OPS_REATTACH(__skel, __ops_name, __uei_name) ({			\
+	struct bpf_link *__link;						\
+	struct timespec __start;						\
+	int __ret;								\
+										\
+	clock_gettime(CLOCK_MONOTONIC, &__start);				\
+	UEI_RESET(__skel, __uei_name);						\
+	__ret = __COMPAT_struct_ops_reattach((__skel)->maps.__ops_name,	\
+					     &__link);				\
+	if (!__ret)								\
+		fprintf(stderr, "RESTART: re-attached in %.3lfms\n",		\
+			__COMPAT_elapsed_ms(&__start));				\
+	else									\
+		fprintf(stderr, "RESTART: re-attach failed (%s), reloading\n",	\
+			strerror(-__ret));					\
+	__link;									\
+})
+
 #endif	/* __SCX_COMPAT_H */
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2026 sched_ext contributors
+ */
+#ifndef __SCX_HIST_BPF_H__
+#define __SCX_HIST_BPF_H__
+
+/*
+ * Log-linear histogram layout shared between BPF progs and userspace. Assumes
+ * u64 is already defined (vmlinux.h on the BPF side, scx/common.h in
+ * userspace).
+ *
+ * Each power of two is split into SCX_HIST_SUB_BUCKETS linear sub-buckets, so
+ * the relative error of a bucket's bounds is at most 1/SCX_HIST_SUB_BUCKETS
+ * while the whole u64 range fits in SCX_HIST_NR_BUCKETS counters. Values below
+ * SCX_HIST_SUB_BUCKETS * 2 get an exact bucket each.
+ *
+ * See hist_impl.bpf.h for recording and scx/common.h for reading.
+ */
+enum scx_hist_consts {
+	SCX_HIST_SUB_BITS	= 2,
+	SCX_HIST_SUB_BUCKETS	= 1 << SCX_HIST_SUB_BITS,
+	SCX_HIST_NR_BUCKETS	= (64 - SCX_HIST_SUB_BITS + 1) * SCX_HIST_SUB_BUCKETS,
+};
+
+struct scx_hist {
+	u64			buckets[SCX_HIST_NR_BUCKETS];
+};
+
+#endif /* __SCX_HIST_BPF_H__ */
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2026 sched_ext contributors
+ */
+/* to be included in the main bpf.c file */
+#include "hist.bpf.h"
+
+#define HIST_FN_ATTRS		inline __attribute__((unused, always_inline))
+
+/**
+ * SCX_HIST_DEFINE - Define a set of per-CPU histograms
+ * @__name: name of the map
+ * @__nr: number of histograms in the set
+ *
+ * Each CPU owns a private copy of every histogram, so recording is a plain
+ * increment without atomics or cache line sharing. Userspace merges the
+ * per-CPU copies with scx_hist_read() from scx/common.h.
+ */
+#define SCX_HIST_DEFINE(__name, __nr)						\
+	struct {								\
+		__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);			\
+		__type(key, u32);						\
+		__type(value, struct scx_hist);					\
+		__uint(max_entries, __nr);					\
+	} __name SEC(".maps")
+
+/**
+ * scx_hist_bucket - Map a value to its log-linear bucket index
+ * @v: value to map
+ *
+ * Values below SCX_HIST_SUB_BUCKETS map to themselves. Above that, the top
+ * SCX_HIST_SUB_BITS bits below the most significant one select the linear
+ * sub-bucket within the power of two.
+ */
+static HIST_FN_ATTRS u32 scx_hist_bucket(u64 v)
+{
+	u32 msb;
+
+	if (v < SCX_HIST_SUB_BUCKETS)
+		return v;
+
+	/* log2_u64() returns floor(log2(@v)) + 1 */
+	msb = log2_u64(v) - 1;
+	return (msb - SCX_HIST_SUB_BITS + 1) * SCX_HIST_SUB_BUCKETS +
+		((v >> (msb - SCX_HIST_SUB_BITS)) & (SCX_HIST_SUB_BUCKETS - 1));
+}
+
+/**
+ * scx_hist_record - Record a value into a per-CPU histogram
+ * @map: map defined with SCX_HIST_DEFINE()
+ * @idx: index of the histogram within @map
+ * @v: value to record
+ *
+ * Must be called with preemption disabled, which is the case for all
+ * struct_ops callbacks and tracing progs.
+ */
+static HIST_FN_ATTRS void scx_hist_record(void *map, u32 idx, u64 v)
+{
+	struct scx_hist *hist;
+	u32 bucket;
+
+	hist = bpf_map_lookup_elem(map, &idx);
+	if (!hist)
+		return;
+
+	bucket = scx_hist_bucket(v);
+	if (bucket >= SCX_HIST_NR_BUCKETS)
+		bucket = SCX_HIST_NR_BUCKETS - 1;
+
+	hist->buckets[bucket]++;
+}
@@ -58,6 +58,7 @@ struct user_exit_info {
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 
 /* no need to call the following explicitly if SCX_OPS_LOAD() is used */
 #define UEI_SET_SIZE(__skel, __ops_name, __uei_name) ({					\
@@ -71,6 +72,13 @@ struct user_exit_info {
 	__sync_val_compare_and_swap(&(__skel)->data->__uei_name.kind, -1, -1);	\
 })
 
+/* clear the exit info of a scheduler before attaching it again */
+#define UEI_RESET(__skel, __uei_name) ({					\
+	memset(&(__skel)->data->__uei_name, 0,					\
+	       sizeof((__skel)->data->__uei_name));				\
+	(__skel)->data_##__uei_name##_dump->__uei_name##_dump[0] = '\0';	\
+})
+
 #define UEI_REPORT(__skel, __uei_name) ({					\
 	struct user_exit_info *__uei = &(__skel)->data->__uei_name;		\
 	char *__uei_dump = (__skel)->data_##__uei_name##_dump->__uei_name##_dump; \
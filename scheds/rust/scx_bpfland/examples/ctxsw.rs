@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Copyright (c) 2026 sched_ext contributors
+
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+//! Context switch scalability microbenchmark.
+//!
+//! Pairs of threads, both pinned to the same CPU, ping-pong a byte over two
+//! pipes, so that every round trip goes through two context switches on that
+//! CPU. The benchmark is repeated with pairs on 1, 2, 4, ... of the CPUs the
+//! process is allowed to run on, up to all of them: any state shared by the
+//! scheduler across CPUs in the hot path (e.g., global counters updated from
+//! .running() and .stopping()) shows up as a per-CPU rate that drops as more
+//! CPUs are added. Compare the reported rates across scheduler versions:
+//!
+//! $ cargo run --release --example ctxsw [MAX_CPUS] [SECS]
+
+mod common;
+
+use std::time::Duration;
+
+use common::allowed_cpus;
+use common::arg;
+use common::run_for;
+use common::PingPong;
+use common::StopFlag;
+
+// Run one ping-pong pair on each of @cpus for @duration and return the total
+// number of context switches per second.
+fn run(cpus: &[usize], duration: Duration) -> f64 {
+    let stop = StopFlag::new();
+    let pairs: Vec<_> = cpus
+        .iter()
+        .map(|cpu| PingPong::spawn(Some(*cpu), &stop))
+        .collect();
+
+    let elapsed = run_for(duration, &stop);
+    let round_trips: u64 = pairs.into_iter().map(|p| p.join()).sum();
+
+    (round_trips * 2) as f64 / elapsed
+}
+
+fn main() {
+    let cpus = allowed_cpus();
+    let max_cpus = arg(1, cpus.len()).clamp(1, cpus.len());
+    let duration = Duration::from_secs(arg(2, 5) as u64);
+
+    let mut nr_cpus = 1;
+    loop {
+        let rate = run(&cpus[..nr_cpus], duration);
+        println!(
+            "cpus={} ctxsw/s={:.0} ctxsw/s/cpu={:.0}",
+            nr_cpus,
+            rate,
+            rate / nr_cpus as f64,
+        );
+        if nr_cpus == max_cpus {
+            break;
+        }
+        nr_cpus = (nr_cpus * 2).min(max_cpus);
+    }
+}
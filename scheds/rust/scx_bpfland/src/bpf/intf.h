@@ -19,6 +19,9 @@ enum consts {
 	NSEC_PER_USEC = 1000ULL,
 	NSEC_PER_MSEC = (1000ULL * NSEC_PER_USEC),
 	NSEC_PER_SEC = (1000ULL * NSEC_PER_MSEC),
+
+	MAX_CPUS = 1024,
+	MAX_LLCS = 64,
 };
 
 #ifndef __VMLINUX_H__
@@ -27,9 +27,15 @@ const volatile bool debug;
 #define MAX_WAKEUP_FREQ		1024
 
 /*
- * DSQ used to dispatch regular tasks.
+ * Regular tasks are dispatched to a vtime DSQ per last level cache (LLC).
+ *
+ * The DSQ of an LLC has the same id as the LLC, so with a single LLC (or L3
+ * cache awareness disabled) all the tasks share DSQ 0. LLC ids and their NUMA
+ * nodes are initialized by the user-space scheduler.
  */
-#define SHARED_DSQ		0
+const volatile u32 nr_llcs = 1;
+const volatile u32 cpu_llc_id[MAX_CPUS];
+const volatile u32 llc_node_id[MAX_LLCS];
 
 /*
  * Default task time slice.
@@ -73,14 +79,22 @@ volatile s64 cpufreq_perf_lvl;
 
 /*
  * Scheduling statistics.
+ *
+ * These are aggregated from the per-CPU counters in cpu_ctx by the stats
+ * timer, so they can lag behind by up to STATS_TIMER_NS.
  */
 volatile u64 nr_kthread_dispatches, nr_direct_dispatches, nr_shared_dispatches;
 
 /*
- * Amount of currently running tasks.
+ * Amount of currently running tasks (aggregated by the stats timer).
  */
 volatile u64 nr_running, nr_interactive;
 
+/*
+ * Refresh period of the aggregated statistics.
+ */
+#define STATS_TIMER_NS		(NSEC_PER_SEC / 10)
+
 /*
  * Amount of online CPUs.
  */
@@ -116,6 +130,16 @@ struct cpu_ctx {
 	u64 last_running;
 	struct bpf_cpumask __kptr *l2_cpumask;
 	struct bpf_cpumask __kptr *l3_cpumask;
+
+	/*
+	 * Per-CPU statistics, only updated by the owning CPU (so they don't
+	 * need atomics) and aggregated by the stats timer.
+	 */
+	u64 nr_running;
+	u64 nr_interactive;
+	u64 nr_kthread_dispatches;
+	u64 nr_direct_dispatches;
+	u64 nr_shared_dispatches;
 };
 
 struct {
@@ -134,6 +158,29 @@ struct cpu_ctx *try_lookup_cpu_ctx(s32 cpu)
 	return bpf_map_lookup_percpu_elem(&cpu_ctx_stor, &idx, cpu);
 }
 
+/*
+ * Return the context of the current CPU.
+ */
+static struct cpu_ctx *this_cpu_ctx(void)
+{
+	const u32 idx = 0;
+	return bpf_map_lookup_elem(&cpu_ctx_stor, &idx);
+}
+
+/*
+ * Timer used to aggregate the per-CPU statistics.
+ */
+struct stats_timer {
+	struct bpf_timer timer;
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, u32);
+	__type(value, struct stats_timer);
+} stats_timer SEC(".maps");
+
 /*
  * Per-task local storage.
  *
@@ -270,11 +317,32 @@ static u64 update_freq(u64 freq, u64 delta)
 }
 
 /*
- * Return the total amount of tasks that are currently waiting to be scheduled.
+ * Return the DSQ of the LLC that contains @cpu.
  */
-static u64 nr_tasks_waiting(void)
+static u64 cpu_dsq(s32 cpu)
 {
-	return scx_bpf_dsq_nr_queued(SHARED_DSQ) + 1;
+	const volatile u32 *llc = MEMBER_VPTR(cpu_llc_id, [cpu]);
+
+	return llc ? *llc : 0;
+}
+
+/*
+ * Return the NUMA node of an LLC.
+ */
+static u32 llc_node(u32 llc)
+{
+	const volatile u32 *node = MEMBER_VPTR(llc_node_id, [llc]);
+
+	return node ? *node : 0;
+}
+
+/*
+ * Return the total amount of tasks that are currently waiting to be scheduled
+ * in the LLC of @cpu.
+ */
+static u64 nr_tasks_waiting(s32 cpu)
+{
+	return scx_bpf_dsq_nr_queued(cpu_dsq(cpu)) + 1;
 }
 
 /*
@@ -452,7 +520,8 @@ static inline void task_refill_slice(struct task_struct *p)
 	 * Scale the time slice of an inversely proportional factor of the
 	 * total amount of tasks that are waiting.
 	 */
-	p->scx.slice = CLAMP(slice_max / nr_tasks_waiting(), slice_min, slice_max);
+	p->scx.slice = CLAMP(slice_max / nr_tasks_waiting(scx_bpf_task_cpu(p)),
+			     slice_min, slice_max);
 }
 
 static void task_set_domain(struct task_struct *p, s32 cpu,
@@ -770,8 +839,11 @@ s32 BPF_STRUCT_OPS(bpfland_select_cpu, struct task_struct *p,
 
 	cpu = pick_idle_cpu(p, prev_cpu, wake_flags, &is_idle);
 	if (is_idle) {
+		struct cpu_ctx *cctx = this_cpu_ctx();
+
 		scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL, 0);
-		__sync_fetch_and_add(&nr_direct_dispatches, 1);
+		if (cctx)
+			cctx->nr_direct_dispatches++;
 	}
 
 	return cpu;
@@ -797,11 +869,14 @@ static void kick_task_cpu(struct task_struct *p)
 void BPF_STRUCT_OPS(bpfland_enqueue, struct task_struct *p, u64 enq_flags)
 {
 	struct task_ctx *tctx;
+	struct cpu_ctx *cctx;
 
 	tctx = try_lookup_task_ctx(p);
 	if (!tctx)
 		return;
 
+	cctx = this_cpu_ctx();
+
 	/*
 	 * Per-CPU kthreads are critical for system responsiveness so make sure
 	 * they are dispatched before any other task.
@@ -811,17 +886,20 @@ void BPF_STRUCT_OPS(bpfland_enqueue, struct task_struct *p, u64 enq_flags)
 	if (is_kthread(p) && (local_kthreads || p->nr_cpus_allowed == 1)) {
 		scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL,
 				 enq_flags | SCX_ENQ_PREEMPT);
-		__sync_fetch_and_add(&nr_kthread_dispatches, 1);
+		if (cctx)
+			cctx->nr_kthread_dispatches++;
 		return;
 	}
 
 	/*
-	 * Dispatch interactive tasks to the priority DSQ and regular tasks to
-	 * the shared DSQ.
+	 * Dispatch the task to the DSQ of the LLC of its assigned CPU: the one
+	 * picked by select_cpu(), that tries to keep the task in its L3 cache
+	 * domain.
 	 */
-	scx_bpf_dispatch_vtime(p, SHARED_DSQ, SCX_SLICE_DFL,
+	scx_bpf_dispatch_vtime(p, cpu_dsq(scx_bpf_task_cpu(p)), SCX_SLICE_DFL,
 			       task_vtime(p, tctx), enq_flags);
-	__sync_fetch_and_add(&nr_shared_dispatches, 1);
+	if (cctx)
+		cctx->nr_shared_dispatches++;
 
 	/*
 	 * If there is an idle CPU available for the task, wake it up so it can
@@ -830,13 +908,49 @@ void BPF_STRUCT_OPS(bpfland_enqueue, struct task_struct *p, u64 enq_flags)
 	kick_task_cpu(p);
 }
 
+/*
+ * Steal a task from the DSQ of another LLC, trying first the LLCs in the same
+ * NUMA node as @llc.
+ */
+static bool consume_remote_llc(u32 llc)
+{
+	u32 node = llc_node(llc), i, other;
+	int pass;
+
+	bpf_for(pass, 0, 2) {
+		bpf_for(i, 1, nr_llcs) {
+			other = (llc + i) % nr_llcs;
+			if ((llc_node(other) == node) == pass)
+				continue;
+			/* skip empty DSQs without taking their lock */
+			if (scx_bpf_dsq_nr_queued(other) && scx_bpf_consume(other))
+				return true;
+		}
+	}
+
+	return false;
+}
+
 void BPF_STRUCT_OPS(bpfland_dispatch, s32 cpu, struct task_struct *prev)
 {
+	u64 dsq_id = cpu_dsq(cpu);
+
 	/*
-	 * Consume regular tasks from the shared DSQ, transferring them to the
-	 * local CPU DSQ.
+	 * Consume regular tasks from the DSQ of the local LLC, transferring
+	 * them to the local CPU DSQ.
 	 */
-	if (scx_bpf_consume(SHARED_DSQ))
+	if (scx_bpf_consume(dsq_id))
+		return;
+
+	/*
+	 * The local LLC has nothing to run, pull a task from the nearest LLC.
+	 *
+	 * Like with a single shared DSQ, a CPU never goes idle or keeps
+	 * running the previous task while other tasks are waiting anywhere,
+	 * and the tasks of each LLC are still served in deadline order, so
+	 * interactive tasks are never left waiting while a CPU is available.
+	 */
+	if (consume_remote_llc(dsq_id))
 		return;
 	/*
 	 * If the current task expired its time slice and no other task wants
@@ -903,8 +1017,15 @@ static void update_cpuperf_target(struct task_struct *p, struct task_ctx *tctx)
 void BPF_STRUCT_OPS(bpfland_running, struct task_struct *p)
 {
 	struct task_ctx *tctx;
+	struct cpu_ctx *cctx;
 
-	__sync_fetch_and_add(&nr_running, 1);
+	/*
+	 * .running() and .stopping() of a task are called on the CPU where
+	 * the task runs, so its running counters can be updated locally.
+	 */
+	cctx = this_cpu_ctx();
+	if (cctx)
+		cctx->nr_running++;
 
 	/*
 	 * Refresh task's time slice immediately before it starts to run on its
@@ -925,8 +1046,8 @@ void BPF_STRUCT_OPS(bpfland_running, struct task_struct *p)
 	/*
 	 * Update CPU interactive state.
 	 */
-	if (tctx->is_interactive)
-		__sync_fetch_and_add(&nr_interactive, 1);
+	if (tctx->is_interactive && cctx)
+		cctx->nr_interactive++;
 
 	/*
 	 * Update global vruntime.
@@ -948,17 +1069,17 @@ void BPF_STRUCT_OPS(bpfland_stopping, struct task_struct *p, bool runnable)
 	struct task_ctx *tctx;
 
 	cctx = try_lookup_cpu_ctx(cpu);
-	if (cctx)
+	if (cctx) {
 		cctx->tot_runtime += now - cctx->last_running;
-
-	__sync_fetch_and_sub(&nr_running, 1);
+		cctx->nr_running--;
+	}
 
 	tctx = try_lookup_task_ctx(p);
 	if (!tctx)
 		return;
 
-	if (tctx->is_interactive)
-		__sync_fetch_and_sub(&nr_interactive, 1);
+	if (tctx->is_interactive && cctx)
+		cctx->nr_interactive--;
 
 	/*
 	 * If the time slice is not fully depleted, it means that the task
@@ -1235,20 +1356,80 @@ int enable_primary_cpu(struct cpu_arg *input)
 	return err;
 }
 
+/*
+ * Aggregate the per-CPU statistics into the global counters read by the
+ * user-space scheduler.
+ */
+static int stats_timer_fn(void *map, int *key, struct bpf_timer *timer)
+{
+	u64 nr_cpu_ids = scx_bpf_nr_cpu_ids();
+	u64 running = 0, interactive = 0;
+	u64 kthread = 0, direct = 0, shared = 0;
+	struct cpu_ctx *cctx;
+	s32 cpu;
+	int err;
+
+	bpf_for(cpu, 0, nr_cpu_ids) {
+		cctx = try_lookup_cpu_ctx(cpu);
+		if (!cctx)
+			continue;
+		running += cctx->nr_running;
+		interactive += cctx->nr_interactive;
+		kthread += cctx->nr_kthread_dispatches;
+		direct += cctx->nr_direct_dispatches;
+		shared += cctx->nr_shared_dispatches;
+	}
+
+	nr_running = running;
+	nr_interactive = interactive;
+	nr_kthread_dispatches = kthread;
+	nr_direct_dispatches = direct;
+	nr_shared_dispatches = shared;
+
+	err = bpf_timer_start(timer, STATS_TIMER_NS, 0);
+	if (err)
+		scx_bpf_error("Failed to arm stats timer");
+
+	return 0;
+}
+
+static int stats_timer_init(void)
+{
+	struct bpf_timer *timer;
+	u32 key = 0;
+	int err;
+
+	timer = bpf_map_lookup_elem(&stats_timer, &key);
+	if (!timer) {
+		scx_bpf_error("Failed to lookup stats timer");
+		return -ESRCH;
+	}
+	bpf_timer_init(timer, &stats_timer, CLOCK_MONOTONIC);
+	bpf_timer_set_callback(timer, stats_timer_fn);
+	err = bpf_timer_start(timer, STATS_TIMER_NS, 0);
+	if (err)
+		scx_bpf_error("Failed to arm stats timer");
+
+	return err;
+}
+
 s32 BPF_STRUCT_OPS_SLEEPABLE(bpfland_init)
 {
+	u32 llc;
 	int err;
 
 	/* Initialize amount of online CPUs */
 	nr_online_cpus = get_nr_online_cpus();
 
 	/*
-	 * Create the global shared DSQ.
+	 * Create the per-LLC DSQs.
 	 */
-	err = scx_bpf_create_dsq(SHARED_DSQ, -1);
-	if (err) {
-		scx_bpf_error("failed to create shared DSQ: %d", err);
-		return err;
+	bpf_for(llc, 0, nr_llcs) {
+		err = scx_bpf_create_dsq(llc, -1);
+		if (err) {
+			scx_bpf_error("failed to create LLC DSQ %d: %d", llc, err);
+			return err;
+		}
 	}
 
 	/* Initialize the primary scheduling domain */
@@ -1256,7 +1437,7 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(bpfland_init)
 	if (err)
 		return err;
 
-	return 0;
+	return stats_timer_init();
 }
 
 void BPF_STRUCT_OPS(bpfland_exit, struct scx_exit_info *ei)
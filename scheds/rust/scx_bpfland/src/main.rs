@@ -165,7 +165,8 @@ struct Opts {
     #[clap(long, action = clap::ArgAction::SetTrue)]
     disable_l2: bool,
 
-    /// Disable L3 cache awareness.
+    /// Disable L3 cache awareness (this also makes all the CPUs share a single DSQ, instead of
+    /// using a DSQ per LLC).
     #[clap(long, action = clap::ArgAction::SetTrue)]
     disable_l3: bool,
 
@@ -253,12 +254,17 @@ impl<'a> Scheduler<'a> {
         skel.maps.rodata_data.slice_lag = opts.slice_us_lag * 1000;
         skel.maps.rodata_data.nvcsw_max_thresh = opts.nvcsw_max_thresh;
 
-        // Load the BPF program for validation.
-        let mut skel = scx_ops_load!(skel, bpfland_ops, uei)?;
-
         // Initialize CPU topology.
         let topo = Topology::new().unwrap();
 
+        // Initialize the per-LLC DSQs.
+        if !opts.disable_l3 {
+            Self::init_llc_dsqs(&mut skel, &topo);
+        }
+
+        // Load the BPF program for validation.
+        let mut skel = scx_ops_load!(skel, bpfland_ops, uei)?;
+
         // Initialize the primary scheduling domain and the preferred domain.
         let energy_profile = Self::read_energy_profile();
         if let Err(err) = Self::init_energy_domain(&mut skel, &opts.primary_domain, &energy_profile)
@@ -295,6 +301,37 @@ impl<'a> Scheduler<'a> {
         })
     }
 
+    fn init_llc_dsqs(skel: &mut OpenBpfSkel<'_>, topo: &Topology) {
+        let mut cpu_llc_id = [0u32; consts_MAX_CPUS as usize];
+        let mut llc_node_id = [0u32; consts_MAX_LLCS as usize];
+        let mut nr_llcs = 0;
+
+        // Assign contiguous ids to the LLCs, so that the LLCs of the same NUMA node are adjacent.
+        for node in topo.nodes() {
+            for (_, llc) in node.llcs() {
+                if nr_llcs >= consts_MAX_LLCS as usize {
+                    warn!(
+                        "too many LLCs (max {}), using a single shared DSQ",
+                        consts_MAX_LLCS
+                    );
+                    return;
+                }
+                for cpu in llc.cpus().keys() {
+                    if let Some(llc_id) = cpu_llc_id.get_mut(*cpu) {
+                        *llc_id = nr_llcs as u32;
+                    }
+                }
+                llc_node_id[nr_llcs] = node.id() as u32;
+                nr_llcs += 1;
+            }
+        }
+        info!("LLC DSQs: {}", nr_llcs.max(1));
+
+        skel.maps.rodata_data.nr_llcs = nr_llcs.max(1) as u32;
+        skel.maps.rodata_data.cpu_llc_id = cpu_llc_id;
+        skel.maps.rodata_data.llc_node_id = llc_node_id;
+    }
+
     fn enable_primary_cpu(skel: &mut BpfSkel<'_>, cpu: i32) -> Result<(), u32> {
         let prog = &mut skel.progs.enable_primary_cpu;
         let mut args = cpu_arg {
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Copyright (c) 2026 sched_ext contributors
+
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+//! Kernel lock contention microbenchmark for --lock-boost-kernel.
+//!
+//! Worker threads of a single process repeatedly mmap() and munmap() an
+//! anonymous page, serializing on the process's mmap_lock rw semaphore,
+//! while spinner threads oversubscribe the CPUs so that lock holders get
+//! preempted. Compare the reported latencies with and without
+//! --lock-boost-kernel.
+//!
+//! $ cargo run --release --example lock_contention [WORKERS] [SPINNERS] [SECS]
+
+use std::env::args;
+use std::ptr;
+use std::sync::atomic::AtomicBool;
+use std::sync::atomic::Ordering;
+use std::sync::Arc;
+use std::thread;
+use std::time::Duration;
+use std::time::Instant;
+
+fn mmap_munmap() {
+    unsafe {
+        let addr = libc::mmap(
+            ptr::null_mut(),
+            4096,
+            libc::PROT_READ | libc::PROT_WRITE,
+            libc::MAP_PRIVATE | libc::MAP_ANONYMOUS,
+            -1,
+            0,
+        );
+        assert!(addr != libc::MAP_FAILED, "mmap failed");
+        // Fault the page in to take the lock for read as well.
+        *(addr as *mut u8) = 1;
+        libc::munmap(addr, 4096);
+    }
+}
+
+fn main() {
+    let nr_cpus = thread::available_parallelism().map_or(1, |n| n.get());
+    let arg = |i: usize, dfl: usize| -> usize {
+        args().nth(i).map_or(dfl, |a| a.parse().expect("invalid argument"))
+    };
+    let nr_workers = arg(1, nr_cpus);
+    let nr_spinners = arg(2, nr_cpus * 2);
+    let duration = Duration::from_secs(arg(3, 10) as u64);
+
+    let stop = Arc::new(AtomicBool::new(false));
+
+    let spinners: Vec<_> = (0..nr_spinners)
+        .map(|_| {
+            let stop = stop.clone();
+            thread::spawn(move || {
+                while !stop.load(Ordering::Relaxed) {
+                    std::hint::spin_loop();
+                }
+            })
+        })
+        .collect();
+
+    let workers: Vec<_> = (0..nr_workers)
+        .map(|_| {
+            let stop = stop.clone();
+            thread::spawn(move || {
+                let mut lats = Vec::with_capacity(1 << 20);
+                while !stop.load(Ordering::Relaxed) {
+                    let started_at = Instant::now();
+                    mmap_munmap();
+                    lats.push(started_at.elapsed().as_nanos() as u64);
+                }
+                lats
+            })
+        })
+        .collect();
+
+    thread::sleep(duration);
+    stop.store(true, Ordering::Relaxed);
+
+    let mut lats: Vec<u64> = workers
+        .into_iter()
+        .flat_map(|w| w.join().unwrap())
+        .collect();
+    for s in spinners {
+        s.join().unwrap();
+    }
+    if lats.is_empty() {
+        println!("no operation completed");
+        return;
+    }
+    lats.sort_unstable();
+
+    let pct = |p: f64| lats[((lats.len() - 1) as f64 * p) as usize] as f64 / 1000.0;
+    println!(
+        "workers={} spinners={} ops/s={:.0} p50={:.1}us p99={:.1}us p999={:.1}us max={:.1}us",
+        nr_workers,
+        nr_spinners,
+        lats.len() as f64 / duration.as_secs_f64(),
+        pct(0.5),
+        pct(0.99),
+        pct(0.999),
+        pct(1.0),
+    );
+}
@@ -50,8 +50,8 @@ extern void bpf_iter_task_destroy(struct bpf_iter_task *it) __weak __ksym;
 enum {
 	LAVD_CPU_ID_MAX			= 512,
 
-	LAVD_CPDOM_MAX_NR		= 32, /* maximum number of compute domain */
-	LAVD_CPDOM_MAX_DIST		= 4,  /* maximum distance from one compute domain to another */
+	LAVD_CPDOM_MAX_NR		= 256, /* maximum number of compute domain */
+	LAVD_CPDOM_MAX_DIST		= 8,  /* maximum distance from one compute domain to another */
 
 	LAVD_STATUS_STR_LEN		= 5, /* {LR: Latency-critical, Regular}
 						{HI: performance-Hungry, performance-Insensitive}
@@ -93,6 +93,10 @@ struct sys_stat {
 	volatile u64	nr_lc_on_big;	/* latency-critical tasks scheduled on big core */
 
 	volatile u64	nr_lhp;		/* number of lock holder preemption */
+	volatile u64	nr_lh_boosted;	/* number of schedules of boosted lock holders */
+	volatile u64	lh_boosted_run_ns; /* run time of boosted lock holders */
+	volatile u64	nr_vkick;	/* number of victim kicks */
+	volatile u64	nr_vkick_hit;	/* number of victim kicks which preempted a running task */
 };
 
 /*
@@ -133,6 +137,7 @@ struct task_ctx {
 	volatile s16 lock_boost;	/* lock boost count */
 	volatile s16 futex_boost;	/* futex boost count */
 	volatile u8 need_lock_boost;	/* need to boost lock for deadline calculation */
+	u8	lock_boosted;		/* boosted as a lock holder in this schedule */
 	u8	wakeup_ft;		/* regular wakeup = 1, sync wakeup = 2 */
 	volatile u32 *futex_uaddr;	/* futex uaddr */
 
@@ -194,6 +199,61 @@ struct msg_task_ctx {
 };
 
 
+/*
+ * Binary trace
+ *
+ * A trace file starts with LAVD_TRACE_MAGIC followed by a stream of batches.
+ * Each batch is a trace_batch_hdr followed by hdr.nr_events trace_rec
+ * records from a single CPU in time order. The first record of a batch
+ * happened at hdr.base_clk and each record's ts_delta is the time elapsed
+ * since the previous record of the same batch.
+ */
+#define LAVD_TRACE_MAGIC	"LAVDTRC3"
+
+enum {
+	LAVD_TRACE_ENQUEUE		= 0x1, /* arg: vdeadline delta, aux: dsq id */
+	LAVD_TRACE_DIRECT_DISPATCH	= 0x2, /* arg: time slice */
+	LAVD_TRACE_CONSUME		= 0x3, /* arg: dsq id, no task */
+	LAVD_TRACE_RUNNING		= 0x4, /* arg: time slice */
+	LAVD_TRACE_STOPPING		= 0x5, /* arg: run time, aux: still runnable */
+	LAVD_TRACE_PREEMPT_KICK		= 0x6, /* arg: victim cpu, aux: self kick */
+	LAVD_TRACE_CORE_COMPACT		= 0x7, /* arg: nr_active, pid: old nr_active */
+
+	LAVD_TRACE_BATCH_NR		= 64, /* records per batch */
+	LAVD_TRACE_COST_BUDGET_NS	= 100, /* per-record overhead budget */
+};
+
+struct trace_rec {
+	u64	arg;		/* event specific, see LAVD_TRACE_*, times in nsec */
+	u32	ts_delta;	/* nsec since the previous record */
+	u32	pid;
+	u32	aux;		/* event specific, see LAVD_TRACE_* */
+	u16	lat_cri;	/* task's latency criticality, saturated */
+	u8	kind;		/* LAVD_TRACE_* */
+	u8	__pad;
+};
+
+struct trace_batch_hdr {
+	u64	base_clk;	/* clock of the first record */
+	u32	cpu_id;
+	u32	nr_events;	/* number of valid records */
+};
+
+struct trace_batch {
+	struct trace_batch_hdr	hdr;
+	struct trace_rec	events[LAVD_TRACE_BATCH_NR];
+};
+
+struct trace_buf {
+	struct trace_batch	batch;		/* batch being filled */
+	u64			last_clk;	/* clock of the last record */
+	u64			nr_events;	/* total number of records */
+	u64			nr_drops;	/* records lost on a full ring buffer */
+	u64			cost_ns;	/* sampled time spent recording */
+	u64			nr_cost_samples;
+};
+
+
 /*
  * BPF syscall
  */
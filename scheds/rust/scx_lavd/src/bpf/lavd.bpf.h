@@ -53,6 +53,17 @@ enum consts_internal  {
 						  performance mode when cpu util > 40% */
 
 	LAVD_CPDOM_STARV_NS		= (5ULL * NSEC_PER_MSEC),
+
+	LAVD_VTREE_MAX_NODES		= (4 * LAVD_CPU_ID_MAX), /* victim tree nodes of all compute domains */
+	LAVD_VTREE_MAX_DEPTH		= 10, /* log2(LAVD_CPU_ID_MAX) + 1 */
+	LAVD_VTREE_CPU_MASK		= 0x3ff, /* low bits of a victim tree key holding a cpu id */
+	LAVD_VTREE_LAT_CRI_SHIFT	= 56, /* high bits of a victim tree key holding the inverted lat_cri */
+	LAVD_VTREE_LAT_CRI_MAX		= 0xfe, /* lat_cri saturates in a victim tree key */
+	LAVD_VTREE_NR_TRIES		= 4, /* victim candidates checked per preemption */
+	LAVD_VTREE_WALK_MAX		= (LAVD_VTREE_NR_TRIES * LAVD_VTREE_MAX_DEPTH), /* pending subtrees of a victim search */
+
+	LAVD_TRACE_FLUSH_NS		= (10ULL * NSEC_PER_MSEC), /* max age of a pending batch */
+	LAVD_TRACE_COST_SAMPLE		= 1009, /* measure the cost every N records */
 };
 
 const volatile u64 LAVD_TIME_INFINITY_NS;
@@ -69,8 +80,10 @@ struct cpdom_ctx {
 	u8	node_id;			    /* numa domain id */
 	u8	is_big;				    /* is it a big core or little core? */
 	u8	is_active;			    /* if this compute domain is active */
-	u8	nr_neighbors[LAVD_CPDOM_MAX_DIST];  /* number of neighbors per distance */
-	u64	neighbor_bits[LAVD_CPDOM_MAX_DIST]; /* bitmask of neighbor bitmask per distance */
+	u16	vtree_base;			    /* offset of the victim tree in vtree[] */
+	u16	vtree_nr_leaves;		    /* number of leaves of the victim tree */
+	u16	nr_neighbors[LAVD_CPDOM_MAX_DIST];  /* number of neighbors per distance */
+	u16	steal_order[LAVD_CPDOM_MAX_NR];	    /* ids of neighbors sorted by distance */
 	u64	__cpumask[LAVD_CPU_ID_MAX/64];	    /* cpumasks belongs to this compute domain */
 } __attribute__((aligned(CACHELINE_SIZE)));
 
@@ -118,7 +131,9 @@ struct cpu_ctx {
 	volatile u16	lat_cri;	/* latency criticality */
 	volatile u8	is_online;	/* is this CPU online? */
 	volatile bool	lock_holder;	/* is a lock holder running */
+	volatile u8	vkick_pending;	/* kicked as a victim but not stopped yet */
 	s32		cpu_id;		/* cpu id */
+	u16		vtree_leaf;	/* leaf index in the compute domain's victim tree */
 
 	/*
 	 * Information for CPU frequency scaling
@@ -134,9 +149,9 @@ struct cpu_ctx {
 	u16		capacity;	/* CPU capacity based on 1000 */
 	u8		big_core;	/* is it a big core? */
 	u8		turbo_core;	/* is it a turbo core? */
-	u8		cpdom_id;	/* compute domain id (== dsq_id) */
-	u8		cpdom_alt_id;	/* compute domain id of anternative type (== dsq_id) */
-	u8		cpdom_poll_pos;	/* index to check if a DSQ of a compute domain is starving */
+	u16		cpdom_id;	/* compute domain id (== dsq_id) */
+	u16		cpdom_alt_id;	/* compute domain id of anternative type (== dsq_id) */
+	u16		cpdom_poll_pos;	/* index to check if a DSQ of a compute domain is starving */
 	struct bpf_cpumask __kptr *tmp_a_mask;	/* temporary cpu mask */
 	struct bpf_cpumask __kptr *tmp_o_mask;	/* temporary cpu mask */
 	struct bpf_cpumask __kptr *tmp_t_mask;	/* temporary cpu mask */
@@ -151,6 +166,10 @@ struct cpu_ctx {
 	volatile u32	nr_perf_cri;
 	volatile u32	nr_lat_cri;
 	volatile u32	nr_lhp;		/* number of lock holder preemption */
+	volatile u32	nr_lh_boosted;	/* number of schedules of boosted lock holders */
+	volatile u64	lh_boosted_run_ns; /* run time of boosted lock holders */
+	volatile u32	nr_vkick;	/* number of victim kicks resolved */
+	volatile u32	nr_vkick_hit;	/* victim kicks which preempted a running task */
 } __attribute__((aligned(CACHELINE_SIZE)));
 
 
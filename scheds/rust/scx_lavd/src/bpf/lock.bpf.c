@@ -46,6 +46,42 @@ static void dec_futex_boost(u32 *uaddr)
 	try_dec_futex_boost(taskc, cpuc, uaddr);
 }
 
+static void try_inc_lock_boost(struct task_ctx *taskc, struct cpu_ctx *cpuc)
+{
+	if (taskc && cpuc) {
+		taskc->lock_boost++;
+		cpuc->lock_holder = is_lock_holder(taskc);
+	}
+	/*
+	 * If taskc is null, the task is not under sched_ext so ignore the error.
+	 */
+}
+
+static void try_dec_lock_boost(struct task_ctx *taskc, struct cpu_ctx *cpuc)
+{
+	if (taskc && cpuc && taskc->lock_boost > 0) {
+		taskc->lock_boost--;
+		cpuc->lock_holder = is_lock_holder(taskc);
+	}
+	/*
+	 * If taskc is null, the task is not under sched_ext so ignore the error.
+	 */
+}
+
+static void inc_lock_boost(void)
+{
+	struct task_ctx *taskc = try_get_current_task_ctx();
+	struct cpu_ctx *cpuc = get_cpu_ctx();
+	try_inc_lock_boost(taskc, cpuc);
+}
+
+static void dec_lock_boost(void)
+{
+	struct task_ctx *taskc = try_get_current_task_ctx();
+	struct cpu_ctx *cpuc = get_cpu_ctx();
+	try_dec_lock_boost(taskc, cpuc);
+}
+
 static void reset_lock_futex_boost(struct task_ctx *taskc, struct cpu_ctx *cpuc)
 {
 	if (is_lock_holder(taskc)) {
@@ -194,6 +230,140 @@ int BPF_PROG(fexit_futex_unlock_pi, u32 *uaddr, unsigned int flags, int ret)
 }
 #endif /* LAVD_TRACE_FUTEX */
 
+/**
+ * Kernel mutexes and rw semaphores (kernel/locking/)
+ *
+ * Unlike futexes, kernel locks are acquired and released in pairs by the
+ * kernel itself, so we simply count the locks held in task_ctx->lock_boost.
+ * A task holding any of them is a lock holder, so it is not picked as a
+ * victim, its time slice is extended on ops.dispatch(), and it is boosted
+ * on its next schedule if it is preempted with a lock held, exactly as a
+ * futex holder.
+ *
+ * mutex_lock() and down_read() are some of the hottest functions in the
+ * kernel, so even an fexit trampoline adds a measurable cost. Hence, these
+ * programs are not loaded by default ("?fexit"), and the user space loads
+ * the ones whose target exists in the running kernel with
+ * --lock-boost-kernel. For example, with CONFIG_DEBUG_LOCK_ALLOC,
+ * mutex_lock() is a macro and there is no such function to trace.
+ *
+ * We trace the folloing kernel lock calls:
+ * - void mutex_lock(struct mutex *lock)
+ * - int mutex_lock_interruptible(struct mutex *lock)
+ * - int mutex_lock_killable(struct mutex *lock)
+ * - int mutex_trylock(struct mutex *lock)
+ * - void mutex_unlock(struct mutex *lock)
+ *
+ * - void down_read(struct rw_semaphore *sem)
+ * - int down_read_killable(struct rw_semaphore *sem)
+ * - int down_read_trylock(struct rw_semaphore *sem)
+ * - void down_write(struct rw_semaphore *sem)
+ * - int down_write_killable(struct rw_semaphore *sem)
+ * - int down_write_trylock(struct rw_semaphore *sem)
+ * - void up_read(struct rw_semaphore *sem)
+ * - void up_write(struct rw_semaphore *sem)
+ */
+struct mutex;
+struct rw_semaphore;
+
+SEC("?fexit/mutex_lock")
+int BPF_PROG(fexit_mutex_lock, struct mutex *lock)
+{
+	inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/mutex_lock_interruptible")
+int BPF_PROG(fexit_mutex_lock_interruptible, struct mutex *lock, int ret)
+{
+	if (ret == 0)
+		inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/mutex_lock_killable")
+int BPF_PROG(fexit_mutex_lock_killable, struct mutex *lock, int ret)
+{
+	if (ret == 0)
+		inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/mutex_trylock")
+int BPF_PROG(fexit_mutex_trylock, struct mutex *lock, int ret)
+{
+	if (ret == 1)
+		inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/mutex_unlock")
+int BPF_PROG(fexit_mutex_unlock, struct mutex *lock)
+{
+	dec_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/down_read")
+int BPF_PROG(fexit_down_read, struct rw_semaphore *sem)
+{
+	inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/down_read_killable")
+int BPF_PROG(fexit_down_read_killable, struct rw_semaphore *sem, int ret)
+{
+	if (ret == 0)
+		inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/down_read_trylock")
+int BPF_PROG(fexit_down_read_trylock, struct rw_semaphore *sem, int ret)
+{
+	if (ret == 1)
+		inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/down_write")
+int BPF_PROG(fexit_down_write, struct rw_semaphore *sem)
+{
+	inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/down_write_killable")
+int BPF_PROG(fexit_down_write_killable, struct rw_semaphore *sem, int ret)
+{
+	if (ret == 0)
+		inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/down_write_trylock")
+int BPF_PROG(fexit_down_write_trylock, struct rw_semaphore *sem, int ret)
+{
+	if (ret == 1)
+		inc_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/up_read")
+int BPF_PROG(fexit_up_read, struct rw_semaphore *sem)
+{
+	dec_lock_boost();
+	return 0;
+}
+
+SEC("?fexit/up_write")
+int BPF_PROG(fexit_up_write, struct rw_semaphore *sem)
+{
+	dec_lock_boost();
+	return 0;
+}
+
 
 /**
  * TODO: NTsync driver in recent kernel (when ntsync is fully mainlined)
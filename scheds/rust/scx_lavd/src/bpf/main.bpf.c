@@ -120,9 +120,10 @@
  * high (e.g., 15). If the task is urgent enough, the scheduler finds a victim
  * CPU, which runs a lower-priority task, and kicks the remote victim CPU by
  * sending IPI. Then, the remote CPU will preempt out its running task and
- * schedule the highest priority task in the global run queue. The scheduler
- * uses 'The Power of Two Random Choices' heuristic so all N CPUs can run the N
- * highest priority tasks.
+ * schedule the highest priority task in the global run queue. To find a
+ * victim in constant time, each compute domain keeps a tournament tree of its
+ * CPUs ordered by the estimated stopping time of their running tasks, so all
+ * N CPUs can run the N highest priority tasks.
  *
  *
  * 7. Performance criticality
@@ -197,6 +198,7 @@ char _license[] SEC("license") = "GPL";
  */
 #include "util.bpf.c"
 #include "introspec.bpf.c"
+#include "trace.bpf.c"
 #include "power.bpf.c"
 #include "sys_stat.bpf.c"
 #include "preempt.bpf.c"
@@ -293,6 +295,7 @@ static u64 calc_weight_factor(struct task_struct *p, struct task_ctx *taskc,
 	 */
 	if (taskc->need_lock_boost) {
 		taskc->need_lock_boost = false;
+		taskc->lock_boosted = true;
 		weight_boost += LAVD_LC_WEIGHT_BOOST;
 	}
 
@@ -618,6 +621,16 @@ static void update_stat_for_stopping(struct task_struct *p,
 	taskc->svc_time += task_run_time / p->scx.weight;
 	taskc->victim_cpu = (s32)LAVD_CPU_ID_NONE;
 
+	/*
+	 * Account how long a boosted lock holder ran to see if the boost
+	 * helps it leave its critical section.
+	 */
+	if (taskc->lock_boosted) {
+		taskc->lock_boosted = false;
+		cpuc->nr_lh_boosted++;
+		cpuc->lh_boosted_run_ns += task_run_time;
+	}
+
 	/*
 	 * Reset waker's latency criticality here to limit the latency boost of
 	 * a task. A task will be latency-boosted only once after wake-up.
@@ -971,6 +984,7 @@ static void direct_dispatch(struct task_struct *p, struct task_ctx *taskc,
 	p->scx.slice = calc_time_slice(p, taskc);
 
 	scx_bpf_dispatch(p, SCX_DSQ_LOCAL, p->scx.slice, enq_flags);
+	trace_task(LAVD_TRACE_DIRECT_DISPATCH, p, taskc, p->scx.slice, 0);
 }
 
 s32 BPF_STRUCT_OPS(lavd_select_cpu, struct task_struct *p, s32 prev_cpu,
@@ -1032,6 +1046,48 @@ static u64 find_proper_dsq(struct task_ctx *taskc, struct cpu_ctx *cpuc)
 	return cpuc->cpdom_alt_id;
 }
 
+/*
+ * Bitmap of compute domains whose DSQ has tasks but has not been consumed
+ * for LAVD_CPDOM_STARV_NS. A domain is marked by ops.enqueue() and
+ * ops.tick() on its own CPUs and cleared whenever it is consumed, so
+ * ops.dispatch() only needs to look at the marked domains.
+ */
+u64 cpdom_starving[LAVD_CPDOM_MAX_NR / 64];
+
+static bool is_cpdom_starving(struct cpdom_ctx *cpdomc, u64 now)
+{
+	return READ_ONCE(cpdomc->last_consume_clk) + LAVD_CPDOM_STARV_NS < now;
+}
+
+static void set_cpdom_starving(u64 dsq_id, bool starving)
+{
+	u64 *word = MEMBER_VPTR(cpdom_starving, [dsq_id / 64]);
+	u64 bit = 1LLU << (dsq_id % 64);
+
+	if (!word)
+		return;
+
+	/*
+	 * Test the bit first not to bounce the cacheline on every call.
+	 */
+	if (starving && !(READ_ONCE(*word) & bit))
+		__sync_fetch_and_or(word, bit);
+	else if (!starving && (READ_ONCE(*word) & bit))
+		__sync_fetch_and_and(word, ~bit);
+}
+
+static void check_cpdom_starving(u64 dsq_id, u64 now)
+{
+	struct cpdom_ctx *cpdomc;
+
+	if (nr_cpdoms == 1)
+		return;
+
+	cpdomc = MEMBER_VPTR(cpdom_ctxs, [dsq_id]);
+	if (cpdomc && is_cpdom_starving(cpdomc, now))
+		set_cpdom_starving(dsq_id, true);
+}
+
 static bool try_kick_task_idle_cpu(struct task_struct *p, struct task_ctx *taskc)
 {
 	bool found_idle = false;
@@ -1089,6 +1145,9 @@ void BPF_STRUCT_OPS(lavd_enqueue, struct task_struct *p, u64 enq_flags)
 	 */
 	scx_bpf_dispatch_vtime(p, dsq_id, p->scx.slice,
 		 taskc->vdeadline_log_clk, enq_flags);
+	check_cpdom_starving(dsq_id, bpf_ktime_get_ns());
+	trace_task(LAVD_TRACE_ENQUEUE, p, taskc, taskc->vdeadline_delta_ns,
+		   dsq_id);
 
 	/*
 	 * If there is an idle cpu for the task, try to kick it up now
@@ -1140,59 +1199,77 @@ static bool consume_dsq(s32 cpu, u64 dsq_id, u64 now)
 		return false;
 	}
 	WRITE_ONCE(cpdomc->last_consume_clk, now);
+	set_cpdom_starving(dsq_id, false);
 
 	/*
 	 * Try to consume a task on the associated DSQ.
 	 */
-	if (scx_bpf_consume(dsq_id))
+	if (scx_bpf_consume(dsq_id)) {
+		trace_event(LAVD_TRACE_CONSUME, 0, 0, dsq_id, 0);
 		return true;
+	}
 	return false;
 }
 
 static bool consume_starving_task(s32 cpu, struct cpu_ctx *cpuc, u64 now)
 {
 	struct cpdom_ctx *cpdomc;
-	u64 dsq_id = cpuc->cpdom_poll_pos;
-	u64 dl;
-	bool ret = false;
-	int i;
+	u64 dsq_id, *word, bits;
+	s64 pos;
+	int i, w, nr_words;
 
 	if (nr_cpdoms == 1)
 		return false;
 
-	bpf_for(i, 0, nr_cpdoms) {
-		if (i >= LAVD_CPDOM_MAX_NR)
+	/*
+	 * Visit only the compute domains marked as starving. Each CPU starts
+	 * from a different word of the bitmap and a random bit in the word
+	 * so the CPUs spread over the starving domains.
+	 */
+	nr_words = (nr_cpdoms + 63) / 64;
+	bpf_for(i, 0, nr_words) {
+		w = (cpuc->cpdom_poll_pos + i) % nr_words;
+		word = MEMBER_VPTR(cpdom_starving, [w]);
+		if (!word)
 			break;
 
-		dsq_id = (dsq_id + i) % LAVD_CPDOM_MAX_NR;
+		bits = READ_ONCE(*word);
+		if (cpuc->cpdom_id / 64 == w)
+			bits &= ~(1LLU << (cpuc->cpdom_id % 64));
+		if (!bits)
+			continue;
 
-		if (dsq_id == cpuc->cpdom_id)
+		pos = pick_any_bit(bits, bpf_get_prandom_u32());
+		if (pos < 0)
 			continue;
 
+		dsq_id = w * 64 + pos;
 		cpdomc = MEMBER_VPTR(cpdom_ctxs, [dsq_id]);
 		if (!cpdomc) {
 			scx_bpf_error("Failed to lookup cpdom_ctx for %llu", dsq_id);
-			goto out;
+			return false;
 		}
 
-		if (cpdomc->is_active) {
-			dl = READ_ONCE(cpdomc->last_consume_clk) + LAVD_CPDOM_STARV_NS;
-			if (dl < now) {
-				ret = consume_dsq(cpu, dsq_id, now);
-			}
-			goto out;
+		/*
+		 * The domain might have caught up since it was marked.
+		 */
+		if (!cpdomc->is_active || !is_cpdom_starving(cpdomc, now)) {
+			set_cpdom_starving(dsq_id, false);
+			continue;
 		}
+
+		cpuc->cpdom_poll_pos = w + 1;
+		return consume_dsq(cpu, dsq_id, now);
 	}
-out:
-	cpuc->cpdom_poll_pos = (dsq_id + 1) % LAVD_CPDOM_MAX_NR;
-	return ret;
+
+	return false;
 }
 
 static bool consume_task(s32 cpu, struct cpu_ctx *cpuc, u64 now)
 {
 	struct cpdom_ctx *cpdomc, *cpdomc_pick;
-	u64 dsq_id, nr_nbr;
-	s64 nuance;
+	u64 dsq_id, nr_nbr, nuance, idx, pos = 0;
+	int i, j;
 
 	/*
 	 * If there is a starving DSQ, try to consume it first.
@@ -1209,7 +1286,9 @@ static bool consume_task(s32 cpu, struct cpu_ctx *cpuc, u64 now)
 
 	/*
 	 * If there is no task in the assssociated DSQ, traverse neighbor
-	 * compute domains in distance order -- task stealing.
+	 * compute domains in distance order -- task stealing. The steal
+	 * order is sorted by distance in user space, and we start from a
+	 * random neighbor among the ones at the same distance.
 	 */
 	cpdomc = MEMBER_VPTR(cpdom_ctxs, [dsq_id]);
 	if (!cpdomc) {
@@ -1217,18 +1296,19 @@ static bool consume_task(s32 cpu, struct cpu_ctx *cpuc, u64 now)
 		return false;
 	}
 
-	for (int i = 0; i < LAVD_CPDOM_MAX_DIST; i++) {
+	bpf_for(i, 0, LAVD_CPDOM_MAX_DIST) {
 		nr_nbr = min(cpdomc->nr_neighbors[i], LAVD_CPDOM_MAX_NR);
 		if (nr_nbr == 0)
 			break;
 
 		nuance = bpf_get_prandom_u32();
-		for (int j = 0; j < LAVD_CPDOM_MAX_NR; j++, nuance = dsq_id + 1) {
-			if (j >= nr_nbr)
+		bpf_for(j, 0, nr_nbr) {
+			idx = pos + (nuance + j) % nr_nbr;
+			if (idx >= LAVD_CPDOM_MAX_NR)
 				break;
 
-			dsq_id = pick_any_bit(cpdomc->neighbor_bits[i], nuance);
-			if (dsq_id == -ENOENT)
+			dsq_id = cpdomc->steal_order[idx];
+			if (!scx_bpf_dsq_nr_queued(dsq_id))
 				continue;
 
 			cpdomc_pick = MEMBER_VPTR(cpdom_ctxs, [dsq_id]);
@@ -1243,6 +1323,7 @@ static bool consume_task(s32 cpu, struct cpu_ctx *cpuc, u64 now)
 			if (consume_dsq(cpu, dsq_id, now))
 				return true;
 		}
+		pos += nr_nbr;
 	}
 
 	return false;
@@ -1417,6 +1498,12 @@ void BPF_STRUCT_OPS(lavd_tick, struct task_struct *p_run)
 	if (!cpuc_run || !taskc_run)
 		goto update_cpuperf;
 
+	/*
+	 * Mark the CPU's compute domain if its tasks have been waiting long.
+	 */
+	if (scx_bpf_dsq_nr_queued(cpuc_run->cpdom_id))
+		check_cpdom_starving(cpuc_run->cpdom_id, bpf_ktime_get_ns());
+
 	/*
 	 * If a task is eligible, don't consider its being preempted.
 	 */
@@ -1533,6 +1620,9 @@ void BPF_STRUCT_OPS(lavd_running, struct task_struct *p)
 	 */
 	cpuc->lat_cri = taskc->lat_cri;
 	cpuc->stopping_tm_est_ns = get_est_stopping_time(taskc);
+	vtree_update(cpuc, cpuc->stopping_tm_est_ns);
+
+	trace_task(LAVD_TRACE_RUNNING, p, taskc, p->scx.slice, 0);
 
 	/*
 	 * If there is a relevant introspection command with @p, process it.
@@ -1589,10 +1679,30 @@ void BPF_STRUCT_OPS(lavd_stopping, struct task_struct *p, bool runnable)
 
 	update_stat_for_stopping(p, taskc, cpuc);
 
+	/*
+	 * The CPU is not a victim candidate until the next task runs.
+	 */
+	vtree_update(cpuc, 0);
+
+	/*
+	 * A victim kick hits if it preempted a task which is still runnable.
+	 * Otherwise, the task was about to stop anyway and the IPI was wasted.
+	 */
+	if (cpuc->vkick_pending) {
+		WRITE_ONCE(cpuc->vkick_pending, false);
+		cpuc->nr_vkick++;
+		if (runnable)
+			cpuc->nr_vkick_hit++;
+	}
+
 	/*
 	 * Adjust slice boost for the task's next schedule.
 	 */
 	adjust_slice_boost(cpuc, taskc);
+
+	trace_task(LAVD_TRACE_STOPPING, p, taskc,
+		   taskc->last_stopping_clk - taskc->last_running_clk,
+		   runnable);
 }
 
 void BPF_STRUCT_OPS(lavd_quiescent, struct task_struct *p, u64 deq_flags)
@@ -1821,9 +1931,9 @@ s32 BPF_STRUCT_OPS(lavd_init_task, struct task_struct *p,
 static s32 init_cpdoms(u64 now)
 {
 	struct cpdom_ctx *cpdomc;
-	int err;
+	int i, err;
 
-	for (int i = 0; i < LAVD_CPDOM_MAX_NR; i++) {
+	bpf_for(i, 0, LAVD_CPDOM_MAX_NR) {
 		/*
 		 * Fetch a cpdom context.
 		 */
@@ -1918,6 +2028,8 @@ static s32 init_per_cpu_ctx(u64 now)
 	struct cpdom_ctx *cpdomc;
 	int cpu, i, j, err = 0, nr_cpus_non_zero = 0;
 	u64 cpdom_id;
+	u32 nr_leaves, vtree_base = 0;
+	u16 vtree_leaf;
 	u32 sum_capacity = 0, avg_capacity, big_capacity = 0;
 	u16 turbo_cap;
 
@@ -2040,6 +2152,7 @@ static s32 init_per_cpu_ctx(u64 now)
 		if (!cpdomc->is_active)
 			continue;
 
+		vtree_leaf = 0;
 		bpf_for(i, 0, LAVD_CPU_ID_MAX/64) {
 			u64 cpumask = cpdomc->__cpumask[i];
 			bpf_for(j, 0, 64) {
@@ -2054,9 +2167,31 @@ static s32 init_per_cpu_ctx(u64 now)
 					}
 					cpuc->cpdom_id = cpdomc->id;
 					cpuc->cpdom_alt_id = cpdomc->alt_id;
+					cpuc->vtree_leaf = vtree_leaf++;
 				}
 			}
 		}
+
+		/*
+		 * Carve out a victim tree with a power-of-two number of
+		 * leaves for the compute domain. Since each tree takes less
+		 * than four nodes per CPU, all the trees fit in vtree[].
+		 */
+		nr_leaves = 1;
+		bpf_for(i, 0, LAVD_VTREE_MAX_DEPTH) {
+			if (nr_leaves >= vtree_leaf)
+				break;
+			nr_leaves <<= 1;
+		}
+		if (vtree_base + 2 * nr_leaves > LAVD_VTREE_MAX_NODES) {
+			scx_bpf_error("Failed to allocate a victim tree for cpdom %llu",
+				      cpdom_id);
+			err = -ENOMEM;
+			goto unlock_out;
+		}
+		cpdomc->vtree_base = vtree_base;
+		cpdomc->vtree_nr_leaves = nr_leaves;
+		vtree_base += 2 * nr_leaves;
 	}
 
 	bpf_for(cpu, 0, nr_cpu_ids) {
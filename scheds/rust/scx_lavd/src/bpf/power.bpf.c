@@ -180,6 +180,10 @@ static void do_core_compaction(void)
 	cur_big_core_ratio = (1000 * big_capacity) / sum_capacity;
 	stat_cur->nr_active = nr_active;
 
+	if (nr_active != nr_active_old)
+		trace_event(LAVD_TRACE_CORE_COMPACT, nr_active_old, 0,
+			    nr_active, 0);
+
 unlock_out:
 	bpf_rcu_read_unlock();
 }
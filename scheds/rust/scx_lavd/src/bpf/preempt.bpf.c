@@ -90,7 +90,159 @@ static bool can_cpu_be_kicked(u64 now, struct cpu_ctx *cpuc)
 	return cpuc->is_online && (now >= cpuc->last_kick_clk);
 }
 
+/*
+ * Victim tournament tree
+ *
+ * Each compute domain keeps a max tournament tree over its CPUs in vtree[].
+ * A leaf holds the key of the task running on the CPU, and an internal node
+ * holds the larger of its two children. Hence, the root always names the
+ * best victim for a preemption: the CPU running the least latency critical
+ * task and, among those, the one which will keep its task the longest.
+ *
+ * A key packs the inverted latency criticality in its top bits, the
+ * estimated stopping time below it and the cpu id in its low
+ * LAVD_VTREE_CPU_MASK bits. So comparing two keys compares lat_cri first and
+ * then the stopping times at 1 usec granularity. The stopping time wraps
+ * around every 2^56 nsec (~2.3 years of uptime), which only makes the order
+ * of the victims wrong for a moment. A key of zero means that there is no
+ * running task on the CPU.
+ *
+ * The tree is updated on every ops.running() and ops.stopping() in
+ * O(log(#CPUs in a domain)) without a lock. Concurrent updates along the same
+ * path may leave a stale internal node until the next update passing
+ * through it, so a victim picked from the tree is re-checked with
+ * can_cpu1_kick_cpu2() before being kicked.
+ */
+u64 vtree[LAVD_VTREE_MAX_NODES];
+
+static u64 vtree_key(u64 stopping_tm_est_ns, u64 lat_cri, s32 cpu)
+{
+	u64 time_mask = ((1ULL << LAVD_VTREE_LAT_CRI_SHIFT) - 1) &
+			~(u64)LAVD_VTREE_CPU_MASK;
+
+	if (!stopping_tm_est_ns)
+		return 0;
+
+	/* never zero as the inverted lat_cri is at least one */
+	lat_cri = LAVD_VTREE_LAT_CRI_MAX + 1 -
+		  min(lat_cri, (u64)LAVD_VTREE_LAT_CRI_MAX);
+	return (lat_cri << LAVD_VTREE_LAT_CRI_SHIFT) |
+	       (stopping_tm_est_ns & time_mask) |
+	       (cpu & LAVD_VTREE_CPU_MASK);
+}
+
+static u64 vtree_get(u64 idx)
+{
+	u64 *node = MEMBER_VPTR(vtree, [idx]);
+
+	return node ? READ_ONCE(*node) : 0;
+}
+
+static void vtree_set(u64 idx, u64 key)
+{
+	u64 *node = MEMBER_VPTR(vtree, [idx]);
+
+	if (node)
+		WRITE_ONCE(*node, key);
+}
+
+static void vtree_update(struct cpu_ctx *cpuc, u64 stopping_tm_est_ns)
+{
+	struct cpdom_ctx *cpdomc;
+	u64 base, idx;
+	int i;
+
+	cpdomc = MEMBER_VPTR(cpdom_ctxs, [cpuc->cpdom_id]);
+	if (!cpdomc || !cpdomc->vtree_nr_leaves)
+		return;
+
+	/*
+	 * Update the leaf and replay the matches up to the root.
+	 */
+	base = cpdomc->vtree_base;
+	idx = cpdomc->vtree_nr_leaves + cpuc->vtree_leaf;
+	vtree_set(base + idx, vtree_key(stopping_tm_est_ns, cpuc->lat_cri,
+					cpuc->cpu_id));
+
+	bpf_for(i, 0, LAVD_VTREE_MAX_DEPTH) {
+		if (idx <= 1)
+			break;
+		idx >>= 1;
+		vtree_set(base + idx, max(vtree_get(base + 2 * idx),
+					  vtree_get(base + 2 * idx + 1)));
+	}
+}
+
+/*
+ * Best-first search over a victim tree. nodes[] holds the subtrees which
+ * haven't been visited yet, starting with the root.
+ */
+struct vtree_walk {
+	u32	nr;
+	u16	nodes[LAVD_VTREE_WALK_MAX];
+};
+
+static void vtree_walk_push(struct vtree_walk *walk, u64 idx)
+{
+	u32 nr = walk->nr;
+
+	if (nr < LAVD_VTREE_WALK_MAX) {
+		walk->nodes[nr] = idx;
+		walk->nr = nr + 1;
+	}
+}
+
+/*
+ * Return the cpu of the best victim candidate which hasn't been returned
+ * yet, or -ENOENT if there is none. Each call takes the best pending
+ * subtree and descends to its best leaf, leaving the other children on the
+ * way as pending subtrees, so the n-th call returns the n-th best candidate.
+ */
+static s32 vtree_walk_next(struct cpdom_ctx *cpdomc, struct vtree_walk *walk)
+{
+	u64 base = cpdomc->vtree_base, key, best_key = 0, idx, left, right;
+	u32 i, nr = walk->nr, best = 0;
+
+	bpf_for(i, 0, LAVD_VTREE_WALK_MAX) {
+		if (i >= nr)
+			break;
+		key = vtree_get(base + walk->nodes[i]);
+		if (key > best_key) {
+			best_key = key;
+			best = i;
+		}
+	}
+	if (!best_key || best >= nr || best >= LAVD_VTREE_WALK_MAX ||
+	    nr > LAVD_VTREE_WALK_MAX)
+		return -ENOENT;
+
+	idx = walk->nodes[best];
+	walk->nodes[best] = walk->nodes[nr - 1];
+	walk->nr = nr - 1;
+
+	bpf_for(i, 0, LAVD_VTREE_MAX_DEPTH) {
+		if (idx >= cpdomc->vtree_nr_leaves)
+			break;
+		left = 2 * idx;
+		right = left + 1;
+		if (vtree_get(base + left) >= vtree_get(base + right)) {
+			vtree_walk_push(walk, right);
+			idx = left;
+		} else {
+			vtree_walk_push(walk, left);
+			idx = right;
+		}
+	}
+
+	/* the leaf may have changed under us, it's re-checked anyway */
+	key = vtree_get(base + idx);
+	if (!key)
+		return -ENOENT;
+	return key & LAVD_VTREE_CPU_MASK;
+}
+
 static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
+				       struct cpdom_ctx *cpdomc,
 				       struct task_ctx *taskc,
 				       u64 *p_old_last_kick_clk)
 {
@@ -100,15 +252,22 @@ static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
 	 * should run on the N CPUs all the time. This is the same as the
 	 * load-balancing problem; the load-balancing problem finds a least
 	 * loaded server, and the preemption problem finds a CPU running a
-	 * least latency critical task. Hence, we use the 'power of two random
-	 * choices' technique.
+	 * least latency critical task.
+	 *
+	 * Instead of sampling CPUs, we walk the compute domain's victim tree
+	 * from its best candidate, the CPU running the least latency critical
+	 * task with the latest estimated stopping time. If @p cannot run on
+	 * a candidate, or it cannot be kicked, we try the next best one. At
+	 * most LAVD_VTREE_NR_TRIES candidates are checked, so finding a victim
+	 * takes O(log(#CPUs)) regardless of the number of CPUs. If none of
+	 * them works out, we give up the kick-based preemption and leave it to
+	 * the yield-based one.
 	 */
 	u64 now = bpf_ktime_get_ns();
 	struct cpu_ctx *cpuc;
-	struct preemption_info prm_task, prm_cpus[2], *victim_cpu;
-	int cpu, nr_cpus;
-	int i, v = 0, cur_cpu = bpf_get_smp_processor_id();
-	int ret;
+	struct preemption_info prm_task, prm_cpu, *victim_cpu;
+	struct vtree_walk walk = { .nr = 1, .nodes = { 1 } };
+	int i, cpu, cur_cpu = bpf_get_smp_processor_id();
 
 	/*
 	 * Get task's preemption information for comparison.
@@ -127,7 +286,7 @@ static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
 	 */
 	if (can_cpu_be_kicked(now, cpuc) &&
 	    bpf_cpumask_test_cpu(cur_cpu, cpumask) &&
-	    can_cpu1_kick_cpu2(&prm_task, &prm_cpus[0], cpuc)) {
+	    can_cpu1_kick_cpu2(&prm_task, &prm_cpu, cpuc)) {
 		victim_cpu = &prm_task;
 		goto bingo_out;
 	}
@@ -140,76 +299,37 @@ static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
 		goto null_out;
 
 	/*
-	 * Randomly find _two_ CPUs that run lower-priority tasks than @p. To
-	 * traverse CPUs in a random order, we start from a random CPU ID in a
-	 * random direction (left or right). The random-order traversal helps
-	 * to mitigate the thundering herd problem. Otherwise, all CPUs may end
-	 * up finding the same victim CPU.
-	 *
-	 * In the worst case, the current logic traverses _all_ CPUs. It would
-	 * be too expensive to perform every task queue. We need to revisit
-	 * this if the traversal cost becomes problematic.
+	 * Check the best victim candidates of the compute domain.
 	 */
-	barrier();
-	nr_cpus = bpf_cpumask_weight(cpumask);
-	bpf_for(i, 0, nr_cpus) {
-		/*
-		 * Decide a CPU ID to examine.
-		 */
-		cpu = bpf_cpumask_any_distribute(cpumask);
-
-		if (cpu >= nr_cpu_ids || cur_cpu == cpu)
+	bpf_for(i, 0, LAVD_VTREE_NR_TRIES) {
+		cpu = vtree_walk_next(cpdomc, &walk);
+		if (cpu < 0)
+			break;
+		if (cpu >= nr_cpu_ids || cpu == cur_cpu ||
+		    !bpf_cpumask_test_cpu(cpu, cpumask))
 			continue;
 
-		/*
-		 * Check whether that CPU is qualified to run @p.
-		 */
 		cpuc = get_cpu_ctx_id(cpu);
 		if (!cpuc) {
 			scx_bpf_error("Failed to lookup cpu_ctx: %d", cpu);
 			goto null_out;
 		}
 
-		if (!can_cpu_be_kicked(now, cpuc))
-			continue;
-
-		/*
-		 * If that CPU runs a lower priority task, that's a victim
-		 * candidate.
-		 *
-		 * Note that a task running on cpu 2 (prm_cpus[v]) cannot
-		 * be a lock holder.
-		 */
-		ret = can_cpu1_kick_cpu2(&prm_task, &prm_cpus[v], cpuc);
-		if (ret == true && ++v >= 2)
-			break;
+		if (can_cpu_be_kicked(now, cpuc) &&
+		    can_cpu1_kick_cpu2(&prm_task, &prm_cpu, cpuc)) {
+			victim_cpu = &prm_cpu;
+			goto bingo_out;
+		}
 	}
 
-	/*
-	 * Choose a final victim CPU.
-	 */
-	switch(v) {
-	case 2:	/* two candidates */
-		victim_cpu = can_task1_kick_task2(&prm_cpus[0], &prm_cpus[1]) ?
-				&prm_cpus[0] : &prm_cpus[1];
-		goto bingo_out;
-	case 1:	/* one candidate */
-		victim_cpu = &prm_cpus[0];
-		goto bingo_out;
-	case 0:	/* no candidate */
-		goto null_out;
-	default:/* something wrong */
-		goto null_out;
-	}
+null_out:
+	taskc->victim_cpu = (s32)LAVD_CPU_ID_NONE;
+	return NULL;
 
 bingo_out:
 	taskc->victim_cpu = victim_cpu->cpuc->cpu_id;
 	*p_old_last_kick_clk = victim_cpu->last_kick_clk;
 	return victim_cpu->cpuc;
-
-null_out:
-	taskc->victim_cpu = (s32)LAVD_CPU_ID_NONE;
-	return NULL;
 }
 
 static bool try_kick_cpu(struct cpu_ctx *victim_cpuc, u64 victim_last_kick_clk)
@@ -249,8 +369,10 @@ static bool try_kick_cpu(struct cpu_ctx *victim_cpuc, u64 victim_last_kick_clk)
 	/*
 	 * Kick the remote CPU for preemption.
 	 */
-	if (ret)
+	if (ret) {
+		WRITE_ONCE(victim_cpuc->vkick_pending, true);
 		scx_bpf_kick_cpu(victim_cpuc->cpu_id, SCX_KICK_PREEMPT);
+	}
 
 	return ret;
 }
@@ -280,13 +402,19 @@ static bool try_find_and_kick_victim_cpu(struct task_struct *p,
 	/*
 	 * Find a victim CPU among CPUs that run lower-priority tasks.
 	 */
-	victim_cpuc = find_victim_cpu(cast_mask(cpumask), taskc, &victim_last_kick_clk);
+	victim_cpuc = find_victim_cpu(cast_mask(cpumask), cpdomc, taskc,
+				      &victim_last_kick_clk);
 
 	/*
 	 * If a victim CPU is chosen, preempt the victim by kicking it.
 	 */
-	if (victim_cpuc)
+	if (victim_cpuc) {
 		ret = try_kick_cpu(victim_cpuc, victim_last_kick_clk);
+		if (ret)
+			trace_task(LAVD_TRACE_PREEMPT_KICK, p, taskc,
+				   victim_cpuc->cpu_id,
+				   victim_cpuc == cpuc_cur);
+	}
 
 	if (!ret)
 		taskc->victim_cpu = (s32)LAVD_CPU_ID_NONE;
@@ -45,6 +45,10 @@ struct sys_stat_ctx {
 	u32		nr_pc_on_big;
 	u32		nr_lc_on_big;
 	u64		nr_lhp;
+	u64		nr_lh_boosted;
+	u64		lh_boosted_run_ns;
+	u64		nr_vkick;
+	u64		nr_vkick_hit;
 	u64		min_perf_cri;
 	u64		avg_perf_cri;
 	u64		max_perf_cri;
@@ -110,6 +114,18 @@ static void collect_sys_stat(struct sys_stat_ctx *c)
 		c->nr_lhp += cpuc->nr_lhp;
 		cpuc->nr_lhp = 0;
 
+		c->nr_lh_boosted += cpuc->nr_lh_boosted;
+		cpuc->nr_lh_boosted = 0;
+
+		c->lh_boosted_run_ns += cpuc->lh_boosted_run_ns;
+		cpuc->lh_boosted_run_ns = 0;
+
+		c->nr_vkick += cpuc->nr_vkick;
+		cpuc->nr_vkick = 0;
+
+		c->nr_vkick_hit += cpuc->nr_vkick_hit;
+		cpuc->nr_vkick_hit = 0;
+
 		/*
 		 * Accumulate task's latency criticlity information.
 		 *
@@ -184,7 +200,7 @@ static void collect_sys_stat(struct sys_stat_ctx *c)
 		cpuc->idle_total = 0;
 	}
  
-	bpf_for(dsq_id, 0, LAVD_CPDOM_MAX_NR) {
+	bpf_for(dsq_id, 0, nr_cpdoms) {
 		nr = scx_bpf_dsq_nr_queued(dsq_id);
 		if (nr > 0)
 			c->nr_queued_task += nr;
@@ -276,6 +292,10 @@ static void update_sys_stat_next(struct sys_stat_ctx *c)
 		stat_next->nr_pc_on_big >>= 1;
 		stat_next->nr_lc_on_big >>= 1;
 		stat_next->nr_lhp >>= 1;
+		stat_next->nr_lh_boosted >>= 1;
+		stat_next->lh_boosted_run_ns >>= 1;
+		stat_next->nr_vkick >>= 1;
+		stat_next->nr_vkick_hit >>= 1;
 
 		__sync_fetch_and_sub(&performance_mode_ns, performance_mode_ns/2);
 		__sync_fetch_and_sub(&balanced_mode_ns, balanced_mode_ns/2);
@@ -292,6 +312,10 @@ static void update_sys_stat_next(struct sys_stat_ctx *c)
 	stat_next->nr_pc_on_big += c->nr_pc_on_big;
 	stat_next->nr_lc_on_big += c->nr_lc_on_big;
 	stat_next->nr_lhp += c->nr_lhp;
+	stat_next->nr_lh_boosted += c->nr_lh_boosted;
+	stat_next->lh_boosted_run_ns += c->lh_boosted_run_ns;
+	stat_next->nr_vkick += c->nr_vkick;
+	stat_next->nr_vkick_hit += c->nr_vkick_hit;
 
 	update_power_mode_time();
 }
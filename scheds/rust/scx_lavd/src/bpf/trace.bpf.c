@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2026 sched_ext contributors
+ */
+
+/*
+ * To be included to the main.bpf.c
+ */
+
+/*
+ * Binary scheduling trace
+ *
+ * Each scheduling event is appended as a 24-byte record to a per-CPU batch.
+ * The batch is copied to the trace_msg ring buffer when it becomes full or
+ * when the next event arrives more than LAVD_TRACE_FLUSH_NS after the
+ * previous one. Hence, the shared ring buffer is reserved only once every
+ * LAVD_TRACE_BATCH_NR events in the common case, and a record's timestamp
+ * always fits in 32 bits as a delta from the previous record.
+ *
+ * The ring buffer is sized by the user space at load time according to the
+ * number of CPUs. When trace_on is false, the verifier prunes all the
+ * trace_*() calls as dead code, so the trace mode costs nothing unless it is
+ * enabled.
+ */
+const volatile bool	trace_on;
+
+struct {
+	__uint(type, BPF_MAP_TYPE_RINGBUF);
+	__uint(max_entries, 4096 /* resized at load time */);
+} trace_msg SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, u32);
+	__type(value, struct trace_buf);
+	__uint(max_entries, 1);
+} trace_buf_stor SEC(".maps");
+
+static void flush_trace_buf(struct trace_buf *tb)
+{
+	u32 nr = tb->batch.hdr.nr_events;
+	u64 sz;
+
+	if (nr == 0)
+		return;
+	if (nr > LAVD_TRACE_BATCH_NR)
+		nr = LAVD_TRACE_BATCH_NR;
+
+	/*
+	 * Copy only the valid records. If the ring buffer is full, the
+	 * user space is falling behind, so just count the lost records.
+	 */
+	sz = sizeof(tb->batch.hdr) + nr * sizeof(struct trace_rec);
+	if (bpf_ringbuf_output(&trace_msg, &tb->batch, sz, 0))
+		tb->nr_drops += nr;
+
+	tb->batch.hdr.nr_events = 0;
+}
+
+static void trace_event(u8 kind, u32 pid, u32 lat_cri, u64 arg, u32 aux)
+{
+	struct trace_rec *ev;
+	struct trace_buf *tb;
+	u32 zero = 0, nr;
+	u64 now;
+
+	if (!trace_on)
+		return;
+
+	tb = bpf_map_lookup_elem(&trace_buf_stor, &zero);
+	if (!tb)
+		return;
+
+	/*
+	 * Flush a stale batch first so ts_delta never overflows.
+	 */
+	now = bpf_ktime_get_ns();
+	if (tb->batch.hdr.nr_events &&
+	    (now - tb->last_clk) > LAVD_TRACE_FLUSH_NS)
+		flush_trace_buf(tb);
+
+	nr = tb->batch.hdr.nr_events;
+	if (nr == 0) {
+		tb->batch.hdr.base_clk = now;
+		tb->batch.hdr.cpu_id = bpf_get_smp_processor_id();
+		tb->last_clk = now;
+	}
+	if (nr >= LAVD_TRACE_BATCH_NR)
+		return;
+
+	ev = &tb->batch.events[nr];
+	ev->ts_delta = now - tb->last_clk;
+	ev->pid = pid;
+	ev->arg = arg;
+	ev->lat_cri = min(lat_cri, 0xffff);
+	ev->kind = kind;
+	ev->aux = aux;
+
+	tb->last_clk = now;
+	tb->batch.hdr.nr_events = ++nr;
+	tb->nr_events++;
+
+	if (nr >= LAVD_TRACE_BATCH_NR)
+		flush_trace_buf(tb);
+
+	/*
+	 * Measure the recording cost once in a while. The sampling period is
+	 * prime, so the samples cover the full and non-full cases in
+	 * proportion and their average is the amortized per-event cost.
+	 */
+	if (!(tb->nr_events % LAVD_TRACE_COST_SAMPLE)) {
+		tb->cost_ns += bpf_ktime_get_ns() - now;
+		tb->nr_cost_samples++;
+	}
+}
+
+static void trace_task(u8 kind, struct task_struct *p, struct task_ctx *taskc,
+		       u64 arg, u32 aux)
+{
+	trace_event(kind, p->pid, taskc->lat_cri, arg, aux);
+}
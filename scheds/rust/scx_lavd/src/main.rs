@@ -12,9 +12,11 @@ pub mod bpf_intf;
 pub use bpf_intf::*;
 
 mod stats;
+mod trace;
 use std::cell::Cell;
 use std::cell::RefCell;
 use std::collections::BTreeMap;
+use std::collections::HashSet;
 use std::ffi::c_int;
 use std::ffi::CStr;
 use std::fmt;
@@ -50,6 +52,7 @@ use log::warn;
 use plain::Plain;
 use scx_stats::prelude::*;
 use scx_utils::build_id;
+use scx_utils::compat;
 use scx_utils::import_enums;
 use scx_utils::scx_enums;
 use scx_utils::scx_ops_attach;
@@ -66,6 +69,7 @@ use stats::SchedSamples;
 use stats::StatsReq;
 use stats::StatsRes;
 use stats::SysStats;
+use trace::TraceWriter;
 
 /// scx_lavd: Latency-criticality Aware Virtual Deadline (LAVD) scheduler
 ///
@@ -124,6 +128,11 @@ struct Opts {
     #[clap(long = "no-freq-scaling", action = clap::ArgAction::SetTrue)]
     no_freq_scaling: bool,
 
+    /// Boost holders of kernel mutexes and rw semaphores as well as futexes. This traces the
+    /// kernel lock functions, which adds a small overhead to every lock operation.
+    #[clap(long = "lock-boost-kernel", action = clap::ArgAction::SetTrue)]
+    lock_boost_kernel: bool,
+
     /// Enable stats monitoring with the specified interval.
     #[clap(long)]
     stats: Option<f64>,
@@ -137,6 +146,15 @@ struct Opts {
     #[clap(long)]
     monitor_sched_samples: Option<u64>,
 
+    /// Write a binary trace of scheduling events (enqueue, dispatch, running, stopping,
+    /// preemption kicks, and core compaction) to the specified file. See intf.h for the format.
+    #[clap(long)]
+    trace: Option<String>,
+
+    /// Ring buffer capacity per CPU in KiB for --trace. Increase it if records are dropped.
+    #[clap(long, default_value = "256")]
+    trace_buf_kb: u64,
+
     /// Enable verbose output, including libbpf details. Specify multiple
     /// times to increase verbosity.
     #[clap(short = 'v', long, action = clap::ArgAction::Count)]
@@ -471,10 +489,33 @@ impl FlatTopology {
     }
 }
 
+// The optional kernel lock hooks of lock.bpf.c and their target functions.
+macro_rules! lock_hooks {
+    ($progs: expr) => {
+        [
+            ("mutex_lock", &mut $progs.fexit_mutex_lock),
+            ("mutex_lock_interruptible", &mut $progs.fexit_mutex_lock_interruptible),
+            ("mutex_lock_killable", &mut $progs.fexit_mutex_lock_killable),
+            ("mutex_trylock", &mut $progs.fexit_mutex_trylock),
+            ("mutex_unlock", &mut $progs.fexit_mutex_unlock),
+            ("down_read", &mut $progs.fexit_down_read),
+            ("down_read_killable", &mut $progs.fexit_down_read_killable),
+            ("down_read_trylock", &mut $progs.fexit_down_read_trylock),
+            ("down_write", &mut $progs.fexit_down_write),
+            ("down_write_killable", &mut $progs.fexit_down_write_killable),
+            ("down_write_trylock", &mut $progs.fexit_down_write_trylock),
+            ("up_read", &mut $progs.fexit_up_read),
+            ("up_write", &mut $progs.fexit_up_write),
+        ]
+    };
+}
+
 struct Scheduler<'a> {
     skel: BpfSkel<'a>,
     struct_ops: Option<libbpf_rs::Link>,
+    lock_links: Vec<libbpf_rs::Link>,
     rb_mgr: libbpf_rs::RingBuffer<'static>,
+    tracer: Option<TraceWriter>,
     intrspc: introspec,
     intrspc_rx: Receiver<SchedSample>,
     monitor_tid: Option<ThreadId>,
@@ -509,10 +550,13 @@ impl<'a> Scheduler<'a> {
 
         // Initialize skel according to @opts.
         Self::init_globals(&mut skel, &opts);
+        Self::init_trace(&mut skel, &opts)?;
+        let lock_hooks = Self::init_lock_boost(&mut skel, &opts)?;
 
         // Attach.
         let mut skel = scx_ops_load!(skel, lavd_ops, uei)?;
         let struct_ops = Some(scx_ops_attach!(skel, lavd_ops)?);
+        let lock_links = Self::attach_lock_boost(&mut skel, &lock_hooks);
         let stats_server = StatsServer::new(stats::server_data(*NR_CPU_IDS as u64)).launch()?;
 
         // Build a ring buffer for instrumentation
@@ -526,10 +570,17 @@ impl<'a> Scheduler<'a> {
             .unwrap();
         let rb_mgr = builder.build().unwrap();
 
+        let tracer = match &opts.trace {
+            Some(path) => Some(TraceWriter::start(&skel, path)?),
+            None => None,
+        };
+
         Ok(Self {
             skel,
             struct_ops,
+            lock_links,
             rb_mgr,
+            tracer,
             intrspc: introspec::new(),
             intrspc_rx,
             monitor_tid: None,
@@ -556,6 +607,13 @@ impl<'a> Scheduler<'a> {
         debug!("{:#?}", topo);
 
         // Initialize compute domain contexts
+        if topo.cpdom_map.len() > LAVD_CPDOM_MAX_NR as usize {
+            panic!(
+                "Num compute domains ({}) exceeds maximum of ({})",
+                topo.cpdom_map.len(),
+                LAVD_CPDOM_MAX_NR
+            );
+        }
         for (k, v) in topo.cpdom_map.iter() {
             skel.maps.bss_data.cpdom_ctxs[v.cpdom_id].id = v.cpdom_id as u64;
             skel.maps.bss_data.cpdom_ctxs[v.cpdom_id].alt_id = v.cpdom_alt_id.get() as u64;
@@ -572,14 +630,15 @@ impl<'a> Scheduler<'a> {
                 panic!("The processor topology is too complex to handle in BPF.");
             }
 
+            // Flatten the neighbor map into a steal order sorted by
+            // distance. BPF walks it group by group using nr_neighbors.
+            let mut pos = 0;
             for (k, (_d, neighbors)) in v.neighbor_map.borrow().iter().enumerate() {
-                let nr_neighbors = neighbors.borrow().len() as u8;
-                if nr_neighbors > LAVD_CPDOM_MAX_NR as u8 {
-                    panic!("The processor topology is too complex to handle in BPF.");
-                }
-                skel.maps.bss_data.cpdom_ctxs[v.cpdom_id].nr_neighbors[k] = nr_neighbors;
-                for n in neighbors.borrow().iter() {
-                    skel.maps.bss_data.cpdom_ctxs[v.cpdom_id].neighbor_bits[k] |= 0x1 << n;
+                let neighbors = neighbors.borrow();
+                skel.maps.bss_data.cpdom_ctxs[v.cpdom_id].nr_neighbors[k] = neighbors.len() as u16;
+                for n in neighbors.iter() {
+                    skel.maps.bss_data.cpdom_ctxs[v.cpdom_id].steal_order[pos] = *n as u16;
+                    pos += 1;
                 }
             }
         }
@@ -603,6 +662,65 @@ impl<'a> Scheduler<'a> {
         skel.maps.rodata_data.verbose = opts.verbose;
     }
 
+    fn init_trace(skel: &mut OpenBpfSkel, opts: &Opts) -> Result<()> {
+        // Keep the ring buffer at its minimum size unless tracing.
+        if opts.trace.is_none() {
+            return Ok(());
+        }
+        let sz = trace::ring_size(*NR_CPU_IDS, opts.trace_buf_kb);
+        skel.maps.trace_msg.set_max_entries(sz)?;
+        skel.maps.rodata_data.trace_on = true;
+        Ok(())
+    }
+
+    fn init_lock_boost(skel: &mut OpenBpfSkel, opts: &Opts) -> Result<Vec<&'static str>> {
+        if !opts.lock_boost_kernel {
+            return Ok(vec![]);
+        }
+
+        // Load only the hooks whose target function exists in the running
+        // kernel and its BTF, which fexit needs to load. Lock functions can
+        // be macros depending on the config. The lock counts are reset on
+        // every schedule, so a missing release hook only over-boosts a
+        // holder until then.
+        let mut kallsyms = String::new();
+        File::open("/proc/kallsyms")?.read_to_string(&mut kallsyms)?;
+        let ksyms: HashSet<&str> = kallsyms
+            .lines()
+            .filter_map(|l| l.split_whitespace().nth(2))
+            .collect();
+
+        // Attach the hooks one by one after the scheduler is attached, see
+        // attach_lock_boost().
+        let mut enabled = vec![];
+        for (func, prog) in lock_hooks!(skel.progs) {
+            if ksyms.contains(func) && compat::ksym_exists(func).unwrap_or(false) {
+                let _ = prog.set_autoload(true);
+                let _ = prog.set_autoattach(false);
+                enabled.push(func);
+            } else {
+                warn!("Kernel lock function {} is not traceable.", func);
+            }
+        }
+        Ok(enabled)
+    }
+
+    fn attach_lock_boost(skel: &mut BpfSkel, enabled: &[&str]) -> Vec<libbpf_rs::Link> {
+        // The hooks are optional. A hook failing to attach only loses the
+        // boost for that lock function, so keep running without it.
+        let mut links = vec![];
+        for (func, prog) in lock_hooks!(skel.progs) {
+            if !enabled.contains(&func) {
+                continue;
+            }
+            match prog.attach() {
+                Ok(link) => links.push(link),
+                Err(e) => warn!("Failed to attach kernel lock hook {}: {}", func, e),
+            }
+        }
+        links
+    }
+
     fn get_msg_seq_id() -> u64 {
         static mut MSEQ: u64 = 0;
         unsafe {
@@ -712,8 +830,10 @@ impl<'a> Scheduler<'a> {
                 let nr_active = st.nr_active;
                 let nr_sched = st.nr_sched;
                 let pc_lhp = Self::get_pc(st.nr_lhp, nr_sched);
+                let avg_lh_run_time = st.lh_boosted_run_ns / st.nr_lh_boosted.max(1);
                 let pc_migration = Self::get_pc(st.nr_migration, nr_sched);
                 let pc_preemption = Self::get_pc(st.nr_preemption, nr_sched);
+                let pc_vkick_hit = Self::get_pc(st.nr_vkick_hit, st.nr_vkick);
                 let pc_greedy = Self::get_pc(st.nr_greedy, nr_sched);
                 let pc_pc = Self::get_pc(st.nr_perf_cri, nr_sched);
                 let pc_lc = Self::get_pc(st.nr_lat_cri, nr_sched);
@@ -736,8 +856,10 @@ impl<'a> Scheduler<'a> {
                     nr_active,
                     nr_sched,
                     pc_lhp,
+                    avg_lh_run_time,
                     pc_migration,
                     pc_preemption,
+                    pc_vkick_hit,
                     pc_greedy,
                     pc_pc,
                     pc_lc,
@@ -871,6 +993,10 @@ impl<'a> Scheduler<'a> {
         self.rb_mgr.consume().unwrap();
 
         self.struct_ops.take();
+        self.lock_links.clear();
+        if let Some(mut tracer) = self.tracer.take() {
+            tracer.finish(&self.skel)?;
+        }
         uei_report!(&self.skel, uei)
     }
 }
@@ -37,12 +37,18 @@ pub struct SysStats {
     #[stat(desc = "% lock holder preemption")]
     pub pc_lhp: f64,
 
+    #[stat(desc = "Average runtime per schedule of boosted lock holders")]
+    pub avg_lh_run_time: u64,
+
     #[stat(desc = "% of task migration")]
     pub pc_migration: f64,
 
     #[stat(desc = "% of task preemption")]
     pub pc_preemption: f64,
 
+    #[stat(desc = "% of victim kicks which preempted a running task")]
+    pub pc_vkick_hit: f64,
+
     #[stat(desc = "% of greedy tasks")]
     pub pc_greedy: f64,
 
@@ -78,15 +84,17 @@ impl SysStats {
     pub fn format_header<W: Write>(w: &mut W) -> Result<()> {
         writeln!(
             w,
-            "\x1b[93m| {:8} | {:13} | {:9} | {:9} | {:9} | {:9} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:11} | {:12} | {:12} | {:12} |\x1b[0m",
+            "\x1b[93m| {:8} | {:13} | {:9} | {:9} | {:9} | {:9} | {:9} | {:9} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:11} | {:12} | {:12} | {:12} |\x1b[0m",
             "MSEQ",
             "SVC_TIME",
             "# Q TASK",
             "# ACT CPU",
             "# SCHED",
             "LHP%",
+            "LH_RUN",
             "MIGRATE%",
             "PREEMPT%",
+            "KICK-HIT%",
             "GREEDY%",
             "PERF-CR%",
             "LAT-CR%",
@@ -108,15 +116,17 @@ impl SysStats {
 
         writeln!(
             w,
-            "| {:8} | {:13} | {:9} | {:9} | {:9} | {:9} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:11} | {:12} | {:12} | {:12} |",
+            "| {:8} | {:13} | {:9} | {:9} | {:9} | {:9} | {:9} | {:9} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:11} | {:12} | {:12} | {:12} |",
             self.mseq,
             self.avg_svc_time,
             self.nr_queued_task,
             self.nr_active,
             self.nr_sched,
             GPoint(self.pc_lhp),
+            self.avg_lh_run_time,
             GPoint(self.pc_migration),
             GPoint(self.pc_preemption),
+            GPoint(self.pc_vkick_hit),
             GPoint(self.pc_greedy),
             GPoint(self.pc_pc),
             GPoint(self.pc_lc),
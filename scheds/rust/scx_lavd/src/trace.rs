@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// Copyright (c) 2026 sched_ext contributors
+
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+use std::fs::File;
+use std::io::BufWriter;
+use std::io::Write;
+use std::mem;
+use std::sync::atomic::AtomicBool;
+use std::sync::atomic::Ordering;
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::Duration;
+
+use anyhow::Context;
+use anyhow::Result;
+use libbpf_rs::MapCore;
+use libbpf_rs::MapFlags;
+use libbpf_rs::MapHandle;
+use log::info;
+use log::warn;
+use plain::Plain;
+
+use crate::bpf_intf::*;
+use crate::BpfSkel;
+
+unsafe impl Plain for trace_buf {}
+
+/// Ring buffer size for @nr_cpus CPUs with @kb_per_cpu KiB each. A BPF ring
+/// buffer must be a power-of-two multiple of the page size.
+pub fn ring_size(nr_cpus: usize, kb_per_cpu: u64) -> u32 {
+    let sz = (nr_cpus as u64 * kb_per_cpu * 1024).max(4096);
+    sz.next_power_of_two().min(1 << 31) as u32
+}
+
+/// Drains the trace_msg ring buffer into a file from a dedicated thread so
+/// that a slow disk never stalls the stats loop and vice versa.
+pub struct TraceWriter {
+    path: String,
+    stop: Arc<AtomicBool>,
+    handle: Option<JoinHandle<Result<BufWriter<File>>>>,
+}
+
+impl TraceWriter {
+    pub fn start(skel: &BpfSkel, path: &str) -> Result<Self> {
+        let mut out = BufWriter::with_capacity(1 << 20, File::create(path)?);
+        out.write_all(&LAVD_TRACE_MAGIC[..8])?;
+
+        let map = MapHandle::try_from(&skel.maps.trace_msg)?;
+        let stop = Arc::new(AtomicBool::new(false));
+        let stop_clone = stop.clone();
+
+        let handle = std::thread::spawn(move || -> Result<BufWriter<File>> {
+            let (tx, rx) = std::sync::mpsc::channel::<Vec<u8>>();
+            let mut builder = libbpf_rs::RingBufferBuilder::new();
+            builder.add(&map, move |data: &[u8]| {
+                let _ = tx.send(data.to_vec());
+                0
+            })?;
+            let rb = builder.build()?;
+
+            loop {
+                let done = stop_clone.load(Ordering::Relaxed);
+                rb.poll(Duration::from_millis(100))?;
+                while let Ok(batch) = rx.try_recv() {
+                    out.write_all(&batch)?;
+                }
+                if done {
+                    break;
+                }
+            }
+            Ok(out)
+        });
+
+        info!("Writing a scheduling trace to {}", path);
+        Ok(Self {
+            path: path.to_string(),
+            stop,
+            handle: Some(handle),
+        })
+    }
+
+    /// Stop draining, append the batches still pending on each CPU, and
+    /// report how much the trace cost. Call after the scheduler is detached
+    /// so no more records are produced.
+    pub fn finish(&mut self, skel: &BpfSkel) -> Result<()> {
+        let Some(handle) = self.handle.take() else {
+            return Ok(());
+        };
+        self.stop.store(true, Ordering::Relaxed);
+        let mut out = handle.join().unwrap()?;
+
+        let percpu = skel
+            .maps
+            .trace_buf_stor
+            .lookup_percpu(&0u32.to_ne_bytes(), MapFlags::ANY)
+            .context("Failed to lookup trace_buf_stor")?
+            .unwrap_or_default();
+
+        let (mut nr_events, mut nr_drops) = (0, 0);
+        let (mut cost_ns, mut nr_cost_samples) = (0, 0);
+        for raw in percpu.iter() {
+            let mut tb = unsafe { mem::zeroed::<trace_buf>() };
+            plain::copy_from_bytes(&mut tb, raw).expect("trace_buf is too short");
+
+            let nr = (tb.batch.hdr.nr_events as usize).min(LAVD_TRACE_BATCH_NR as usize);
+            if nr > 0 {
+                let sz = mem::size_of::<trace_batch_hdr>() + nr * mem::size_of::<trace_rec>();
+                out.write_all(&raw[..sz])?;
+            }
+
+            nr_events += tb.nr_events;
+            nr_drops += tb.nr_drops;
+            cost_ns += tb.cost_ns;
+            nr_cost_samples += tb.nr_cost_samples;
+        }
+        out.flush()?;
+
+        let avg_cost = cost_ns as f64 / nr_cost_samples.max(1) as f64;
+        info!(
+            "Trace {}: {} events, {} dropped, {:.1} ns/event (budget {} ns)",
+            self.path, nr_events, nr_drops, avg_cost, LAVD_TRACE_COST_BUDGET_NS
+        );
+        if avg_cost > LAVD_TRACE_COST_BUDGET_NS as f64 {
+            warn!("Tracing exceeded its per-event overhead budget.");
+        }
+        if nr_drops > 0 {
+            warn!("Trace records were dropped. Consider a larger --trace-buf-kb.");
+        }
+        Ok(())
+    }
+}
@@ -41,19 +41,21 @@ static u64 budget_id_to_fallback_dsq(u32 budget_id)
 }
 
 /*
- * Map used for global cost accounting. Can be extended to support NUMA nodes.
+ * Map used for global and per LLC cost accounting. The global account is at
+ * COST_GLOBAL_KEY followed by the LLC accounts. Can be extended to support
+ * NUMA nodes.
  */
 struct {
 	__uint(type, BPF_MAP_TYPE_ARRAY);
 	__type(key, u32);
 	__type(value, struct cost);
-	__uint(max_entries, 1);
+	__uint(max_entries, NR_COST_KEYS);
 	__uint(map_flags, 0);
 } cost_data SEC(".maps");
 
 /*
- * CPU map for cost accounting. When budget is expired it requests budget from
- * global entries.
+ * CPU map for cost accounting. When budget is expired it leases budget from
+ * the LLC entry.
  */
 struct {
 	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
@@ -75,6 +77,11 @@ static __always_inline struct cost *lookup_cost(u32 cost_id)
 	return costc;
 }
 
+static __always_inline u32 llc_cost_key(u32 llc_id)
+{
+	return COST_LLC_KEY_BASE + llc_id;
+}
+
 static __always_inline struct cost *lookup_cpu_cost(s32 cpu)
 {
 	struct cost *costc;
@@ -220,46 +227,76 @@ static __always_inline bool has_preempt_budget(struct cost *costc,
 	return costc->budget[budget_id] > costc->budget[cur_budget];
 }
 
+/*
+ * Leases @amount of @budget_id from @parent. An exhausted @parent is only read,
+ * so CPUs waiting for a refresh don't bounce its cache line. Returns the budget
+ * @parent had before the lease, which was granted if positive.
+ */
+static s64 lease_budget(struct cost *parent, u32 budget_id, s64 amount)
+{
+	s64 *budget, left;
+
+	if (!(budget = MEMBER_VPTR(*parent, .budget[budget_id]))) {
+		scx_bpf_error("invalid budget id %d", budget_id);
+		return 0;
+	}
+
+	if (READ_ONCE(*budget) <= 0)
+		return 0;
+
+	left = __sync_fetch_and_sub(budget, amount);
+	if (left <= 0)
+		__sync_fetch_and_add(budget, amount);
+
+	return left;
+}
+
+/*
+ * Refills an exhausted LLC account from the global one. If that drains the
+ * global account, the refresh timer is kicked instead of refreshing inline.
+ */
+static void refill_llc_budget(struct cost *llc_costc, u32 budget_id)
+{
+	struct cost *global_costc;
+	s64 amount, left;
+
+	if (budget_id >= MAX_GLOBAL_BUDGETS ||
+	    !(global_costc = lookup_cost(COST_GLOBAL_KEY)))
+		return;
+
+	amount = llc_costc->capacity[budget_id];
+	left = lease_budget(global_costc, budget_id, amount);
+	if (left <= 0)
+		return;
+
+	__sync_fetch_and_add(&llc_costc->budget[budget_id], amount);
+
+	if (left <= amount) {
+		trace("COST global budget %d exhausted", budget_id);
+		kick_layered_timer(COST_TIMER);
+	}
+}
+
 /*
  * Refreshes the budget of a cost.
  */
 int refresh_budget(int cost_id)
 {
 	struct cost *costc;
-	s64 capacity;
+	u32 budget_id;
 
 	if (!(costc = lookup_cost(cost_id))) {
 		scx_bpf_error("failed to lookup cost %d", cost_id);
 		return 0;
 	}
 
-	u32 budget_id, id;
-	u32 rotation = bpf_get_smp_processor_id() % nr_layers;
-	bpf_for(id, 0, nr_layers) {
-		budget_id = rotate_layer_id(id, rotation);
-		if (budget_id > nr_layers) {
-			scx_bpf_error("invalid budget id");
-			return 0;
-		}
-		capacity = costc->capacity[budget_id];
-		__sync_lock_test_and_set(MEMBER_VPTR(*costc, .budget[budget_id]),
-					 capacity);
-	}
-	// Hi fallback DSQs
-	bpf_for(id, 0, nr_llcs) {
-		budget_id = fallback_llc_cost_id(id);
-		capacity = costc->capacity[budget_id];
-		__sync_lock_test_and_set(MEMBER_VPTR(*costc, .budget[budget_id]),
-					 capacity);
-	}
-	budget_id = fallback_dsq_cost_id(LO_FALLBACK_DSQ);
-	if (budget_id > MAX_GLOBAL_BUDGETS) {
-		scx_bpf_error("invalid budget");
-		return 0;
+	bpf_for(budget_id, 0, MAX_GLOBAL_BUDGETS) {
+		s64 *budget = MEMBER_VPTR(*costc, .budget[budget_id]);
+
+		if (!budget || !costc->capacity[budget_id])
+			continue;
+		__sync_lock_test_and_set(budget, costc->capacity[budget_id]);
 	}
-	capacity = costc->capacity[budget_id];
-	__sync_lock_test_and_set(MEMBER_VPTR(*costc, .budget[budget_id]),
-				 capacity);
 
 	trace("COST refreshed budget %d", cost_id);
 
@@ -267,68 +304,84 @@ int refresh_budget(int cost_id)
 }
 
 /*
- * Refreshes all budgets for all costs.
+ * Refreshes the global budgets and refills the LLC accounts which ran dry
+ * since the last refresh. Called from COST_TIMER.
  */
-int refresh_budgets(void)
+static bool refresh_budgets(void)
 {
-	refresh_budget(0);
+	struct cost *llc_costc;
+	u32 llc_id, budget_id;
 
-	return 0;
+	refresh_budget(COST_GLOBAL_KEY);
+
+	bpf_for(llc_id, 0, nr_llcs) {
+		if (!(llc_costc = lookup_cost(llc_cost_key(llc_id))))
+			return false;
+
+		bpf_for(budget_id, 0, MAX_GLOBAL_BUDGETS) {
+			if (!llc_costc->capacity[budget_id] ||
+			    READ_ONCE(llc_costc->budget[budget_id]) > 0)
+				continue;
+			refill_llc_budget(llc_costc, budget_id);
+		}
+	}
+
+	return true;
 }
 
 /*
- * Acquires a budget from a parent cost account.
+ * Acquires a budget lease from a parent cost account. Returns the leased amount
+ * or zero if the parent is out of budget until the next refresh.
  */
 s64 acquire_budget(struct cost *costc, u32 budget_id, s64 amount)
 {
-	s64 budget = 0;
+	struct cost *parent_cost;
+	s64 left;
 
 	if (budget_id >= MAX_GLOBAL_BUDGETS) {
 		scx_bpf_error("invalid parent cost");
-		return budget;
+		return 0;
 	}
 
 	if (!costc || !costc->has_parent)
-		return budget;
+		return 0;
 
-	struct cost *parent_cost;
 	if (!(parent_cost = lookup_cost(costc->idx))) {
 		scx_bpf_error("failed to find parent");
-		return budget;
+		return 0;
 	}
 
-	__sync_fetch_and_sub(&parent_cost->budget[budget_id], amount);
+	left = lease_budget(parent_cost, budget_id, amount);
+	if (left <= 0)
+		return 0;
 
-	if (parent_cost->budget[budget_id] <= 0)
-		refresh_budgets();
+	/* this lease drained the LLC, refill it for the next one */
+	if (left <= amount && parent_cost->has_parent)
+		refill_llc_budget(parent_cost, budget_id);
 
 	return amount;
 }
 
 /*
  * Records the cost to the CPU budget. If the CPU is out of cost the CPU will
- * acquire budget by either retrieving budget from the global context or
- * refreshing all budgets.
+ * lease budget from its LLC. The CPU account is only charged from its own CPU,
+ * so it's updated without atomics; other CPUs only read it.
  */
 int record_cpu_cost(struct cost *costc, u32 budget_id, s64 amount, u64 slice_ns)
 {
+	s64 lease;
+
 	if (budget_id > MAX_GLOBAL_BUDGETS || !costc) {
 		scx_bpf_error("invalid budget %d", budget_id);
 		return 0;
 	}
 
-	__sync_fetch_and_sub(&costc->budget[budget_id], amount);
+	costc->budget[budget_id] -= amount;
 
-	if (costc->budget[budget_id] <= 0 ||
-	    costc->budget[budget_id] < slice_ns) {
-		if (costc->has_parent) {
-			s64 req_budget = costc->capacity[budget_id] - costc->budget[budget_id];
-			s64 budget = acquire_budget(costc, budget_id, req_budget);
-			if (budget > 0) {
-				__sync_fetch_and_add(&costc->budget[budget_id],
-						     costc->capacity[budget_id]);
-			}
-		}
+	if (costc->budget[budget_id] < (s64)slice_ns && costc->has_parent) {
+		lease = costc->capacity[budget_id] - costc->budget[budget_id];
+		if (acquire_budget(costc, budget_id, lease) > 0)
+			costc->budget[budget_id] += lease;
 	}
 	calc_preferred_cost(costc);
 
@@ -403,11 +456,9 @@ static void initialize_budgets(u64 refresh_intvl_ns)
 		trace("COST GLOBAL[%d][%s] budget %lld",
 		      layer_id, layer->name, global_costc->budget[layer_id]);
 
-		// TODO: add L3 budgets for topology awareness
-
 		bpf_for(cpu, 0, nr_possible_cpus) {
-			costc = initialize_cost(cpu, COST_GLOBAL_KEY, true,
-						true, false);
+			costc = initialize_cost(cpu, llc_cost_key(__cpu_to_llc_id(cpu)),
+						true, true, false);
 			if (!costc) {
 				scx_bpf_error("failed to cpu budget: %d", cpu);
 				return;
@@ -461,4 +512,31 @@ static void initialize_budgets(u64 refresh_intvl_ns)
 				      cpu, budget_id, costc->budget[budget_id]);
 		}
 	}
+
+	/*
+	 * Each LLC account holds the global budgets scaled down to its share of
+	 * the CPUs, so that the LLCs together drain the global account once per
+	 * refresh interval.
+	 */
+	bpf_for(llc_id, 0, nr_llcs) {
+		u32 nr_llc_cpus = 0;
+
+		bpf_for(cpu, 0, nr_possible_cpus)
+			if (__cpu_to_llc_id(cpu) == llc_id)
+				nr_llc_cpus++;
+
+		costc = initialize_cost(llc_cost_key(llc_id), COST_GLOBAL_KEY,
+					false, true, false);
+		if (!costc) {
+			scx_bpf_error("failed to initialize llc budget: %d", llc_id);
+			return;
+		}
+
+		bpf_for(budget_id, 0, MAX_GLOBAL_BUDGETS) {
+			s64 capacity = global_costc->capacity[budget_id];
+
+			initialize_budget(costc, budget_id,
+					  capacity * nr_llc_cpus / nr_possible_cpus);
+		}
+	}
 }
@@ -15,6 +15,8 @@
 
 enum cost_consts {
 	COST_GLOBAL_KEY		= 0,
+	COST_LLC_KEY_BASE	= 1,
+	NR_COST_KEYS		= COST_LLC_KEY_BASE + MAX_LLCS,
 	HI_FALLBACK_DSQ_WEIGHT	= 95,
 	LO_FALLBACK_DSQ_WEIGHT	= 85,
 
@@ -28,9 +30,13 @@ enum cost_consts {
 	MAX_GLOBAL_BUDGETS	= MAX_LLCS + MAX_LAYERS + 1,
 };
 
+/* interval at which the global budgets are refreshed */
+#define COST_REFRESH_NS		(15LLU * NSEC_PER_SEC)
+
 /*
- * Cost accounting struct that is used in both the per CPU and global context.
- * Budgets are allowed to recurse to parent structs.
+ * Cost accounting struct that is used in the per CPU, per LLC and global
+ * context. CPUs lease budget from their LLC and LLCs from the global account,
+ * which is refreshed by COST_TIMER. @idx is the key of the parent account.
  */
 struct cost {
 	s64		budget[MAX_GLOBAL_BUDGETS];
@@ -16,6 +16,7 @@
 #ifndef __KERNEL__
 typedef int s32;
 typedef long long s64;
+typedef unsigned short u16;
 typedef unsigned u32;
 typedef unsigned long long u64;
 #endif
@@ -36,9 +37,14 @@ enum consts {
 	MAX_NUMA_NODES		= 64,
 	MAX_LLCS		= 64,
 	MAX_COMM		= 16,
-	MAX_LAYER_MATCH_ORS	= 32,
 	MAX_LAYER_NAME		= 64,
 	MAX_LAYERS		= 16,
+	MAX_LAYER_MATCH_ORS	= 32,
+	MAX_MATCH_CLAUSES	= MAX_LAYERS * MAX_LAYER_MATCH_ORS,
+	MATCH_SET_WORDS		= MAX_MATCH_CLAUSES / 64,
+	MAX_MATCH_NODES		= 16384,
+	MATCH_COMP_LEN		= 256,		/* NAME_MAX + 1 */
+	MATCH_TAIL_LONG		= 63,
 	MAX_LAYER_WEIGHT	= 10000,
 	MIN_LAYER_WEIGHT	= 1,
 	DEFAULT_LAYER_WEIGHT	= 100,
@@ -165,6 +171,53 @@ struct layer_match_ands {
 	int			nr_match_ands;
 };
 
+/*
+ * Compiled layer matching
+ *
+ * Userspace compiles the layer specs into the structures below (see
+ * layer_match.rs). Each OR clause of each layer is a bit in a match_set,
+ * numbered layer_idx * MAX_LAYER_MATCH_ORS + or_idx, so the lowest set bit is
+ * the first matching clause in layer order.
+ *
+ * Cgroup prefixes form a trie over path components keyed by the parent node
+ * and the FNV-1a hash of the component. A prefix ending in the middle of a
+ * component is a partial entry under its parent, and the parent's tail_lens
+ * tells at which lengths the next component should be probed for one. Comm
+ * prefixes are partial entries under node 0. The ID matches are keyed by the
+ * ID itself. Prefix entries carry their string which is compared on a hit, so
+ * that a name colliding with a configured one doesn't match.
+ */
+#define MATCH_FNV_OFFSET	0xcbf29ce484222325ULL
+#define MATCH_FNV_PRIME		0x100000001b3ULL
+
+struct match_set {
+	u64			bits[MATCH_SET_WORDS];
+};
+
+struct match_key {
+	u64			hash;
+	u32			node;
+	u16			kind;
+	u16			partial;
+};
+
+struct match_node {
+	struct match_set	clauses;
+	u64			tail_lens;
+	u32			id;
+	u16			len;
+	char			str[MATCH_COMP_LEN];
+};
+
+struct match_index {
+	/* clauses which don't constrain the kind or are always true for it */
+	struct match_set	free[NR_LAYER_MATCH_KINDS];
+	/* clauses with matches which must be evaluated per task */
+	struct match_set	residual;
+	/* tail_lens of node 0 for each prefix kind */
+	u64			tail_lens[NR_LAYER_MATCH_KINDS];
+};
+
 enum layer_growth_algo {
 	GROWTH_ALGO_STICKY,
 	GROWTH_ALGO_LINEAR,
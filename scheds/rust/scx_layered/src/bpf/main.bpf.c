@@ -6,9 +6,11 @@
 #define LSP_INC
 #include "../../../../include/scx/common.bpf.h"
 #include "../../../../include/scx/ravg_impl.bpf.h"
+#include "../../../../include/scx/hist_impl.bpf.h"
 #else
 #include <scx/common.bpf.h>
 #include <scx/ravg_impl.bpf.h>
+#include <scx/hist_impl.bpf.h>
 #endif
 
 #include "intf.h"
@@ -331,6 +333,12 @@ static struct cpumask *lookup_layer_cpumask(int idx)
 	}
 }
 
+/*
+ * Bumped whenever any layer's cpumask changes so that the CPUs refresh their
+ * dispatch orders, see refresh_dispatch_order().
+ */
+u64 dispatch_order_seq;
+
 /*
  * Returns if any cpus were added to the layer.
  */
@@ -380,6 +388,7 @@ static bool refresh_cpumasks(int idx)
 
 	layer->nr_cpus = total;
 	__sync_fetch_and_add(&layer->cpus_seq, 1);
+	__sync_fetch_and_add(&dispatch_order_seq, 1);
 	trace("LAYER[%d] now has %d cpus, seq=%llu", idx, layer->nr_cpus, layer->cpus_seq);
 	return total > 0;
 }
@@ -1462,99 +1471,172 @@ void layered_dispatch_no_topo(s32 cpu, struct task_struct *prev)
 	scx_bpf_consume(LO_FALLBACK_DSQ);
 }
 
-__weak int consume_preempting(struct cost *costc, u32 my_llc_id)
+/*
+ * Per-CPU dispatch order
+ *
+ * The layer DSQs a CPU consumes from only depend on the layer configs, the
+ * layer cpumasks and the CPU's LLC. Each CPU keeps each layer's LLC DSQs
+ * ordered by distance from its own LLC, which never changes and is built on
+ * the first dispatch, and a mask of the layers in each group. A layer's group
+ * bits are recomputed when its cpus_seq changes, all of them when fallback_cpu
+ * changes, and dispatch_order_seq tells whether any layer needs a look at all.
+ * Dispatching is then a walk over the lists which only checks the dynamic
+ * layer budgets.
+ */
+enum dispatch_group {
+	DGRP_PREEMPT,		/* preempting layers */
+	DGRP_NON_OPEN,		/* layers whose cpumask includes the CPU */
+	DGRP_OPEN,		/* !preempting open layers */
+	NR_DGRPS,
+};
+
+struct dispatch_order {
+	u64			seq;
+	u64			layer_seq[MAX_LAYERS];
+	u32			fallback_cpu;
+	bool			built;
+	u32			layer_mask[NR_DGRPS];
+	u16			dsq_ids[MAX_LAYERS][MAX_LLCS];
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, u32);
+	__type(value, struct dispatch_order);
+	__uint(max_entries, 1);
+} dispatch_orders SEC(".maps");
+
+SCX_HIST_DEFINE(dispatch_lat_hist, 1);
+
+static bool dispatch_group_has_layer(u32 grp, struct layer *layer,
+				     u32 layer_idx, s32 cpu)
 {
-	struct layer *layer;
-	u64 dsq_id;
-	u32 idx, llc_idx, layer_idx;
+	struct cpumask *layer_cpumask;
 
-	if (!costc)
-		return -EINVAL;
+	switch (grp) {
+	case DGRP_PREEMPT:
+		return layer->preempt;
+	case DGRP_NON_OPEN:
+		if (!(layer_cpumask = lookup_layer_cpumask(layer_idx)))
+			return false;
+		return bpf_cpumask_test_cpu(cpu, layer_cpumask) ||
+			(cpu == fallback_cpu && layer->nr_cpus == 0);
+	case DGRP_OPEN:
+		return !layer->preempt && layer->kind != LAYER_KIND_CONFINED;
+	default:
+		return false;
+	}
+}
 
-	bpf_for(idx, 0, nr_layers) {
-		layer_idx = rotate_layer_id(costc->pref_layer, idx);
-		if (layer_idx >= nr_layers) {
-			scx_bpf_error("can't happen");
-			return -EINVAL;
-		}
-		layer = MEMBER_VPTR(layers, [layer_idx]);
-		if (!layer->preempt || has_budget(costc, layer) == 0)
-			continue;
+static void build_dispatch_dsqs(struct dispatch_order *order, s32 cpu)
+{
+	u32 my_llc_id = cpu_to_llc_id(cpu);
+	u32 layer_idx, llc_idx;
 
+	bpf_for(layer_idx, 0, nr_layers) {
 		bpf_for(llc_idx, 0, nr_llcs) {
-			u32 llc_id = rotate_llc_id(my_llc_id, llc_idx);
-			dsq_id = layer_dsq_id(layer_idx, llc_id);
-			if (scx_bpf_consume(dsq_id))
-				return 0;
+			u16 *dsq_id;
+
+			if (!(dsq_id = MEMBER_VPTR(*order, .dsq_ids[layer_idx][llc_idx]))) {
+				scx_bpf_error("can't happen");
+				return;
+			}
+			*dsq_id = layer_dsq_id(layer_idx,
+					       rotate_llc_id(my_llc_id, llc_idx));
 		}
 	}
-
-	return -ENOENT;
+	order->built = true;
 }
 
-__weak int consume_non_open(struct cost *costc, s32 cpu, u32 my_llc_id)
+static void refresh_dispatch_order(struct dispatch_order *order, s32 cpu, u64 seq)
 {
-	struct layer *layer;
-	u64 dsq_id;
-	u32 idx, llc_idx, layer_idx;
+	bool all = !order->built || order->fallback_cpu != fallback_cpu;
+	u32 layer_idx, grp;
 
-	if (!costc)
-		return -EINVAL;
+	if (!order->built)
+		build_dispatch_dsqs(order, cpu);
 
-	bpf_for(idx, 0, nr_layers) {
-		layer_idx = rotate_layer_id(costc->pref_layer, idx);
-		if (layer_idx >= nr_layers) {
+	bpf_for(layer_idx, 0, nr_layers) {
+		struct layer *layer;
+		u64 *layer_seq, cpus_seq;
+
+		if (!(layer = MEMBER_VPTR(layers, [layer_idx])) ||
+		    !(layer_seq = MEMBER_VPTR(*order, .layer_seq[layer_idx]))) {
 			scx_bpf_error("can't happen");
-			return -EINVAL;
+			return;
 		}
-		layer = MEMBER_VPTR(layers, [layer_idx]);
-		if (has_budget(costc, layer) == 0)
-			continue;
 
-		struct cpumask *layer_cpumask;
-		if (!(layer_cpumask = lookup_layer_cpumask(layer_idx)))
-			return -ENOENT;
-		if (!bpf_cpumask_test_cpu(cpu, layer_cpumask) &&
-		    (cpu > nr_possible_cpus || cpu != fallback_cpu || layer->nr_cpus != 0))
+		cpus_seq = READ_ONCE(layer->cpus_seq);
+		if (!all && *layer_seq == cpus_seq)
 			continue;
+		*layer_seq = cpus_seq;
 
-		bpf_for(llc_idx, 0, nr_llcs) {
-			u32 llc_id = rotate_llc_id(my_llc_id, llc_idx);
-			dsq_id = layer_dsq_id(layer_idx, llc_id);
-
-			if (scx_bpf_consume(dsq_id))
-				return 0;
+		bpf_for(grp, 0, NR_DGRPS) {
+			if (grp >= NR_DGRPS)
+				break;
+			if (dispatch_group_has_layer(grp, layer, layer_idx, cpu))
+				order->layer_mask[grp] |= 1 << layer_idx;
+			else
+				order->layer_mask[grp] &= ~(1 << layer_idx);
 		}
+		trace("DISPATCH cpu%d layer%d order refreshed seq=%llu",
+		      cpu, layer_idx, cpus_seq);
 	}
 
-	return -ENOENT;
+	order->fallback_cpu = fallback_cpu;
+	order->seq = seq;
 }
 
-__weak int consume_open_no_preempt(struct cost *costc, u32 my_llc_id)
+static struct dispatch_order *lookup_dispatch_order(s32 cpu)
 {
-	struct layer *layer;
-	u64 dsq_id;
-	u32 idx, llc_idx, layer_idx;
+	struct dispatch_order *order;
+	u32 zero = 0;
+	u64 seq;
+
+	if (!(order = bpf_map_lookup_elem(&dispatch_orders, &zero))) {
+		scx_bpf_error("dispatch_order lookup failed");
+		return NULL;
+	}
+
+	seq = READ_ONCE(dispatch_order_seq);
+	if (!order->built || order->seq != seq ||
+	    order->fallback_cpu != fallback_cpu)
+		refresh_dispatch_order(order, cpu, seq);
 
-	if (!costc)
+	return order;
+}
+
+/*
+ * Consume from the first DSQ of the layers in @grp which has a task and whose
+ * layer has budget, starting from costc->pref_layer.
+ */
+static __noinline int consume_dispatch_group(struct dispatch_order *order,
+					     struct cost *costc, u32 grp)
+{
+	u32 idx, layer_idx, llc_idx, mask;
+
+	if (!order || !costc || grp >= NR_DGRPS)
 		return -EINVAL;
 
+	mask = order->layer_mask[grp];
+
 	bpf_for(idx, 0, nr_layers) {
+		struct layer *layer;
+
 		layer_idx = rotate_layer_id(costc->pref_layer, idx);
-		if (layer_idx >= nr_layers) {
-			scx_bpf_error("can't happen");
+		if (layer_idx >= MAX_LAYERS ||
+		    !(layer = MEMBER_VPTR(layers, [layer_idx])))
 			return -EINVAL;
-		}
-		layer = MEMBER_VPTR(layers, [layer_idx]);
-		if (has_budget(costc, layer) == 0)
-			continue;
-		if (layer->preempt || layer->kind == LAYER_KIND_CONFINED)
+
+		if (!(mask & (1 << layer_idx)) || !has_budget(costc, layer))
 			continue;
+
 		bpf_for(llc_idx, 0, nr_llcs) {
-			u32 llc_id = rotate_llc_id(my_llc_id, llc_idx);
-			dsq_id = layer_dsq_id(layer_idx, llc_id);
+			u16 *dsq_id;
 
-			if (scx_bpf_consume(dsq_id))
+			if (!(dsq_id = MEMBER_VPTR(*order, .dsq_ids[layer_idx][llc_idx])))
+				return -EINVAL;
+			if (scx_bpf_consume(*dsq_id))
 				return 0;
 		}
 	}
@@ -1562,11 +1644,9 @@ __weak int consume_open_no_preempt(struct cost *costc, u32 my_llc_id)
 	return -ENOENT;
 }
 
-void BPF_STRUCT_OPS(layered_dispatch, s32 cpu, struct task_struct *prev)
+static void layered_dispatch_topo(s32 cpu, struct task_struct *prev)
 {
-	if (disable_topology)
-		return layered_dispatch_no_topo(cpu, prev);
-
+	struct dispatch_order *order;
 	struct cpu_ctx *cctx, *sib_cctx;
 	struct cost *costc;
 	u64 dsq_id;
@@ -1605,7 +1685,8 @@ void BPF_STRUCT_OPS(layered_dispatch, s32 cpu, struct task_struct *prev)
 		return;
 	}
 
-	u32 my_llc_id = cpu_to_llc_id(cpu);
+	if (!(order = lookup_dispatch_order(cpu)))
+		return;
 
 	/*
 	 * If one of the fallback DSQs has the most budget then consume from it
@@ -1621,7 +1702,7 @@ void BPF_STRUCT_OPS(layered_dispatch, s32 cpu, struct task_struct *prev)
 	}
 
 	/* consume preempting layers first */
-	if (consume_preempting(costc, my_llc_id) == 0)
+	if (consume_dispatch_group(order, costc, DGRP_PREEMPT) == 0)
 		return;
 
 	dsq_id = cpu_hi_fallback_dsq_id(cpu);
@@ -1629,156 +1710,152 @@ void BPF_STRUCT_OPS(layered_dispatch, s32 cpu, struct task_struct *prev)
 		return;
 
 	/* consume !open layers second */
-	if (consume_non_open(costc, cpu, my_llc_id) == 0)
+	if (consume_dispatch_group(order, costc, DGRP_NON_OPEN) == 0)
 		return;
 
 	/* consume !preempting open layers */
-	if (consume_open_no_preempt(costc, my_llc_id) == 0)
+	if (consume_dispatch_group(order, costc, DGRP_OPEN) == 0)
 		return;
 
 	scx_bpf_consume(LO_FALLBACK_DSQ);
 }
 
-static __noinline bool match_one(struct layer_match *match,
-				 struct task_struct *p, const char *cgrp_path)
+void BPF_STRUCT_OPS(layered_dispatch, s32 cpu, struct task_struct *prev)
 {
-	bool result = false;
-	const struct cred *cred;
+	u64 started_at = bpf_ktime_get_ns();
 
-	switch (match->kind) {
-	case MATCH_CGROUP_PREFIX: {
-		return match_prefix(match->cgroup_prefix, cgrp_path, MAX_PATH);
-	}
-	case MATCH_COMM_PREFIX: {
-		char comm[MAX_COMM];
-		memcpy(comm, p->comm, MAX_COMM);
-		return match_prefix(match->comm_prefix, comm, MAX_COMM);
-	}
-	case MATCH_PCOMM_PREFIX: {
-		char pcomm[MAX_COMM];
+	if (disable_topology)
+		layered_dispatch_no_topo(cpu, prev);
+	else
+		layered_dispatch_topo(cpu, prev);
 
-		memcpy(pcomm, p->group_leader->comm, MAX_COMM);
-		return match_prefix(match->pcomm_prefix, pcomm, MAX_COMM);
-	}
+	scx_hist_record(&dispatch_lat_hist, 0, bpf_ktime_get_ns() - started_at);
+}
+
+/*
+ * Everything but the nice comparisons is resolved by the match index, see
+ * match_task_layer().
+ */
+static bool match_residual_one(struct layer_match *match, struct task_struct *p)
+{
+	s32 nice = prio_to_nice((s32)p->static_prio);
+
+	switch (match->kind) {
 	case MATCH_NICE_ABOVE:
-		return prio_to_nice((s32)p->static_prio) > match->nice;
+		return nice > match->nice;
 	case MATCH_NICE_BELOW:
-		return prio_to_nice((s32)p->static_prio) < match->nice;
+		return nice < match->nice;
 	case MATCH_NICE_EQUALS:
-		return prio_to_nice((s32)p->static_prio) == match->nice;
-	case MATCH_USER_ID_EQUALS:
-		bpf_rcu_read_lock();
-		cred = p->real_cred;
-		if (cred)
-			result = cred->euid.val == match->user_id;
-		bpf_rcu_read_unlock();
-		return result;
-	case MATCH_GROUP_ID_EQUALS:
-		bpf_rcu_read_lock();
-		cred = p->real_cred;
-		if (cred)
-			result = cred->egid.val == match->group_id;
-		bpf_rcu_read_unlock();
-		return result;
-	case MATCH_PID_EQUALS:
-		return p->pid == match->pid;
-	case MATCH_PPID_EQUALS:
-		return p->real_parent->pid == match->ppid;
-	case MATCH_TGID_EQUALS:
-		return p->tgid == match->tgid;
+		return nice == match->nice;
 	default:
-		scx_bpf_error("invalid match kind %d", match->kind);
-		return result;
+		return true;
 	}
 }
 
-int match_layer(u32 layer_id, pid_t pid, const char *cgrp_path)
+static bool match_residual(u32 clause, struct task_struct *p)
 {
+	u32 layer_id = clause / MAX_LAYER_MATCH_ORS;
+	u32 or_idx = clause % MAX_LAYER_MATCH_ORS;
+	struct layer_match_ands *ands;
+	u64 and_idx;
 
-	struct task_struct *p;
-	struct layer *layer;
-	u32 nr_match_ors;
-	u64 or_idx, and_idx;
+	if (!(ands = MEMBER_VPTR(layers, [layer_id].matches[or_idx]))) {
+		scx_bpf_error("invalid clause %u", clause);
+		return false;
+	}
 
-	p = bpf_task_from_pid(pid);
-	if (!p)
-		return -EINVAL;
+	bpf_for(and_idx, 0, ands->nr_match_ands) {
+		struct layer_match *match;
 
-	if (layer_id >= nr_layers)
-		goto err;
+		if (!(match = MEMBER_VPTR(ands->matches, [and_idx])))
+			break;
+		if (!match_residual_one(match, p))
+			return false;
+	}
+	return true;
+}
 
-	layer = &layers[layer_id];
-	nr_match_ors = layer->nr_match_ors;
+/*
+ * Find the first layer matching @p. Each kind of match narrows down the
+ * candidate clauses with a few hash lookups, so the cost scales with the depth
+ * of the cgroup path rather than the number of layers and matches. Only the
+ * surviving candidates with nice matches are then checked one by one.
+ */
+static s32 match_task_layer(struct task_struct *p)
+{
+	struct match_scratch *ms;
+	const struct cred *cred;
+	u32 zero = 0, uid = -1, gid = -1;
+	u64 w;
 
-	if (nr_match_ors > MAX_LAYER_MATCH_ORS)
-		goto err;
+	if (!(ms = bpf_map_lookup_elem(&match_scratch, &zero))) {
+		scx_bpf_error("match_scratch lookup failed");
+		return -ENOENT;
+	}
 
-	bpf_for(or_idx, 0, nr_match_ors) {
-		struct layer_match_ands *ands;
-		bool matched = true;
+	__builtin_memset(&ms->cand, 0xff, sizeof(ms->cand));
 
-		barrier_var(or_idx);
-		if (or_idx >= MAX_LAYER_MATCH_ORS)
-			goto err;
+	bpf_rcu_read_lock();
+	cred = p->real_cred;
+	if (cred) {
+		uid = cred->euid.val;
+		gid = cred->egid.val;
+	}
+	bpf_rcu_read_unlock();
 
-		ands = &layer->matches[or_idx];
+	if (!match_cgroup(ms, p->cgroups->dfl_cgrp) ||
+	    !match_comm(ms, MATCH_COMM_PREFIX, p->comm) ||
+	    !match_comm(ms, MATCH_PCOMM_PREFIX, p->group_leader->comm) ||
+	    !match_id(ms, MATCH_USER_ID_EQUALS, uid) ||
+	    !match_id(ms, MATCH_GROUP_ID_EQUALS, gid) ||
+	    !match_id(ms, MATCH_PID_EQUALS, p->pid) ||
+	    !match_id(ms, MATCH_PPID_EQUALS, p->real_parent->pid) ||
+	    !match_id(ms, MATCH_TGID_EQUALS, p->tgid))
+		return -ENOENT;
 
-		if (ands->nr_match_ands > NR_LAYER_MATCH_KINDS)
-			goto err;
+	bpf_for(w, 0, MATCH_SET_WORDS) {
+		u64 bits, residual;
+		u32 i;
 
-		bpf_for(and_idx, 0, ands->nr_match_ands) {
-			struct layer_match *match;
+		barrier_var(w);
+		if (w >= MATCH_SET_WORDS)
+			break;
+		bits = ms->cand.bits[w];
+		residual = match_index.residual.bits[w];
 
-			barrier_var(and_idx);
-			if (and_idx >= NR_LAYER_MATCH_KINDS)
-				goto err;
+		bpf_for(i, 0, 64) {
+			u32 clause;
+			u64 bit;
 
-			match = &ands->matches[and_idx];
-			if (!match_one(match, p, cgrp_path)) {
-				matched = false;
+			if (!bits)
 				break;
-			}
-		}
 
-		if (matched) {
-			bpf_task_release(p);
-			return 0;
+			bit = bits & -bits;
+			bits &= bits - 1;
+			clause = w * 64 + log2_u64(bit) - 1;
+
+			if (!(residual & bit) || match_residual(clause, p))
+				return clause / MAX_LAYER_MATCH_ORS;
 		}
 	}
 
-	bpf_task_release(p);
 	return -ENOENT;
-
-err:
-	bpf_task_release(p);
-	return -EINVAL;
 }
 
 static void maybe_refresh_layer(struct task_struct *p, struct task_ctx *tctx)
 {
-	const char *cgrp_path;
-	bool matched = false;
-	u64 idx;	// XXX - int makes verifier unhappy
-	pid_t pid = p->pid;
+	s32 idx;
 
 	if (!tctx->refresh_layer)
 		return;
 	tctx->refresh_layer = false;
 
-	if (!(cgrp_path = format_cgrp_path(p->cgroups->dfl_cgrp)))
-		return;
-
 	if (tctx->layer >= 0 && tctx->layer < nr_layers)
 		__sync_fetch_and_add(&layers[tctx->layer].nr_tasks, -1);
 
-	bpf_for(idx, 0, nr_layers) {
-		if (match_layer(idx, pid, cgrp_path) == 0) {
-			matched = true;
-			break;
-		}
-	}
+	idx = match_task_layer(p);
 
-	if (matched) {
+	if (idx >= 0 && idx < nr_layers) {
 		struct layer *layer = &layers[idx];
 
 		tctx->layer = idx;
@@ -1799,9 +1876,13 @@ static void maybe_refresh_layer(struct task_struct *p, struct task_ctx *tctx)
 		scx_bpf_error("[%s]%d didn't match any layer", p->comm, p->pid);
 	}
 
-	if (tctx->layer < nr_layers - 1)
-		trace("LAYER=%d %s[%d] cgrp=\"%s\"",
-		      tctx->layer, p->comm, p->pid, cgrp_path);
+	if (debug > 1 && tctx->layer < nr_layers - 1) {
+		const char *cgrp_path;
+
+		if ((cgrp_path = format_cgrp_path(p->cgroups->dfl_cgrp)))
+			trace("LAYER=%d %s[%d] cgrp=\"%s\"",
+			      tctx->layer, p->comm, p->pid, cgrp_path);
+	}
 }
 
 static s32 create_save_cpumask(struct bpf_cpumask **kptr)
@@ -2292,6 +2373,24 @@ int dump_cost(void)
 			     costc->budget[budget_id], costc->capacity[budget_id]);
 	}
 
+	// Per LLC costs
+	bpf_for(i, 0, nr_llcs) {
+		if (!(costc = lookup_cost(llc_cost_key(i)))) {
+			scx_bpf_error("unabled to lookup llc cost %d", i);
+			continue;
+		}
+		bpf_for(j, 0, nr_layers) {
+			layer = lookup_layer(j);
+			if (!layer) {
+				scx_bpf_error("unabled to lookup layer %d", j);
+				continue;
+			}
+			scx_bpf_dump("COST LLC[%d][%d][%s] budget=%lld capacity=%lld\n",
+				     i, j, layer->name,
+				     costc->budget[j], costc->capacity[j]);
+		}
+	}
+
 	// Per CPU costs
 	bpf_for(i, 0, nr_possible_cpus) {
 		if (!(costc = lookup_cpu_cost(i))) {
@@ -2513,6 +2612,8 @@ static bool run_timer_cb(int key)
 		return layered_monitor();
 	case ANTISTALL_TIMER:
 		return antistall_scan();
+	case COST_TIMER:
+		return refresh_budgets();
 	case NOOP_TIMER:
 	case MAX_TIMERS:
 	default:
@@ -2523,6 +2624,7 @@ static bool run_timer_cb(int key)
 struct layered_timer layered_timers[MAX_TIMERS] = {
 	{15LLU * NSEC_PER_SEC, CLOCK_BOOTTIME, 0},
 	{1LLU * NSEC_PER_SEC, CLOCK_BOOTTIME, 0},
+	{COST_REFRESH_NS, CLOCK_BOOTTIME, 0},
 	{0LLU, CLOCK_BOOTTIME, 0},
 };
 
@@ -2733,7 +2835,7 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(layered_init)
 			}
 		}
 	}
-	initialize_budgets(15LLU * NSEC_PER_SEC);
+	initialize_budgets(COST_REFRESH_NS);
 	ret = start_layered_timers();
 	if (ret < 0)
 		return ret;
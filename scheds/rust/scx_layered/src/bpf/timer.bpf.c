@@ -96,3 +96,23 @@ static int start_layered_timers(void)
 
 	return 0;
 }
+
+/*
+ * Runs the timer callback as soon as possible. The timer resumes its regular
+ * interval afterwards.
+ */
+static int kick_layered_timer(int key)
+{
+	struct timer_wrapper *timerw;
+	struct layered_timer *cb_timer;
+
+	if (key < 0 || key >= MAX_TIMERS)
+		return -EINVAL;
+
+	timerw = bpf_map_lookup_elem(&layered_timer_data, &key);
+	cb_timer = &layered_timers[key];
+	if (!timerw || !cb_timer)
+		return -ENOENT;
+
+	return bpf_timer_start(&timerw->timer, 0, cb_timer->start_flags);
+}
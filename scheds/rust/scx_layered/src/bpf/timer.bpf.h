@@ -26,11 +26,13 @@ struct layered_timer {
 enum layer_timer_callbacks {
 	LAYERED_MONITOR,
 	ANTISTALL_TIMER,
+	COST_TIMER,
 	NOOP_TIMER,
 	MAX_TIMERS,
 };
 
 static bool run_timer_cb(int key);
+static int kick_layered_timer(int key);
 
 extern struct layered_timer layered_timers[MAX_TIMERS];
 
@@ -26,20 +26,6 @@ struct {
 	__uint(max_entries, 1);
 } cgrp_path_bufs SEC(".maps");
 
-struct {
-	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
-	__uint(key_size, sizeof(u32));
-	__uint(value_size, MAX_PATH);
-	__uint(max_entries, 1);
-} prefix_bufs SEC(".maps");
-
-struct {
-	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
-	__uint(key_size, sizeof(u32));
-	__uint(value_size, MAX_PATH);
-	__uint(max_entries, 1);
-} str_bufs SEC(".maps");
-
 static char *format_cgrp_path(struct cgroup *cgrp)
 {
 	u32 zero = 0;
@@ -86,46 +72,201 @@ static char *format_cgrp_path(struct cgroup *cgrp)
 	return path;
 }
 
-bool __noinline match_prefix(const char *prefix, const char *str, u32 max_len)
+struct match_index match_index;
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__type(key, struct match_key);
+	__type(value, struct match_node);
+	__uint(max_entries, MAX_MATCH_NODES);
+} match_nodes SEC(".maps");
+
+struct match_scratch {
+	struct match_set	cand;
+	struct match_set	acc;
+	char			str[MATCH_COMP_LEN];
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, u32);
+	__type(value, struct match_scratch);
+	__uint(max_entries, 1);
+} match_scratch SEC(".maps");
+
+static __always_inline u64 match_tail_bit(u32 len)
+{
+	return 1LLU << (len < MATCH_TAIL_LONG ? len : MATCH_TAIL_LONG);
+}
+
+static __always_inline void match_set_or(struct match_set *dst,
+					 const struct match_set *src)
 {
-	u32 c, zero = 0;
-	int len;
+	int i;
 
-	if (!prefix || !str || max_len > MAX_PATH) {
-		scx_bpf_error("invalid args: %s %s %u",
-			      prefix, str, max_len);
-		return false;
+	for (i = 0; i < MATCH_SET_WORDS; i++)
+		dst->bits[i] |= src->bits[i];
+}
+
+/*
+ * Start accumulating the clauses satisfied by the @kind matches of the task.
+ */
+static void match_acc_begin(struct match_scratch *ms, u32 kind)
+{
+	struct match_set *free;
+
+	if (!(free = MEMBER_VPTR(match_index, .free[kind]))) {
+		scx_bpf_error("invalid match kind %u", kind);
+		return;
 	}
+	ms->acc = *free;
+}
 
-	char *pre_buf = bpf_map_lookup_elem(&prefix_bufs, &zero);
-	char *str_buf = bpf_map_lookup_elem(&str_bufs, &zero);
-	if (!pre_buf || !str_buf) {
-		scx_bpf_error("failed to look up buf");
-		return false;
+/*
+ * Narrow the candidates down to the clauses accumulated since the last
+ * match_acc_begin(). Returns whether any candidate is left.
+ */
+static bool match_acc_end(struct match_scratch *ms)
+{
+	u64 left = 0;
+	int i;
+
+	for (i = 0; i < MATCH_SET_WORDS; i++) {
+		ms->cand.bits[i] &= ms->acc.bits[i];
+		left |= ms->cand.bits[i];
 	}
+	return left;
+}
 
-	len = bpf_probe_read_kernel_str(pre_buf, MAX_PATH, prefix);
-	if (len < 0) {
-		scx_bpf_error("failed to read prefix");
+/*
+ * Whether @mn is the entry of the first @len bytes of @ms->str. Tasks control
+ * their comm and cgroup names, so a hash hit alone could be a crafted
+ * collision.
+ */
+static bool match_node_is(struct match_node *mn, struct match_scratch *ms,
+			  u32 len)
+{
+	u32 i;
+
+	if (mn->len != len)
 		return false;
+
+	bpf_for(i, 0, len) {
+		barrier_var(i);
+		if (i >= MATCH_COMP_LEN || mn->str[i] != ms->str[i])
+			return false;
 	}
+	return true;
+}
 
-	len = bpf_probe_read_kernel_str(str_buf, MAX_PATH, str);
-	if (len < 0) {
-		scx_bpf_error("failed to read str");
-		return false;
+/*
+ * Hash @ms->str as a child of @node. Partial entries are probed at the
+ * lengths in @tail_lens on the way and their clauses are added to @ms->acc.
+ * Returns the child node for the whole string, NULL if there is none.
+ */
+static struct match_node *match_walk_str(struct match_scratch *ms, u16 kind,
+					 u32 node, u64 tail_lens)
+{
+	struct match_key key = { .node = node, .kind = kind };
+	struct match_node *mn;
+	u64 hash = MATCH_FNV_OFFSET;
+	u32 i, len = 0;
+
+	bpf_for(i, 0, MATCH_COMP_LEN) {
+		u8 c;
+
+		barrier_var(i);
+		if (i >= MATCH_COMP_LEN)
+			break;
+		if (!(c = ms->str[i]))
+			break;
+
+		hash = (hash ^ c) * MATCH_FNV_PRIME;
+		len = i + 1;
+
+		if (tail_lens & match_tail_bit(len)) {
+			key.hash = hash;
+			key.partial = 1;
+			if ((mn = bpf_map_lookup_elem(&match_nodes, &key)) &&
+			    match_node_is(mn, ms, len))
+				match_set_or(&ms->acc, &mn->clauses);
+		}
 	}
 
-	bpf_for(c, 0, max_len) {
-		c &= 0xfff;
-		if (c > len) {
-			scx_bpf_error("invalid length");
-			return false; /* appease the verifier */
+	key.hash = hash;
+	key.partial = 0;
+	if ((mn = bpf_map_lookup_elem(&match_nodes, &key)) &&
+	    match_node_is(mn, ms, len))
+		return mn;
+	return NULL;
+}
+
+/*
+ * Walk the cgroup path trie down @cgrp's ancestry. Each step is a single hash
+ * lookup unless a prefix ends in the middle of the component.
+ */
+static bool match_cgroup(struct match_scratch *ms, struct cgroup *cgrp)
+{
+	struct match_node *mn;
+	u32 node = 0, level, min_level, max_level;
+	u64 tail_lens = match_index.tail_lens[MATCH_CGROUP_PREFIX];
+
+	match_acc_begin(ms, MATCH_CGROUP_PREFIX);
+
+	max_level = cgrp->level;
+	if (max_level > 127)
+		max_level = 127;
+
+	/* the root cgroup's path is "/", i.e. a single empty component */
+	min_level = max_level ? 1 : 0;
+
+	bpf_for(level, min_level, max_level + 1) {
+		if (level) {
+			if (bpf_probe_read_kernel_str(ms->str, MATCH_COMP_LEN,
+					BPF_CORE_READ(cgrp, ancestors[level], kn, name)) < 0) {
+				scx_bpf_error("bpf_probe_read_kernel_str failed");
+				return false;
+			}
+		} else {
+			ms->str[0] = '\0';
 		}
-		if (pre_buf[c] == '\0')
-			return true;
-		if (str_buf[c] != pre_buf[c])
-			return false;
+
+		if (!(mn = match_walk_str(ms, MATCH_CGROUP_PREFIX, node, tail_lens)))
+			break;
+
+		match_set_or(&ms->acc, &mn->clauses);
+		node = mn->id;
+		tail_lens = mn->tail_lens;
+	}
+
+	return match_acc_end(ms);
+}
+
+static bool match_comm(struct match_scratch *ms, u16 kind, const char *comm)
+{
+	if (kind >= NR_LAYER_MATCH_KINDS)
+		return false;
+
+	match_acc_begin(ms, kind);
+
+	if (bpf_probe_read_kernel_str(ms->str, MAX_COMM, comm) < 0) {
+		scx_bpf_error("bpf_probe_read_kernel_str failed");
+		return false;
 	}
-	return false;
+	match_walk_str(ms, kind, 0, match_index.tail_lens[kind]);
+
+	return match_acc_end(ms);
+}
+
+static bool match_id(struct match_scratch *ms, u16 kind, u32 id)
+{
+	struct match_key key = { .hash = id, .kind = kind };
+	struct match_node *mn;
+
+	match_acc_begin(ms, kind);
+
+	if ((mn = bpf_map_lookup_elem(&match_nodes, &key)))
+		match_set_or(&ms->acc, &mn->clauses);
+
+	return match_acc_end(ms);
 }
@@ -0,0 +1,312 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+
+//! Compiles the layer match specs into the match index walked by
+//! match_task_layer() in BPF. See the comment above struct match_set in
+//! intf.h for the layout.
+
+use std::collections::HashMap;
+
+use anyhow::bail;
+use anyhow::Result;
+
+use crate::bpf_intf;
+use crate::LayerMatch;
+use crate::LayerSpec;
+
+const MAX_LAYERS: usize = bpf_intf::consts_MAX_LAYERS as usize;
+const MAX_LAYER_MATCH_ORS: usize = bpf_intf::consts_MAX_LAYER_MATCH_ORS as usize;
+const MATCH_SET_WORDS: usize = bpf_intf::consts_MATCH_SET_WORDS as usize;
+const MAX_MATCH_NODES: usize = bpf_intf::consts_MAX_MATCH_NODES as usize;
+const MATCH_TAIL_LONG: usize = bpf_intf::consts_MATCH_TAIL_LONG as usize;
+const MAX_COMM: usize = bpf_intf::consts_MAX_COMM as usize;
+const MATCH_COMP_LEN: usize = bpf_intf::consts_MATCH_COMP_LEN as usize;
+const NR_LAYER_MATCH_KINDS: usize = bpf_intf::layer_match_kind_NR_LAYER_MATCH_KINDS as usize;
+
+const KIND_CGROUP: u16 = bpf_intf::layer_match_kind_MATCH_CGROUP_PREFIX as u16;
+const KIND_COMM: u16 = bpf_intf::layer_match_kind_MATCH_COMM_PREFIX as u16;
+const KIND_PCOMM: u16 = bpf_intf::layer_match_kind_MATCH_PCOMM_PREFIX as u16;
+const KIND_UID: u16 = bpf_intf::layer_match_kind_MATCH_USER_ID_EQUALS as u16;
+const KIND_GID: u16 = bpf_intf::layer_match_kind_MATCH_GROUP_ID_EQUALS as u16;
+const KIND_PID: u16 = bpf_intf::layer_match_kind_MATCH_PID_EQUALS as u16;
+const KIND_PPID: u16 = bpf_intf::layer_match_kind_MATCH_PPID_EQUALS as u16;
+const KIND_TGID: u16 = bpf_intf::layer_match_kind_MATCH_TGID_EQUALS as u16;
+
+pub type MatchSet = [u64; MATCH_SET_WORDS];
+
+fn fnv1a(s: &str) -> u64 {
+    s.bytes().fold(bpf_intf::MATCH_FNV_OFFSET, |h, c| {
+        (h ^ c as u64).wrapping_mul(bpf_intf::MATCH_FNV_PRIME)
+    })
+}
+
+fn tail_bit(len: usize) -> u64 {
+    1 << len.min(MATCH_TAIL_LONG)
+}
+
+fn set_bit(set: &mut MatchSet, clause: usize) {
+    set[clause / 64] |= 1 << (clause % 64);
+}
+
+/// Narrow the prefix matches of one kind in an AND clause down to a single
+/// prefix. All of them can hold only if they are prefixes of each other, in
+/// which case the longest one implies the rest. None if they conflict.
+fn merge_prefixes<'a>(prefixes: &[&'a str]) -> Option<&'a str> {
+    let longest = prefixes.iter().max_by_key(|p| p.len())?;
+    prefixes
+        .iter()
+        .all(|p| longest.starts_with(p))
+        .then_some(*longest)
+}
+
+/// Likewise for ID matches which can all hold only if they're the same.
+fn merge_ids(ids: &[u32]) -> Option<u32> {
+    let first = *ids.first()?;
+    ids.iter().all(|id| *id == first).then_some(first)
+}
+
+#[derive(Clone, Copy, PartialEq, Eq, Hash)]
+struct NodeKey {
+    hash: u64,
+    node: u32,
+    kind: u16,
+    partial: bool,
+}
+
+struct Node {
+    clauses: MatchSet,
+    tail_lens: u64,
+    id: u32,
+    // to detect hash collisions here and verify lookups in BPF
+    name: String,
+}
+
+/// The compiled form of the layer specs. `free`, `residual` and `tail_lens`
+/// go into the match_index in bss and `entries()` into the match_nodes map.
+pub struct LayerMatcher {
+    pub free: [MatchSet; NR_LAYER_MATCH_KINDS],
+    pub residual: MatchSet,
+    pub tail_lens: [u64; NR_LAYER_MATCH_KINDS],
+    nodes: HashMap<NodeKey, Node>,
+    // keys of the cgroup trie nodes indexed by id - 1
+    trie_keys: Vec<NodeKey>,
+}
+
+impl LayerMatcher {
+    pub fn compile(specs: &[LayerSpec]) -> Result<Self> {
+        if specs.len() > MAX_LAYERS {
+            bail!("Too many layers ({} > {})", specs.len(), MAX_LAYERS);
+        }
+
+        let mut lm = Self {
+            free: [[0; MATCH_SET_WORDS]; NR_LAYER_MATCH_KINDS],
+            residual: [0; MATCH_SET_WORDS],
+            tail_lens: [0; NR_LAYER_MATCH_KINDS],
+            nodes: HashMap::new(),
+            trie_keys: vec![],
+        };
+
+        for (layer_idx, spec) in specs.iter().enumerate() {
+            if spec.matches.len() > MAX_LAYER_MATCH_ORS {
+                bail!(
+                    "Layer {:?} has too many ORs ({} > {})",
+                    spec.name,
+                    spec.matches.len(),
+                    MAX_LAYER_MATCH_ORS
+                );
+            }
+            for (or_idx, ands) in spec.matches.iter().enumerate() {
+                lm.add_clause(layer_idx * MAX_LAYER_MATCH_ORS + or_idx, ands)?;
+            }
+        }
+
+        if lm.nodes.len() > MAX_MATCH_NODES {
+            bail!(
+                "Layer matches need {} index entries (max {})",
+                lm.nodes.len(),
+                MAX_MATCH_NODES
+            );
+        }
+        Ok(lm)
+    }
+
+    fn add_clause(&mut self, clause: usize, ands: &[LayerMatch]) -> Result<()> {
+        let mut cgroups = vec![];
+        let mut comms = vec![];
+        let mut pcomms = vec![];
+        let mut ids: HashMap<u16, Vec<u32>> = HashMap::new();
+
+        for and in ands.iter() {
+            match and {
+                LayerMatch::CgroupPrefix(prefix) => cgroups.push(prefix.as_str()),
+                LayerMatch::CommPrefix(prefix) => comms.push(prefix.as_str()),
+                LayerMatch::PcommPrefix(prefix) => pcomms.push(prefix.as_str()),
+                LayerMatch::NiceAbove(_) | LayerMatch::NiceBelow(_) | LayerMatch::NiceEquals(_) => {
+                    set_bit(&mut self.residual, clause)
+                }
+                LayerMatch::UIDEquals(id) => ids.entry(KIND_UID).or_default().push(*id),
+                LayerMatch::GIDEquals(id) => ids.entry(KIND_GID).or_default().push(*id),
+                LayerMatch::PIDEquals(id) => ids.entry(KIND_PID).or_default().push(*id),
+                LayerMatch::PPIDEquals(id) => ids.entry(KIND_PPID).or_default().push(*id),
+                LayerMatch::TGIDEquals(id) => ids.entry(KIND_TGID).or_default().push(*id),
+            }
+        }
+
+        // A kind whose matches conflict is left out of both the free set and
+        // the entries, which makes the clause impossible to match.
+        if cgroups.is_empty() {
+            set_bit(&mut self.free[KIND_CGROUP as usize], clause);
+        } else if let Some(prefix) = merge_prefixes(&cgroups) {
+            self.add_cgroup_prefix(clause, prefix)?;
+        }
+
+        for (kind, prefixes) in [(KIND_COMM, &comms), (KIND_PCOMM, &pcomms)] {
+            if prefixes.is_empty() {
+                set_bit(&mut self.free[kind as usize], clause);
+            } else if let Some(prefix) = merge_prefixes(prefixes) {
+                // comm is at most MAX_COMM - 1 long
+                if prefix.is_empty() {
+                    set_bit(&mut self.free[kind as usize], clause);
+                } else if prefix.len() < MAX_COMM {
+                    self.add_tail(clause, kind, 0, prefix)?;
+                }
+            }
+        }
+
+        for kind in [KIND_UID, KIND_GID, KIND_PID, KIND_PPID, KIND_TGID] {
+            match ids.get(&kind) {
+                None => set_bit(&mut self.free[kind as usize], clause),
+                Some(ids) => {
+                    if let Some(id) = merge_ids(ids) {
+                        let key = NodeKey {
+                            hash: id as u64,
+                            node: 0,
+                            kind,
+                            partial: false,
+                        };
+                        set_bit(&mut self.node(key, &id.to_string())?.clauses, clause);
+                    }
+                }
+            }
+        }
+
+        Ok(())
+    }
+
+    /// A prefix is split at '/'. All but the last part are full path
+    /// components which become trie nodes. The last part is either empty, in
+    /// which case the clause is attached to the last node, or the beginning
+    /// of the next component, which becomes a partial entry.
+    fn add_cgroup_prefix(&mut self, clause: usize, prefix: &str) -> Result<()> {
+        let mut parts: Vec<&str> = prefix.split('/').collect();
+        let tail = parts.pop().unwrap();
+
+        let mut node = 0;
+        let mut last = None;
+        for comp in parts {
+            let key = NodeKey {
+                hash: fnv1a(comp),
+                node,
+                kind: KIND_CGROUP,
+                partial: false,
+            };
+            node = self.node(key, comp)?.id;
+            last = Some(key);
+        }
+
+        match (tail.is_empty(), last) {
+            (true, None) => set_bit(&mut self.free[KIND_CGROUP as usize], clause),
+            (true, Some(key)) => set_bit(&mut self.nodes.get_mut(&key).unwrap().clauses, clause),
+            (false, _) => self.add_tail(clause, KIND_CGROUP, node, tail)?,
+        }
+        Ok(())
+    }
+
+    fn add_tail(&mut self, clause: usize, kind: u16, node: u32, tail: &str) -> Result<()> {
+        let tail_lens = match node {
+            0 => &mut self.tail_lens[kind as usize],
+            _ => {
+                let parent = self.trie_keys[node as usize - 1];
+                &mut self.nodes.get_mut(&parent).unwrap().tail_lens
+            }
+        };
+        *tail_lens |= tail_bit(tail.len());
+
+        let key = NodeKey {
+            hash: fnv1a(tail),
+            node,
+            kind,
+            partial: true,
+        };
+        set_bit(&mut self.node(key, tail)?.clauses, clause);
+        Ok(())
+    }
+
+    fn node(&mut self, key: NodeKey, name: &str) -> Result<&mut Node> {
+        if name.len() >= MATCH_COMP_LEN {
+            bail!(
+                "Layer match component {:?} is too long (max {})",
+                name,
+                MATCH_COMP_LEN - 1
+            );
+        }
+        let is_trie = key.kind == KIND_CGROUP && !key.partial;
+        if is_trie && !self.nodes.contains_key(&key) {
+            self.trie_keys.push(key);
+        }
+        let id = if is_trie {
+            self.trie_keys.len() as u32
+        } else {
+            0
+        };
+
+        let n = self.nodes.entry(key).or_insert_with(|| Node {
+            clauses: [0; MATCH_SET_WORDS],
+            tail_lens: 0,
+            id,
+            name: name.to_string(),
+        });
+        if n.name != name {
+            bail!(
+                "Layer match hash collision between {:?} and {:?}",
+                n.name,
+                name
+            );
+        }
+        Ok(n)
+    }
+
+    /// The match_nodes map entries as (key, value) byte pairs.
+    pub fn entries(&self) -> Vec<(Vec<u8>, Vec<u8>)> {
+        self.nodes
+            .iter()
+            .map(|(key, n)| {
+                let mut k: bpf_intf::match_key = unsafe { std::mem::zeroed() };
+                k.hash = key.hash;
+                k.node = key.node;
+                k.kind = key.kind;
+                k.partial = key.partial as u16;
+
+                let mut v: bpf_intf::match_node = unsafe { std::mem::zeroed() };
+                v.clauses.bits = n.clauses;
+                v.tail_lens = n.tail_lens;
+                v.id = n.id;
+                // ID entries are keyed by the ID itself and need no check
+                if key.kind == KIND_CGROUP || key.kind == KIND_COMM || key.kind == KIND_PCOMM {
+                    v.len = n.name.len() as u16;
+                    for (dst, src) in v.str.iter_mut().zip(n.name.bytes()) {
+                        *dst = src as _;
+                    }
+                }
+
+                (as_bytes(&k).to_vec(), as_bytes(&v).to_vec())
+            })
+            .collect()
+    }
+}
+
+fn as_bytes<T>(v: &T) -> &[u8] {
+    unsafe { std::slice::from_raw_parts(v as *const T as *const u8, std::mem::size_of::<T>()) }
+}
@@ -4,6 +4,7 @@
 // GNU General Public License version 2.
 mod config;
 mod layer_core_growth;
+mod layer_match;
 
 pub mod bpf_intf;
 
@@ -17,6 +18,7 @@ pub use config::LayerKind;
 pub use config::LayerMatch;
 pub use config::LayerSpec;
 pub use layer_core_growth::LayerGrowthAlgo;
+pub use layer_match::LayerMatcher;
 use log::debug;
 use log::info;
 use scx_utils::Core;
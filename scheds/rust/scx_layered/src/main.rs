@@ -40,6 +40,7 @@ use log::warn;
 use scx_layered::*;
 use scx_stats::prelude::*;
 use scx_utils::compat;
+use scx_utils::hist::Hist;
 use scx_utils::import_enums;
 use scx_utils::init_libbpf_logging;
 use scx_utils::ravg::ravg_read;
@@ -562,6 +563,16 @@ fn cachemask_from_llcs(llcs: &BTreeMap<usize, Cache>) -> usize {
     mask
 }
 
+fn read_dispatch_lat(skel: &BpfSkel) -> Result<Hist> {
+    let percpu = skel
+        .maps
+        .dispatch_lat_hist
+        .lookup_percpu(&0u32.to_ne_bytes(), libbpf_rs::MapFlags::ANY)
+        .context("Failed to lookup dispatch_lat_hist")?
+        .unwrap_or_default();
+    Ok(Hist::from_percpu(&percpu))
+}
+
 fn read_cpu_ctxs(skel: &BpfSkel) -> Result<Vec<bpf_intf::cpu_ctx>> {
     let mut cpu_ctxs = vec![];
     let cpu_ctxs_vec = skel
@@ -704,6 +715,9 @@ struct Stats {
     bpf_stats: BpfStats,
     prev_bpf_stats: BpfStats,
 
+    dispatch_lat: Hist,
+    prev_dispatch_lat: Hist,
+
     processing_dur: Duration,
     prev_processing_dur: Duration,
 
@@ -778,6 +792,9 @@ impl Stats {
             bpf_stats: bpf_stats.clone(),
             prev_bpf_stats: bpf_stats,
 
+            dispatch_lat: Hist::default(),
+            prev_dispatch_lat: read_dispatch_lat(skel)?,
+
             processing_dur: Default::default(),
             prev_processing_dur: Default::default(),
 
@@ -857,6 +874,9 @@ impl Stats {
         let cur_bpf_stats = BpfStats::read(&cpu_ctxs, self.nr_layers);
         let bpf_stats = &cur_bpf_stats - &self.prev_bpf_stats;
 
+        let cur_dispatch_lat = read_dispatch_lat(skel)?;
+        let dispatch_lat = &cur_dispatch_lat - &self.prev_dispatch_lat;
+
         let processing_dur = cur_processing_dur
             .checked_sub(self.prev_processing_dur)
             .unwrap();
@@ -886,6 +906,9 @@ impl Stats {
             bpf_stats,
             prev_bpf_stats: cur_bpf_stats,
 
+            dispatch_lat,
+            prev_dispatch_lat: cur_dispatch_lat,
+
             processing_dur,
             prev_processing_dur: cur_processing_dur,
 
@@ -1510,8 +1533,23 @@ impl<'a> Scheduler<'a> {
         Self::init_layers(&mut skel, opts, &layer_specs, &topo)?;
         Self::init_nodes(&mut skel, opts, &topo);
 
+        let matcher = LayerMatcher::compile(&layer_specs)?;
+        let index = &mut skel.maps.bss_data.match_index;
+        for kind in 0..NR_LAYER_MATCH_KINDS {
+            index.free[kind].bits = matcher.free[kind];
+            index.tail_lens[kind] = matcher.tail_lens[kind];
+        }
+        index.residual.bits = matcher.residual;
+
         let mut skel = scx_ops_load!(skel, layered, uei)?;
 
+        for (key, val) in matcher.entries().iter() {
+            skel.maps
+                .match_nodes
+                .update(key, val, libbpf_rs::MapFlags::ANY)
+                .context("Failed to update match_nodes")?;
+        }
+
         let mut layers = vec![];
         for (idx, spec) in layer_specs.iter().enumerate() {
             layers.push(Layer::new(&spec, idx, &cpu_pool, &topo)?);
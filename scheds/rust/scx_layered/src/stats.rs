@@ -377,6 +377,12 @@ pub struct SysStats {
     pub load: f64,
     #[stat(desc = "fallback CPU")]
     pub fallback_cpu: u32,
+    #[stat(desc = "ops.dispatch() latency p50 (ns)")]
+    pub dispatch_lat_p50: u64,
+    #[stat(desc = "ops.dispatch() latency p99 (ns)")]
+    pub dispatch_lat_p99: u64,
+    #[stat(desc = "ops.dispatch() latency p99.9 (ns)")]
+    pub dispatch_lat_p999: u64,
     #[stat(desc = "per-layer statistics")]
     pub layers: BTreeMap<String, LayerStats>,
 }
@@ -414,6 +420,9 @@ impl SysStats {
             util: stats.total_util * 100.0,
             load: normalize_load_metric(stats.total_load),
             fallback_cpu: fallback_cpu as u32,
+            dispatch_lat_p50: stats.dispatch_lat.percentile(50.0),
+            dispatch_lat_p99: stats.dispatch_lat.percentile(99.0),
+            dispatch_lat_p999: stats.dispatch_lat.percentile(99.9),
             layers: BTreeMap::new(),
         })
     }
@@ -442,6 +451,12 @@ impl SysStats {
             self.excl_collision, self.excl_preempt, self.excl_idle, self.excl_wakeup
         )?;
 
+        writeln!(
+            w,
+            "dispatch_lat p50={}ns p99={}ns p999={}ns",
+            self.dispatch_lat_p50, self.dispatch_lat_p99, self.dispatch_lat_p999
+        )?;
+
         Ok(())
     }
 
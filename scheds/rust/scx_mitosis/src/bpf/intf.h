@@ -23,10 +23,13 @@ enum consts {
 	MAX_CPUS = 1 << MAX_CPUS_SHIFT,
 	MAX_CPUS_U8 = MAX_CPUS / 8,
 	MAX_CELLS = 16,
+	MAX_LLCS = 64,
+	CACHELINE_SIZE = 64,
 	USAGE_HALF_LIFE = 100000000, /* 100ms */
 
-	HI_FALLBACK_DSQ = MAX_CELLS,
-	LO_FALLBACK_DSQ = MAX_CELLS + 1,
+	/* DSQ cell * MAX_LLCS + llc queues the cell's tasks on that LLC */
+	HI_FALLBACK_DSQ = MAX_CELLS * MAX_LLCS,
+	LO_FALLBACK_DSQ = MAX_CELLS * MAX_LLCS + 1,
 };
 
 /* Statistics */
@@ -34,6 +37,11 @@ enum cell_stat_idx {
 	CSTAT_LOCAL,
 	CSTAT_GLOBAL,
 	CSTAT_AFFN_VIOL,
+	/* LLC locality, the LLC being that of the CPU counting them */
+	CSTAT_LLC_IDLE,		/* idle CPU found in prev_cpu's LLC */
+	CSTAT_LLC_DISPATCH,	/* dispatched from the CPU's own LLC DSQ */
+	CSTAT_LLC_STEAL,	/* stolen from another LLC DSQ of the cell */
+	CSTAT_LLC_DRAIN,	/* drained from a DSQ on an LLC the cell left */
 	NR_CSTATS,
 };
 
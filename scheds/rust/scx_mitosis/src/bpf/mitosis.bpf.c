@@ -8,8 +8,10 @@
  * of cells is dynamic, as is cgroup to cell assignment and cell to CPU
  * assignment (all are determined by userspace).
  *
- * Each cell has an associated DSQ which it uses for vtime scheduling of the
- * cgroups belonging to the cell.
+ * Each cell has a DSQ per LLC which it uses for vtime scheduling of the
+ * cgroups belonging to the cell. Tasks are queued on the DSQ of the LLC they
+ * last ran on and CPUs only steal from the cell's other LLCs when their own
+ * LLC's DSQ is empty.
  */
 
 #include "intf.h"
@@ -33,6 +35,8 @@ const volatile bool debug = false;
 const volatile u32 nr_possible_cpus = 1;
 const volatile bool smt_enabled = true;
 const volatile unsigned char all_cpus[MAX_CPUS_U8];
+const volatile u32 nr_llcs = 1;
+const volatile u32 cpu_to_llc[MAX_CPUS];
 
 const volatile u64 slice_ns;
 
@@ -186,7 +190,8 @@ static inline struct cpu_ctx *lookup_cpu_ctx(int cpu)
 
 struct cell {
 	u64 vtime_now;
-	u32 dsq;
+	/* LLCs the cell has CPUs in, updated on reconfiguration */
+	u64 llc_mask;
 	// The following field is populated from userspace to indicate
 	// which cpus the cell should belong to.
 	unsigned char cpus[MAX_CPUS_U8];
@@ -206,6 +211,67 @@ static inline struct cell *lookup_cell(int idx)
 	return cell;
 }
 
+static inline u32 cpu_llc(s32 cpu)
+{
+	const volatile u32 *llc;
+
+	if (!(llc = MEMBER_VPTR(cpu_to_llc, [cpu])))
+		return 0;
+	return *llc;
+}
+
+static inline u64 cell_llc_dsq(u32 cell, u32 llc)
+{
+	return (u64)cell * MAX_LLCS + llc;
+}
+
+struct cpumask_wrapper {
+	struct bpf_cpumask __kptr *cpumask;
+};
+
+/* The CPUs of each LLC (owned by BPF logic) */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, u32);
+	__type(value, struct cpumask_wrapper);
+	__uint(max_entries, MAX_LLCS);
+	__uint(map_flags, 0);
+} llc_cpumasks SEC(".maps");
+
+/* Per-CPU scratch cpumask for intersecting with the LLC cpumasks */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, u32);
+	__type(value, struct cpumask_wrapper);
+	__uint(max_entries, MAX_CPUS);
+	__uint(map_flags, 0);
+} tmp_cpumasks SEC(".maps");
+
+static inline const struct cpumask *lookup_llc_cpumask(u32 llc)
+{
+	struct cpumask_wrapper *cpumaskw;
+
+	if (!(cpumaskw = bpf_map_lookup_elem(&llc_cpumasks, &llc))) {
+		scx_bpf_error("no llc cpumask");
+		return NULL;
+	}
+
+	return (const struct cpumask *)cpumaskw->cpumask;
+}
+
+static inline struct bpf_cpumask *lookup_tmp_cpumask()
+{
+	struct cpumask_wrapper *cpumaskw;
+	u32 cpu = bpf_get_smp_processor_id();
+
+	if (!(cpumaskw = bpf_map_lookup_elem(&tmp_cpumasks, &cpu))) {
+		scx_bpf_error("no tmp cpumask");
+		return NULL;
+	}
+
+	return cpumaskw->cpumask;
+}
+
 /*
  * Store the cpumask for each cell (owned by BPF logic)
  */
@@ -239,85 +305,104 @@ static inline const struct cpumask *lookup_cell_cpumask(int idx)
 /*
  * This is an RCU-like implementation to keep track of scheduling events so we
  * can establish when cell assignments have propagated completely.
+ *
+ * Each CPU bumps its cs_seq when entering and leaving a critical section, so
+ * an odd value means that it's inside one. When a new configuration is
+ * published, only the CPUs inside a critical section at that moment may still
+ * be acting on the old one. quiesce_start() records their cs_seq in wait_seq
+ * and counts them in quiesce_pending, and each of them retires itself on
+ * leaving the critical section. Publishing costs one pass over the CPUs and
+ * waiting for the grace period to end is a single load.
  */
-struct {
-	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
-	__type(key, u32);
-	__type(value, u32);
-	__uint(max_entries, 1);
-} percpu_critical_sections SEC(".maps");
+struct cpu_epoch {
+	u32 cs_seq;
+	u32 wait_seq; /* cs_seq to leave for the grace period, 0 if none */
+} __attribute__((aligned(CACHELINE_SIZE)));
 
-/* Same implementation for enter/exit */
-static __always_inline int critical_section()
+struct cpu_epoch cpu_epochs[MAX_CPUS];
+u32 quiesce_pending;
+
+static __always_inline struct cpu_epoch *lookup_cpu_epoch(s32 cpu)
 {
-	u32 zero = 0;
-	u32 *data;
+	struct cpu_epoch *epoch;
 
-	if (!(data = bpf_map_lookup_elem(&percpu_critical_sections, &zero))) {
-		scx_bpf_error("no percpu_critical_sections");
+	if (!(epoch = MEMBER_VPTR(cpu_epochs, [cpu])))
+		scx_bpf_error("no cpu_epoch for cpu %d", cpu);
+
+	return epoch;
+}
+
+/* Whoever clears wait_seq first, the CPU or the writer, retires the CPU */
+static __always_inline void quiesce_retire(struct cpu_epoch *epoch, u32 seq)
+{
+	if (__sync_val_compare_and_swap(&epoch->wait_seq, seq, 0) == seq)
+		__sync_fetch_and_sub(&quiesce_pending, 1);
+}
+
+static __always_inline int critical_section_enter()
+{
+	struct cpu_epoch *epoch;
+
+	if (!(epoch = lookup_cpu_epoch(bpf_get_smp_processor_id())))
 		return -1;
-	}
 
 	/*
-	 * Bump the counter, the LSB indicates we are in a critical section and the
-	 * rest of the bits keep track of how many critical sections.
+	 * Full barrier so that global_seq is read after the store. Pairs with
+	 * the one between the global_seq bump and quiesce_start()'s scan.
 	 */
-	WRITE_ONCE(*data, *data + 1);
+	__sync_fetch_and_add(&epoch->cs_seq, 1);
 	return 0;
 }
 
-#define critical_section_enter() critical_section()
-#define critical_section_exit() critical_section()
-
-u32 critical_section_state[MAX_CPUS];
-/*
- * Write side will record the current state and then poll to check that the
- * generation has advanced (somewhat like call_rcu)
- */
-static __always_inline int critical_section_record()
+static __always_inline int critical_section_exit()
 {
-	u32 zero = 0;
-	u32 *data;
-	int nr_cpus = nr_possible_cpus;
-	if (nr_cpus > MAX_CPUS)
-		nr_cpus = MAX_CPUS;
+	struct cpu_epoch *epoch;
+	u32 seq;
 
-	for (int i = 0; i < nr_cpus; ++i) {
-		if (!(data = bpf_map_lookup_percpu_elem(
-			      &percpu_critical_sections, &zero, i))) {
-			scx_bpf_error("no percpu_critical_sections");
-			return -1;
-		}
+	if (!(epoch = lookup_cpu_epoch(bpf_get_smp_processor_id())))
+		return -1;
 
-		critical_section_state[i] = READ_ONCE(*data);
-	}
+	seq = __sync_fetch_and_add(&epoch->cs_seq, 1);
+	if (READ_ONCE(epoch->wait_seq) == seq)
+		quiesce_retire(epoch, seq);
 	return 0;
 }
 
-static __always_inline int critical_section_poll()
+/*
+ * Write side. Called after bumping global_seq to start a grace period which
+ * ends when quiesce_pending drops to zero (somewhat like call_rcu).
+ */
+static __always_inline int quiesce_start()
 {
-	u32 zero = 0;
-	u32 *data;
+	u32 cpu, nr_cpus = nr_possible_cpus;
 
-	int nr_cpus = nr_possible_cpus;
+	/* cpu_epochs is sized for MAX_CPUS */
 	if (nr_cpus > MAX_CPUS)
 		nr_cpus = MAX_CPUS;
 
-	for (int i = 0; i < nr_cpus; ++i) {
-		/* If not in a critical section at the time of record, then it passes */
-		if (!(critical_section_state[i] & 1))
-			continue;
+	/* hold the grace period open during the scan, also a full barrier */
+	__sync_fetch_and_add(&quiesce_pending, 1);
 
-		if (!(data = bpf_map_lookup_percpu_elem(
-			      &percpu_critical_sections, &zero, i))) {
-			scx_bpf_error("no percpu_critical_sections");
+	bpf_for(cpu, 0, nr_cpus)
+	{
+		struct cpu_epoch *epoch;
+		u32 seq;
+
+		if (!(epoch = lookup_cpu_epoch(cpu)))
 			return -1;
-		}
 
-		if (READ_ONCE(*data) == critical_section_state[i])
-			return 1;
+		seq = READ_ONCE(epoch->cs_seq);
+		if (!(seq & 1))
+			continue;
+
+		__sync_fetch_and_add(&quiesce_pending, 1);
+		__sync_val_compare_and_swap(&epoch->wait_seq, 0, seq);
+		/* it may have left before seeing wait_seq */
+		if (READ_ONCE(epoch->cs_seq) != seq)
+			quiesce_retire(epoch, seq);
 	}
 
+	__sync_fetch_and_sub(&quiesce_pending, 1);
 	return 0;
 }
 
@@ -340,6 +425,8 @@ int BPF_PROG(sched_tick_fentry)
 	struct cell_cpumask_wrapper *cell_cpumaskw;
 	struct cgroup_subsys_state *root_css, *pos;
 	struct cgroup *root_cgrp;
+	struct cell *cellp;
+	u64 llc_mask;
 
 	if (bpf_get_smp_processor_id() != 0)
 		return 0;
@@ -350,7 +437,7 @@ int BPF_PROG(sched_tick_fentry)
 	 * scheduler tick. This is a crude way of mimicing RCU synchronization.
 	 */
 	if (READ_ONCE(draining)) {
-		if (critical_section_poll())
+		if (READ_ONCE(quiesce_pending))
 			return 0;
 		/* FIXME: If a cell is being destroyed, we need to make sure that dsq is
 		 * drained before removing it from all the cpus
@@ -394,6 +481,7 @@ int BPF_PROG(sched_tick_fentry)
 			return 0;
 		}
 		bpf_cpumask_clear(cpumask);
+		llc_mask = 0;
 
 		bpf_for(cpu_idx, 0, nr_possible_cpus)
 		{
@@ -403,6 +491,8 @@ int BPF_PROG(sched_tick_fentry)
 				     cells, [cell_idx].cpus[cpu_idx / 8]))) {
 				if (*u8_ptr & (1 << (cpu_idx % 8))) {
 					bpf_cpumask_set_cpu(cpu_idx, cpumask);
+					llc_mask |= 1LLU << (cpu_llc(cpu_idx) %
+							     MAX_LLCS);
 					if (!(cpu_ctx = lookup_cpu_ctx(
 						      cpu_idx))) {
 						bpf_cpumask_release(cpumask);
@@ -418,6 +508,8 @@ int BPF_PROG(sched_tick_fentry)
 			scx_bpf_error("cpumask should never be null");
 			return 0;
 		}
+		if ((cellp = MEMBER_VPTR(cells, [cell_idx])))
+			WRITE_ONCE(cellp->llc_mask, llc_mask);
 		cpumask = bpf_kptr_xchg(&cell_cpumaskw->tmp_cpumask, cpumask);
 		/* We just xchg'd NULL into it, so tmp_cpumask should be NULL */
 		if (cpumask) {
@@ -520,9 +612,9 @@ int BPF_PROG(sched_tick_fentry)
 	WRITE_ONCE(global_seq, global_seq + 1);
 	/*
 	 * On subsequent ticks we'll check that all in-flight enqueues are done so
-	 * we can clear the prev_cell for each cpu. Record the state here.
+	 * we can clear the prev_cell for each cpu. Start the grace period here.
 	 */
-	critical_section_record();
+	quiesce_start();
 	return 0;
 }
 
@@ -692,6 +784,26 @@ static __always_inline s32 pick_idle_cpu(struct task_struct *p, s32 prev_cpu,
 		goto out;
 	}
 
+	/* Look for an idle CPU sharing @prev_cpu's LLC first */
+	if (nr_llcs > 1) {
+		const struct cpumask *llc_cpumask;
+		struct bpf_cpumask *tmp_cpumask;
+
+		if (!(llc_cpumask = lookup_llc_cpumask(cpu_llc(prev_cpu))) ||
+		    !(tmp_cpumask = lookup_tmp_cpumask())) {
+			cpu = -1;
+			goto out;
+		}
+
+		bpf_cpumask_and(tmp_cpumask, task_cpumask, llc_cpumask);
+		cpu = pick_idle_cpu_from((const struct cpumask *)tmp_cpumask,
+					 prev_cpu, idle_smtmask);
+		if (cpu >= 0) {
+			cstat_inc(CSTAT_LLC_IDLE, tctx->cell, cctx);
+			goto out;
+		}
+	}
+
 	cpu = pick_idle_cpu_from(task_cpumask, prev_cpu, idle_smtmask);
 out:
 	scx_bpf_put_idle_cpumask(idle_smtmask);
@@ -762,6 +874,22 @@ static inline bool vtime_before(u64 a, u64 b)
 	return (s64)(a - b) < 0;
 }
 
+/*
+ * The LLC whose DSQ @p should be queued on: that of @task_cpu if it belongs
+ * to @p's cell, otherwise that of some CPU of the cell.
+ */
+static inline u32 task_llc(struct task_ctx *tctx, s32 task_cpu)
+{
+	const struct cpumask *cpumask = (const struct cpumask *)tctx->cpumask;
+	s32 cpu;
+
+	if (cpumask && !bpf_cpumask_test_cpu(task_cpu, cpumask) &&
+	    (cpu = bpf_cpumask_any_distribute(cpumask)) < MAX_CPUS)
+		task_cpu = cpu;
+
+	return cpu_llc(task_cpu);
+}
+
 void BPF_STRUCT_OPS(mitosis_enqueue, struct task_struct *p, u64 enq_flags)
 {
 	struct cpu_ctx *cctx;
@@ -798,8 +926,10 @@ void BPF_STRUCT_OPS(mitosis_enqueue, struct task_struct *p, u64 enq_flags)
 	} else if (!tctx->all_cpus_allowed) {
 		scx_bpf_dispatch(p, LO_FALLBACK_DSQ, slice_ns, 0);
 	} else {
-		scx_bpf_dispatch_vtime(p, tctx->cell, slice_ns, vtime,
-				       enq_flags);
+		scx_bpf_dispatch_vtime(p,
+				       cell_llc_dsq(tctx->cell,
+						    task_llc(tctx, task_cpu)),
+				       slice_ns, vtime, enq_flags);
 	}
 
 	/*
@@ -812,10 +942,63 @@ out:
 	critical_section_exit();
 }
 
+/*
+ * Consume from @cell_idx's DSQ on @llc, or steal from the cell's other LLCs if
+ * it's empty.
+ *
+ * The cell may have lost all its CPUs in some LLCs on reconfiguration. Tasks
+ * already queued on those LLCs' DSQs could then only be reached by stealing,
+ * which never happens while the local DSQ stays busy. Drain them first.
+ */
+static bool consume_cell(u32 cell_idx, u32 llc, struct cpu_ctx *cctx)
+{
+	struct cell *cell;
+	u64 orphans;
+	u32 i;
+
+	if (!(cell = lookup_cell(cell_idx)))
+		return false;
+
+	orphans = ~READ_ONCE(cell->llc_mask);
+	if (nr_llcs < MAX_LLCS)
+		orphans &= (1LLU << nr_llcs) - 1;
+
+	if (orphans) {
+		bpf_for(i, 0, nr_llcs)
+		{
+			u64 dsq = cell_llc_dsq(cell_idx, i);
+
+			if (!(orphans & (1LLU << i)))
+				continue;
+			if (scx_bpf_dsq_nr_queued(dsq) && scx_bpf_consume(dsq)) {
+				cstat_inc(CSTAT_LLC_DRAIN, cell_idx, cctx);
+				return true;
+			}
+		}
+	}
+
+	if (scx_bpf_consume(cell_llc_dsq(cell_idx, llc))) {
+		cstat_inc(CSTAT_LLC_DISPATCH, cell_idx, cctx);
+		return true;
+	}
+
+	bpf_for(i, 1, nr_llcs)
+	{
+		u64 dsq = cell_llc_dsq(cell_idx, (llc + i) % nr_llcs);
+
+		if (scx_bpf_dsq_nr_queued(dsq) && scx_bpf_consume(dsq)) {
+			cstat_inc(CSTAT_LLC_STEAL, cell_idx, cctx);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void BPF_STRUCT_OPS(mitosis_dispatch, s32 cpu, struct task_struct *prev)
 {
 	struct cpu_ctx *cctx;
-	u32 prev_cell, cell;
+	u32 prev_cell, cell, llc = cpu_llc(cpu);
 
 	if (!(cctx = lookup_cpu_ctx(-1)))
 		return;
@@ -831,10 +1014,10 @@ void BPF_STRUCT_OPS(mitosis_dispatch, s32 cpu, struct task_struct *prev)
 	 * scheduling racing with assignment change, we schedule from the previous
 	 * cell first to make sure it drains.
 	 */
-	if (prev_cell != cell && scx_bpf_consume(prev_cell))
+	if (prev_cell != cell && consume_cell(prev_cell, llc, cctx))
 		return;
 
-	if (scx_bpf_consume(cell))
+	if (consume_cell(cell, llc, cctx))
 		return;
 
 	scx_bpf_consume(LO_FALLBACK_DSQ);
@@ -1083,15 +1266,67 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(mitosis_init)
 	if (cpumask)
 		bpf_cpumask_release(cpumask);
 
+	bpf_for(i, 0, MAX_LLCS)
+	{
+		struct cpumask_wrapper *cpumaskw;
+
+		if (!(cpumaskw = bpf_map_lookup_elem(&llc_cpumasks, &i)))
+			return -ENOENT;
+
+		cpumask = bpf_cpumask_create();
+		if (!cpumask)
+			return -ENOMEM;
+
+		cpumask = bpf_kptr_xchg(&cpumaskw->cpumask, cpumask);
+		if (cpumask) {
+			bpf_cpumask_release(cpumask);
+			return -EINVAL;
+		}
+	}
+
+	bpf_for(i, 0, nr_possible_cpus)
+	{
+		struct cpumask_wrapper *cpumaskw;
+
+		if (!(cpumaskw = bpf_map_lookup_elem(&tmp_cpumasks, &i)))
+			return -ENOENT;
+
+		cpumask = bpf_cpumask_create();
+		if (!cpumask)
+			return -ENOMEM;
+
+		cpumask = bpf_kptr_xchg(&cpumaskw->cpumask, cpumask);
+		if (cpumask) {
+			bpf_cpumask_release(cpumask);
+			return -EINVAL;
+		}
+
+		/* set @i in its LLC's cpumask */
+		u32 llc = cpu_llc(i);
+
+		if (!(cpumaskw = bpf_map_lookup_elem(&llc_cpumasks, &llc)))
+			return -ENOENT;
+
+		bpf_rcu_read_lock();
+		if (cpumaskw->cpumask)
+			bpf_cpumask_set_cpu(i, cpumaskw->cpumask);
+		bpf_rcu_read_unlock();
+	}
+
 	bpf_for(i, 0, MAX_CELLS)
 	{
 		struct cell_cpumask_wrapper *cpumaskw;
 		struct cell *cell = &cells[i];
 
-		ret = scx_bpf_create_dsq(i, -1);
-		if (ret < 0)
-			return ret;
-		cell->dsq = i;
+		u32 llc;
+
+		bpf_for(llc, 0, nr_llcs)
+		{
+			ret = scx_bpf_create_dsq(cell_llc_dsq(i, llc), -1);
+			if (ret < 0)
+				return ret;
+		}
+		cell->llc_mask = ~0LLU;
 
 		if (!(cpumaskw = bpf_map_lookup_elem(&cell_cpumasks, &i)))
 			return -ENOENT;
@@ -45,11 +45,20 @@ use scx_utils::scx_ops_load;
 use scx_utils::scx_ops_open;
 use scx_utils::uei_exited;
 use scx_utils::uei_report;
+use scx_utils::Topology;
 use scx_utils::UserExitInfo;
 
 const RAVG_FRAC_BITS: u32 = bpf_intf::ravg_consts_RAVG_FRAC_BITS;
 const MAX_CPUS: usize = bpf_intf::consts_MAX_CPUS as usize;
 const MAX_CELLS: usize = bpf_intf::consts_MAX_CELLS as usize;
+const MAX_LLCS: usize = bpf_intf::consts_MAX_LLCS as usize;
+const NR_CSTATS: usize = bpf_intf::cell_stat_idx_NR_CSTATS as usize;
+const LLC_CSTATS: [(usize, &str); 4] = [
+    (bpf_intf::cell_stat_idx_CSTAT_LLC_IDLE as usize, "llc_idle"),
+    (bpf_intf::cell_stat_idx_CSTAT_LLC_DISPATCH as usize, "llc_dispatch"),
+    (bpf_intf::cell_stat_idx_CSTAT_LLC_STEAL as usize, "llc_steal"),
+    (bpf_intf::cell_stat_idx_CSTAT_LLC_DRAIN as usize, "llc_drain"),
+];
 const USAGE_HALF_LIFE: u32 = bpf_intf::consts_USAGE_HALF_LIFE;
 
 lazy_static::lazy_static! {
@@ -259,6 +268,8 @@ struct Scheduler<'a> {
     cells: BTreeMap<u32, Cell>,
     cgroup_to_cell: HashMap<String, u32>,
     prev_percpu_cell_cycles: Vec<[u64; MAX_CELLS]>,
+    cpu_to_llc: Vec<usize>,
+    prev_llc_cstats: BTreeMap<(usize, usize), [u64; NR_CSTATS]>,
     last_reconfiguration: std::time::Instant,
     last_cpu_rebalancing: std::time::Instant,
     reconfiguration_interval: std::time::Duration,
@@ -302,6 +313,21 @@ impl<'a> Scheduler<'a> {
             cpu_pool.alloc();
         }
 
+        // Cells are subdivided into a DSQ per LLC.
+        let topo = Topology::new()?;
+        let mut cpu_to_llc = vec![0; *NR_POSSIBLE_CPUS];
+        let mut nr_llcs = 1;
+        for (id, cpu) in topo.cpus().iter() {
+            let llc = cpu.llc_id();
+            if llc >= MAX_LLCS {
+                bail!("LLC ID {} of CPU {} >= MAX_LLCS {}", llc, id, MAX_LLCS);
+            }
+            cpu_to_llc[*id] = llc;
+            skel.maps.rodata_data.cpu_to_llc[*id] = llc as u32;
+            nr_llcs = nr_llcs.max(llc + 1);
+        }
+        skel.maps.rodata_data.nr_llcs = nr_llcs as u32;
+
         let mut skel = scx_ops_load!(skel, mitosis, uei)?;
 
         let struct_ops = Some(scx_ops_attach!(skel, mitosis)?);
@@ -334,6 +360,8 @@ impl<'a> Scheduler<'a> {
             cells,
             cgroup_to_cell,
             prev_percpu_cell_cycles: vec![[0; MAX_CELLS]; nr_cpus],
+            cpu_to_llc,
+            prev_llc_cstats: BTreeMap::new(),
             last_reconfiguration: now,
             last_cpu_rebalancing: now,
             reconfiguration_interval: std::time::Duration::from_secs(
@@ -539,11 +567,19 @@ impl<'a> Scheduler<'a> {
             .lookup_percpu(zero_slice, libbpf_rs::MapFlags::ANY)
             .context("Failed to lookup cpu_ctxs map")?
         {
+            let mut llc_cstats: BTreeMap<(usize, usize), [u64; NR_CSTATS]> = BTreeMap::new();
             for (cpu, ctx) in v.iter().enumerate() {
                 let cpu_ctx = unsafe {
                     let ptr = ctx.as_slice().as_ptr() as *const bpf_intf::cpu_ctx;
                     &*ptr
                 };
+                let llc = self.cpu_to_llc.get(cpu).copied().unwrap_or(0);
+                for (cell, cstats) in cpu_ctx.cstats.iter().enumerate() {
+                    let acc = llc_cstats.entry((cell, llc)).or_insert([0; NR_CSTATS]);
+                    for (a, v) in acc.iter_mut().zip(cstats.iter()) {
+                        *a += v;
+                    }
+                }
                 let diff_cycles: Vec<i64> = self.prev_percpu_cell_cycles[cpu]
                     .iter()
                     .zip(cpu_ctx.cell_cycles.iter())
@@ -552,6 +588,45 @@ impl<'a> Scheduler<'a> {
                 self.prev_percpu_cell_cycles[cpu] = cpu_ctx.cell_cycles;
                 trace!("CPU {}: {:?}", cpu, diff_cycles);
             }
+
+            // LLC locality of each cell, in total and per LLC
+            let mut cell_locality: BTreeMap<usize, [u64; NR_CSTATS]> = BTreeMap::new();
+            for ((cell, llc), cstats) in llc_cstats.iter() {
+                let prev = self
+                    .prev_llc_cstats
+                    .get(&(*cell, *llc))
+                    .copied()
+                    .unwrap_or([0; NR_CSTATS]);
+                if cstats == &prev {
+                    continue;
+                }
+                let acc = cell_locality.entry(*cell).or_insert([0; NR_CSTATS]);
+                let diff: Vec<String> = LLC_CSTATS
+                    .iter()
+                    .map(|(idx, name)| {
+                        let delta = cstats[*idx] - prev[*idx];
+                        acc[*idx] += delta;
+                        format!("{}={}", name, delta)
+                    })
+                    .collect();
+                debug!("Cell {} LLC {}: {}", cell, llc, diff.join(" "));
+            }
+            for (cell, locality) in cell_locality.iter() {
+                let dispatch = locality[bpf_intf::cell_stat_idx_CSTAT_LLC_DISPATCH as usize];
+                let steal = locality[bpf_intf::cell_stat_idx_CSTAT_LLC_STEAL as usize];
+                let drain = locality[bpf_intf::cell_stat_idx_CSTAT_LLC_DRAIN as usize];
+                let diff: Vec<String> = LLC_CSTATS
+                    .iter()
+                    .map(|(idx, name)| format!("{}={}", name, locality[*idx]))
+                    .collect();
+                debug!(
+                    "Cell {} LLC locality: {} steal%={:.1}",
+                    cell,
+                    diff.join(" "),
+                    steal as f64 * 100.0 / (dispatch + steal + drain).max(1) as f64
+                );
+            }
+            self.prev_llc_cstats = llc_cstats;
         }
         Ok(())
     }
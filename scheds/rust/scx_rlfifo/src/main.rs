@@ -43,6 +43,7 @@
 //!
 //! struct QueuedTask {
 //!     pub pid: i32,              // pid that uniquely identifies a task
+//!     pub slot: u32,             // slot id, unique among the live tasks (< MAX_TASK_SLOTS)
 //!     pub cpu: i32,              // CPU previously used by the task
 //!     pub flags: u64,            // task's enqueue flags
 //!     pub sum_exec_runtime: u64, // Total cpu time in nanoseconds
@@ -62,7 +62,7 @@ const SCX_ENQ_WAKEUP: u64 = 1;
 /// All the tasks are stored in a BTreeSet (TaskTree), using vruntime as the ordering key.
 /// Once the order of execution is determined all tasks are sent back to the BPF counterpart to be
 /// dispatched. To keep track of the accumulated cputime and vruntime the scheduler maintain a
-/// HashMap (TaskInfoMap) indexed by pid.
+/// table (TaskInfoMap) indexed by the task slot ids assigned by the BPF component.
 ///
 /// The BPF dispatcher is completely agnostic of the particular scheduling policy implemented in
 /// user-space. For this reason developers that are willing to use this scheduler to experiment
@@ -124,8 +124,9 @@ const NSEC_PER_SEC: u64 = 1_000_000_000;
 const MAX_LATENCY_WEIGHT: u64 = 1_000;
 
 // Basic item stored in the task information map.
-#[derive(Debug)]
+#[derive(Debug, Default)]
 struct TaskInfo {
+    pid: i32, // owner of the slot
     nvcsw: u64,
     nvcsw_ts: u64,
     avg_nvcsw: u64,
@@ -135,24 +136,40 @@ struct TaskInfo {
 
 // Task information map: store total execution time and vruntime of each task in the system.
 //
-// TaskInfo objects are stored in the HashMap and they are indexed by pid.
+// TaskInfo objects are stored in a Vec indexed by the task's slot id (see QueuedTask.slot), that
+// is unique among the live tasks and always lower than MAX_TASK_SLOTS.
 //
-// Entries are removed when the corresponding task exits.
-//
-// This information is fetched from the BPF section (through the .exit_task() callback) and
-// received by the user-space scheduler via self.bpf.dequeue_task(): a task with a negative .cpu
-// value represents an exiting task, so in this case we can free the corresponding entry in
-// TaskInfoMap (see also Scheduler::drain_queued_tasks()).
+// Slots are reused when tasks exit, so each entry also records the pid of its owner and it is
+// reset when a different task shows up in the same slot.
 struct TaskInfoMap {
-    tasks: HashMap<i32, TaskInfo>,
+    tasks: Vec<TaskInfo>,
 }
 
-// TaskInfoMap implementation: provide methods to get items and update items by pid.
+// TaskInfoMap implementation: provide methods to get items and update items by slot.
 impl TaskInfoMap {
     fn new() -> Self {
-        TaskInfoMap {
-            tasks: HashMap::new(),
+        TaskInfoMap { tasks: Vec::new() }
+    }
+
+    // Get the information of a task, creating a new entry if the task is not known yet.
+    fn get_or_insert(&mut self, task: &QueuedTask, now: u64, vruntime: u64) -> &mut TaskInfo {
+        let slot = task.slot as usize;
+        if slot >= self.tasks.len() {
+            self.tasks.resize_with(slot + 1, TaskInfo::default);
+        }
+
+        let task_info = &mut self.tasks[slot];
+        if task_info.pid != task.pid {
+            *task_info = TaskInfo {
+                pid: task.pid,
+                nvcsw: task.nvcsw,
+                nvcsw_ts: now,
+                avg_nvcsw: 0,
+                sum_exec_runtime: task.sum_exec_runtime,
+                vruntime,
+            };
         }
+        task_info
     }
 }
 
@@ -220,7 +237,7 @@ struct Scheduler<'a> {
     bpf: BpfScheduler<'a>,                  // BPF connector
     stats_server: StatsServer<(), Metrics>, // statistics
     task_pool: TaskTree,                    // tasks ordered by deadline
-    task_map: TaskInfoMap,                  // map pids to the corresponding task information
+    task_map: TaskInfoMap,                  // map slots to the corresponding task information
     min_vruntime: u64,                      // Keep track of the minimum vruntime across all tasks
     init_page_faults: u64,                  // Initial page faults counter
     slice_ns: u64,                          // Default time slice (in ns)
@@ -294,17 +311,7 @@ impl<'a> Scheduler<'a> {
 
         // Get task information if the task is already stored in the task map,
         // otherwise create a new entry for it.
-        let task_info = self
-            .task_map
-            .tasks
-            .entry(task.pid)
-            .or_insert_with_key(|&_pid| TaskInfo {
-                nvcsw: task.nvcsw,
-                nvcsw_ts: now,
-                avg_nvcsw: 0,
-                sum_exec_runtime: task.sum_exec_runtime,
-                vruntime: self.min_vruntime,
-            });
+        let task_info = self.task_map.get_or_insert(task, now, self.min_vruntime);
 
         // Refresh voluntary context switches metrics.
         let delta_t = now - task_info.nvcsw_ts;
@@ -107,6 +107,7 @@ struct task_ctx {
 	u32 weight;
 	bool runnable;
 	u64 dom_active_tptrs_gen;
+	u32 dom_active_idx;
 	u64 deadline;
 
 	u64 sum_runtime;
@@ -130,7 +131,30 @@ struct task_ctx {
 	/* select_cpu() telling enqueue() to queue directly on the DSQ */
 	bool dispatch_local;
 
+	/* The domain DSQ @p is counted in dom_queued[] for and its weight */
+	u32 queued_dom;
+	u32 queued_weight;
+
+	struct ravg_data dcyc_rd;
+};
+
+/*
+ * Load balancing snapshot of a recently active task. The load balancer reads
+ * these directly from the mmapped dom_active_tasks map as task_ctx lives in
+ * task-local storage which userspace can't look up.
+ */
+struct dom_active_task {
+	u64 tptr;
+	u64 dom_mask;
+	u64 preferred_dom_mask;
 	struct ravg_data dcyc_rd;
+	u32 dom_id;
+	u32 weight;
+	bool is_kworker;
+};
+
+struct dom_active_ring {
+	struct dom_active_task tasks[MAX_DOM_ACTIVE_TPTRS];
 };
 
 struct bucket_ctx {
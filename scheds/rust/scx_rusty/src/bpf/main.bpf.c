@@ -8,7 +8,7 @@
  * calculates the load factor of each domain and tells the BPF part how to load
  * balance the domains.
  *
- * Every task has an entry in the task_data map which lists which domain the
+ * Every task has a task_ctx in task-local storage which lists which domain the
  * task belongs to. When a task first enters the system (rusty_prep_enable),
  * they are round-robined to a domain.
  *
@@ -29,11 +29,12 @@
  * corresponding dispatch queue (this occurs after scheduling any tasks directly
  * assigned to it due to the logic in rusty_select_cpu). If no task is found,
  * then greedy load stealing will attempt to find a task on another dispatch
- * queue to run.
+ * queue to run, starting with the most loaded domain on the same NUMA node.
  *
- * Load balancing is almost entirely handled by userspace. BPF populates the
- * task weight, dom mask and current dom in the task_data map and executes the
- * load balance based on userspace populating the lb_data map.
+ * Load balancing is almost entirely handled by userspace. BPF publishes the
+ * task weight, dom mask and current dom of recently active tasks in the
+ * dom_active_tasks rings and executes the load balance based on userspace
+ * populating the lb_data map.
  */
 
 #ifdef LSP
@@ -107,6 +108,20 @@ struct pcpu_ctx {
 
 struct pcpu_ctx pcpu_ctx[MAX_CPUS];
 
+/*
+ * Summary of the tasks waiting on each domain's DSQ. It's updated without
+ * locking when a task is queued and when it leaves the DSQ, and lets an idle
+ * CPU steal from the most loaded domain on its node first instead of probing
+ * the DSQs round-robin. It may lag behind the DSQs momentarily, which only
+ * affects the order in which the victims are tried.
+ */
+struct dom_queued {
+	s64 nr;
+	s64 load;	/* sum of the weights of the queued tasks */
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+struct dom_queued dom_queued[MAX_DOMS];
+
 /*
  * Numa node context
  */
@@ -153,20 +168,30 @@ struct dom_active_tptrs {
 	u64 gen;
 	u64 read_idx;
 	u64 write_idx;
-	u64 tptrs[MAX_DOM_ACTIVE_TPTRS];
 };
 
 struct dom_active_tptrs dom_active_tptrs[MAX_DOMS];
 
+/*
+ * The rings of recently active tasks indexed by dom_active_tptrs[].write_idx.
+ * Too large for .bss, so it lives in its own map which the load balancer
+ * mmaps to read the snapshots without any syscall.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, u32);
+	__type(value, struct dom_active_ring);
+	__uint(max_entries, MAX_DOMS);
+	__uint(map_flags, BPF_F_MMAPABLE);
+} dom_active_tasks SEC(".maps");
+
 const u64 ravg_1 = 1 << RAVG_FRAC_BITS;
 
-/* Map tptr -> task_ctx */
 struct {
-	__uint(type, BPF_MAP_TYPE_HASH);
-	__type(key, u64);
+	__uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
 	__type(value, struct task_ctx);
-	__uint(max_entries, 1000000);
-	__uint(map_flags, 0);
 } task_data SEC(".maps");
 
 static struct dom_ctx *try_lookup_dom_ctx(u32 dom_id)
@@ -201,10 +226,7 @@ static u64 t_to_tptr(struct task_struct *p)
 
 static struct task_ctx *try_lookup_task_ctx(struct task_struct *p)
 {
-	u64 tptr;
-	tptr = t_to_tptr(p);
-
-	return bpf_map_lookup_elem(&task_data, &tptr);
+	return bpf_task_storage_get(&task_data, p, 0, 0);
 }
 
 static struct task_ctx *lookup_task_ctx(struct task_struct *p)
@@ -220,6 +242,39 @@ static struct task_ctx *lookup_task_ctx(struct task_struct *p)
 	return taskc;
 }
 
+static void dom_queued_del(struct task_ctx *taskc)
+{
+	struct dom_queued *dq;
+
+	if (!taskc->queued_weight)
+		return;
+
+	dq = MEMBER_VPTR(dom_queued, [taskc->queued_dom]);
+	if (dq) {
+		__sync_fetch_and_sub(&dq->nr, 1);
+		__sync_fetch_and_sub(&dq->load, taskc->queued_weight);
+	}
+	taskc->queued_weight = 0;
+}
+
+static void dom_queued_add(struct task_ctx *taskc)
+{
+	u32 weight = taskc->weight ?: 1;
+	struct dom_queued *dq;
+
+	/* @p may have been dequeued without going through running */
+	dom_queued_del(taskc);
+
+	dq = MEMBER_VPTR(dom_queued, [taskc->dom_id]);
+	if (!dq)
+		return;
+
+	__sync_fetch_and_add(&dq->nr, 1);
+	__sync_fetch_and_add(&dq->load, weight);
+	taskc->queued_dom = taskc->dom_id;
+	taskc->queued_weight = weight;
+}
+
 static struct pcpu_ctx *lookup_pcpu_ctx(s32 cpu)
 {
 	struct pcpu_ctx *pcpuc;
@@ -237,11 +292,54 @@ static inline u32 weight_to_bucket_idx(u32 weight)
 	return weight * LB_LOAD_BUCKETS / LB_MAX_WEIGHT;
 }
 
-static void task_load_adj(struct task_ctx *taskc,
+/*
+ * Returns @p's snapshot in its domain's active ring if @p has been recorded
+ * in the current generation and the slot hasn't been reused since.
+ */
+static struct dom_active_task *lookup_dom_active_task(struct task_struct *p,
+						      struct task_ctx *taskc)
+{
+	struct dom_active_ring *ring;
+	struct dom_active_task *snap;
+	u32 dom_id = taskc->dom_id;
+
+	if (dom_id >= MAX_DOMS ||
+	    taskc->dom_active_tptrs_gen != dom_active_tptrs[dom_id].gen)
+		return NULL;
+
+	ring = bpf_map_lookup_elem(&dom_active_tasks, &dom_id);
+	if (!ring)
+		return NULL;
+
+	snap = MEMBER_VPTR(*ring, .tasks[taskc->dom_active_idx]);
+	if (!snap || snap->tptr != t_to_tptr(p))
+		return NULL;
+
+	return snap;
+}
+
+static void dom_active_task_fill(struct dom_active_task *snap,
+				 struct task_ctx *taskc)
+{
+	snap->dom_mask = taskc->dom_mask;
+	snap->preferred_dom_mask = taskc->preferred_dom_mask;
+	snap->dcyc_rd = taskc->dcyc_rd;
+	snap->dom_id = taskc->dom_id;
+	snap->weight = taskc->weight;
+	snap->is_kworker = taskc->is_kworker;
+}
+
+static void task_load_adj(struct task_struct *p, struct task_ctx *taskc,
 			  u64 now, bool runnable)
 {
+	struct dom_active_task *snap;
+
 	taskc->runnable = runnable;
 	ravg_accumulate(&taskc->dcyc_rd, taskc->runnable, now, load_half_life);
+
+	/* keep the snapshot fresh until the load balancer consumes it */
+	if ((snap = lookup_dom_active_task(p, taskc)))
+		dom_active_task_fill(snap, taskc);
 }
 
 static struct bucket_ctx *lookup_dom_bucket(struct dom_ctx *dom_ctx,
@@ -414,48 +512,18 @@ static u64 dom_min_vruntime(struct dom_ctx *domc)
 	return READ_ONCE(domc->min_vruntime);
 }
 
-static struct task_struct *tptr_to_task(u64 tptr)
-{
-	struct task_struct *p, *task;
-	int err_task;
-
-	task = (struct task_struct *)tptr;
-
-	err_task = bpf_probe_read_kernel(&p, sizeof(struct task_struct *), &task);
-	if (err_task) {
-		scx_bpf_error("Failed to retrieve task_struct for tptr %llu",
-			      tptr);
-		return NULL;
-	}
-
-	return p;
-}
-
-int dom_xfer_task(u64 tptr, u32 new_dom_id, u64 now)
+static void dom_xfer_task(struct task_struct *p, struct task_ctx *taskc,
+			  u32 new_dom_id, u64 now)
 {
 	struct dom_ctx *from_domc, *to_domc;
-	struct task_ctx *taskc;
-	struct task_struct *p;
-
-	p = tptr_to_task(tptr);
-
-	if (!p) {
-		scx_bpf_error("Failed to lookup task %llu", tptr);
-		return 0;
-	}
-
-	taskc = lookup_task_ctx(p);
-	if (!taskc)
-		return 0;
 
 	from_domc = lookup_dom_ctx(taskc->dom_id);
 	to_domc = lookup_dom_ctx(new_dom_id);
 
-	if (!from_domc || !to_domc || !taskc)
-		return 0;
+	if (!from_domc || !to_domc)
+		return;
 
 	dom_dcycle_xfer_task(p, taskc, from_domc, to_domc, now);
-	return 0;
 }
 
 /*
@@ -479,7 +547,8 @@ static inline void stat_add(enum stat_idx idx, u64 addend)
 
 /*
  * This is populated from userspace to indicate which tptrs should be reassigned
- * to new doms.
+ * to new doms. It's only consulted from enqueue where the task_struct is at
+ * hand, so this small map is the only place tasks are still keyed by tptr.
  */
 struct {
 	__uint(type, BPF_MAP_TYPE_HASH);
@@ -785,9 +854,7 @@ static bool task_set_domain(struct task_ctx *taskc, struct task_struct *p,
 {
 	struct dom_ctx *old_domc, *new_domc;
 	struct bpf_cpumask *d_cpumask, *t_cpumask;
-	u64 tptr;
 	u32 old_dom_id = taskc->dom_id;
-	tptr = t_to_tptr(p);
 
 	t_cpumask = taskc->cpumask;
 	if (!t_cpumask) {
@@ -821,10 +888,19 @@ static bool task_set_domain(struct task_ctx *taskc, struct task_struct *p,
 	 * here and @p might not be able to run in @dom_id anymore. Verify.
 	 */
 	if (bpf_cpumask_intersects(cast_mask(d_cpumask), p->cpus_ptr)) {
+		struct dom_active_task *snap;
 		u64 now = bpf_ktime_get_ns();
 
 		if (!init_dsq_vtime)
-			dom_xfer_task(tptr, new_dom_id, now);
+			dom_xfer_task(p, taskc, new_dom_id, now);
+
+		/*
+		 * Retire the snapshot in the old domain's ring. @p is recorded
+		 * in the new domain's ring when it runs next.
+		 */
+		if ((snap = lookup_dom_active_task(p, taskc)))
+			snap->dom_id = new_dom_id;
+		taskc->dom_active_tptrs_gen = -1;
 
 		taskc->dom_id = new_dom_id;
 		p->scx.dsq_vtime = dom_min_vruntime(new_domc);
@@ -1184,6 +1260,7 @@ dom_queue:
 		scx_bpf_dispatch(p, taskc->dom_id, slice_ns, enq_flags);
 	else
 		place_task_dl(p, taskc, enq_flags);
+	dom_queued_add(taskc);
 
 	/*
 	 * If there are CPUs which are idle and not saturated, wake them up to
@@ -1300,6 +1377,47 @@ static void task_set_preferred_mempolicy_dom_mask(struct task_struct *p,
 	return;
 }
 
+/*
+ * Steal from the domain on @node with the most queued load according to
+ * dom_queued[]. If the summary was stale and the victim turns out to be empty,
+ * try the next most loaded one.
+ */
+static bool steal_most_loaded(u32 curr_dom, u32 node)
+{
+	u64 tried = 1LLU << curr_dom;
+
+	bpf_repeat(nr_doms - 1) {
+		u32 dom, victim = NO_DOM_FOUND;
+		s64 max_load = 0;
+
+		bpf_for(dom, 0, nr_doms) {
+			struct dom_queued *dq;
+			s64 load;
+
+			if ((tried & (1LLU << dom)) || dom_node_id(dom) != node)
+				continue;
+			if (!(dq = MEMBER_VPTR(dom_queued, [dom])))
+				break;
+			if (READ_ONCE(dq->nr) <= 0)
+				continue;
+
+			load = READ_ONCE(dq->load);
+			if (victim == NO_DOM_FOUND || load > max_load) {
+				victim = dom;
+				max_load = load;
+			}
+		}
+
+		if (victim == NO_DOM_FOUND)
+			return false;
+		if (scx_bpf_consume(victim))
+			return true;
+		tried |= 1LLU << victim;
+	}
+
+	return false;
+}
+
 void BPF_STRUCT_OPS(rusty_dispatch, s32 cpu, struct task_struct *prev)
 {
 	u32 curr_dom = cpu_to_dom_id(cpu), dom;
@@ -1331,15 +1449,9 @@ void BPF_STRUCT_OPS(rusty_dispatch, s32 cpu, struct task_struct *prev)
 	my_node = dom_node_id(curr_dom);
 
 	/* try to steal a task from domains on the current NUMA node */
-	bpf_repeat(nr_doms - 1) {
-		dom = pcpuc->dom_rr_cur++ % nr_doms;
-		if (dom == curr_dom || dom_node_id(dom) != my_node)
-			continue;
-
-		if (scx_bpf_consume(dom)) {
-			stat_add(RUSTY_STAT_GREEDY_LOCAL, 1);
-			return;
-		}
+	if (steal_most_loaded(curr_dom, my_node)) {
+		stat_add(RUSTY_STAT_GREEDY_LOCAL, 1);
+		return;
 	}
 
 	if (!greedy_threshold_x_numa || nr_nodes == 1)
@@ -1391,7 +1503,7 @@ void BPF_STRUCT_OPS(rusty_runnable, struct task_struct *p, u64 enq_flags)
 
 	wakee_ctx->is_kworker = p->flags & PF_WQ_WORKER;
 
-	task_load_adj(wakee_ctx, now, true);
+	task_load_adj(p, wakee_ctx, now, true);
 	dom_dcycle_adj(wakee_ctx->dom_id, wakee_ctx->weight, now, true);
 
 	if (fifo_sched)
@@ -1432,6 +1544,8 @@ void BPF_STRUCT_OPS(rusty_running, struct task_struct *p)
 	if (!(taskc = lookup_task_ctx(p)))
 		return;
 
+	dom_queued_del(taskc);
+
 	dom_id = taskc->dom_id;
 	if (dom_id >= MAX_DOMS) {
 		scx_bpf_error("Invalid dom ID");
@@ -1447,17 +1561,21 @@ void BPF_STRUCT_OPS(rusty_running, struct task_struct *p)
 	if (taskc->dom_active_tptrs_gen != dap_gen) {
 		u64 idx = __sync_fetch_and_add(&dom_active_tptrs[dom_id].write_idx, 1) %
 			MAX_DOM_ACTIVE_TPTRS;
-		u64 *tptrp;
+		struct dom_active_ring *ring;
+		struct dom_active_task *snap;
 
-		tptrp = MEMBER_VPTR(dom_active_tptrs, [dom_id].tptrs[idx]);
-		if (!tptrp) {
-			scx_bpf_error("dom_active_tptrs[%u][%llu] indexing failed",
+		ring = bpf_map_lookup_elem(&dom_active_tasks, &dom_id);
+		snap = ring ? MEMBER_VPTR(*ring, .tasks[idx]) : NULL;
+		if (!snap) {
+			scx_bpf_error("dom_active_tasks[%u][%llu] indexing failed",
 				      dom_id, idx);
 			return;
 		}
 
-		*tptrp = t_to_tptr(p);
+		snap->tptr = t_to_tptr(p);
+		dom_active_task_fill(snap, taskc);
 		taskc->dom_active_tptrs_gen = dap_gen;
+		taskc->dom_active_idx = idx;
 	}
 
 	if (fifo_sched)
@@ -1517,7 +1635,8 @@ void BPF_STRUCT_OPS(rusty_quiescent, struct task_struct *p, u64 deq_flags)
 	if (!(taskc = lookup_task_ctx(p)))
 		return;
 
-	task_load_adj(taskc, now, false);
+	dom_queued_del(taskc);
+	task_load_adj(p, taskc, now, false);
 	dom_dcycle_adj(taskc->dom_id, taskc->weight, now, false);
 
 	if (fifo_sched)
@@ -1639,55 +1758,37 @@ s32 BPF_STRUCT_OPS(rusty_init_task, struct task_struct *p,
 		   struct scx_init_task_args *args)
 {
 	u64 now = bpf_ktime_get_ns();
-	struct task_ctx taskc = {
-		.dom_active_tptrs_gen = -1,
-		.last_blocked_at = now,
-		.last_woke_at = now,
-		.preferred_dom_mask = 0,
-
-	};
-	struct task_ctx *map_value;
+	struct task_ctx *taskc;
 	long ret;
-	u64 tptr;
-
-	tptr = t_to_tptr(p);
 
-	/*
-	 * XXX - We want BPF_NOEXIST but bpf_map_delete_elem() in .disable() may
-	 * fail spuriously due to BPF recursion protection triggering
-	 * unnecessarily.
-	 */
-	ret = bpf_map_update_elem(&task_data, &tptr, &taskc, 0 /*BPF_NOEXIST*/);
-	if (ret) {
+	taskc = bpf_task_storage_get(&task_data, p, 0,
+				     BPF_LOCAL_STORAGE_GET_F_CREATE);
+	if (!taskc) {
 		stat_add(RUSTY_STAT_TASK_GET_ERR, 1);
-		return ret;
+		return -ENOMEM;
 	}
 
-	if (debug >= 2)
-		bpf_printk("%s[%llu]: INIT (weight %u))", p->comm, tptr, p->scx.weight);
+	taskc->dom_active_tptrs_gen = -1;
+	taskc->last_blocked_at = now;
+	taskc->last_woke_at = now;
 
-	/*
-	 * Read the entry from the map immediately so we can add the cpumask
-	 * with bpf_kptr_xchg().
-	 */
-	map_value = bpf_map_lookup_elem(&task_data, &tptr);
-	if (!map_value)
-		/* Should never happen -- it was just inserted above. */
-		return -EINVAL;
+	if (debug >= 2)
+		bpf_printk("%s[%llu]: INIT (weight %u))", p->comm, t_to_tptr(p),
+			   p->scx.weight);
 
-	ret = create_save_cpumask(&map_value->cpumask);
+	ret = create_save_cpumask(&taskc->cpumask);
 	if (ret) {
-		bpf_map_delete_elem(&task_data, &tptr);
+		bpf_task_storage_delete(&task_data, p);
 		return ret;
 	}
 
-	ret = create_save_cpumask(&map_value->tmp_cpumask);
+	ret = create_save_cpumask(&taskc->tmp_cpumask);
 	if (ret) {
-		bpf_map_delete_elem(&task_data, &tptr);
+		bpf_task_storage_delete(&task_data, p);
 		return ret;
 	}
 
-	task_pick_and_set_domain(map_value, p, p->cpus_ptr, true);
+	task_pick_and_set_domain(taskc, p, p->cpus_ptr, true);
 
 	return 0;
 }
@@ -1695,20 +1796,28 @@ s32 BPF_STRUCT_OPS(rusty_init_task, struct task_struct *p,
 void BPF_STRUCT_OPS(rusty_exit_task, struct task_struct *p,
 		    struct scx_exit_task_args *args)
 {
-	u64 tptr = t_to_tptr(p);
-	long ret;
+	struct dom_active_task *snap;
+	struct task_ctx *taskc;
+
+	if ((taskc = try_lookup_task_ctx(p))) {
+		dom_queued_del(taskc);
+
+		/*
+		 * Retire @p's snapshot so that the load balancer doesn't pick
+		 * an exited task as a migration candidate.
+		 */
+		if ((snap = lookup_dom_active_task(p, taskc))) {
+			snap->dom_id = NO_DOM_FOUND;
+			snap->tptr = 0;
+		}
+	}
 
 	/*
-	 * XXX - There's no reason delete should fail here but BPF's recursion
-	 * protection can unnecessarily fail the operation. The fact that
-	 * deletions aren't reliable means that we sometimes leak task_ctx and
-	 * can't use BPF_NOEXIST on allocation in .prep_enable().
+	 * The storage would be freed along with @p anyway. Delete it now so
+	 * that a fresh task_ctx is created if @p comes back to this scheduler.
 	 */
-	ret = bpf_map_delete_elem(&task_data, &tptr);
-	if (ret) {
+	if (bpf_task_storage_delete(&task_data, p))
 		stat_add(RUSTY_STAT_TASK_GET_ERR, 1);
-		return;
-	}
 }
 
 static s32 create_node(u32 node_id)
@@ -135,6 +135,8 @@ use std::cell::Cell;
 use std::collections::BTreeMap;
 use std::collections::VecDeque;
 use std::fmt;
+use std::os::fd::AsFd;
+use std::os::fd::AsRawFd;
 use std::sync::Arc;
 
 use anyhow::bail;
@@ -144,7 +146,7 @@ use libbpf_rs::MapCore as _;
 use log::debug;
 use log::warn;
 use ordered_float::OrderedFloat;
-use scx_utils::ravg::ravg_read;
+use scx_utils::ravg::RavgBatch;
 use scx_utils::LoadAggregator;
 use scx_utils::LoadLedger;
 use sorted_vec::SortedVec;
@@ -168,6 +170,66 @@ fn now_monotonic() -> u64 {
     time.tv_sec as u64 * 1_000_000_000 + time.tv_nsec as u64
 }
 
+/// The dom_active_tasks map mmapped read-only. BPF keeps a snapshot of each
+/// recently active task in its domain's ring so that the load balancer can
+/// collect the candidates without a syscall per task.
+pub struct DomActiveTasks {
+    rings: *const bpf_intf::dom_active_ring,
+    len: usize,
+}
+
+impl DomActiveTasks {
+    pub fn new(skel: &BpfSkel) -> Result<Self> {
+        const MAX_DOMS: usize = bpf_intf::consts_MAX_DOMS as usize;
+        let len = std::mem::size_of::<bpf_intf::dom_active_ring>() * MAX_DOMS;
+        let fd = skel.maps.dom_active_tasks.as_fd().as_raw_fd();
+
+        let rings = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_SHARED,
+                fd,
+                0,
+            )
+        };
+        if rings == libc::MAP_FAILED {
+            bail!(
+                "Failed to mmap dom_active_tasks ({})",
+                std::io::Error::last_os_error()
+            );
+        }
+
+        Ok(Self {
+            rings: rings as *const bpf_intf::dom_active_ring,
+            len,
+        })
+    }
+
+    /// Copy of the snapshot in slot @idx of @dom's ring. BPF may be
+    /// updating it concurrently, which is fine as the LB is best-effort.
+    /// Returns None if the slot doesn't hold a task of @dom, e.g. when BPF
+    /// retired the snapshot because the task exited.
+    fn read(&self, dom: usize, idx: usize) -> Option<bpf_intf::dom_active_task> {
+        const MAX_DOMS: usize = bpf_intf::consts_MAX_DOMS as usize;
+        assert!(dom < MAX_DOMS);
+        let task = unsafe { std::ptr::read_volatile(&(*self.rings.add(dom)).tasks[idx]) };
+        if task.tptr == 0 || task.dom_id as usize != dom {
+            return None;
+        }
+        Some(task)
+    }
+}
+
+impl Drop for DomActiveTasks {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.rings as *mut libc::c_void, self.len);
+        }
+    }
+}
+
 fn clear_map(map: &libbpf_rs::Map) {
     for key in map.keys() {
         let _ = map.delete(&key);
@@ -472,6 +534,7 @@ impl_ord_for_type!(NumaNode);
 
 pub struct LoadBalancer<'a, 'b> {
     skel: &'a mut BpfSkel<'b>,
+    dom_active_tasks: &'a DomActiveTasks,
     dom_group: Arc<DomainGroup>,
     skip_kworkers: bool,
 
@@ -493,6 +556,7 @@ const_assert_eq!(
 impl<'a, 'b> LoadBalancer<'a, 'b> {
     pub fn new(
         skel: &'a mut BpfSkel<'b>,
+        dom_active_tasks: &'a DomActiveTasks,
         dom_group: Arc<DomainGroup>,
         skip_kworkers: bool,
         lb_apply_weight: bool,
@@ -500,6 +564,7 @@ impl<'a, 'b> LoadBalancer<'a, 'b> {
     ) -> Self {
         Self {
             skel,
+            dom_active_tasks,
             skip_kworkers,
 
             infeas_threshold: bpf_intf::consts_LB_MAX_WEIGHT as f64,
@@ -587,6 +652,8 @@ impl<'a, 'b> LoadBalancer<'a, 'b> {
 
         let mut aggregator =
             LoadAggregator::new(self.dom_group.weight(), !self.lb_apply_weight.clone());
+        let mut rds = RavgBatch::with_capacity(NUM_BUCKETS as usize);
+        let mut duty_cycles = vec![];
 
         for dom_id in self.dom_group.doms().keys() {
             let dom = *dom_id;
@@ -601,24 +668,19 @@ impl<'a, 'b> LoadBalancer<'a, 'b> {
                 let dom_ctx =
                     unsafe { &*(dom_ctx_map_elem.as_slice().as_ptr() as *const bpf_intf::dom_ctx) };
 
-                for bucket in 0..NUM_BUCKETS {
-                    let bucket_ctx = dom_ctx.buckets[bucket as usize];
+                rds.clear();
+                for bucket_ctx in dom_ctx.buckets.iter() {
                     let rd = &bucket_ctx.rd;
-                    let duty_cycle = ravg_read(
-                        rd.val,
-                        rd.val_at,
-                        rd.old,
-                        rd.cur,
-                        now_mono,
-                        load_half_life,
-                        RAVG_FRAC_BITS,
-                    );
+                    rds.push(rd.val, rd.val_at, rd.old, rd.cur);
+                }
+                rds.read(now_mono, load_half_life, RAVG_FRAC_BITS, &mut duty_cycles);
 
+                for (bucket, &duty_cycle) in duty_cycles.iter().enumerate() {
                     if duty_cycle == 0.0f64 {
                         continue;
                     }
 
-                    let weight = self.bucket_weight(bucket);
+                    let weight = self.bucket_weight(bucket as u64);
                     aggregator.record_dom_load(dom, weight, duty_cycle)?;
                 }
             }
@@ -666,54 +728,59 @@ impl<'a, 'b> LoadBalancer<'a, 'b> {
         active_tptrs.read_idx = active_tptrs.write_idx;
         active_tptrs.gen += 1;
 
-        let active_tptrs = &self.skel.maps.bss_data.dom_active_tptrs[dom.id];
         if widx - ridx > MAX_TPTRS {
             ridx = widx - MAX_TPTRS;
         }
 
-        // Read task_ctx and load.
+        // Read the task snapshots and load.
         let load_half_life = self.skel.maps.rodata_data.load_half_life;
-        let task_data = &self.skel.maps.task_data;
         let now_mono = now_monotonic();
 
-        for idx in ridx..widx {
-            let tptr = active_tptrs.tptrs[(idx % MAX_TPTRS) as usize];
-            let key = unsafe { std::mem::transmute::<u64, [u8; 8]>(tptr) };
+        // Collect the candidates first so that their loads can be read in
+        // one batch.
+        let mut candidates = Vec::with_capacity((widx - ridx) as usize);
+        let mut rds = RavgBatch::with_capacity((widx - ridx) as usize);
 
-            if let Some(task_data_elem) = task_data.lookup(&key, libbpf_rs::MapFlags::ANY)? {
-                let task_ctx =
-                    unsafe { &*(task_data_elem.as_slice().as_ptr() as *const bpf_intf::task_ctx) };
-                if task_ctx.dom_id as usize != dom.id {
-                    continue;
-                }
+        for idx in ridx..widx {
+            let task = match self
+                .dom_active_tasks
+                .read(dom.id, (idx % MAX_TPTRS) as usize)
+            {
+                Some(task) => task,
+                None => continue,
+            };
+
+            let rd = &task.dcyc_rd;
+            rds.push(rd.val, rd.val_at, rd.old, rd.cur);
+            candidates.push((
+                task.tptr,
+                task.weight,
+                task.dom_mask,
+                task.preferred_dom_mask,
+                task.is_kworker,
+            ));
+        }
 
-                let rd = &task_ctx.dcyc_rd;
-                let mut load = ravg_read(
-                    rd.val,
-                    rd.val_at,
-                    rd.old,
-                    rd.cur,
-                    now_mono,
-                    load_half_life,
-                    RAVG_FRAC_BITS,
-                );
+        let mut loads = vec![];
+        rds.read(now_mono, load_half_life, RAVG_FRAC_BITS, &mut loads);
 
-                let weight = if self.lb_apply_weight {
-                    (task_ctx.weight as f64).min(self.infeas_threshold)
-                } else {
-                    DEFAULT_WEIGHT
-                };
-                load *= weight;
-
-                dom.tasks.insert(TaskInfo {
-                    tptr,
-                    load: OrderedFloat(load),
-                    dom_mask: task_ctx.dom_mask,
-                    preferred_dom_mask: task_ctx.preferred_dom_mask,
-                    migrated: Cell::new(false),
-                    is_kworker: task_ctx.is_kworker,
-                });
-            }
+        for ((tptr, weight, dom_mask, preferred_dom_mask, is_kworker), load) in
+            candidates.into_iter().zip(loads.into_iter())
+        {
+            let weight = if self.lb_apply_weight {
+                (weight as f64).min(self.infeas_threshold)
+            } else {
+                DEFAULT_WEIGHT
+            };
+
+            dom.tasks.insert(TaskInfo {
+                tptr,
+                load: OrderedFloat(load * weight),
+                dom_mask,
+                preferred_dom_mask,
+                migrated: Cell::new(false),
+                is_kworker,
+            });
         }
 
         Ok(())
@@ -13,6 +13,7 @@ pub mod tuner;
 use tuner::Tuner;
 
 pub mod load_balance;
+use load_balance::DomActiveTasks;
 use load_balance::LoadBalancer;
 
 mod stats;
@@ -334,6 +335,7 @@ impl StatsCtx {
 struct Scheduler<'a> {
     skel: BpfSkel<'a>,
     struct_ops: Option<libbpf_rs::Link>,
+    dom_active_tasks: DomActiveTasks,
 
     sched_interval: Duration,
     tune_interval: Duration,
@@ -449,6 +451,7 @@ impl<'a> Scheduler<'a> {
 
         // Attach.
         let mut skel = scx_ops_load!(skel, rusty, uei)?;
+        let dom_active_tasks = DomActiveTasks::new(&skel)?;
         let struct_ops = Some(scx_ops_attach!(skel, rusty)?);
         let stats_server = StatsServer::new(stats::server_data()).launch()?;
 
@@ -460,6 +463,7 @@ impl<'a> Scheduler<'a> {
         Ok(Self {
             skel,
             struct_ops, // should be held to keep it attached
+            dom_active_tasks,
 
             sched_interval: Duration::from_secs_f64(opts.interval),
             tune_interval: Duration::from_secs_f64(opts.tune_interval),
@@ -557,6 +561,7 @@ impl<'a> Scheduler<'a> {
     fn lb_step(&mut self) -> Result<()> {
         let mut lb = LoadBalancer::new(
             &mut self.skel,
+            &self.dom_active_tasks,
             self.dom_group.clone(),
             self.balanced_kworkers,
             self.tuner.fully_utilized.clone(),
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Stand-in for libbpf's bpf_core_read.h, see bpf_helpers.h. The policies
+ * are compiled against the same vmlinux.h the simulator uses, so every CO-RE
+ * relocation is resolved at build time.
+ */
+#ifndef __SIM_BPF_CORE_READ_H
+#define __SIM_BPF_CORE_READ_H
+
+#define bpf_core_field_exists(field)			1
+#define bpf_core_type_exists(type)			1
+#define bpf_core_enum_value_exists(enum_type, value)	1
+/* bpf_obj_new() passes this to bpf_obj_new_impl() which only needs the size */
+#define bpf_core_type_id_local(type)			sizeof(type)
+
+#define ___sim_core_read1(s, a)			((s)->a)
+#define ___sim_core_read2(s, a, b)		((s)->a->b)
+#define ___sim_core_read3(s, a, b, c)		((s)->a->b->c)
+#define ___sim_core_read4(s, a, b, c, d)	((s)->a->b->c->d)
+#define BPF_CORE_READ(src, a, ...)						\
+	___bpf_apply(___sim_core_read, ___bpf_narg(a, ##__VA_ARGS__))(src, a, ##__VA_ARGS__)
+
+#endif /* __SIM_BPF_CORE_READ_H */
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Stand-in for libbpf's bpf_helpers.h used to build the .bpf.c policies as
+ * regular userspace code for the scheduling simulator.
+ *
+ * Section and BTF annotations are dropped, kfuncs become plain extern
+ * functions implemented in sim_ext.c and the BPF helpers the simulator
+ * supports are declared as regular functions. Calling a helper or a kfunc
+ * which isn't implemented fails at link time, except for __weak kfuncs which
+ * bpf_ksym_exists() reports as missing as it would on an older kernel.
+ */
+#ifndef __SIM_BPF_HELPERS_H
+#define __SIM_BPF_HELPERS_H
+
+#define SEC(name)		__attribute__((used))
+#define __uint(name, val)	int (*name)[val]
+#define __type(name, val)	typeof(val) *name
+#define __array(name, val)	typeof(val) *name[]
+#define __ulong(name, val)	enum { ___bpf_concat(__unique_value, __COUNTER__) = val } name
+
+#define __ksym
+/* Kconfig values the policies use are defined in sim_ext.c */
+#define __kconfig
+#define __kptr
+#define __kptr_untrusted
+#define __percpu_kptr
+#define __weak			__attribute__((weak))
+#define __hidden		__attribute__((visibility("hidden")))
+#define __noinline		__attribute__((noinline))
+#undef __always_inline
+#define __always_inline		inline __attribute__((always_inline))
+
+#ifndef NULL
+#define NULL			((void *)0)
+#endif
+
+#ifndef barrier
+#define barrier()		asm volatile("" ::: "memory")
+#endif
+
+#define ___bpf_concat(a, b)	a ## b
+#define ___bpf_apply(fn, n)	___bpf_concat(fn, n)
+#define ___bpf_nth(_, _1, _2, _3, _4, _5, _6, _7, _8, _9, _a, _b, _c, N, ...) N
+#define ___bpf_narg(...)	___bpf_nth(_, ##__VA_ARGS__, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#define ___bpf_fill0(arr, p, x) do {} while (0)
+#define ___bpf_fill1(arr, p, x) arr[p] = x
+#define ___bpf_fill2(arr, p, x, args...) arr[p] = x; ___bpf_fill1(arr, p + 1, args)
+#define ___bpf_fill3(arr, p, x, args...) arr[p] = x; ___bpf_fill2(arr, p + 1, args)
+#define ___bpf_fill4(arr, p, x, args...) arr[p] = x; ___bpf_fill3(arr, p + 1, args)
+#define ___bpf_fill5(arr, p, x, args...) arr[p] = x; ___bpf_fill4(arr, p + 1, args)
+#define ___bpf_fill6(arr, p, x, args...) arr[p] = x; ___bpf_fill5(arr, p + 1, args)
+#define ___bpf_fill7(arr, p, x, args...) arr[p] = x; ___bpf_fill6(arr, p + 1, args)
+#define ___bpf_fill8(arr, p, x, args...) arr[p] = x; ___bpf_fill7(arr, p + 1, args)
+#define ___bpf_fill9(arr, p, x, args...) arr[p] = x; ___bpf_fill8(arr, p + 1, args)
+#define ___bpf_fill10(arr, p, x, args...) arr[p] = x; ___bpf_fill9(arr, p + 1, args)
+#define ___bpf_fill11(arr, p, x, args...) arr[p] = x; ___bpf_fill10(arr, p + 1, args)
+#define ___bpf_fill12(arr, p, x, args...) arr[p] = x; ___bpf_fill11(arr, p + 1, args)
+#define ___bpf_fill(arr, args...) \
+	___bpf_apply(___bpf_fill, ___bpf_narg(args))(arr, 0, args)
+
+/* Weak symbols which aren't implemented resolve to NULL */
+#define bpf_ksym_exists(sym)	(!!&(sym))
+
+/* Open coded iterators become plain loops */
+#define bpf_for(i, start, end)	for ((i) = (start); (i) < (end); (i)++)
+#define bpf_repeat(N)		for (int ___i = 0; ___i < (N); ___i++)
+#define bpf_for_each(type, cur, args...)					\
+	for (struct bpf_iter_##type ___it					\
+		__attribute__((cleanup(bpf_iter_##type##_destroy))),		\
+	     *___p __attribute__((unused)) =					\
+		(bpf_iter_##type##_new(&___it, ##args), &___it);		\
+	     ((cur) = bpf_iter_##type##_next(&___it));)
+
+#define bpf_printk(fmt, args...)						\
+({										\
+	unsigned long long ___param[___bpf_narg(args) ?: 1] = {};		\
+										\
+	_Pragma("GCC diagnostic push")						\
+	_Pragma("GCC diagnostic ignored \"-Wint-conversion\"")		\
+	___bpf_fill(___param, args);						\
+	_Pragma("GCC diagnostic pop")						\
+	sim_bpf_printk(fmt, ___param, ___bpf_narg(args));			\
+})
+
+void sim_bpf_printk(const char *fmt, unsigned long long *args, int nr_args);
+
+/* Helpers supported by the simulator */
+void *bpf_map_lookup_elem(void *map, const void *key);
+void *bpf_map_lookup_percpu_elem(void *map, const void *key, u32 cpu);
+long bpf_map_update_elem(void *map, const void *key, const void *value, u64 flags);
+long bpf_map_delete_elem(void *map, const void *key);
+void *bpf_task_storage_get(void *map, struct task_struct *task, void *value, u64 flags);
+long bpf_task_storage_delete(void *map, struct task_struct *task);
+u64 bpf_ktime_get_ns(void);
+u64 bpf_ktime_get_boot_ns(void);
+u32 bpf_get_smp_processor_id(void);
+u32 bpf_get_prandom_u32(void);
+u64 bpf_get_current_pid_tgid(void);
+long bpf_probe_read_kernel(void *dst, u32 size, const void *unsafe_ptr);
+long bpf_probe_read_kernel_str(void *dst, u32 size, const void *unsafe_ptr);
+void *bpf_kptr_xchg(void *dst, void *ptr);
+long bpf_spin_lock(struct bpf_spin_lock *lock);
+long bpf_spin_unlock(struct bpf_spin_lock *lock);
+long bpf_timer_init(struct bpf_timer *timer, void *map, u64 flags);
+long bpf_timer_set_callback(struct bpf_timer *timer, void *callback_fn);
+long bpf_timer_start(struct bpf_timer *timer, u64 nsecs, u64 flags);
+long bpf_timer_cancel(struct bpf_timer *timer);
+
+#endif /* __SIM_BPF_HELPERS_H */
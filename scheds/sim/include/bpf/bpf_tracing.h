@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Stand-in for libbpf's bpf_tracing.h, see bpf_helpers.h. Programs take
+ * their arguments directly instead of unpacking them from a context array,
+ * so struct_ops callbacks can be called through struct sched_ext_ops.
+ */
+#ifndef __SIM_BPF_TRACING_H
+#define __SIM_BPF_TRACING_H
+
+#define BPF_PROG(name, args...)		name(args)
+
+#endif /* __SIM_BPF_TRACING_H */
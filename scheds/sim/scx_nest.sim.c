@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include "scx_nest.bpf.c"
+#include "sim_policy.h"
+
+/* see the rodata setup in scx_nest.c */
+SIM_POLICY(nest_ops,
+	   SIM_MAP(stats),
+	   SIM_MAP(pcpu_ctxs),
+	   SIM_MAP(stats_timer),
+	   SIM_TASK_STORAGE(task_ctx_stor),
+	   SIM_RODATA_NR_CPUS(nr_cpus),
+	   SIM_RODATA_SET(slice_ns, 20 * NSEC_PER_MSEC),
+	   SIM_RODATA(p_remove_ns),
+	   SIM_RODATA(r_max),
+	   SIM_RODATA(r_impatient),
+	   SIM_RODATA(find_fully_idle),
+	   SIM_RODATA(sampling_cadence_ns));
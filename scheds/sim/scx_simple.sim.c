@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include "scx_simple.bpf.c"
+#include "sim_policy.h"
+
+SIM_POLICY(simple_ops,
+	   SIM_MAP(stats),
+	   SIM_MAP(hists),
+	   SIM_TASK_STORAGE(task_ctx_stor),
+	   SIM_RODATA(fifo_sched));
@@ -0,0 +1,879 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Discrete-event scheduling simulator.
+ *
+ * Replays a trace of tasks alternating between running and sleeping on a
+ * modeled set of CPUs, with every scheduling decision made by a sched_ext
+ * policy built from its .bpf.c source (see sim_ext.c). Time only advances
+ * from one event to the next, so a trace covering minutes of wall time
+ * replays in a fraction of a second.
+ *
+ * Trace format, one directive per line, '#' starting a comment:
+ *
+ *	task PID WEIGHT START COMM
+ *		A task with the given sched_ext weight (100 for nice 0)
+ *		which is created and becomes runnable at START.
+ *
+ *	run PID RUN SLEEP [COUNT]
+ *		The task runs for RUN and then sleeps for SLEEP, COUNT times
+ *		(default 1). Bursts are replayed in order and the task exits
+ *		after the last one.
+ *
+ * Durations are in nsecs unless suffixed with us, ms or s.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "sim.h"
+
+#define NSEC_PER_USEC		1000ULL
+#define NSEC_PER_MSEC		1000000ULL
+#define NSEC_PER_SEC		1000000000ULL
+
+/* Period of ops.tick() */
+#define TICK_NS			(4 * NSEC_PER_MSEC)
+
+const char help_fmt[] =
+"Replay a task trace against a sched_ext policy.\n"
+"\n"
+"See scheds/sim/README.md for the trace format.\n"
+"\n"
+"Usage: %s [-c CPUS] [-l CPUS_PER_LLC] [-m NSECS] [-t SECS] [-s SEED]\n"
+"       [-o NAME=VALUE]... [-j] [-v] TRACE\n"
+"\n"
+"  -c CPUS       Number of simulated CPUs (default: 8)\n"
+"  -l CPUS       Number of CPUs sharing an LLC (default: all)\n"
+"  -m NSECS      Extra run time charged to a task migrating across LLCs\n"
+"                to model the cache refill (default: 0)\n"
+"  -t SECS       Stop after SECS of simulated time (default: end of trace)\n"
+"  -s SEED       Seed for bpf_get_prandom_u32() and random CPU picks\n"
+"  -o NAME=VAL   Set a rodata knob of the policy, see the wrapper .sim.c\n"
+"  -j            Print the results as a single JSON object\n"
+"  -v            Print per-task results\n"
+"  -h            Display this help and exit\n";
+
+struct burst {
+	unsigned long long	run;
+	unsigned long long	sleep;
+	unsigned int		count;
+};
+
+enum task_state {
+	TASK_NEW,
+	TASK_SLEEPING,
+	TASK_RUNNABLE,
+	TASK_RUNNING,
+	TASK_DEAD,
+};
+
+struct task {
+	int			pid;
+	unsigned int		weight;
+	unsigned long long	start;
+	char			comm[16];
+	struct burst		*bursts;
+	int			nr_bursts;
+
+	struct task_struct	*p;
+	enum task_state		state;
+	int			cur_burst;
+	unsigned int		cur_count;
+	/* run time left in the current burst */
+	unsigned long long	left;
+	unsigned long long	runnable_at;
+	bool			woken;
+	int			last_cpu;
+
+	unsigned long long	run_time;
+	unsigned long long	wait_time;
+	unsigned long long	nr_wakeups;
+	unsigned long long	wakeup_lat_sum;
+};
+
+struct cpu {
+	struct task		*curr;
+	/* start of the current accounting segment of @curr */
+	unsigned long long	seg_start;
+	bool			seg_tick;
+	unsigned long long	gen;
+	unsigned long long	busy_time;
+	int			llc;
+};
+
+enum event_type {
+	EV_WAKEUP,
+	EV_CPU,
+	EV_WATCHDOG,
+};
+
+struct event {
+	unsigned long long	at;
+	/* FIFO order for events at the same time */
+	unsigned long long	seq;
+	enum event_type		type;
+	int			target;
+	unsigned long long	gen;
+};
+
+static struct task *tasks;
+static int nr_tasks;
+static int nr_live;
+
+static struct cpu cpus[SIM_MAX_CPUS];
+static int nr_cpus = 8;
+static int cpus_per_llc;
+static unsigned long long migration_penalty;
+static unsigned long long time_limit = ~0ULL;
+static bool json, verbose;
+
+static struct event *events;
+static int nr_events, max_events;
+static unsigned long long event_seq;
+
+static unsigned long long *lats;
+static unsigned long long nr_lats, max_lats;
+
+static struct sim_opt opts[64];
+static int nr_opts;
+
+static unsigned long long nr_ctxsw, nr_migrations, nr_llc_migrations;
+static unsigned long long rand_state = 0x2545f4914f6cdd1dULL;
+
+__attribute__((noreturn, format(printf, 1, 2)))
+static void die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "scx_sim: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+	exit(1);
+}
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr)
+		die("out of memory");
+	return ptr;
+}
+
+/*
+ * Interface for sim_ext.c
+ */
+void *sim_zalloc(unsigned long size)
+{
+	void *ptr = calloc(1, size ?: 1);
+
+	if (!ptr)
+		die("out of memory");
+	return ptr;
+}
+
+void sim_free(void *ptr)
+{
+	free(ptr);
+}
+
+void sim_log(const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "[%llu.%06llu] ", sim_now / NSEC_PER_SEC,
+		sim_now % NSEC_PER_SEC / NSEC_PER_USEC);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	if (!*fmt || fmt[strlen(fmt) - 1] != '\n')
+		fprintf(stderr, "\n");
+}
+
+void sim_poke(void *dst, unsigned long long value, unsigned int size)
+{
+	unsigned long pgsz = sysconf(_SC_PAGESIZE);
+	unsigned long start = (unsigned long)dst & ~(pgsz - 1);
+	unsigned long end = ((unsigned long)dst + size + pgsz - 1) & ~(pgsz - 1);
+
+	/*
+	 * Like the skeleton's rodata before load. The knobs are volatile, so
+	 * the policy reads them from memory instead of using the initializer.
+	 */
+	if (mprotect((void *)start, end - start, PROT_READ | PROT_WRITE))
+		die("failed to make rodata writable (%s)", strerror(errno));
+
+	switch (size) {
+	case 1: *(unsigned char *)dst = value; break;
+	case 2: *(unsigned short *)dst = value; break;
+	case 4: *(unsigned int *)dst = value; break;
+	case 8: *(unsigned long long *)dst = value; break;
+	default: die("unsupported rodata size %u", size);
+	}
+}
+
+unsigned int sim_random(void)
+{
+	/* xorshift64* */
+	rand_state ^= rand_state >> 12;
+	rand_state ^= rand_state << 25;
+	rand_state ^= rand_state >> 27;
+	return (rand_state * 0x2545f4914f6cdd1dULL) >> 32;
+}
+
+void sim_bstr_format(char *buf, unsigned int size, const char *fmt,
+		     const unsigned long long *args, int nr_args)
+{
+	unsigned int len = 0;
+	int arg = 0;
+
+	if (!size)
+		return;
+	buf[0] = '\0';
+
+	while (*fmt && len < size - 1) {
+		const char *start = fmt;
+		char spec[32];
+		unsigned long long v;
+		int n;
+
+		if (*fmt != '%' || fmt[1] == '%') {
+			buf[len++] = *fmt;
+			fmt += *fmt == '%' ? 2 : 1;
+			buf[len] = '\0';
+			continue;
+		}
+
+		/* flags, width and precision are passed through as-is */
+		for (fmt++; *fmt && strchr("-+ #0123456789.", *fmt); fmt++)
+			;
+		/* the arguments are u64s, drop the length modifiers */
+		n = fmt - start;
+		while (*fmt && strchr("hlzjt", *fmt))
+			fmt++;
+		if (!*fmt || n + 3 > (int)sizeof(spec))
+			break;
+		memcpy(spec, start, n);
+
+		v = arg < nr_args ? args[arg] : 0;
+		arg++;
+
+		switch (*fmt) {
+		case 'd':
+		case 'i':
+			memcpy(spec + n, "lld", 4);
+			n = snprintf(buf + len, size - len, spec, (long long)v);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			spec[n] = 'l';
+			spec[n + 1] = 'l';
+			spec[n + 2] = *fmt;
+			spec[n + 3] = '\0';
+			n = snprintf(buf + len, size - len, spec, v);
+			break;
+		case 'c':
+			memcpy(spec + n, "c", 2);
+			n = snprintf(buf + len, size - len, spec, (int)v);
+			break;
+		case 's':
+			memcpy(spec + n, "s", 2);
+			n = snprintf(buf + len, size - len, spec,
+				     v ? (const char *)(unsigned long)v : "(null)");
+			break;
+		case 'p':
+			memcpy(spec + n, "p", 2);
+			n = snprintf(buf + len, size - len, spec, (void *)(unsigned long)v);
+			break;
+		default:
+			n = snprintf(buf + len, size - len, "%.*s", (int)(fmt - start + 1), start);
+			break;
+		}
+		fmt++;
+		if (n < 0)
+			break;
+		len += n;
+		if (len >= size)
+			len = size - 1;
+	}
+	buf[len] = '\0';
+}
+
+/*
+ * Event queue, a binary min-heap on (at, seq)
+ */
+static bool event_before(const struct event *a, const struct event *b)
+{
+	return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+}
+
+static void push_event(unsigned long long at, enum event_type type, int target,
+		       unsigned long long gen)
+{
+	int i;
+
+	if (nr_events == max_events) {
+		max_events = max_events ? max_events * 2 : 1024;
+		events = xrealloc(events, max_events * sizeof(*events));
+	}
+
+	i = nr_events++;
+	events[i] = (struct event){ .at = at, .seq = event_seq++, .type = type,
+				    .target = target, .gen = gen };
+	while (i && event_before(&events[i], &events[(i - 1) / 2])) {
+		struct event tmp = events[i];
+
+		events[i] = events[(i - 1) / 2];
+		events[(i - 1) / 2] = tmp;
+		i = (i - 1) / 2;
+	}
+}
+
+static struct event pop_event(void)
+{
+	struct event top = events[0];
+	int i = 0;
+
+	events[0] = events[--nr_events];
+	for (;;) {
+		int l = 2 * i + 1, r = l + 1, min = i;
+		struct event tmp;
+
+		if (l < nr_events && event_before(&events[l], &events[min]))
+			min = l;
+		if (r < nr_events && event_before(&events[r], &events[min]))
+			min = r;
+		if (min == i)
+			break;
+		tmp = events[i];
+		events[i] = events[min];
+		events[min] = tmp;
+		i = min;
+	}
+	return top;
+}
+
+/*
+ * Trace parsing
+ */
+static bool parse_time(const char *str, unsigned long long *v)
+{
+	static const struct { const char *sfx; unsigned long long mult; } units[] = {
+		{ "", 1 }, { "ns", 1 }, { "us", NSEC_PER_USEC },
+		{ "ms", NSEC_PER_MSEC }, { "s", NSEC_PER_SEC },
+	};
+	char *end;
+	double d;
+	int i;
+
+	errno = 0;
+	d = strtod(str, &end);
+	if (errno || end == str || d < 0)
+		return false;
+	for (i = 0; i < (int)(sizeof(units) / sizeof(units[0])); i++) {
+		if (!strcmp(end, units[i].sfx)) {
+			*v = d * units[i].mult;
+			return true;
+		}
+	}
+	return false;
+}
+
+static struct task *find_task(int pid)
+{
+	int i;
+
+	/* bursts usually follow their task line, search backwards */
+	for (i = nr_tasks - 1; i >= 0; i--)
+		if (tasks[i].pid == pid)
+			return &tasks[i];
+	return NULL;
+}
+
+static void read_trace(const char *path)
+{
+	char line[512];
+	int lineno = 0, i;
+	FILE *f;
+
+	f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!f)
+		die("failed to open %s (%s)", path, strerror(errno));
+
+	while (fgets(line, sizeof(line), f)) {
+		char kind[8], a1[32], a2[32], a3[32], a4[32];
+		struct task *t;
+		int pid, n;
+
+		lineno++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = '\0';
+
+		n = sscanf(line, "%7s %d %31s %31s %31s", kind, &pid, a1, a2, a3);
+		if (n <= 0)
+			continue;
+
+		if (!strcmp(kind, "task")) {
+			if (n != 5 || find_task(pid))
+				die("%s:%d: invalid or duplicate task", path, lineno);
+			tasks = xrealloc(tasks, (nr_tasks + 1) * sizeof(*tasks));
+			t = &tasks[nr_tasks++];
+			memset(t, 0, sizeof(*t));
+			t->pid = pid;
+			t->weight = strtoul(a1, NULL, 0);
+			if (t->weight < 1 || t->weight > 10000 ||
+			    !parse_time(a2, &t->start))
+				die("%s:%d: invalid weight or start time", path, lineno);
+			snprintf(t->comm, sizeof(t->comm), "%.15s", a3);
+			t->last_cpu = -1;
+		} else if (!strcmp(kind, "run")) {
+			struct burst *b;
+
+			t = find_task(pid);
+			if (!t)
+				die("%s:%d: run for unknown task %d", path, lineno, pid);
+			n = sscanf(line, "%7s %d %31s %31s %31s", kind, &pid, a1, a2, a4);
+			t->bursts = xrealloc(t->bursts, (t->nr_bursts + 1) * sizeof(*t->bursts));
+			b = &t->bursts[t->nr_bursts++];
+			b->count = n == 5 ? strtoul(a4, NULL, 0) : 1;
+			if (n < 4 || !parse_time(a1, &b->run) ||
+			    !parse_time(a2, &b->sleep) || !b->run || !b->count)
+				die("%s:%d: invalid run", path, lineno);
+		} else {
+			die("%s:%d: unknown directive \"%s\"", path, lineno, kind);
+		}
+	}
+
+	if (f != stdin)
+		fclose(f);
+
+	for (i = 0; i < nr_tasks; i++)
+		if (!tasks[i].nr_bursts)
+			die("task %d has no run lines", tasks[i].pid);
+	if (!nr_tasks)
+		die("no tasks in %s", path);
+}
+
+/*
+ * Simulation
+ */
+static void check_error(void)
+{
+	const char *err = sim_ext_error();
+
+	if (err)
+		die("%s: %s at %llu.%06llus", sim_ext_name(), err,
+		    sim_now / NSEC_PER_SEC, sim_now % NSEC_PER_SEC / NSEC_PER_USEC);
+}
+
+static void record_lat(unsigned long long lat)
+{
+	if (nr_lats == max_lats) {
+		max_lats = max_lats ? max_lats * 2 : 4096;
+		lats = xrealloc(lats, max_lats * sizeof(*lats));
+	}
+	lats[nr_lats++] = lat;
+}
+
+/* Charge the time since the start of the segment to the running task */
+static void account(int cpu, bool tick)
+{
+	struct cpu *c = &cpus[cpu];
+	struct task *t = c->curr;
+	unsigned long long ran = sim_now - c->seg_start;
+
+	if (!t)
+		return;
+
+	c->seg_start = sim_now;
+	c->busy_time += ran;
+	t->run_time += ran;
+	t->left -= ran < t->left ? ran : t->left;
+	sim_ext_charge(cpu, t->p, ran, tick);
+}
+
+/* Start the next accounting segment of the task running on @cpu */
+static void start_segment(int cpu)
+{
+	struct cpu *c = &cpus[cpu];
+	unsigned long long len = c->curr->left;
+	unsigned long long slice = sim_ext_task_slice(c->curr->p);
+
+	c->seg_tick = false;
+	if (slice < len)
+		len = slice;
+	if (sim_ext_has_tick() && TICK_NS < len) {
+		len = TICK_NS;
+		c->seg_tick = true;
+	}
+
+	c->seg_start = sim_now;
+	push_event(sim_now + len, EV_CPU, cpu, ++c->gen);
+}
+
+static void task_sleep(struct task *t)
+{
+	struct burst *b = &t->bursts[t->cur_burst];
+	unsigned long long sleep = b->sleep;
+
+	if (++t->cur_count >= b->count) {
+		t->cur_count = 0;
+		t->cur_burst++;
+	}
+
+	if (t->cur_burst >= t->nr_bursts) {
+		t->state = TASK_DEAD;
+		sim_ext_task_free(t->p);
+		t->p = NULL;
+		nr_live--;
+		return;
+	}
+
+	t->state = TASK_SLEEPING;
+	t->left = t->bursts[t->cur_burst].run;
+	push_event(sim_now + sleep, EV_WAKEUP, t - tasks, 0);
+}
+
+static void resched(int cpu)
+{
+	struct cpu *c = &cpus[cpu];
+	struct task *prev = c->curr, *next = NULL;
+	struct task_struct *p;
+	bool prev_runnable;
+
+	account(cpu, false);
+	prev_runnable = prev && prev->left;
+
+	p = sim_ext_schedule(cpu, prev ? prev->p : NULL, prev_runnable);
+	if (p)
+		next = &tasks[sim_ext_task_id(p)];
+
+	if (prev && !prev_runnable)
+		task_sleep(prev);
+
+	if (next != prev) {
+		if (prev)
+			nr_ctxsw++;
+		if (prev && prev_runnable) {
+			prev->state = TASK_RUNNABLE;
+			prev->runnable_at = sim_now;
+		}
+		if (next) {
+			unsigned long long wait = sim_now - next->runnable_at;
+
+			next->state = TASK_RUNNING;
+			next->wait_time += wait;
+			if (next->woken) {
+				next->woken = false;
+				next->wakeup_lat_sum += wait;
+				record_lat(wait);
+			}
+			if (next->last_cpu >= 0 && next->last_cpu != cpu) {
+				nr_migrations++;
+				if (cpus[next->last_cpu].llc != c->llc) {
+					nr_llc_migrations++;
+					next->left += migration_penalty;
+				}
+			}
+			next->last_cpu = cpu;
+		}
+	}
+
+	c->curr = next;
+	if (next)
+		start_segment(cpu);
+	else
+		c->gen++;
+}
+
+static void handle_kicks(void)
+{
+	bool preempt;
+	int cpu;
+
+	while (sim_ext_pop_kick(&cpu, &preempt)) {
+		/* a plain kick doesn't make a busy CPU switch tasks */
+		if (!cpus[cpu].curr || preempt)
+			resched(cpu);
+	}
+}
+
+static void handle_wakeup(struct task *t)
+{
+	int cpu;
+
+	if (t->state == TASK_NEW) {
+		t->p = sim_ext_task_new(t - tasks, t->pid, t->comm, t->weight);
+		if (!t->p)
+			return;
+		t->left = t->bursts[0].run;
+	}
+
+	t->state = TASK_RUNNABLE;
+	t->runnable_at = sim_now;
+	t->woken = true;
+	t->nr_wakeups++;
+
+	cpu = sim_ext_wakeup(t->p);
+	/* an idle CPU is rescheduled when a task is queued on its runqueue */
+	if (cpu >= 0 && cpu < nr_cpus && !cpus[cpu].curr)
+		resched(cpu);
+}
+
+static void handle_cpu(int cpu, unsigned long long gen)
+{
+	struct cpu *c = &cpus[cpu];
+
+	if (gen != c->gen || !c->curr)
+		return;
+
+	account(cpu, c->seg_tick);
+	if (!c->curr->left || !sim_ext_task_slice(c->curr->p))
+		resched(cpu);
+	else
+		start_segment(cpu);
+}
+
+static void handle_watchdog(void)
+{
+	unsigned long long timeout = sim_ext_timeout_ms() * NSEC_PER_MSEC;
+	int i;
+
+	for (i = 0; i < nr_tasks; i++) {
+		struct task *t = &tasks[i];
+
+		if (t->state == TASK_RUNNABLE && sim_now - t->runnable_at > timeout)
+			die("%s: %s[%d] stalled for %llums", sim_ext_name(), t->comm,
+			    t->pid, (sim_now - t->runnable_at) / NSEC_PER_MSEC);
+	}
+
+	if (nr_live)
+		push_event(sim_now + timeout / 2, EV_WATCHDOG, 0, 0);
+}
+
+static void simulate(void)
+{
+	int i;
+
+	for (i = 0; i < nr_tasks; i++)
+		push_event(tasks[i].start, EV_WAKEUP, i, 0);
+	nr_live = nr_tasks;
+	push_event(sim_ext_timeout_ms() * NSEC_PER_MSEC / 2, EV_WATCHDOG, 0, 0);
+
+	while (nr_live && nr_events) {
+		unsigned long long timer_at = sim_ext_next_timer();
+		struct event ev;
+
+		if (timer_at < events[0].at) {
+			if (timer_at > time_limit)
+				break;
+			sim_now = timer_at;
+			sim_ext_run_timers();
+			check_error();
+			handle_kicks();
+			check_error();
+			continue;
+		}
+
+		if (events[0].at > time_limit)
+			break;
+		ev = pop_event();
+		sim_now = ev.at;
+
+		switch (ev.type) {
+		case EV_WAKEUP:
+			handle_wakeup(&tasks[ev.target]);
+			break;
+		case EV_CPU:
+			handle_cpu(ev.target, ev.gen);
+			break;
+		case EV_WATCHDOG:
+			handle_watchdog();
+			break;
+		}
+		check_error();
+		handle_kicks();
+		check_error();
+	}
+
+	if (time_limit != ~0ULL && nr_live)
+		sim_now = time_limit;
+
+	/* account the tasks which are still running or waiting */
+	for (i = 0; i < nr_cpus; i++) {
+		if (cpus[i].curr) {
+			cpus[i].busy_time += sim_now - cpus[i].seg_start;
+			cpus[i].curr->run_time += sim_now - cpus[i].seg_start;
+		}
+	}
+	for (i = 0; i < nr_tasks; i++)
+		if (tasks[i].state == TASK_RUNNABLE)
+			tasks[i].wait_time += sim_now - tasks[i].runnable_at;
+}
+
+/*
+ * Results
+ */
+static int cmp_u64(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double lat_pct_us(double pct)
+{
+	unsigned long long idx;
+
+	if (!nr_lats)
+		return 0;
+	idx = nr_lats * pct / 100;
+	if (idx >= nr_lats)
+		idx = nr_lats - 1;
+	return lats[idx] / 1000.0;
+}
+
+/*
+ * Jain's fairness index of the CPU share each task got while runnable,
+ * normalized by weight. 1.0 if every task got a share proportional to its
+ * weight, 1/n if a single task got everything.
+ */
+static double fairness(void)
+{
+	double sum = 0, sum_sq = 0;
+	int i, n = 0;
+
+	for (i = 0; i < nr_tasks; i++) {
+		struct task *t = &tasks[i];
+		double share;
+
+		if (!t->run_time && !t->wait_time)
+			continue;
+		share = (double)t->run_time / (t->run_time + t->wait_time) / t->weight;
+		sum += share;
+		sum_sq += share * share;
+		n++;
+	}
+	return sum_sq ? sum * sum / (n * sum_sq) : 1;
+}
+
+static void print_results(const char *trace)
+{
+	unsigned long long busy = 0;
+	double util;
+	int i;
+
+	for (i = 0; i < nr_cpus; i++)
+		busy += cpus[i].busy_time;
+	util = sim_now ? (double)busy / sim_now / nr_cpus : 0;
+	qsort(lats, nr_lats, sizeof(*lats), cmp_u64);
+
+	if (json) {
+		printf("{\"sched\": \"%s\", \"trace\": \"%s\", \"cpus\": %d, "
+		       "\"sim_time_ms\": %.3f, \"ctxsw\": %llu, \"migrations\": %llu, "
+		       "\"llc_migrations\": %llu, \"util\": %.4f, "
+		       "\"wakeup_lat_us\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}, "
+		       "\"fairness\": %.4f}\n",
+		       sim_ext_name(), trace, nr_cpus, sim_now / 1e6, nr_ctxsw,
+		       nr_migrations, nr_llc_migrations, util, lat_pct_us(50),
+		       lat_pct_us(99), lat_pct_us(100), fairness());
+	} else {
+		printf("sched=%s cpus=%d tasks=%d sim_time=%.3fms\n",
+		       sim_ext_name(), nr_cpus, nr_tasks, sim_now / 1e6);
+		printf("ctxsw=%llu migrations=%llu llc_migrations=%llu util=%.1f%%\n",
+		       nr_ctxsw, nr_migrations, nr_llc_migrations, util * 100);
+		printf("wakeup_lat p50=%.1fus p99=%.1fus max=%.1fus fairness=%.4f\n",
+		       lat_pct_us(50), lat_pct_us(99), lat_pct_us(100), fairness());
+	}
+
+	if (!verbose)
+		return;
+
+	for (i = 0; i < nr_tasks; i++) {
+		struct task *t = &tasks[i];
+
+		fprintf(json ? stderr : stdout,
+			"%8d %-16s weight=%-5u run=%.3fms wait=%.3fms wakeups=%llu avg_lat=%.1fus\n",
+			t->pid, t->comm, t->weight, t->run_time / 1e6, t->wait_time / 1e6,
+			t->nr_wakeups,
+			t->nr_wakeups ? t->wakeup_lat_sum / 1e3 / t->nr_wakeups : 0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long secs;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "c:l:m:t:s:o:jvh")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_cpus = strtol(optarg, NULL, 0);
+			if (nr_cpus < 1 || nr_cpus > SIM_MAX_CPUS)
+				die("the number of CPUs must be between 1 and %d",
+				    SIM_MAX_CPUS);
+			break;
+		case 'l':
+			cpus_per_llc = strtol(optarg, NULL, 0);
+			break;
+		case 'm':
+			if (!parse_time(optarg, &migration_penalty))
+				die("invalid migration penalty %s", optarg);
+			break;
+		case 't':
+			secs = strtoull(optarg, NULL, 0);
+			time_limit = secs * NSEC_PER_SEC;
+			break;
+		case 's':
+			rand_state = strtoull(optarg, NULL, 0) ?: 1;
+			break;
+		case 'o':
+			if (nr_opts >= (int)(sizeof(opts) / sizeof(opts[0])) ||
+			    !strchr(optarg, '='))
+				die("invalid or too many -o %s", optarg);
+			*strchr(optarg, '=') = '\0';
+			opts[nr_opts].name = optarg;
+			opts[nr_opts++].value = strtoull(optarg + strlen(optarg) + 1, NULL, 0);
+			break;
+		case 'j':
+			json = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, help_fmt, basename(argv[0]));
+			return opt != 'h';
+		}
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, help_fmt, basename(argv[0]));
+		return 1;
+	}
+
+	read_trace(argv[optind]);
+
+	for (i = 0; i < nr_cpus; i++)
+		cpus[i].llc = cpus_per_llc > 0 ? i / cpus_per_llc : 0;
+
+	if (sim_ext_init(nr_cpus, cpus_per_llc, opts, nr_opts))
+		check_error();
+
+	simulate();
+	sim_ext_exit();
+	check_error();
+
+	print_results(argv[optind]);
+	return 0;
+}
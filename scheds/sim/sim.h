@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Interface between the simulator's event loop (sim.c), which is regular
+ * userspace code, and the sched_ext core emulation (sim_ext.c), which is
+ * built against vmlinux.h together with the policy. The two sides can't
+ * include each other's headers, so only plain C types cross this boundary.
+ */
+#ifndef __SIM_H
+#define __SIM_H
+
+#define SIM_MAX_CPUS		512
+
+struct task_struct;
+
+/* Simulated time in ns, returned by bpf_ktime_get_ns() */
+extern unsigned long long sim_now;
+
+/* CPU the current callback runs on, returned by bpf_get_smp_processor_id() */
+extern int sim_cur_cpu;
+
+/*
+ * Provided by sim.c.
+ */
+void *sim_zalloc(unsigned long size);
+void sim_free(void *ptr);
+void sim_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+unsigned int sim_random(void);
+
+/* Write @size bytes of @value to the rodata variable at @dst */
+void sim_poke(void *dst, unsigned long long value, unsigned int size);
+
+/* Format @fmt with the u64 @args the way the kernel formats bstr kfuncs */
+void sim_bstr_format(char *buf, unsigned int size, const char *fmt,
+		     const unsigned long long *args, int nr_args);
+
+/*
+ * Provided by sim_ext.c.
+ */
+
+/* Rodata knob set on the command line */
+struct sim_opt {
+	const char		*name;
+	unsigned long long	value;
+};
+
+/* Load the policy, returns the ops.init() error */
+int sim_ext_init(int nr_cpus, int cpus_per_llc, const struct sim_opt *opts,
+		 int nr_opts);
+void sim_ext_exit(void);
+const char *sim_ext_name(void);
+
+/* ops.timeout_ms or the kernel's default watchdog timeout */
+unsigned int sim_ext_timeout_ms(void);
+
+struct task_struct *sim_ext_task_new(int id, int pid, const char *comm,
+				     unsigned int weight);
+void sim_ext_task_free(struct task_struct *p);
+int sim_ext_task_id(struct task_struct *p);
+int sim_ext_task_cpu(struct task_struct *p);
+
+/* @p becomes runnable, returns the CPU whose runqueue it was put on */
+int sim_ext_wakeup(struct task_struct *p);
+
+/*
+ * Reschedule @cpu which is running @prev (NULL if idle). @prev_runnable is
+ * false if @prev is going to sleep. Returns the task to run next, which is
+ * @prev if it keeps running, or NULL if the CPU goes idle.
+ */
+struct task_struct *sim_ext_schedule(int cpu, struct task_struct *prev,
+				     _Bool prev_runnable);
+
+/* Remaining slice of @p */
+unsigned long long sim_ext_task_slice(struct task_struct *p);
+
+/* Charge @ran ns to the running @p, calling ops.tick() if @tick */
+void sim_ext_charge(int cpu, struct task_struct *p, unsigned long long ran,
+		    _Bool tick);
+_Bool sim_ext_has_tick(void);
+
+/* Expiration time of the first armed BPF timer, ~0ULL if none */
+unsigned long long sim_ext_next_timer(void);
+
+/* Run the callbacks of the timers expired at sim_now */
+void sim_ext_run_timers(void);
+
+/* Take a CPU kicked by the policy, false if there are none left */
+_Bool sim_ext_pop_kick(int *cpu, _Bool *preempt);
+
+/* Error raised by the policy or the core, NULL if none */
+const char *sim_ext_error(void);
+
+#endif /* __SIM_H */
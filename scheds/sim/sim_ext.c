@@ -0,0 +1,1680 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Userspace emulation of the sched_ext core for the scheduling simulator.
+ *
+ * This is built against vmlinux.h and scx/common.bpf.h like a BPF scheduler,
+ * with the bpf/ headers in include/ standing in for libbpf's. It implements
+ * the kfuncs and BPF helpers the policies call, keeps the DSQs and the
+ * per-CPU state, and drives the ops callbacks the way kernel/sched/ext.c
+ * does:
+ *
+ * - A waking task goes through ops.runnable(), ops.select_cpu() and
+ *   ops.enqueue(), unless it was dispatched directly from ops.select_cpu().
+ *
+ * - A CPU picks the first task of its local DSQ, refilling it from
+ *   SCX_DSQ_GLOBAL and then ops.dispatch(). If there's nothing else to run,
+ *   a runnable previous task keeps running unless SCX_OPS_ENQ_LAST is set.
+ *
+ * - Built-in idle tracking, scx_bpf_kick_cpu() and SCX_ENQ_PREEMPT behave
+ *   as in the kernel, with kicked CPUs handed back to the event loop in
+ *   sim.c through sim_ext_pop_kick().
+ *
+ * Everything runs on a single thread, so locks and RCU are no-ops. There's
+ * no SMT, cgroup, BPF list/rbtree or hotplug support yet: policies using
+ * the related kfuncs fail to link.
+ */
+/* The real values of the scx enums are defined below */
+#define __SCX_ENUMS_BPF_H
+#include <scx/common.bpf.h>
+#include "sim.h"
+#include "sim_policy.h"
+
+#define SIM_MAX_MAPS		64
+#define SIM_MAX_DSQS		1024
+#define SIM_MAX_TIMERS		64
+#define SIM_MAX_TASKS_LOOKUP	65536
+#define SIM_DISPATCH_LOOPS	32
+#define SIM_DISPATCH_BATCH	32
+
+/*
+ * The policy's ops, maps and rodata knobs, from SIM_POLICY().
+ */
+extern struct sched_ext_ops *sim_ops;
+extern struct sim_def sim_defs[];
+
+/*
+ * Userspace sets the __SCX_* enums in rodata before loading a BPF scheduler,
+ * see SCX_ENUM_INIT(). Here, the policy's weak definitions resolve to these.
+ */
+#define SIM_ENUM(name)	const volatile u64 __##name = name
+
+SIM_ENUM(SCX_OPS_NAME_LEN);
+SIM_ENUM(SCX_SLICE_DFL);
+SIM_ENUM(SCX_SLICE_INF);
+SIM_ENUM(SCX_DSQ_FLAG_BUILTIN);
+SIM_ENUM(SCX_DSQ_FLAG_LOCAL_ON);
+SIM_ENUM(SCX_DSQ_INVALID);
+SIM_ENUM(SCX_DSQ_GLOBAL);
+SIM_ENUM(SCX_DSQ_LOCAL);
+SIM_ENUM(SCX_DSQ_LOCAL_ON);
+SIM_ENUM(SCX_DSQ_LOCAL_CPU_MASK);
+SIM_ENUM(SCX_TASK_QUEUED);
+SIM_ENUM(SCX_TASK_RESET_RUNNABLE_AT);
+SIM_ENUM(SCX_TASK_DEQD_FOR_SLEEP);
+SIM_ENUM(SCX_TASK_STATE_SHIFT);
+SIM_ENUM(SCX_TASK_STATE_BITS);
+SIM_ENUM(SCX_TASK_STATE_MASK);
+SIM_ENUM(SCX_TASK_CURSOR);
+SIM_ENUM(SCX_TASK_NONE);
+SIM_ENUM(SCX_TASK_INIT);
+SIM_ENUM(SCX_TASK_READY);
+SIM_ENUM(SCX_TASK_ENABLED);
+SIM_ENUM(SCX_TASK_NR_STATES);
+SIM_ENUM(SCX_TASK_DSQ_ON_PRIQ);
+SIM_ENUM(SCX_KICK_IDLE);
+SIM_ENUM(SCX_KICK_PREEMPT);
+SIM_ENUM(SCX_KICK_WAIT);
+SIM_ENUM(SCX_ENQ_WAKEUP);
+SIM_ENUM(SCX_ENQ_HEAD);
+SIM_ENUM(SCX_ENQ_PREEMPT);
+SIM_ENUM(SCX_ENQ_REENQ);
+SIM_ENUM(SCX_ENQ_LAST);
+SIM_ENUM(SCX_ENQ_CLEAR_OPSS);
+SIM_ENUM(SCX_ENQ_DSQ_PRIQ);
+
+/* The tick period in sim.c */
+unsigned long CONFIG_HZ = 250;
+
+unsigned long long sim_now;
+int sim_cur_cpu;
+
+struct sim_dsq;
+
+struct sim_task {
+	struct task_struct	p;
+	int			id;
+	/* CPU whose runqueue the task is on */
+	s32			cpu;
+	bool			runnable;
+	/* enqueued without being dispatched, waiting for ops.dispatch() */
+	bool			bpf_owned;
+	/* direct dispatch from ops.select_cpu() or ops.enqueue() */
+	bool			ddsp;
+	u64			ddsp_dsq_id;
+	u64			ddsp_enq_flags;
+	struct sim_dsq		*dsq;
+	struct sim_task		*dsq_prev;
+	struct sim_task		*dsq_next;
+	void			*storage[SIM_MAX_MAPS];
+};
+
+struct sim_dsq {
+	u64			id;
+	bool			priq;
+	u32			nr;
+	struct sim_task		*head;
+	struct sim_task		*tail;
+};
+
+struct sim_cpu {
+	struct sim_dsq		local;
+	struct task_struct	*curr;
+	s32			llc;
+	bool			idle;
+	bool			kick_pending;
+	bool			kick_preempt;
+	u32			perf;
+};
+
+struct sim_map {
+	struct sim_def		def;
+	u32			value_size;
+	void			*values;
+	/* hash maps */
+	void			*keys;
+	bool			*used;
+};
+
+struct sim_timer {
+	struct bpf_timer	*timer;
+	struct sim_map		*map;
+	void			*callback;
+	/* CPU the timer was started on, where the callback runs */
+	s32			cpu;
+	u64			expires;
+	bool			armed;
+};
+
+/* Context of the ops callback being run, for the kfuncs */
+enum sim_ctx {
+	SIM_CTX_NONE,
+	SIM_CTX_SELECT_CPU,
+	SIM_CTX_ENQUEUE,
+	SIM_CTX_DISPATCH,
+};
+
+static enum sim_ctx cur_ctx;
+static struct sim_task *ctx_task;
+static u32 nr_ctx_dispatched;
+
+static s32 nr_cpus;
+static struct sim_cpu cpus[SIM_MAX_CPUS];
+static struct sim_dsq global_dsq = { .id = SCX_DSQ_GLOBAL };
+static struct sim_dsq dsqs[SIM_MAX_DSQS];
+static u32 nr_dsqs;
+static struct sim_map maps[SIM_MAX_MAPS];
+static u32 nr_maps;
+static struct sim_timer timers[SIM_MAX_TIMERS];
+static u32 nr_timers;
+static struct sim_task *tasks_by_pid[SIM_MAX_TASKS_LOOKUP];
+
+static struct cpumask possible_mask;
+static struct cpumask idle_mask;
+static s32 kicks[SIM_MAX_CPUS];
+static u32 nr_kicks;
+
+static char error_msg[1024];
+static bool errored;
+
+#define task_of(__p)	((struct sim_task *)((char *)(__p) - __builtin_offsetof(struct sim_task, p)))
+
+#define SIM_HAS_OP(op)	(sim_ops->op != NULL)
+
+static void set_error(const char *fmt, unsigned long long *args, int nr_args)
+{
+	/* keep the first error, the following ones are usually fallout */
+	if (errored)
+		return;
+	sim_bstr_format(error_msg, sizeof(error_msg), fmt, args, nr_args);
+	errored = true;
+}
+
+#define sim_ext_err(fmt, args...)						\
+({										\
+	unsigned long long ___param[___bpf_narg(args) ?: 1] = {};		\
+										\
+	_Pragma("GCC diagnostic push")						\
+	_Pragma("GCC diagnostic ignored \"-Wint-conversion\"")		\
+	___bpf_fill(___param, args);						\
+	_Pragma("GCC diagnostic pop")						\
+	set_error(fmt, ___param, ___bpf_narg(args));				\
+})
+
+static void copy_str(char *dst, const char *src, u32 size)
+{
+	u32 i;
+
+	if (!size)
+		return;
+	for (i = 0; i < size - 1 && src[i]; i++)
+		dst[i] = src[i];
+	dst[i] = '\0';
+}
+
+/*
+ * cpumasks
+ */
+static bool mask_test(const struct cpumask *mask, u32 cpu)
+{
+	return cpu < (u32)nr_cpus && (mask->bits[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+static void mask_set(struct cpumask *mask, u32 cpu)
+{
+	if (cpu < (u32)nr_cpus)
+		mask->bits[cpu / 64] |= 1UL << (cpu % 64);
+}
+
+static void mask_clear(struct cpumask *mask, u32 cpu)
+{
+	if (cpu < (u32)nr_cpus)
+		mask->bits[cpu / 64] &= ~(1UL << (cpu % 64));
+}
+
+static u32 mask_weight(const struct cpumask *mask)
+{
+	u32 cpu, weight = 0;
+
+	for (cpu = 0; cpu < (u32)nr_cpus; cpu++)
+		weight += mask_test(mask, cpu);
+	return weight;
+}
+
+/*
+ * Maps
+ */
+static struct sim_map *find_map(void *map)
+{
+	u32 i;
+
+	for (i = 0; i < nr_maps; i++)
+		if (maps[i].def.sym == map)
+			return &maps[i];
+
+	sim_ext_err("map %p is not listed in SIM_POLICY()", map);
+	return NULL;
+}
+
+static void *array_elem(struct sim_map *m, u32 idx, s32 cpu)
+{
+	if (idx >= m->def.max_entries)
+		return NULL;
+	if (m->def.type == BPF_MAP_TYPE_PERCPU_ARRAY)
+		idx = idx * nr_cpus + cpu;
+	return (char *)m->values + (u64)idx * m->value_size;
+}
+
+static s32 hash_find(struct sim_map *m, const void *key)
+{
+	const char *k = key;
+	u32 i, j;
+
+	for (i = 0; i < m->def.max_entries; i++) {
+		const char *cur = (char *)m->keys + (u64)i * m->def.key_size;
+
+		if (!m->used[i])
+			continue;
+		for (j = 0; j < m->def.key_size && cur[j] == k[j]; j++)
+			;
+		if (j == m->def.key_size)
+			return i;
+	}
+	return -1;
+}
+
+static void *map_lookup(void *map, const void *key, s32 cpu)
+{
+	struct sim_map *m = find_map(map);
+	s32 idx;
+
+	if (!m)
+		return NULL;
+
+	switch (m->def.type) {
+	case BPF_MAP_TYPE_ARRAY:
+	case BPF_MAP_TYPE_PERCPU_ARRAY:
+		return array_elem(m, *(const u32 *)key, cpu);
+	case BPF_MAP_TYPE_HASH:
+		idx = hash_find(m, key);
+		return idx < 0 ? NULL : (char *)m->values + (u64)idx * m->value_size;
+	default:
+		sim_ext_err("%s: unsupported map type %u", m->def.name, m->def.type);
+		return NULL;
+	}
+}
+
+void *bpf_map_lookup_elem(void *map, const void *key)
+{
+	return map_lookup(map, key, sim_cur_cpu);
+}
+
+void *bpf_map_lookup_percpu_elem(void *map, const void *key, u32 cpu)
+{
+	if (cpu >= (u32)nr_cpus)
+		return NULL;
+	return map_lookup(map, key, cpu);
+}
+
+long bpf_map_update_elem(void *map, const void *key, const void *value, u64 flags)
+{
+	struct sim_map *m = find_map(map);
+	void *elem;
+	s32 idx;
+
+	if (!m)
+		return -EINVAL;
+
+	switch (m->def.type) {
+	case BPF_MAP_TYPE_ARRAY:
+	case BPF_MAP_TYPE_PERCPU_ARRAY:
+		if (flags == BPF_NOEXIST)
+			return -EEXIST;
+		elem = array_elem(m, *(const u32 *)key, sim_cur_cpu);
+		if (!elem)
+			return -E2BIG;
+		break;
+	case BPF_MAP_TYPE_HASH:
+		idx = hash_find(m, key);
+		if (idx >= 0 && flags == BPF_NOEXIST)
+			return -EEXIST;
+		if (idx < 0 && flags == BPF_EXIST)
+			return -ENOENT;
+		if (idx < 0) {
+			for (idx = 0; idx < (s32)m->def.max_entries && m->used[idx]; idx++)
+				;
+			if (idx == (s32)m->def.max_entries)
+				return -E2BIG;
+			__builtin_memcpy((char *)m->keys + (u64)idx * m->def.key_size,
+					 key, m->def.key_size);
+			m->used[idx] = true;
+		}
+		elem = (char *)m->values + (u64)idx * m->value_size;
+		break;
+	default:
+		sim_ext_err("%s: unsupported map type %u", m->def.name, m->def.type);
+		return -EINVAL;
+	}
+
+	__builtin_memcpy(elem, value, m->def.value_size);
+	return 0;
+}
+
+long bpf_map_delete_elem(void *map, const void *key)
+{
+	struct sim_map *m = find_map(map);
+	s32 idx;
+
+	if (!m)
+		return -EINVAL;
+	if (m->def.type != BPF_MAP_TYPE_HASH)
+		return -EINVAL;
+
+	idx = hash_find(m, key);
+	if (idx < 0)
+		return -ENOENT;
+	m->used[idx] = false;
+	__builtin_memset((char *)m->values + (u64)idx * m->value_size, 0, m->value_size);
+	return 0;
+}
+
+void *bpf_task_storage_get(void *map, struct task_struct *p, void *value, u64 flags)
+{
+	struct sim_map *m = find_map(map);
+	struct sim_task *t = task_of(p);
+	u32 idx;
+
+	if (!m)
+		return NULL;
+
+	idx = m - maps;
+	if (!t->storage[idx] && (flags & BPF_LOCAL_STORAGE_GET_F_CREATE)) {
+		t->storage[idx] = sim_zalloc(m->value_size);
+		if (value)
+			__builtin_memcpy(t->storage[idx], value, m->def.value_size);
+	}
+	return t->storage[idx];
+}
+
+long bpf_task_storage_delete(void *map, struct task_struct *p)
+{
+	struct sim_map *m = find_map(map);
+	struct sim_task *t = task_of(p);
+
+	if (!m || !t->storage[m - maps])
+		return -ENOENT;
+	sim_free(t->storage[m - maps]);
+	t->storage[m - maps] = NULL;
+	return 0;
+}
+
+void *bpf_kptr_xchg(void *dst, void *ptr)
+{
+	void *old = *(void **)dst;
+
+	*(void **)dst = ptr;
+	return old;
+}
+
+long bpf_spin_lock(struct bpf_spin_lock *lock)
+{
+	return 0;
+}
+
+long bpf_spin_unlock(struct bpf_spin_lock *lock)
+{
+	return 0;
+}
+
+/*
+ * Other helpers
+ */
+u64 bpf_ktime_get_ns(void)
+{
+	return sim_now;
+}
+
+u64 bpf_ktime_get_boot_ns(void)
+{
+	return sim_now;
+}
+
+u32 bpf_get_smp_processor_id(void)
+{
+	return sim_cur_cpu;
+}
+
+u32 bpf_get_prandom_u32(void)
+{
+	return sim_random();
+}
+
+u64 bpf_get_current_pid_tgid(void)
+{
+	struct task_struct *curr = cpus[sim_cur_cpu].curr;
+
+	return curr ? ((u64)curr->tgid << 32) | (u32)curr->pid : 0;
+}
+
+long bpf_probe_read_kernel(void *dst, u32 size, const void *unsafe_ptr)
+{
+	__builtin_memcpy(dst, unsafe_ptr, size);
+	return 0;
+}
+
+long bpf_probe_read_kernel_str(void *dst, u32 size, const void *unsafe_ptr)
+{
+	copy_str(dst, unsafe_ptr ?: "", size);
+	return 0;
+}
+
+void sim_bpf_printk(const char *fmt, unsigned long long *args, int nr_args)
+{
+	char buf[1024];
+
+	sim_bstr_format(buf, sizeof(buf), fmt, args, nr_args);
+	sim_log("%s", buf);
+}
+
+/*
+ * Timers
+ */
+static struct sim_timer *find_timer(struct bpf_timer *timer)
+{
+	u64 idx = timer->__opaque[0];
+
+	if (!idx || idx > nr_timers || timers[idx - 1].timer != timer)
+		return NULL;
+	return &timers[idx - 1];
+}
+
+long bpf_timer_init(struct bpf_timer *timer, void *map, u64 flags)
+{
+	struct sim_map *m = find_map(map);
+
+	if (!m)
+		return -EINVAL;
+	if (find_timer(timer))
+		return -EBUSY;
+	if (nr_timers >= SIM_MAX_TIMERS)
+		return -ENOMEM;
+
+	timers[nr_timers] = (struct sim_timer){ .timer = timer, .map = m };
+	timer->__opaque[0] = ++nr_timers;
+	return 0;
+}
+
+long bpf_timer_set_callback(struct bpf_timer *timer, void *callback_fn)
+{
+	struct sim_timer *st = find_timer(timer);
+
+	if (!st)
+		return -EINVAL;
+	st->callback = callback_fn;
+	return 0;
+}
+
+long bpf_timer_start(struct bpf_timer *timer, u64 nsecs, u64 flags)
+{
+	struct sim_timer *st = find_timer(timer);
+
+	if (!st || !st->callback)
+		return -EINVAL;
+	st->cpu = sim_cur_cpu;
+	st->expires = sim_now + nsecs;
+	st->armed = true;
+	return 0;
+}
+
+long bpf_timer_cancel(struct bpf_timer *timer)
+{
+	struct sim_timer *st = find_timer(timer);
+
+	if (!st)
+		return -EINVAL;
+	st->armed = false;
+	return 0;
+}
+
+unsigned long long sim_ext_next_timer(void)
+{
+	u64 next = ~0ULL;
+	u32 i;
+
+	for (i = 0; i < nr_timers; i++)
+		if (timers[i].armed && timers[i].expires < next)
+			next = timers[i].expires;
+	return next;
+}
+
+void sim_ext_run_timers(void)
+{
+	u32 i;
+
+	for (i = 0; i < nr_timers && !errored; i++) {
+		struct sim_timer *st = &timers[i];
+		int (*cb)(void *, int *, void *) = st->callback;
+		char *value;
+		int key;
+
+		if (!st->armed || st->expires > sim_now)
+			continue;
+		st->armed = false;
+
+		/* timers live in array map values */
+		key = ((char *)st->timer - (char *)st->map->values) / st->map->value_size;
+		value = (char *)st->map->values + (u64)key * st->map->value_size;
+		sim_cur_cpu = st->cpu;
+		cb(st->map->def.sym, &key, value);
+	}
+}
+
+/*
+ * DSQs
+ */
+static struct sim_dsq *find_user_dsq(u64 dsq_id)
+{
+	u32 i;
+
+	for (i = 0; i < nr_dsqs; i++)
+		if (dsqs[i].id == dsq_id)
+			return &dsqs[i];
+	return NULL;
+}
+
+/* Resolve @dsq_id, SCX_DSQ_LOCAL being the local DSQ of @cpu */
+static struct sim_dsq *find_dsq(u64 dsq_id, s32 cpu)
+{
+	struct sim_dsq *dsq;
+
+	if (dsq_id == SCX_DSQ_LOCAL)
+		return &cpus[cpu].local;
+
+	if ((dsq_id & SCX_DSQ_LOCAL_ON) == SCX_DSQ_LOCAL_ON) {
+		s32 target = dsq_id & SCX_DSQ_LOCAL_CPU_MASK;
+
+		if (target < nr_cpus)
+			return &cpus[target].local;
+		sim_ext_err("invalid cpu %d in SCX_DSQ_LOCAL_ON", target);
+		return NULL;
+	}
+
+	if (dsq_id == SCX_DSQ_GLOBAL)
+		return &global_dsq;
+
+	dsq = find_user_dsq(dsq_id);
+	if (!dsq)
+		sim_ext_err("non-existent DSQ 0x%llx", dsq_id);
+	return dsq;
+}
+
+static s32 local_dsq_cpu(struct sim_dsq *dsq)
+{
+	if (dsq >= &cpus[0].local && dsq <= &cpus[nr_cpus - 1].local)
+		return ((char *)dsq - (char *)&cpus[0].local) / sizeof(cpus[0]);
+	return -1;
+}
+
+static void kick(s32 cpu, bool preempt)
+{
+	struct sim_cpu *c = &cpus[cpu];
+
+	if (preempt && c->curr)
+		c->curr->scx.slice = 0;
+
+	if (c->kick_pending) {
+		c->kick_preempt |= preempt;
+		return;
+	}
+	c->kick_pending = true;
+	c->kick_preempt = preempt;
+	kicks[nr_kicks++] = cpu;
+}
+
+static void dsq_insert(struct sim_dsq *dsq, struct sim_task *t, u64 enq_flags,
+		       bool priq)
+{
+	struct sim_task *pos;
+	s32 cpu;
+
+	if (priq && (dsq->id & SCX_DSQ_FLAG_BUILTIN)) {
+		sim_ext_err("cannot use vtime ordering for built-in DSQs");
+		priq = false;
+	}
+	if (dsq->nr && dsq->priq != priq) {
+		sim_ext_err("DSQ 0x%llx already had %s tasks queued", dsq->id,
+			    dsq->priq ? "vtime" : "FIFO");
+		return;
+	}
+	dsq->priq = priq;
+
+	if (priq) {
+		/* walk from the tail, new tasks usually have the largest vtime */
+		for (pos = dsq->tail; pos; pos = pos->dsq_prev)
+			if ((s64)(pos->p.scx.dsq_vtime - t->p.scx.dsq_vtime) <= 0)
+				break;
+	} else {
+		pos = (enq_flags & SCX_ENQ_HEAD) ? NULL : dsq->tail;
+	}
+
+	/* insert after @pos, at the head if NULL */
+	t->dsq_prev = pos;
+	t->dsq_next = pos ? pos->dsq_next : dsq->head;
+	if (t->dsq_next)
+		t->dsq_next->dsq_prev = t;
+	else
+		dsq->tail = t;
+	if (pos)
+		pos->dsq_next = t;
+	else
+		dsq->head = t;
+
+	t->dsq = dsq;
+	t->bpf_owned = false;
+	dsq->nr++;
+
+	cpu = local_dsq_cpu(dsq);
+	if (cpu >= 0) {
+		t->cpu = cpu;
+		if (!cpus[cpu].curr)
+			kick(cpu, false);
+		else if (enq_flags & SCX_ENQ_PREEMPT)
+			kick(cpu, true);
+	}
+}
+
+static void dsq_remove(struct sim_task *t)
+{
+	struct sim_dsq *dsq = t->dsq;
+
+	if (!dsq)
+		return;
+	if (t->dsq_prev)
+		t->dsq_prev->dsq_next = t->dsq_next;
+	else
+		dsq->head = t->dsq_next;
+	if (t->dsq_next)
+		t->dsq_next->dsq_prev = t->dsq_prev;
+	else
+		dsq->tail = t->dsq_prev;
+	t->dsq = NULL;
+	t->dsq_prev = t->dsq_next = NULL;
+	dsq->nr--;
+}
+
+s32 scx_bpf_create_dsq(u64 dsq_id, s32 node)
+{
+	if (dsq_id & SCX_DSQ_FLAG_BUILTIN)
+		return -EINVAL;
+	if (find_user_dsq(dsq_id))
+		return -EEXIST;
+	if (nr_dsqs >= SIM_MAX_DSQS)
+		return -ENOMEM;
+
+	dsqs[nr_dsqs++] = (struct sim_dsq){ .id = dsq_id };
+	return 0;
+}
+
+void scx_bpf_destroy_dsq(u64 dsq_id)
+{
+	struct sim_dsq *dsq = find_user_dsq(dsq_id);
+
+	if (!dsq)
+		return;
+	if (dsq->nr)
+		sim_ext_err("destroying non-empty DSQ 0x%llx", dsq_id);
+	*dsq = dsqs[--nr_dsqs];
+}
+
+s32 scx_bpf_dsq_nr_queued(u64 dsq_id)
+{
+	struct sim_dsq *dsq;
+
+	if (dsq_id == SCX_DSQ_LOCAL)
+		return cpus[sim_cur_cpu].local.nr;
+	if (dsq_id != SCX_DSQ_GLOBAL && !(dsq_id & SCX_DSQ_FLAG_BUILTIN) &&
+	    !find_user_dsq(dsq_id))
+		return -ENOENT;
+
+	dsq = find_dsq(dsq_id, sim_cur_cpu);
+	return dsq ? dsq->nr : -ENOENT;
+}
+
+/*
+ * Dispatching
+ */
+static void dispatch(struct task_struct *p, u64 dsq_id, u64 slice,
+		     u64 enq_flags, bool priq)
+{
+	struct sim_task *t = task_of(p);
+	struct sim_dsq *dsq;
+
+	if (slice)
+		p->scx.slice = slice;
+
+	switch (cur_ctx) {
+	case SIM_CTX_SELECT_CPU:
+	case SIM_CTX_ENQUEUE:
+		if (t != ctx_task) {
+			sim_ext_err("dispatching %s[%d] from the wrong context",
+				    p->comm, p->pid);
+			return;
+		}
+		if (t->ddsp) {
+			sim_ext_err("%s[%d] already dispatched", p->comm, p->pid);
+			return;
+		}
+		t->ddsp = true;
+		t->ddsp_dsq_id = dsq_id;
+		t->ddsp_enq_flags = enq_flags | (priq ? SCX_ENQ_DSQ_PRIQ : 0);
+		return;
+	case SIM_CTX_DISPATCH:
+		if (nr_ctx_dispatched >= SIM_DISPATCH_BATCH) {
+			sim_ext_err("dispatch buffer overflow");
+			return;
+		}
+		/* the task was dequeued or dispatched already, ignore */
+		if (!t->bpf_owned)
+			return;
+		dsq = find_dsq(dsq_id, sim_cur_cpu);
+		if (!dsq)
+			return;
+		nr_ctx_dispatched++;
+		dsq_insert(dsq, t, enq_flags, priq);
+		return;
+	default:
+		sim_ext_err("dispatching %s[%d] from an invalid context",
+			    p->comm, p->pid);
+	}
+}
+
+void scx_bpf_dispatch(struct task_struct *p, u64 dsq_id, u64 slice, u64 enq_flags)
+{
+	dispatch(p, dsq_id, slice, enq_flags, false);
+}
+
+void scx_bpf_dispatch_vtime(struct task_struct *p, u64 dsq_id, u64 slice,
+			    u64 vtime, u64 enq_flags)
+{
+	p->scx.dsq_vtime = vtime;
+	dispatch(p, dsq_id, slice, enq_flags, true);
+}
+
+u32 scx_bpf_dispatch_nr_slots(void)
+{
+	if (cur_ctx != SIM_CTX_DISPATCH)
+		return 0;
+	return SIM_DISPATCH_BATCH - nr_ctx_dispatched;
+}
+
+void scx_bpf_dispatch_cancel(void)
+{
+}
+
+bool scx_bpf_consume(u64 dsq_id)
+{
+	struct sim_dsq *dsq;
+	struct sim_task *t;
+
+	if (cur_ctx != SIM_CTX_DISPATCH) {
+		sim_ext_err("scx_bpf_consume() called from an invalid context");
+		return false;
+	}
+
+	dsq = find_dsq(dsq_id, sim_cur_cpu);
+	if (!dsq || !dsq->head)
+		return false;
+
+	t = dsq->head;
+	dsq_remove(t);
+	dsq_insert(&cpus[sim_cur_cpu].local, t, 0, false);
+	return true;
+}
+
+static void do_enqueue(struct sim_task *t, u64 enq_flags);
+
+u32 scx_bpf_reenqueue_local(void)
+{
+	struct sim_dsq *local = &cpus[sim_cur_cpu].local;
+	u32 nr = local->nr, i;
+
+	for (i = 0; i < nr && local->head; i++) {
+		struct sim_task *t = local->head;
+
+		dsq_remove(t);
+		do_enqueue(t, SCX_ENQ_REENQ);
+	}
+	return i;
+}
+
+int bpf_iter_scx_dsq_new(struct bpf_iter_scx_dsq *it, u64 dsq_id, u64 flags)
+{
+	struct sim_dsq *dsq = find_dsq(dsq_id, sim_cur_cpu);
+
+	it->__opaque[0] = (u64)dsq;
+	it->__opaque[1] = 0;
+	it->__opaque[2] = flags;
+	return dsq ? 0 : -ENOENT;
+}
+
+struct task_struct *bpf_iter_scx_dsq_next(struct bpf_iter_scx_dsq *it)
+{
+	struct sim_dsq *dsq = (struct sim_dsq *)it->__opaque[0];
+	struct sim_task *cur = (struct sim_task *)it->__opaque[1];
+	bool rev = it->__opaque[2] & SCX_DSQ_ITER_REV;
+
+	if (!dsq)
+		return NULL;
+	if (!cur)
+		cur = rev ? dsq->tail : dsq->head;
+	else
+		cur = rev ? cur->dsq_prev : cur->dsq_next;
+	it->__opaque[1] = (u64)cur;
+
+	return cur ? &cur->p : NULL;
+}
+
+void bpf_iter_scx_dsq_destroy(struct bpf_iter_scx_dsq *it)
+{
+	it->__opaque[0] = 0;
+}
+
+/*
+ * Idle tracking and CPU selection
+ */
+static bool builtin_idle_enabled(void)
+{
+	return !SIM_HAS_OP(update_idle) || (sim_ops->flags & SCX_OPS_KEEP_BUILTIN_IDLE);
+}
+
+static void set_cpu_idle(s32 cpu, bool idle)
+{
+	struct sim_cpu *c = &cpus[cpu];
+
+	if (c->idle == idle)
+		return;
+	c->idle = idle;
+
+	if (builtin_idle_enabled()) {
+		if (idle)
+			mask_set(&idle_mask, cpu);
+		else
+			mask_clear(&idle_mask, cpu);
+	}
+	if (SIM_HAS_OP(update_idle)) {
+		sim_cur_cpu = cpu;
+		sim_ops->update_idle(cpu, idle);
+	}
+}
+
+bool scx_bpf_test_and_clear_cpu_idle(s32 cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpus || !mask_test(&idle_mask, cpu))
+		return false;
+	mask_clear(&idle_mask, cpu);
+	return true;
+}
+
+/* Claim an idle CPU in @cpus_allowed, preferring the LLC of @prev_cpu */
+static s32 pick_idle(const struct cpumask *cpus_allowed, s32 prev_cpu)
+{
+	s32 cpu, llc = prev_cpu >= 0 ? cpus[prev_cpu].llc : -1;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (cpus[cpu].llc == llc && mask_test(cpus_allowed, cpu) &&
+		    scx_bpf_test_and_clear_cpu_idle(cpu))
+			return cpu;
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (mask_test(cpus_allowed, cpu) && scx_bpf_test_and_clear_cpu_idle(cpu))
+			return cpu;
+	return -EBUSY;
+}
+
+s32 scx_bpf_pick_idle_cpu(const cpumask_t *cpus_allowed, u64 flags)
+{
+	if (!builtin_idle_enabled()) {
+		sim_ext_err("built-in idle tracking is disabled");
+		return -EBUSY;
+	}
+	return pick_idle(cpus_allowed, -1);
+}
+
+s32 scx_bpf_pick_any_cpu(const cpumask_t *cpus_allowed, u64 flags)
+{
+	s32 cpu, nr;
+
+	if (builtin_idle_enabled()) {
+		cpu = pick_idle(cpus_allowed, -1);
+		if (cpu >= 0)
+			return cpu;
+	}
+
+	nr = mask_weight(cpus_allowed);
+	if (!nr)
+		return -EBUSY;
+	nr = sim_random() % nr;
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (mask_test(cpus_allowed, cpu) && !nr--)
+			return cpu;
+	return -EBUSY;
+}
+
+s32 scx_bpf_select_cpu_dfl(struct task_struct *p, s32 prev_cpu, u64 wake_flags,
+			   bool *is_idle)
+{
+	s32 cpu;
+
+	*is_idle = false;
+	if (!builtin_idle_enabled()) {
+		sim_ext_err("built-in idle tracking is disabled");
+		return prev_cpu;
+	}
+
+	if (mask_test(p->cpus_ptr, prev_cpu) &&
+	    scx_bpf_test_and_clear_cpu_idle(prev_cpu)) {
+		*is_idle = true;
+		return prev_cpu;
+	}
+
+	cpu = pick_idle(p->cpus_ptr, prev_cpu);
+	if (cpu >= 0) {
+		*is_idle = true;
+		return cpu;
+	}
+	return prev_cpu;
+}
+
+const struct cpumask *scx_bpf_get_idle_cpumask(void)
+{
+	return &idle_mask;
+}
+
+const struct cpumask *scx_bpf_get_idle_smtmask(void)
+{
+	return &idle_mask;
+}
+
+void scx_bpf_put_idle_cpumask(const struct cpumask *cpumask)
+{
+}
+
+const struct cpumask *scx_bpf_get_possible_cpumask(void)
+{
+	return &possible_mask;
+}
+
+const struct cpumask *scx_bpf_get_online_cpumask(void)
+{
+	return &possible_mask;
+}
+
+void scx_bpf_put_cpumask(const struct cpumask *cpumask)
+{
+}
+
+u32 scx_bpf_nr_cpu_ids(void)
+{
+	return nr_cpus;
+}
+
+void scx_bpf_kick_cpu(s32 cpu, u64 flags)
+{
+	if (cpu < 0 || cpu >= nr_cpus) {
+		sim_ext_err("invalid cpu %d", cpu);
+		return;
+	}
+	if ((flags & SCX_KICK_IDLE) && !cpus[cpu].idle)
+		return;
+	kick(cpu, flags & SCX_KICK_PREEMPT);
+}
+
+u32 scx_bpf_cpuperf_cap(s32 cpu)
+{
+	return SCX_CPUPERF_ONE;
+}
+
+u32 scx_bpf_cpuperf_cur(s32 cpu)
+{
+	return cpu >= 0 && cpu < nr_cpus ? cpus[cpu].perf : 0;
+}
+
+void scx_bpf_cpuperf_set(s32 cpu, u32 perf)
+{
+	if (cpu >= 0 && cpu < nr_cpus)
+		cpus[cpu].perf = perf;
+}
+
+/*
+ * Tasks
+ */
+s32 scx_bpf_task_cpu(const struct task_struct *p)
+{
+	return task_of(p)->cpu;
+}
+
+bool scx_bpf_task_running(const struct task_struct *p)
+{
+	return cpus[task_of(p)->cpu].curr == p;
+}
+
+struct rq *scx_bpf_cpu_rq(s32 cpu)
+{
+	sim_ext_err("scx_bpf_cpu_rq() is not supported");
+	return NULL;
+}
+
+struct task_struct *bpf_task_from_pid(s32 pid)
+{
+	struct sim_task *t;
+
+	if (pid < 0)
+		return NULL;
+	t = tasks_by_pid[pid % SIM_MAX_TASKS_LOOKUP];
+	return t && t->p.pid == pid ? &t->p : NULL;
+}
+
+struct task_struct *bpf_task_acquire(struct task_struct *p)
+{
+	return p;
+}
+
+void bpf_task_release(struct task_struct *p)
+{
+}
+
+void bpf_rcu_read_lock(void)
+{
+}
+
+void bpf_rcu_read_unlock(void)
+{
+}
+
+void *bpf_obj_new_impl(__u64 local_type_id, void *meta)
+{
+	/* see bpf_core_type_id_local() */
+	return sim_zalloc(local_type_id);
+}
+
+void bpf_obj_drop_impl(void *kptr, void *meta)
+{
+	sim_free(kptr);
+}
+
+/*
+ * BPF cpumasks
+ */
+struct bpf_cpumask *bpf_cpumask_create(void)
+{
+	struct bpf_cpumask *mask = sim_zalloc(sizeof(*mask));
+
+	mask->usage.refs.counter = 1;
+	return mask;
+}
+
+struct bpf_cpumask *bpf_cpumask_acquire(struct bpf_cpumask *cpumask)
+{
+	cpumask->usage.refs.counter++;
+	return cpumask;
+}
+
+void bpf_cpumask_release(struct bpf_cpumask *cpumask)
+{
+	if (!--cpumask->usage.refs.counter)
+		sim_free(cpumask);
+}
+
+u32 bpf_cpumask_first(const struct cpumask *cpumask)
+{
+	s32 cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (mask_test(cpumask, cpu))
+			return cpu;
+	return nr_cpus;
+}
+
+u32 bpf_cpumask_first_zero(const struct cpumask *cpumask)
+{
+	s32 cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (!mask_test(cpumask, cpu))
+			return cpu;
+	return nr_cpus;
+}
+
+void bpf_cpumask_set_cpu(u32 cpu, struct bpf_cpumask *cpumask)
+{
+	mask_set(&cpumask->cpumask, cpu);
+}
+
+void bpf_cpumask_clear_cpu(u32 cpu, struct bpf_cpumask *cpumask)
+{
+	mask_clear(&cpumask->cpumask, cpu);
+}
+
+bool bpf_cpumask_test_cpu(u32 cpu, const struct cpumask *cpumask)
+{
+	return mask_test(cpumask, cpu);
+}
+
+bool bpf_cpumask_test_and_set_cpu(u32 cpu, struct bpf_cpumask *cpumask)
+{
+	bool was_set = mask_test(&cpumask->cpumask, cpu);
+
+	mask_set(&cpumask->cpumask, cpu);
+	return was_set;
+}
+
+bool bpf_cpumask_test_and_clear_cpu(u32 cpu, struct bpf_cpumask *cpumask)
+{
+	bool was_set = mask_test(&cpumask->cpumask, cpu);
+
+	mask_clear(&cpumask->cpumask, cpu);
+	return was_set;
+}
+
+void bpf_cpumask_setall(struct bpf_cpumask *cpumask)
+{
+	cpumask->cpumask = possible_mask;
+}
+
+void bpf_cpumask_clear(struct bpf_cpumask *cpumask)
+{
+	__builtin_memset(&cpumask->cpumask, 0, sizeof(cpumask->cpumask));
+}
+
+#define MASK_WORDS	((nr_cpus + 63) / 64)
+
+bool bpf_cpumask_and(struct bpf_cpumask *dst, const struct cpumask *src1,
+		     const struct cpumask *src2)
+{
+	unsigned long any = 0;
+	s32 i;
+
+	for (i = 0; i < MASK_WORDS; i++)
+		any |= dst->cpumask.bits[i] = src1->bits[i] & src2->bits[i];
+	return any;
+}
+
+void bpf_cpumask_or(struct bpf_cpumask *dst, const struct cpumask *src1,
+		    const struct cpumask *src2)
+{
+	s32 i;
+
+	for (i = 0; i < MASK_WORDS; i++)
+		dst->cpumask.bits[i] = src1->bits[i] | src2->bits[i];
+}
+
+void bpf_cpumask_xor(struct bpf_cpumask *dst, const struct cpumask *src1,
+		     const struct cpumask *src2)
+{
+	s32 i;
+
+	for (i = 0; i < MASK_WORDS; i++)
+		dst->cpumask.bits[i] = (src1->bits[i] ^ src2->bits[i]) &
+				       possible_mask.bits[i];
+}
+
+bool bpf_cpumask_equal(const struct cpumask *src1, const struct cpumask *src2)
+{
+	s32 cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (mask_test(src1, cpu) != mask_test(src2, cpu))
+			return false;
+	return true;
+}
+
+bool bpf_cpumask_intersects(const struct cpumask *src1, const struct cpumask *src2)
+{
+	s32 cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (mask_test(src1, cpu) && mask_test(src2, cpu))
+			return true;
+	return false;
+}
+
+bool bpf_cpumask_subset(const struct cpumask *src1, const struct cpumask *src2)
+{
+	s32 cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (mask_test(src1, cpu) && !mask_test(src2, cpu))
+			return false;
+	return true;
+}
+
+bool bpf_cpumask_empty(const struct cpumask *cpumask)
+{
+	return !mask_weight(cpumask);
+}
+
+bool bpf_cpumask_full(const struct cpumask *cpumask)
+{
+	return mask_weight(cpumask) == (u32)nr_cpus;
+}
+
+void bpf_cpumask_copy(struct bpf_cpumask *dst, const struct cpumask *src)
+{
+	dst->cpumask = *src;
+}
+
+u32 bpf_cpumask_any_distribute(const struct cpumask *cpumask)
+{
+	u32 nr = mask_weight(cpumask);
+	s32 cpu;
+
+	if (!nr)
+		return nr_cpus;
+	nr = sim_random() % nr;
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (mask_test(cpumask, cpu) && !nr--)
+			return cpu;
+	return nr_cpus;
+}
+
+u32 bpf_cpumask_any_and_distribute(const struct cpumask *src1,
+				   const struct cpumask *src2)
+{
+	struct bpf_cpumask tmp;
+
+	bpf_cpumask_and(&tmp, src1, src2);
+	return bpf_cpumask_any_distribute(&tmp.cpumask);
+}
+
+u32 bpf_cpumask_weight(const struct cpumask *cpumask)
+{
+	return mask_weight(cpumask);
+}
+
+/*
+ * Exit
+ */
+void scx_bpf_error_bstr(char *fmt, unsigned long long *data, u32 data_len)
+{
+	set_error(fmt, data, data_len / sizeof(*data));
+}
+
+void scx_bpf_exit_bstr(s64 exit_code, char *fmt, unsigned long long *data,
+		       u32 data__sz)
+{
+	set_error(fmt, data, data__sz / sizeof(*data));
+}
+
+void scx_bpf_dump_bstr(char *fmt, unsigned long long *data, u32 data_len)
+{
+	sim_bpf_printk(fmt, data, data_len / sizeof(*data));
+}
+
+const char *sim_ext_error(void)
+{
+	return errored ? error_msg : NULL;
+}
+
+/*
+ * Core
+ */
+static void apply_ddsp(struct sim_task *t)
+{
+	struct sim_dsq *dsq;
+
+	t->ddsp = false;
+	dsq = find_dsq(t->ddsp_dsq_id, t->cpu);
+	if (dsq)
+		dsq_insert(dsq, t, t->ddsp_enq_flags & ~SCX_ENQ_DSQ_PRIQ,
+			   t->ddsp_enq_flags & SCX_ENQ_DSQ_PRIQ);
+}
+
+static void do_enqueue(struct sim_task *t, u64 enq_flags)
+{
+	if (t->ddsp) {
+		apply_ddsp(t);
+		return;
+	}
+
+	if (!SIM_HAS_OP(enqueue)) {
+		dsq_insert(&global_dsq, t, enq_flags, false);
+		return;
+	}
+
+	cur_ctx = SIM_CTX_ENQUEUE;
+	ctx_task = t;
+	sim_ops->enqueue(&t->p, enq_flags);
+	cur_ctx = SIM_CTX_NONE;
+	ctx_task = NULL;
+
+	if (t->ddsp)
+		apply_ddsp(t);
+	else
+		t->bpf_owned = true;
+}
+
+int sim_ext_wakeup(struct task_struct *p)
+{
+	struct sim_task *t = task_of(p);
+	s32 cpu = t->cpu;
+
+	sim_cur_cpu = cpu;
+	t->runnable = true;
+	if (SIM_HAS_OP(runnable))
+		sim_ops->runnable(p, SCX_ENQ_WAKEUP);
+
+	if (SIM_HAS_OP(select_cpu)) {
+		cur_ctx = SIM_CTX_SELECT_CPU;
+		ctx_task = t;
+		cpu = sim_ops->select_cpu(p, t->cpu, SCX_WAKE_TTWU);
+		cur_ctx = SIM_CTX_NONE;
+		ctx_task = NULL;
+		if (cpu < 0 || cpu >= nr_cpus) {
+			sim_ext_err("select_cpu() returned invalid cpu %d", cpu);
+			cpu = t->cpu;
+		}
+	} else if (builtin_idle_enabled()) {
+		bool is_idle;
+
+		cpu = scx_bpf_select_cpu_dfl(p, t->cpu, SCX_WAKE_TTWU, &is_idle);
+		if (is_idle) {
+			p->scx.slice = SCX_SLICE_DFL;
+			t->ddsp = true;
+			t->ddsp_dsq_id = SCX_DSQ_LOCAL;
+			t->ddsp_enq_flags = 0;
+		}
+	}
+	t->cpu = cpu;
+
+	do_enqueue(t, SCX_ENQ_WAKEUP);
+	return cpu;
+}
+
+static void stop_task(struct sim_task *t, bool runnable)
+{
+	cpus[t->cpu].curr = NULL;
+	if (SIM_HAS_OP(stopping))
+		sim_ops->stopping(&t->p, runnable);
+	if (!runnable) {
+		t->runnable = false;
+		if (SIM_HAS_OP(quiescent))
+			sim_ops->quiescent(&t->p, SCX_DEQ_SLEEP);
+	}
+}
+
+struct task_struct *sim_ext_schedule(int cpu, struct task_struct *prev,
+				     bool prev_runnable)
+{
+	struct sim_cpu *c = &cpus[cpu];
+	struct sim_task *next;
+	u32 loops;
+
+	sim_cur_cpu = cpu;
+	c->kick_pending = false;
+
+	if (prev && !prev_runnable) {
+		stop_task(task_of(prev), false);
+		prev = NULL;
+	}
+
+	/* a running task with slice left isn't preempted by a reschedule */
+	if (prev && prev->scx.slice)
+		return prev;
+
+	if (!c->local.nr && global_dsq.nr) {
+		next = global_dsq.head;
+		dsq_remove(next);
+		dsq_insert(&c->local, next, 0, false);
+	}
+
+	for (loops = 0; !c->local.nr && SIM_HAS_OP(dispatch) &&
+	     loops < SIM_DISPATCH_LOOPS && !errored; loops++) {
+		cur_ctx = SIM_CTX_DISPATCH;
+		nr_ctx_dispatched = 0;
+		sim_ops->dispatch(cpu, prev);
+		cur_ctx = SIM_CTX_NONE;
+		if (!nr_ctx_dispatched)
+			break;
+	}
+
+	if (prev) {
+		if (!c->local.nr && !(sim_ops->flags & SCX_OPS_ENQ_LAST)) {
+			/* nothing else to run, keep going */
+			prev->scx.slice = SCX_SLICE_DFL;
+			return prev;
+		}
+		stop_task(task_of(prev), true);
+		do_enqueue(task_of(prev), c->local.nr ? 0 : SCX_ENQ_LAST);
+	}
+
+	next = c->local.head;
+	if (!next) {
+		set_cpu_idle(cpu, true);
+		return NULL;
+	}
+
+	dsq_remove(next);
+	next->cpu = cpu;
+	c->curr = &next->p;
+	set_cpu_idle(cpu, false);
+	sim_cur_cpu = cpu;
+	if (SIM_HAS_OP(running))
+		sim_ops->running(&next->p);
+
+	return &next->p;
+}
+
+unsigned long long sim_ext_task_slice(struct task_struct *p)
+{
+	return p->scx.slice;
+}
+
+void sim_ext_charge(int cpu, struct task_struct *p, unsigned long long ran,
+		    bool tick)
+{
+	sim_cur_cpu = cpu;
+	if (p->scx.slice != SCX_SLICE_INF)
+		p->scx.slice -= ran < p->scx.slice ? ran : p->scx.slice;
+	if (tick && SIM_HAS_OP(tick))
+		sim_ops->tick(p);
+}
+
+bool sim_ext_has_tick(void)
+{
+	return SIM_HAS_OP(tick);
+}
+
+bool sim_ext_pop_kick(int *cpu, bool *preempt)
+{
+	while (nr_kicks) {
+		s32 k = kicks[0];
+		u32 i;
+
+		for (i = 1; i < nr_kicks; i++)
+			kicks[i - 1] = kicks[i];
+		nr_kicks--;
+
+		/* already rescheduled since */
+		if (!cpus[k].kick_pending)
+			continue;
+		cpus[k].kick_pending = false;
+		*cpu = k;
+		*preempt = cpus[k].kick_preempt;
+		return true;
+	}
+	return false;
+}
+
+struct task_struct *sim_ext_task_new(int id, int pid, const char *comm,
+				     unsigned int weight)
+{
+	struct scx_init_task_args args = { .fork = true };
+	struct sim_task *t = sim_zalloc(sizeof(*t));
+	struct task_struct *p = &t->p;
+	s32 ret;
+
+	t->id = id;
+	t->cpu = id % nr_cpus;
+	p->pid = p->tgid = pid;
+	copy_str(p->comm, comm, sizeof(p->comm));
+	p->prio = p->static_prio = p->normal_prio = 120;
+	p->cpus_mask = possible_mask;
+	p->cpus_ptr = &p->cpus_mask;
+	p->nr_cpus_allowed = nr_cpus;
+	p->scx.weight = weight;
+	p->scx.slice = SCX_SLICE_DFL;
+	if (pid >= 0)
+		tasks_by_pid[pid % SIM_MAX_TASKS_LOOKUP] = t;
+
+	sim_cur_cpu = t->cpu;
+	if (SIM_HAS_OP(init_task)) {
+		ret = sim_ops->init_task(p, &args);
+		if (ret) {
+			sim_ext_err("init_task() failed for %s[%d] (%d)", comm, pid, ret);
+			return NULL;
+		}
+	}
+	if (SIM_HAS_OP(enable))
+		sim_ops->enable(p);
+	if (SIM_HAS_OP(set_weight))
+		sim_ops->set_weight(p, weight);
+
+	return p;
+}
+
+void sim_ext_task_free(struct task_struct *p)
+{
+	struct scx_exit_task_args args = { .cancelled = false };
+	struct sim_task *t = task_of(p);
+	u32 i;
+
+	dsq_remove(t);
+	sim_cur_cpu = t->cpu;
+	if (SIM_HAS_OP(disable))
+		sim_ops->disable(p);
+	if (SIM_HAS_OP(exit_task))
+		sim_ops->exit_task(p, &args);
+
+	if (p->pid >= 0 && tasks_by_pid[p->pid % SIM_MAX_TASKS_LOOKUP] == t)
+		tasks_by_pid[p->pid % SIM_MAX_TASKS_LOOKUP] = NULL;
+	for (i = 0; i < nr_maps; i++)
+		sim_free(t->storage[i]);
+	sim_free(t);
+}
+
+int sim_ext_task_id(struct task_struct *p)
+{
+	return task_of(p)->id;
+}
+
+int sim_ext_task_cpu(struct task_struct *p)
+{
+	return task_of(p)->cpu;
+}
+
+const char *sim_ext_name(void)
+{
+	return sim_ops->name;
+}
+
+unsigned int sim_ext_timeout_ms(void)
+{
+	return sim_ops->timeout_ms ?: 30000;
+}
+
+static s32 set_rodata(struct sim_def *def, u64 value)
+{
+	if (def->value_size > sizeof(value))
+		return -EINVAL;
+	sim_poke(def->sym, value, def->value_size);
+	return 0;
+}
+
+int sim_ext_init(int nr_sim_cpus, int cpus_per_llc,
+		 const struct sim_opt *opts, int nr_opts)
+{
+	struct sim_def *def;
+	s32 cpu, i;
+
+	if (nr_sim_cpus <= 0 || nr_sim_cpus > SIM_MAX_CPUS) {
+		sim_ext_err("invalid number of cpus %d", nr_sim_cpus);
+		return -EINVAL;
+	}
+	nr_cpus = nr_sim_cpus;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		struct sim_cpu *c = &cpus[cpu];
+
+		c->local.id = SCX_DSQ_LOCAL_ON | cpu;
+		c->llc = cpus_per_llc > 0 ? cpu / cpus_per_llc : 0;
+		c->idle = true;
+		c->perf = SCX_CPUPERF_ONE;
+		mask_set(&possible_mask, cpu);
+		mask_set(&idle_mask, cpu);
+	}
+
+	for (def = sim_defs; def->sym; def++) {
+		struct sim_map *m = &maps[nr_maps];
+		u64 nr_values = def->max_entries;
+
+		if (def->type == SIM_DEF_RODATA) {
+			if (def->set)
+				set_rodata(def, def->value);
+			continue;
+		}
+		if (def->type == SIM_DEF_RODATA_NR_CPUS) {
+			set_rodata(def, nr_cpus);
+			continue;
+		}
+
+		if (nr_maps >= SIM_MAX_MAPS) {
+			sim_ext_err("too many maps");
+			return -E2BIG;
+		}
+		m->def = *def;
+		m->value_size = (def->value_size + 7) & ~7;
+		if (def->type == BPF_MAP_TYPE_PERCPU_ARRAY)
+			nr_values *= nr_cpus;
+		if (nr_values)
+			m->values = sim_zalloc(nr_values * m->value_size);
+		if (def->type == BPF_MAP_TYPE_HASH) {
+			m->keys = sim_zalloc((u64)def->max_entries * def->key_size);
+			m->used = sim_zalloc(def->max_entries);
+		}
+		nr_maps++;
+	}
+
+	for (i = 0; i < nr_opts; i++) {
+		for (def = sim_defs; def->sym; def++)
+			if (def->type == SIM_DEF_RODATA &&
+			    !__builtin_strcmp(def->name, opts[i].name))
+				break;
+		if (!def->sym || set_rodata(def, opts[i].value)) {
+			sim_ext_err("%s isn't a rodata knob of %s", opts[i].name,
+				    sim_ops->name);
+			return -ENOENT;
+		}
+	}
+
+	sim_cur_cpu = 0;
+	if (SIM_HAS_OP(init)) {
+		s32 ret = sim_ops->init();
+
+		if (ret) {
+			sim_ext_err("ops.init() failed (%d)", ret);
+			return ret;
+		}
+	}
+	return errored ? -EINVAL : 0;
+}
+
+void sim_ext_exit(void)
+{
+	struct scx_exit_info ei = {
+		.kind = errored ? SCX_EXIT_ERROR : SCX_EXIT_UNREG_BPF,
+		.reason = errored ? "scx_bpf_error" : "simulation ended",
+		.msg = error_msg,
+		.dump = "",
+	};
+
+	if (SIM_HAS_OP(exit))
+		sim_ops->exit(&ei);
+}
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Glue to plug a .bpf.c policy into the simulator. A policy is included in
+ * a small wrapper file which lists its ops, maps and rodata knobs:
+ *
+ *	#include "scx_simple.bpf.c"
+ *	#include "sim_policy.h"
+ *
+ *	SIM_POLICY(simple_ops,
+ *		   SIM_MAP(stats),
+ *		   SIM_TASK_STORAGE(task_ctx_stor),
+ *		   SIM_RODATA(fifo_sched));
+ *
+ * Maps are described by the types in their definitions, which don't exist
+ * at runtime, so they have to be registered with the simulator here.
+ *
+ * Rodata knobs are what the userspace half of a scheduler would set in the
+ * skeleton before loading it. Listed knobs can be set with -o NAME=VALUE,
+ * SIM_RODATA_SET() gives a knob a different default than its initializer
+ * and SIM_RODATA_NR_CPUS() marks a knob holding the number of CPUs.
+ */
+#ifndef __SIM_POLICY_H
+#define __SIM_POLICY_H
+
+enum sim_def_type {
+	/* BPF_MAP_TYPE_* for maps */
+	SIM_DEF_RODATA		= 1 << 16,
+	SIM_DEF_RODATA_NR_CPUS,
+};
+
+struct sim_def {
+	void		*sym;
+	const char	*name;
+	u32		type;
+	u32		key_size;
+	u32		value_size;
+	u32		max_entries;
+	/* rodata default */
+	bool		set;
+	u64		value;
+};
+
+#define __SIM_MAP_TYPE(m)	(sizeof(*(m).type) / sizeof(int))
+
+/* Array, per-CPU array and hash maps */
+#define SIM_MAP(m)								\
+	{ &(m), #m, __SIM_MAP_TYPE(m), sizeof(*(m).key), sizeof(*(m).value),	\
+	  sizeof(*(m).max_entries) / sizeof(int) }
+
+/* Task local storage */
+#define SIM_TASK_STORAGE(m)							\
+	{ &(m), #m, __SIM_MAP_TYPE(m), sizeof(*(m).key), sizeof(*(m).value), 0 }
+
+#define SIM_RODATA(v)								\
+	{ (void *)&(v), #v, SIM_DEF_RODATA, 0, sizeof(v), 0 }
+
+#define SIM_RODATA_SET(v, val)							\
+	{ (void *)&(v), #v, SIM_DEF_RODATA, 0, sizeof(v), 0, true, (val) }
+
+#define SIM_RODATA_NR_CPUS(v)							\
+	{ (void *)&(v), #v, SIM_DEF_RODATA_NR_CPUS, 0, sizeof(v), 0 }
+
+#define SIM_POLICY(__ops, ...)							\
+	struct sched_ext_ops *sim_ops = &(__ops);				\
+	struct sim_def sim_defs[] = { __VA_ARGS__, { } }
+
+#endif /* __SIM_POLICY_H */
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+#
+# Convert recorded scheduling data into a trace for the scheduling
+# simulator, see README.md.
+#
+# ftrace: sched_switch events as printed by scripts/sched_ftrace.py. Each
+#   task's run time between going to sleep is one burst and the time until
+#   it's switched back in is the sleep, which also includes the wakeup
+#   latency of the scheduler the trace was recorded under.
+#
+# ml_collect: the per-task dumps printed by scx_ml_collect. They only carry
+#   totals, so each task becomes a single burst repeated WAIT_CNT times with
+#   its average run and sleep times.
+
+import argparse
+import re
+import sys
+
+# kernel/sched/core.c, nice -20 to 19
+SCHED_PRIO_TO_WEIGHT = [
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+    9548, 7620, 6100, 4904, 3906,
+    3121, 2501, 1991, 1586, 1277,
+    1024, 820, 655, 526, 423,
+    335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45,
+    36, 29, 23, 18, 15,
+]
+
+SWITCH_RE = re.compile(
+    r"(?P<ts>\d+\.\d+): sched_switch: "
+    r"prev_comm=(?P<prev_comm>.*) prev_pid=(?P<prev_pid>\d+) "
+    r"prev_prio=(?P<prev_prio>\d+) prev_state=(?P<prev_state>\S+) ==> "
+    r"next_comm=(?P<next_comm>.*) next_pid=(?P<next_pid>\d+) "
+    r"next_prio=(?P<next_prio>\d+)"
+)
+
+
+def scx_weight(load_weight):
+    # se.load.weight is scaled up by 1024 on 64bit
+    if load_weight > SCHED_PRIO_TO_WEIGHT[0]:
+        load_weight >>= 10
+    return max(1, min(10000, load_weight * 100 // 1024))
+
+
+def prio_weight(prio):
+    # RT tasks get the weight of nice -20
+    nice = min(max(prio - 120, -20), 19)
+    return scx_weight(SCHED_PRIO_TO_WEIGHT[nice + 20])
+
+
+def comm_name(comm):
+    return re.sub(r"\s+", "_", comm.strip()) or "-"
+
+
+class Task:
+    def __init__(self, pid, comm, weight, start):
+        self.pid = pid
+        self.comm = comm
+        self.weight = weight
+        self.start = start
+        self.bursts = []
+        self.run = 0
+        self.running_since = None
+        self.sleeping_since = None
+
+    def add_burst(self, run, sleep, count=1):
+        if run <= 0:
+            return
+        if self.bursts and self.bursts[-1][:2] == [run, sleep]:
+            self.bursts[-1][2] += count
+        else:
+            self.bursts.append([run, sleep, count])
+
+
+def convert_ftrace(lines, resolution):
+    tasks = {}
+    first_ts = None
+    last_ts = 0
+
+    def quantize(ns):
+        return ns // resolution * resolution
+
+    for line in lines:
+        m = SWITCH_RE.search(line)
+        if not m:
+            continue
+        ts = int(float(m["ts"]) * 1e9)
+        if first_ts is None:
+            first_ts = ts
+        ts -= first_ts
+        last_ts = ts
+
+        prev_pid, next_pid = int(m["prev_pid"]), int(m["next_pid"])
+
+        # idle is pid 0 on every CPU
+        if prev_pid:
+            t = tasks.get(prev_pid)
+            if t is None:
+                # running since before the trace started
+                t = tasks[prev_pid] = Task(prev_pid, comm_name(m["prev_comm"]),
+                                           prio_weight(int(m["prev_prio"])), 0)
+                t.running_since = 0
+            if t.running_since is not None:
+                t.run += ts - t.running_since
+                t.running_since = None
+            # preempted tasks stay runnable and keep accumulating the burst
+            if not m["prev_state"].startswith("R"):
+                t.sleeping_since = ts
+
+        if next_pid:
+            t = tasks.get(next_pid)
+            if t is None:
+                t = tasks[next_pid] = Task(next_pid, comm_name(m["next_comm"]),
+                                           prio_weight(int(m["next_prio"])), ts)
+            if t.sleeping_since is not None:
+                t.add_burst(quantize(t.run), quantize(ts - t.sleeping_since))
+                t.run = 0
+                t.sleeping_since = None
+            t.running_since = ts
+
+    for t in tasks.values():
+        if t.running_since is not None:
+            t.run += last_ts - t.running_since
+        t.add_burst(quantize(t.run), 0)
+
+    return tasks.values()
+
+
+def convert_ml_collect(lines):
+    tasks = {}
+    cur = {}
+
+    def flush():
+        if "pid" in cur and cur.get("exec", 0) > 0:
+            nr = max(cur.get("wait_cnt", 1), 1)
+            t = Task(cur["pid"], cur["comm"], scx_weight(cur.get("weight", 1024)), 0)
+            t.add_burst(max(cur["exec"] // nr, 1), cur.get("sleep", 0) // nr, nr)
+            # dumped every second, the last dump of a task has the totals
+            tasks[t.pid] = t
+        cur.clear()
+
+    for line in lines:
+        if "TASK:" in line:
+            flush()
+            cur["comm"] = comm_name(line.split("TASK:")[1].split("<")[0])
+            continue
+        for key, field in (("pid", "PID"), ("weight", "WEIGHT"),
+                           ("exec", "CUR_SUM_EXEC_RTIME"), ("wait_cnt", "WAIT_CNT"),
+                           ("sleep", "SUM_SLEEP_RUNTIME")):
+            m = re.search(r"\b" + field + r": (\d+)", line)
+            if m and "comm" in cur:
+                cur[key] = int(m[1])
+    flush()
+
+    return tasks.values()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Convert scheduling data into a scheduling simulator trace."
+    )
+    parser.add_argument("format", choices=["ftrace", "ml_collect"],
+                        help="Input format")
+    parser.add_argument("input", nargs="?", default="-",
+                        help="Input file (default: stdin)")
+    parser.add_argument("-r", "--resolution", type=int, default=1000,
+                        help="Round ftrace durations down to NSECS (default: 1000)")
+    args = parser.parse_args()
+
+    f = sys.stdin if args.input == "-" else open(args.input)
+    if args.format == "ftrace":
+        tasks = convert_ftrace(f, max(args.resolution, 1))
+    else:
+        tasks = convert_ml_collect(f)
+
+    print("# converted from {} {}".format(args.format, args.input))
+    for t in sorted(tasks, key=lambda t: (t.start, t.pid)):
+        if not t.bursts:
+            continue
+        print("task {} {} {} {}".format(t.pid, t.weight, t.start, t.comm))
+        for run, sleep, count in t.bursts:
+            print("run {} {} {} {}".format(t.pid, run, sleep, count))
+
+
+if __name__ == "__main__":
+    main()